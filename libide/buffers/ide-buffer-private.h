@@ -23,23 +23,31 @@
 
 #include "buffers/ide-buffer.h"
 #include "buffers/ide-buffer-manager.h"
+#include "diagnostics/ide-diagnostic.h"
+#include "highlighting/ide-highlight-engine.h"
 
 G_BEGIN_DECLS
 
-PeasExtensionSet *_ide_buffer_get_addins            (IdeBuffer        *self);
-void              _ide_buffer_set_changed_on_volume (IdeBuffer        *self,
-                                                     gboolean          changed_on_volume);
-gboolean          _ide_buffer_get_loading           (IdeBuffer        *self);
-void              _ide_buffer_set_loading           (IdeBuffer        *self,
-                                                     gboolean          loading);
-void              _ide_buffer_cancel_cursor_restore (IdeBuffer        *self);
-gboolean          _ide_buffer_can_restore_cursor    (IdeBuffer        *self);
-void              _ide_buffer_set_mtime             (IdeBuffer        *self,
-                                                     const GTimeVal   *mtime);
-void              _ide_buffer_set_read_only         (IdeBuffer        *buffer,
-                                                     gboolean          read_only);
+PeasExtensionSet   *_ide_buffer_get_addins             (IdeBuffer             *self);
+void                _ide_buffer_set_changed_on_volume  (IdeBuffer             *self,
+                                                        gboolean               changed_on_volume);
+IdeHighlightEngine *_ide_buffer_get_highlight_engine   (IdeBuffer             *self);
+gboolean            _ide_buffer_get_loading            (IdeBuffer             *self);
+void                _ide_buffer_set_loading            (IdeBuffer             *self,
+                                                        gboolean               loading);
+void                _ide_buffer_cancel_cursor_restore  (IdeBuffer             *self);
+gboolean            _ide_buffer_can_restore_cursor     (IdeBuffer             *self);
+void                _ide_buffer_set_mtime              (IdeBuffer             *self,
+                                                        const GTimeVal        *mtime);
+void                _ide_buffer_set_read_only          (IdeBuffer             *buffer,
+                                                        gboolean               read_only);
+void                _ide_buffer_get_diagnostics_range  (IdeBuffer             *self,
+                                                        guint                  begin_line,
+                                                        guint                  end_line,
+                                                        IdeDiagnosticSeverity *severities);
+IdeBufferLineFlags  _ide_buffer_severity_to_line_flags (IdeDiagnosticSeverity  severity);
 
-void              _ide_buffer_manager_reclaim       (IdeBufferManager *self,
-                                                     IdeBuffer        *buffer);
+void                _ide_buffer_manager_reclaim        (IdeBufferManager      *self,
+                                                        IdeBuffer             *buffer);
 
 G_END_DECLS
@@ -31,6 +31,7 @@
 #include "buffers/ide-buffer-private.h"
 #include "buffers/ide-unsaved-files.h"
 #include "diagnostics/ide-diagnostic.h"
+#include "diagnostics/ide-diagnostics-intervals-private.h"
 #include "diagnostics/ide-diagnostics-manager.h"
 #include "diagnostics/ide-diagnostics.h"
 #include "diagnostics/ide-source-location.h"
@@ -51,9 +52,7 @@
 #include "util/ide-gtk.h"
 #include "vcs/ide-vcs.h"
 
-#define DEFAULT_DIAGNOSE_TIMEOUT_MSEC          333
 #define SETTLING_DELAY_MSEC                    333
-#define DEFAULT_DIAGNOSE_CONSERVE_TIMEOUT_MSEC 5000
 #define RECLAIMATION_TIMEOUT_SECS              1
 #define MODIFICATION_TIMEOUT_SECS              1
 
@@ -71,23 +70,23 @@
 
 typedef struct
 {
-  IdeContext             *context;
-  IdeDiagnostics         *diagnostics;
-  GHashTable             *diagnostics_line_cache;
-  DzlSignalGroup         *diagnostics_manager_signals;
-  IdeFile                *file;
-  GBytes                 *content;
-  IdeBufferChangeMonitor *change_monitor;
-  IdeHighlightEngine     *highlight_engine;
-  IdeExtensionAdapter    *formatter_adapter;
-  IdeExtensionAdapter    *rename_provider_adapter;
-  IdeExtensionAdapter    *symbol_resolver_adapter;
-  PeasExtensionSet       *addins;
-  gchar                  *title;
+  IdeContext              *context;
+  IdeDiagnostics          *diagnostics;
+  IdeDiagnosticsIntervals *diagnostics_intervals;
+  DzlSignalGroup          *diagnostics_manager_signals;
+  IdeFile                 *file;
+  GBytes                  *content;
+  IdeBufferChangeMonitor  *change_monitor;
+  IdeHighlightEngine      *highlight_engine;
+  IdeExtensionAdapter     *formatter_adapter;
+  IdeExtensionAdapter     *rename_provider_adapter;
+  IdeExtensionAdapter     *symbol_resolver_adapter;
+  PeasExtensionSet        *addins;
+  gchar                   *title;
 
-  DzlSignalGroup         *file_signals;
+  DzlSignalGroup          *file_signals;
 
-  GFileMonitor           *file_monitor;
+  GFileMonitor            *file_monitor;
 
   gulong                  change_monitor_changed_handler;
 
@@ -313,8 +312,8 @@ ide_buffer_clear_diagnostics (IdeBuffer *self)
 
   g_assert (IDE_IS_BUFFER (self));
 
-  if (priv->diagnostics_line_cache != NULL)
-    g_hash_table_remove_all (priv->diagnostics_line_cache);
+  if (priv->diagnostics_intervals != NULL)
+    _ide_diagnostics_intervals_clear (priv->diagnostics_intervals);
 
   gtk_text_buffer_get_bounds (buffer, &begin, &end);
 
@@ -334,39 +333,30 @@ ide_buffer_clear_diagnostics (IdeBuffer *self)
 }
 
 static void
-ide_buffer_cache_diagnostic_line (IdeBuffer             *self,
-                                  IdeSourceLocation     *begin,
-                                  IdeSourceLocation     *end,
-                                  IdeDiagnosticSeverity  severity)
+ide_buffer_cache_diagnostic_line (IdeBuffer         *self,
+                                  IdeDiagnostic     *diagnostic,
+                                  IdeSourceLocation *begin,
+                                  IdeSourceLocation *end)
 {
   IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
-  gpointer new_value = GINT_TO_POINTER (severity);
-  gsize line_begin;
-  gsize line_end;
-  gsize i;
 
   g_assert (IDE_IS_BUFFER (self));
+  g_assert (diagnostic);
   g_assert (begin);
   g_assert (end);
 
-  if (!priv->diagnostics_line_cache)
+  if (!priv->diagnostics_intervals)
     return;
 
-  line_begin = MIN (ide_source_location_get_line (begin),
-                    ide_source_location_get_line (end));
-  line_end = MAX (ide_source_location_get_line (begin),
-                  ide_source_location_get_line (end));
-
-  for (i = line_begin; i <= line_end; i++)
-    {
-      gpointer old_value;
-      gpointer key = GINT_TO_POINTER (i);
-
-      old_value = g_hash_table_lookup (priv->diagnostics_line_cache, key);
-
-      if (new_value > old_value)
-        g_hash_table_replace (priv->diagnostics_line_cache, key, new_value);
-    }
+  /*
+   * The diagnostic is borrowed, it is owned by priv->diagnostics which is
+   * released only after the intervals have been cleared.
+   */
+  _ide_diagnostics_intervals_add (priv->diagnostics_intervals,
+                                  ide_source_location_get_line (begin),
+                                  ide_source_location_get_line (end),
+                                  ide_diagnostic_get_severity (diagnostic),
+                                  diagnostic);
 }
 
 static void
@@ -420,7 +410,7 @@ ide_buffer_update_diagnostic (IdeBuffer     *self,
       if (file && priv->file && !ide_file_equal (file, priv->file))
         return;
 
-      ide_buffer_cache_diagnostic_line (self, location, location, severity);
+      ide_buffer_cache_diagnostic_line (self, diagnostic, location, location);
 
       ide_buffer_get_iter_at_location (self, &iter1, location);
       gtk_text_iter_assign (&iter2, &iter1);
@@ -457,7 +447,7 @@ ide_buffer_update_diagnostic (IdeBuffer     *self,
       ide_buffer_get_iter_at_location (self, &iter1, begin);
       ide_buffer_get_iter_at_location (self, &iter2, end);
 
-      ide_buffer_cache_diagnostic_line (self, begin, end, severity);
+      ide_buffer_cache_diagnostic_line (self, diagnostic, begin, end);
 
       if (gtk_text_iter_equal (&iter1, &iter2))
         {
@@ -686,6 +676,11 @@ ide_buffer_delete_range (GtkTextBuffer *buffer,
                          GtkTextIter   *start,
                          GtkTextIter   *end)
 {
+  IdeBuffer *self = (IdeBuffer *)buffer;
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+  guint begin_line;
+  guint end_line;
+
   IDE_ENTRY;
 
 #ifdef IDE_ENABLE_TRACE
@@ -704,8 +699,17 @@ ide_buffer_delete_range (GtkTextBuffer *buffer,
   }
 #endif
 
+  begin_line = gtk_text_iter_get_line (start);
+  end_line = gtk_text_iter_get_line (end);
+
   GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->delete_range (buffer, start, end);
 
+  /* Move the diagnostics along with the lines they were published for */
+  if (end_line > begin_line)
+    _ide_diagnostics_intervals_delete_lines (priv->diagnostics_intervals,
+                                             begin_line,
+                                             end_line - begin_line);
+
   ide_buffer_emit_cursor_moved (IDE_BUFFER (buffer));
 
   IDE_EXIT;
@@ -717,7 +721,11 @@ ide_buffer_insert_text (GtkTextBuffer *buffer,
                         const gchar   *text,
                         gint           len)
 {
+  IdeBuffer *self = (IdeBuffer *)buffer;
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
   gboolean check_modeline = FALSE;
+  guint n_lines;
+  guint line;
 
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (location);
@@ -733,8 +741,22 @@ ide_buffer_insert_text (GtkTextBuffer *buffer,
       ((text [0] == '\n') || ((len > 1) && (strchr (text, '\n') != NULL))))
     check_modeline = TRUE;
 
+  /*
+   * Text inserted at the start of a line pushes that line down, otherwise
+   * the new lines come after it. Comparing the line count handles every
+   * kind of line terminator that GtkTextBuffer understands.
+   */
+  line = gtk_text_iter_get_line (location);
+  if (!gtk_text_iter_starts_line (location))
+    line++;
+  n_lines = gtk_text_buffer_get_line_count (buffer);
+
   GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->insert_text (buffer, location, text, len);
 
+  n_lines = gtk_text_buffer_get_line_count (buffer) - n_lines;
+  if (n_lines > 0)
+    _ide_diagnostics_intervals_insert_lines (priv->diagnostics_intervals, line, n_lines);
+
   ide_buffer_emit_cursor_moved (IDE_BUFFER (buffer));
 
   if (check_modeline)
@@ -1380,7 +1402,7 @@ ide_buffer_dispose (GObject *object)
 
   dzl_signal_group_set_target (priv->diagnostics_manager_signals, NULL);
 
-  g_clear_pointer (&priv->diagnostics_line_cache, g_hash_table_unref);
+  g_clear_pointer (&priv->diagnostics_intervals, _ide_diagnostics_intervals_free);
   g_clear_pointer (&priv->diagnostics, ide_diagnostics_unref);
   g_clear_pointer (&priv->content, g_bytes_unref);
   g_clear_pointer (&priv->title, g_free);
@@ -1715,7 +1737,7 @@ ide_buffer_init (IdeBuffer *self)
                                    self,
                                    G_CONNECT_SWAPPED);
 
-  priv->diagnostics_line_cache = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->diagnostics_intervals = _ide_diagnostics_intervals_new ();
 
   priv->diagnostics_manager_signals = dzl_signal_group_new (IDE_TYPE_DIAGNOSTICS_MANAGER);
   dzl_signal_group_connect_object (priv->diagnostics_manager_signals,
@@ -1831,6 +1853,54 @@ ide_buffer_get_context (IdeBuffer *self)
   return priv->context;
 }
 
+IdeBufferLineFlags
+_ide_buffer_severity_to_line_flags (IdeDiagnosticSeverity severity)
+{
+  switch (severity)
+    {
+    case IDE_DIAGNOSTIC_FATAL:
+    case IDE_DIAGNOSTIC_ERROR:
+      return IDE_BUFFER_LINE_FLAGS_ERROR;
+
+    case IDE_DIAGNOSTIC_DEPRECATED:
+    case IDE_DIAGNOSTIC_WARNING:
+      return IDE_BUFFER_LINE_FLAGS_WARNING;
+
+    case IDE_DIAGNOSTIC_NOTE:
+      return IDE_BUFFER_LINE_FLAGS_NOTE;
+
+    case IDE_DIAGNOSTIC_IGNORED:
+    default:
+      return 0;
+    }
+}
+
+/**
+ * _ide_buffer_get_diagnostics_range:
+ * @self: A #IdeBuffer.
+ * @begin_line: the first line of the range
+ * @end_line: the last line of the range, inclusive
+ * @severities: (array): an array of @end_line - @begin_line + 1 elements
+ *
+ * Fills @severities with the highest diagnostic severity of each line in
+ * the range. The gutter uses this to resolve all of the visible lines
+ * with a single query rather than one lookup per line.
+ */
+void
+_ide_buffer_get_diagnostics_range (IdeBuffer             *self,
+                                   guint                  begin_line,
+                                   guint                  end_line,
+                                   IdeDiagnosticSeverity *severities)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_BUFFER (self));
+  g_return_if_fail (begin_line <= end_line);
+  g_return_if_fail (severities != NULL);
+
+  _ide_diagnostics_intervals_get_range (priv->diagnostics_intervals, begin_line, end_line, severities);
+}
+
 /**
  * ide_buffer_get_line_flags:
  * @self: A #IdeBuffer.
@@ -1849,32 +1919,12 @@ ide_buffer_get_line_flags (IdeBuffer *self,
   IdeBufferLineFlags flags = 0;
   IdeBufferLineChange change = 0;
 
-  if (priv->diagnostics_line_cache)
+  if (priv->diagnostics_intervals)
     {
-      gpointer key = GINT_TO_POINTER (line);
-      gpointer value;
-
-      value = g_hash_table_lookup (priv->diagnostics_line_cache, key);
-
-      switch (GPOINTER_TO_INT (value))
-        {
-        case IDE_DIAGNOSTIC_FATAL:
-        case IDE_DIAGNOSTIC_ERROR:
-          flags |= IDE_BUFFER_LINE_FLAGS_ERROR;
-          break;
-
-        case IDE_DIAGNOSTIC_DEPRECATED:
-        case IDE_DIAGNOSTIC_WARNING:
-          flags |= IDE_BUFFER_LINE_FLAGS_WARNING;
-          break;
+      IdeDiagnosticSeverity severity;
 
-        case IDE_DIAGNOSTIC_NOTE:
-          flags |= IDE_BUFFER_LINE_FLAGS_NOTE;
-          break;
-
-        default:
-          break;
-        }
+      severity = _ide_diagnostics_intervals_get_severity (priv->diagnostics_intervals, line);
+      flags |= _ide_buffer_severity_to_line_flags (severity);
     }
 
   if (priv->change_monitor)
@@ -1952,6 +2002,50 @@ ide_buffer_set_highlight_diagnostics (IdeBuffer *self,
     }
 }
 
+typedef struct
+{
+  IdeDiagnostic *diagnostic;
+  guint          line_offset;
+  guint          distance;
+} NearestDiagnostic;
+
+static void
+find_nearest_diagnostic_cb (guint                  begin_line,
+                            guint                  end_line,
+                            IdeDiagnosticSeverity  severity,
+                            gpointer               data,
+                            gpointer               user_data)
+{
+  IdeDiagnostic *diagnostic = data;
+  NearestDiagnostic *nearest = user_data;
+  IdeSourceLocation *location;
+  guint distance = G_MAXUINT - 1;
+
+  g_assert (diagnostic != NULL);
+  g_assert (nearest != NULL);
+
+  /*
+   * The intervals track line movement while the buffer is edited, but the
+   * diagnostic locations do not, so only compare the column against the
+   * location when the diagnostic is on a single line. Those are preferred
+   * over ranges spanning the line.
+   */
+  if (begin_line == end_line &&
+      NULL != (location = ide_diagnostic_get_location (diagnostic)))
+    {
+      guint column = ide_source_location_get_line_offset (location);
+
+      distance = column > nearest->line_offset ? column - nearest->line_offset
+                                               : nearest->line_offset - column;
+    }
+
+  if (distance < nearest->distance)
+    {
+      nearest->distance = distance;
+      nearest->diagnostic = diagnostic;
+    }
+}
+
 /**
  * ide_buffer_get_diagnostic_at_iter:
  * @self: A #IdeBuffer.
@@ -1972,51 +2066,21 @@ ide_buffer_get_diagnostic_at_iter (IdeBuffer         *self,
 
   if (priv->diagnostics)
     {
-      IdeDiagnostic *diagnostic = NULL;
-      IdeBufferLineFlags flags;
-      guint distance = G_MAXUINT;
-      gsize size;
-      gsize i;
+      NearestDiagnostic nearest = { 0 };
       guint line;
 
       line = gtk_text_iter_get_line (iter);
-      flags = ide_buffer_get_line_flags (self, line);
-
-      if ((flags & IDE_BUFFER_LINE_FLAGS_DIAGNOSTICS_MASK) == 0)
-        return NULL;
-
-      size = ide_diagnostics_get_size (priv->diagnostics);
-
-      for (i = 0; i < size; i++)
-        {
-          IdeDiagnostic *diag;
-          IdeSourceLocation *location;
-          GtkTextIter pos;
-
-          diag = ide_diagnostics_index (priv->diagnostics, i);
-          location = ide_diagnostic_get_location (diag);
-          if (!location)
-            continue;
-
-          /* TODO: This should look at the range for the diagnostic */
-
-          ide_buffer_get_iter_at_location (self, &pos, location);
-
-          if (line == (guint)gtk_text_iter_get_line (&pos))
-            {
-              guint offset;
 
-              offset = ABS (gtk_text_iter_get_offset (iter) - gtk_text_iter_get_offset (&pos));
+      nearest.line_offset = gtk_text_iter_get_line_offset (iter);
+      nearest.distance = G_MAXUINT;
 
-              if (offset < distance)
-                {
-                  distance = offset;
-                  diagnostic = diag;
-                }
-            }
-        }
+      _ide_diagnostics_intervals_foreach (priv->diagnostics_intervals,
+                                          line,
+                                          line,
+                                          find_nearest_diagnostic_cb,
+                                          &nearest);
 
-      return diagnostic;
+      return nearest.diagnostic;
     }
 
   return NULL;
@@ -3031,6 +3095,16 @@ _ide_buffer_can_restore_cursor (IdeBuffer *self)
   return !priv->cancel_cursor_restore;
 }
 
+IdeHighlightEngine *
+_ide_buffer_get_highlight_engine (IdeBuffer *self)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+
+  g_return_val_if_fail (IDE_IS_BUFFER (self), NULL);
+
+  return priv->highlight_engine;
+}
+
 PeasExtensionSet *
 _ide_buffer_get_addins (IdeBuffer *self)
 {
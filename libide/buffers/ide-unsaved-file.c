@@ -18,6 +18,14 @@
 
 #define G_LOG_DOMAIN "ide-unsaved-file"
 
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "ide-debug.h"
 
 #include "buffers/ide-unsaved-file.h"
@@ -32,6 +40,10 @@ struct _IdeUnsavedFile
   GFile         *file;
   gchar         *temp_path;
   gint64         sequence;
+
+  /* Sealed copy of content, created on demand for other processes */
+  GMutex         fd_mutex;
+  gint           fd;
 };
 
 IdeUnsavedFile *
@@ -51,6 +63,8 @@ _ide_unsaved_file_new (GFile       *file,
   ret->content = g_bytes_ref (content);
   ret->sequence = sequence;
   ret->temp_path = g_strdup (temp_path);
+  ret->fd = -1;
+  g_mutex_init (&ret->fd_mutex);
 
   return ret;
 }
@@ -119,6 +133,9 @@ ide_unsaved_file_unref (IdeUnsavedFile *self)
 
   if (g_atomic_int_dec_and_test (&self->ref_count))
     {
+      if (self->fd != -1)
+        g_close (self->fd, NULL);
+      g_mutex_clear (&self->fd_mutex);
       g_clear_pointer (&self->temp_path, g_free);
       g_clear_pointer (&self->content, g_bytes_unref);
       g_clear_object (&self->file);
@@ -156,3 +173,164 @@ ide_unsaved_file_get_file (IdeUnsavedFile *self)
 
   return self->file;
 }
+
+static gint
+create_sealed_fd (GFile   *file,
+                  GBytes  *content,
+                  GError **error)
+{
+  g_autofree gchar *name = NULL;
+  const guint8 *data;
+  gboolean is_memfd = FALSE;
+  gsize len;
+  gint fd = -1;
+
+  g_assert (G_IS_FILE (file));
+  g_assert (content != NULL);
+
+  name = g_file_get_basename (file);
+  data = g_bytes_get_data (content, &len);
+
+#ifdef HAVE_MEMFD_CREATE
+  fd = memfd_create (name ?: "unsaved-file", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  is_memfd = fd != -1;
+#endif
+
+  /* Fallback to an unlinked temporary file when memfd is not available */
+  if (fd == -1)
+    {
+      g_autofree gchar *tmpl_path = NULL;
+
+      if (-1 == (fd = g_file_open_tmp (".ide-unsaved-file-XXXXXX", &tmpl_path, error)))
+        return -1;
+
+      g_unlink (tmpl_path);
+    }
+
+  while (len > 0)
+    {
+      gssize n_written = write (fd, data, len);
+
+      if (n_written < 0)
+        {
+          gint errsv = errno;
+
+          if (errsv == EINTR)
+            continue;
+
+          g_set_error_literal (error,
+                               G_IO_ERROR,
+                               g_io_error_from_errno (errsv),
+                               g_strerror (errsv));
+          g_close (fd, NULL);
+          return -1;
+        }
+
+      data += n_written;
+      len -= n_written;
+    }
+
+#ifdef F_ADD_SEALS
+  /*
+   * Sealing is not supported by the temporary file fallback. Without the
+   * seals the content is still only handed out read-only, so warn and
+   * continue rather than failing.
+   */
+  if (is_memfd &&
+      fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+    g_warning ("Failed to seal unsaved file \"%s\": %s",
+               name ?: "unsaved-file", g_strerror (errno));
+#endif
+
+  if (lseek (fd, 0, SEEK_SET) != 0)
+    {
+      gint errsv = errno;
+
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           g_io_error_from_errno (errsv),
+                           g_strerror (errsv));
+      g_close (fd, NULL);
+      return -1;
+    }
+
+  return fd;
+}
+
+/**
+ * ide_unsaved_file_dup_fd:
+ * @self: A #IdeUnsavedFile.
+ * @error: A location for a #GError, or %NULL.
+ *
+ * Gets a file-descriptor containing the content of the unsaved file, so
+ * that it may be handed to another process such as with
+ * ide_subprocess_launcher_take_fd(). The other process can read it
+ * directly or open it as "/dev/fd/N".
+ *
+ * Where supported this is a sealed memfd, created the first time it is
+ * requested for this snapshot and shared by every caller afterwards. Since
+ * it is sealed, the receiving process cannot modify it.
+ *
+ * Each caller gets a read-only file description of its own, positioned at
+ * the start of the content, so callers do not affect each other's file
+ * offset. On systems without /proc this falls back to dup(), which shares
+ * the offset, so readers that may run concurrently should use pread()
+ * from offset 0 rather than read().
+ *
+ * Returns: A new file-descriptor owned by the caller, or -1 and @error
+ *   is set.
+ */
+gint
+ide_unsaved_file_dup_fd (IdeUnsavedFile  *self,
+                         GError         **error)
+{
+  gint ret = -1;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (self, -1);
+
+  g_mutex_lock (&self->fd_mutex);
+
+  if (self->fd == -1)
+    self->fd = create_sealed_fd (self->file, self->content, error);
+
+  if (self->fd != -1)
+    {
+      g_autofree gchar *proc_path = g_strdup_printf ("/proc/self/fd/%d", self->fd);
+      gint reopened;
+
+      /* Reopening creates a new open file description with its own offset */
+      if (-1 != (reopened = g_open (proc_path, O_RDONLY | O_CLOEXEC, 0)))
+        {
+          /* Keep clear of the standard streams, like the dup() path */
+          if (reopened < 3)
+            {
+              gint errsv;
+
+              ret = fcntl (reopened, F_DUPFD_CLOEXEC, 3);
+              errsv = errno;
+              g_close (reopened, NULL);
+              errno = errsv;
+            }
+          else
+            ret = reopened;
+        }
+      else
+        ret = fcntl (self->fd, F_DUPFD_CLOEXEC, 3);
+
+      if (ret == -1)
+        {
+          gint errsv = errno;
+
+          g_set_error_literal (error,
+                               G_IO_ERROR,
+                               g_io_error_from_errno (errsv),
+                               g_strerror (errsv));
+        }
+    }
+
+  g_mutex_unlock (&self->fd_mutex);
+
+  IDE_RETURN (ret);
+}
@@ -35,6 +35,8 @@ const gchar    *ide_unsaved_file_get_temp_path (IdeUnsavedFile  *self);
 gboolean        ide_unsaved_file_persist       (IdeUnsavedFile  *self,
                                                 GCancellable    *cancellable,
                                                 GError         **error);
+gint            ide_unsaved_file_dup_fd        (IdeUnsavedFile  *self,
+                                                GError         **error);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeUnsavedFile, ide_unsaved_file_unref)
 
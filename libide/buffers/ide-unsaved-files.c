@@ -42,6 +42,7 @@ typedef struct
   gchar           *temp_path;
   gint             temp_fd;
   IdeUnsavedFiles *backptr;
+  IdeUnsavedFile  *snapshot;
 } UnsavedFile;
 
 typedef struct
@@ -96,6 +97,7 @@ unsaved_file_free (gpointer data)
     {
       g_clear_object (&uf->file);
       g_clear_pointer (&uf->content, g_bytes_unref);
+      g_clear_pointer (&uf->snapshot, ide_unsaved_file_unref);
 
       if (uf->temp_path != NULL)
         {
@@ -113,6 +115,22 @@ unsaved_file_free (gpointer data)
     }
 }
 
+/*
+ * Snapshots are shared by everyone asking for the same sequence of a file,
+ * so that anything derived from them (such as a sealed fd) is only
+ * created once per change.
+ */
+static IdeUnsavedFile *
+unsaved_file_get_snapshot (UnsavedFile *uf)
+{
+  g_assert (uf != NULL);
+
+  if (uf->snapshot == NULL)
+    uf->snapshot = _ide_unsaved_file_new (uf->file, uf->content, uf->temp_path, uf->sequence);
+
+  return ide_unsaved_file_ref (uf->snapshot);
+}
+
 static UnsavedFile *
 unsaved_file_copy (const UnsavedFile *uf)
 {
@@ -593,6 +611,7 @@ ide_unsaved_files_update (IdeUnsavedFiles *self,
           if (content != unsaved->content)
             {
               g_clear_pointer (&unsaved->content, g_bytes_unref);
+              g_clear_pointer (&unsaved->snapshot, ide_unsaved_file_unref);
               unsaved->content = g_bytes_ref (content);
               unsaved->sequence = priv->sequence;
             }
@@ -650,13 +669,10 @@ ide_unsaved_files_to_array (IdeUnsavedFiles *self)
 
   for (i = 0; i < priv->unsaved_files->len; i++)
     {
-      IdeUnsavedFile *item;
       UnsavedFile *uf;
 
       uf = g_ptr_array_index (priv->unsaved_files, i);
-      item = _ide_unsaved_file_new (uf->file, uf->content, uf->temp_path, uf->sequence);
-
-      g_ptr_array_add (ar, item);
+      g_ptr_array_add (ar, unsaved_file_get_snapshot (uf));
     }
 
   return ar;
@@ -724,7 +740,7 @@ ide_unsaved_files_get_unsaved_file (IdeUnsavedFiles *self,
       if (g_file_equal (uf->file, file))
         {
           IDE_TRACE_MSG ("Hit");
-          ret = _ide_unsaved_file_new (uf->file, uf->content, uf->temp_path, uf->sequence);
+          ret = unsaved_file_get_snapshot (uf);
           goto complete;
         }
     }
@@ -24,22 +24,36 @@
 #include "buildsystem/ide-build-log.h"
 #include "buildsystem/ide-build-log-private.h"
 
-#define POINTER_MARK(p)   GSIZE_TO_POINTER(GPOINTER_TO_SIZE(p)|1)
-#define POINTER_UNMARK(p) GSIZE_TO_POINTER(GPOINTER_TO_SIZE(p)&~(gsize)1)
-#define POINTER_MARKED(p) (GPOINTER_TO_SIZE(p)&1)
-#define DISPATCH_MAX      20
+/* Longest we will dispatch log lines for before yielding to the main loop */
+#define DISPATCH_MAX_USEC (G_USEC_PER_SEC / 200)
 
 struct _IdeBuildLog
 {
   GObject      parent_instance;
 
   GArray      *observers;
-  GAsyncQueue *log_queue;
   GSource     *log_source;
 
+  /*
+   * Lines logged from threads other than the main thread are appended to
+   * @pending as LogEntry headers followed by the NUL-terminated message.
+   * The main thread swaps @pending with @dispatching to deliver a whole
+   * batch at once, rather than allocating and freeing each line.
+   */
+  GMutex       mutex;
+  GByteArray  *pending;
+  GByteArray  *dispatching;
+  guint        dispatch_pos;
+
   guint        sequence;
 };
 
+typedef struct
+{
+  guint32 len;
+  guint32 stream;
+} LogEntry;
+
 typedef struct
 {
   IdeBuildLogObserver callback;
@@ -50,54 +64,68 @@ typedef struct
 
 G_DEFINE_TYPE (IdeBuildLog, ide_build_log, G_TYPE_OBJECT)
 
+static inline void
+ide_build_log_notify (IdeBuildLog       *self,
+                      IdeBuildLogStream  stream,
+                      const gchar       *message,
+                      gsize              message_len)
+{
+  for (guint i = 0; i < self->observers->len; i++)
+    {
+      const Observer *observer = &g_array_index (self->observers, Observer, i);
+
+      observer->callback (stream, message, message_len, observer->data);
+    }
+}
+
 static gboolean
 emit_log_from_main (gpointer user_data)
 {
   IdeBuildLog *self = user_data;
-  g_autoptr(GPtrArray) ar = g_ptr_array_new ();
-  gpointer item;
+  gint64 deadline;
+  guint n_dispatched = 0;
 
   g_assert (IDE_IS_BUILD_LOG (self));
 
   /*
-   * Pull up to DISPATCH_MAX items from the log queue. We have an upper
-   * bound here so that we don't stall the main loop. Additionally, we
-   * update the ready-time when we run out of items while holding the
-   * async queue lock to synchronize with the caller for further wakeups.
+   * Take the next batch once the previous one has been delivered. We
+   * update the ready-time while holding the lock when there is nothing
+   * left so that we are synchronized with the writers for further wakeups.
    */
-  g_async_queue_lock (self->log_queue);
-  for (guint i = 0; i < DISPATCH_MAX; i++)
+  if (self->dispatch_pos >= self->dispatching->len)
     {
-      if (NULL == (item = g_async_queue_try_pop_unlocked (self->log_queue)))
-        {
-          g_source_set_ready_time (self->log_source, -1);
-          break;
-        }
-      g_ptr_array_add (ar, item);
+      GByteArray *batch;
+
+      g_mutex_lock (&self->mutex);
+      batch = self->pending;
+      self->pending = self->dispatching;
+      self->dispatching = batch;
+      g_byte_array_set_size (self->pending, 0);
+      self->dispatch_pos = 0;
+      if (batch->len == 0)
+        g_source_set_ready_time (self->log_source, -1);
+      g_mutex_unlock (&self->mutex);
     }
-  g_async_queue_unlock (self->log_queue);
-
-  for (guint i = 0; i < ar->len; i++)
-    {
-      IdeBuildLogStream stream = IDE_BUILD_LOG_STDOUT;
-      gchar *message;
-      gsize message_len;
 
-      item = g_ptr_array_index (ar, i);
-      message = POINTER_UNMARK (item);
-      message_len = strlen (message);
+  /*
+   * Deliver as much of the batch as we can within a time slice, so that
+   * a very chatty build cannot stall the main loop. The source remains
+   * ready until the batch is drained.
+   */
+  deadline = g_get_monotonic_time () + DISPATCH_MAX_USEC;
 
-      if (POINTER_MARKED (item))
-        stream = IDE_BUILD_LOG_STDERR;
+  while (self->dispatch_pos < self->dispatching->len)
+    {
+      const guint8 *data = self->dispatching->data + self->dispatch_pos;
+      LogEntry entry;
 
-      for (guint j = 0; j < self->observers->len; j++)
-        {
-          const Observer *observer = &g_array_index (self->observers, Observer, j);
+      memcpy (&entry, data, sizeof entry);
+      self->dispatch_pos += sizeof entry + entry.len + 1;
 
-          observer->callback (stream, message, message_len, observer->data);
-        }
+      ide_build_log_notify (self, entry.stream, (const gchar *)data + sizeof entry, entry.len);
 
-      g_free (message);
+      if ((++n_dispatched % 64) == 0 && g_get_monotonic_time () >= deadline)
+        break;
     }
 
   return G_SOURCE_CONTINUE;
@@ -108,9 +136,11 @@ ide_build_log_finalize (GObject *object)
 {
   IdeBuildLog *self = (IdeBuildLog *)object;
 
-  g_clear_pointer (&self->log_queue, g_async_queue_unref);
   g_clear_pointer (&self->log_source, g_source_destroy);
+  g_clear_pointer (&self->pending, g_byte_array_unref);
+  g_clear_pointer (&self->dispatching, g_byte_array_unref);
   g_clear_pointer (&self->observers, g_array_unref);
+  g_mutex_clear (&self->mutex);
 
   G_OBJECT_CLASS (ide_build_log_parent_class)->finalize (object);
 }
@@ -128,7 +158,9 @@ ide_build_log_init (IdeBuildLog *self)
 {
   self->observers = g_array_new (FALSE, FALSE, sizeof (Observer));
 
-  self->log_queue = g_async_queue_new ();
+  g_mutex_init (&self->mutex);
+  self->pending = g_byte_array_new ();
+  self->dispatching = g_byte_array_new ();
 
   self->log_source = g_timeout_source_new (G_MAXINT);
   g_source_set_priority (self->log_source, G_PRIORITY_LOW);
@@ -144,24 +176,23 @@ ide_build_log_via_main (IdeBuildLog       *self,
                         const gchar       *message,
                         gsize              message_len)
 {
-  gchar *copied = g_strndup (message, message_len);
+  LogEntry entry;
 
-  if G_UNLIKELY (stream == IDE_BUILD_LOG_STDERR)
-    copied = POINTER_MARK (copied);
+  entry.len = message_len;
+  entry.stream = stream;
 
   /*
-   * Add the log entry to our queue to be dispatched in the main thread.
-   * However, we hold the async queue lock while updating the source ready
-   * time so we are synchronized with the main thread for setting the
-   * ready time. This is needed because the main thread may not dispatch
-   * all available items in a single dispatch (to avoid stalling the
-   * main loop).
+   * Add the log entry to the pending batch to be dispatched in the main
+   * thread. We update the source ready time while holding the lock so we
+   * are synchronized with the main thread, which clears it only once
+   * there is nothing left to dispatch.
    */
 
-  g_async_queue_lock (self->log_queue);
-  g_async_queue_push_unlocked (self->log_queue, copied);
+  g_mutex_lock (&self->mutex);
+  g_byte_array_append (self->pending, (const guint8 *)&entry, sizeof entry);
+  g_byte_array_append (self->pending, (const guint8 *)message, message_len + 1);
   g_source_set_ready_time (self->log_source, 0);
-  g_async_queue_unlock (self->log_queue);
+  g_mutex_unlock (&self->mutex);
 }
 
 void
@@ -178,20 +209,12 @@ ide_build_log_observer (IdeBuildLogStream  stream,
     message_len = strlen (message);
 
   g_assert (message[message_len] == '\0');
+  g_assert (message_len <= G_MAXUINT32);
 
   if G_LIKELY (IDE_IS_MAIN_THREAD ())
-    {
-      for (guint i = 0; i < self->observers->len; i++)
-        {
-          const Observer *observer = &g_array_index (self->observers, Observer, i);
-
-          observer->callback (stream, message, message_len, observer->data);
-        }
-    }
+    ide_build_log_notify (self, stream, message, message_len);
   else
-    {
-      ide_build_log_via_main (self, stream, message, message_len);
-    }
+    ide_build_log_via_main (self, stream, message, message_len);
 }
 
 guint
@@ -29,6 +29,7 @@
 #include "buildsystem/ide-configuration-manager.h"
 #include "buildsystem/ide-configuration.h"
 #include "diagnostics/ide-diagnostic.h"
+#include "diagnostics/ide-diagnostics-manager.h"
 #include "runtimes/ide-runtime.h"
 #include "runtimes/ide-runtime-manager.h"
 
@@ -165,17 +166,40 @@ ide_build_manager_stop_timer (IdeBuildManager *self)
   IDE_EXIT;
 }
 
+/*
+ * Build diagnostics are published to the project-wide index so that they
+ * can be browsed after the build finished, even for files that are not
+ * open. They are replaced whenever the counters below are reset.
+ */
+static void
+ide_build_manager_clear_indexed_diagnostics (IdeBuildManager *self)
+{
+  IdeContext *context;
+
+  g_assert (IDE_IS_BUILD_MANAGER (self));
+
+  if (NULL != (context = ide_object_get_context (IDE_OBJECT (self))))
+    ide_diagnostics_manager_clear_indexed_source (ide_context_get_diagnostics_manager (context), "build");
+}
+
 static void
 ide_build_manager_handle_diagnostic (IdeBuildManager  *self,
                                      IdeDiagnostic    *diagnostic,
                                      IdeBuildPipeline *pipeline)
 {
+  IdeContext *context;
+
   IDE_ENTRY;
 
   g_assert (IDE_IS_BUILD_MANAGER (self));
   g_assert (diagnostic != NULL);
   g_assert (IDE_IS_BUILD_PIPELINE (pipeline));
 
+  context = ide_object_get_context (IDE_OBJECT (self));
+  ide_diagnostics_manager_add_indexed_diagnostic (ide_context_get_diagnostics_manager (context),
+                                                  "build",
+                                                  diagnostic);
+
   self->diagnostic_count++;
   if (self->diagnostic_count == 1)
     g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_HAS_DIAGNOSTICS]);
@@ -400,6 +424,8 @@ ide_build_manager_invalidate_pipeline (IdeBuildManager *self)
 
   g_clear_pointer (&self->running_time, g_timer_destroy);
 
+  ide_build_manager_clear_indexed_diagnostics (self);
+
   self->diagnostic_count = 0;
   self->error_count = 0;
   self->warning_count = 0;
@@ -1190,6 +1216,7 @@ ide_build_manager_execute_async (IdeBuildManager     *self,
     {
       g_clear_pointer (&self->last_build_time, g_date_time_unref);
       self->last_build_time = g_date_time_new_now_local ();
+      ide_build_manager_clear_indexed_diagnostics (self);
       self->diagnostic_count = 0;
       self->warning_count = 0;
       self->error_count = 0;
@@ -1310,6 +1337,8 @@ ide_build_manager_clean_async (IdeBuildManager     *self,
 
   g_set_object (&self->cancellable, cancellable);
 
+  ide_build_manager_clear_indexed_diagnostics (self);
+
   self->diagnostic_count = 0;
   self->error_count = 0;
   self->warning_count = 0;
@@ -98,8 +98,16 @@ typedef struct
 
 typedef struct
 {
-  guint   id;
-  GRegex *regex;
+  guint    id;
+  GRegex  *regex;
+
+  /*
+   * Literals that any line matching @regex must contain, in order. Lines
+   * that do not contain them are rejected without running @regex, which
+   * is most of the build output.
+   */
+  gchar  **literals;
+  guint    caseless : 1;
 } ErrorFormat;
 
 struct _IdeBuildPipeline
@@ -334,6 +342,7 @@ clear_error_format (gpointer data)
 
   errfmt->id = 0;
   g_clear_pointer (&errfmt->regex, g_regex_unref);
+  g_clear_pointer (&errfmt->literals, g_strfreev);
 }
 
 static inline const gchar *
@@ -499,6 +508,8 @@ ide_build_pipeline_log_observer (IdeBuildLogStream  stream,
   IdeBuildPipeline *self = user_data;
   g_autofree gchar *filtered_message = NULL;
   const gchar *enterdir;
+  const gchar *text;
+  gsize text_len;
 
   g_assert (stream == IDE_BUILD_LOG_STDOUT || stream == IDE_BUILD_LOG_STDERR);
   g_assert (IDE_IS_BUILD_PIPELINE (self));
@@ -513,7 +524,18 @@ ide_build_pipeline_log_observer (IdeBuildLogStream  stream,
   if (self->log != NULL)
     ide_build_log_observer (stream, message, message_len, self->log);
 
-  filtered_message = ide_build_utils_color_codes_filtering (message);
+  /* Avoid a copy of the message unless there is something to filter */
+  if (ide_build_utils_has_color_codes (message, message_len))
+    {
+      filtered_message = ide_build_utils_color_codes_filtering (message);
+      text = filtered_message;
+      text_len = strlen (filtered_message);
+    }
+  else
+    {
+      text = message;
+      text_len = message_len;
+    }
 
   if (stream == IDE_BUILD_LOG_STDOUT)
     {
@@ -522,7 +544,7 @@ ide_build_pipeline_log_observer (IdeBuildLogStream  stream,
        * Not the most ideal decoupling of logic, but we don't have a whole
        * lot to work with here.
        */
-      if (NULL != (enterdir = strstr (filtered_message, ENTERING_DIRECTORY_BEGIN)) &&
+      if (NULL != (enterdir = strstr (text, ENTERING_DIRECTORY_BEGIN)) &&
           g_str_has_suffix (enterdir, ENTERING_DIRECTORY_END))
         {
           gssize len;
@@ -563,7 +585,13 @@ ide_build_pipeline_log_observer (IdeBuildLogStream  stream,
           const ErrorFormat *errfmt = &g_array_index (self->errfmts, ErrorFormat, i);
           g_autoptr(GMatchInfo) match_info = NULL;
 
-          if (g_regex_match (errfmt->regex, filtered_message, 0, &match_info))
+          if (!ide_build_utils_contains_literals (text,
+                                                  text_len,
+                                                  (const gchar * const *)errfmt->literals,
+                                                  errfmt->caseless))
+            continue;
+
+          if (g_regex_match (errfmt->regex, text, 0, &match_info))
             {
               g_autoptr(IdeDiagnostic) diagnostic = create_diagnostic (self, match_info);
 
@@ -2179,6 +2207,8 @@ ide_build_pipeline_add_error_format (IdeBuildPipeline   *self,
     }
 
   errfmt.id = ++self->errfmt_seqnum;
+  errfmt.literals = ide_build_utils_get_required_literals (regex, flags);
+  errfmt.caseless = !!(flags & G_REGEX_CASELESS);
 
   g_array_append_val (self->errfmts, errfmt);
 
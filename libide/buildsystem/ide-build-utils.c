@@ -17,6 +17,7 @@
  */
 
 #include <ide.h>
+#include <string.h>
 
 #include "ide-build-utils.h"
 
@@ -139,3 +140,238 @@ ide_build_utils_color_codes_filtering (const gchar *txt)
 
   return g_string_free (string, FALSE);
 }
+
+/**
+ * ide_build_utils_has_color_codes:
+ * @txt: the text to check
+ * @len: the length of @txt in bytes
+ *
+ * Checks if @txt may contain color codes, in which case it needs to go
+ * through ide_build_utils_color_codes_filtering() before being matched.
+ *
+ * Returns: %TRUE if @txt contains an escape sequence.
+ */
+gboolean
+ide_build_utils_has_color_codes (const gchar *txt,
+                                 gsize        len)
+{
+  const gchar *end = txt + len;
+
+  g_assert (txt != NULL);
+
+  if (memchr (txt, '\033', len) != NULL)
+    return TRUE;
+
+  for (const gchar *iter = txt; NULL != (iter = memchr (iter, '\\', end - iter)); iter++)
+    {
+      if (iter + 1 < end && iter[1] == 'e')
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/**
+ * ide_build_utils_get_required_literals:
+ * @regex: a regex as passed to ide_build_pipeline_add_error_format()
+ * @flags: the compile flags for @regex
+ *
+ * Extracts the literal strings that must appear, in order, in any text
+ * matched by @regex. These are only taken from the top level of the
+ * pattern, outside of any group or character class.
+ *
+ * This is a conservative analysis. If the pattern uses anything that is
+ * not understood, such as alternation or inline options, %NULL is
+ * returned and every line must be given to the regex.
+ *
+ * Returns: (transfer full) (nullable): the required literals, or %NULL.
+ */
+gchar **
+ide_build_utils_get_required_literals (const gchar        *regex,
+                                       GRegexCompileFlags  flags)
+{
+  g_autoptr(GPtrArray) literals = NULL;
+  g_autoptr(GString) run = NULL;
+  gboolean prev_literal = FALSE;
+  gint depth = 0;
+
+  g_return_val_if_fail (regex != NULL, NULL);
+
+  if ((flags & G_REGEX_EXTENDED) != 0)
+    return NULL;
+
+  literals = g_ptr_array_new_with_free_func (g_free);
+  run = g_string_new (NULL);
+
+  for (const gchar *c = regex; *c != '\0'; c++)
+    {
+      gchar ch = *c;
+      gboolean is_literal = FALSE;
+
+      switch (ch)
+        {
+        case '\\':
+          ch = *++c;
+          if (ch == '\0')
+            return NULL;
+          if (g_ascii_ispunct (ch) || ch == ' ')
+            is_literal = TRUE;
+          else if (strchr ("dDwWsSbBhHvV", ch) == NULL)
+            return NULL;
+          break;
+
+        case '[':
+          c++;
+          if (*c == '^')
+            c++;
+          if (*c == ']')
+            c++;
+          for (; *c != '\0' && *c != ']'; c++)
+            {
+              if (*c == '\\' && c[1] != '\0')
+                c++;
+              else if (*c == '[' && c[1] != '\0' && strchr (":=.", c[1]) != NULL)
+                {
+                  /* [:digit:], [=a=] and [.-.] may contain a ']' of their own */
+                  const gchar *close = c + 2;
+
+                  while (*close != '\0' && !(close[0] == c[1] && close[1] == ']'))
+                    close++;
+                  if (*close == '\0')
+                    return NULL;
+                  c = close + 1;
+                }
+            }
+          if (*c == '\0')
+            return NULL;
+          break;
+
+        case '(':
+          /* Inline options such as (?i) change how the rest is matched */
+          if (c[1] == '?' && c[2] != '\0' && strchr ("<P:=!'", c[2]) == NULL)
+            return NULL;
+          depth++;
+          break;
+
+        case ')':
+          depth--;
+          break;
+
+        case '|':
+          if (depth == 0)
+            return NULL;
+          break;
+
+        case '?':
+        case '*':
+        case '{':
+          /* The previous character may not appear at all */
+          if (prev_literal)
+            g_string_truncate (run, run->len - 1);
+          if (ch == '{')
+            {
+              while (*c != '\0' && *c != '}')
+                c++;
+              if (*c == '\0')
+                return NULL;
+            }
+          break;
+
+        case '+':
+        case '.':
+        case '^':
+        case '$':
+          break;
+
+        default:
+          /* Leave non-ASCII out, a quantifier would apply to the whole character */
+          is_literal = (guchar)ch < 0x80;
+          break;
+        }
+
+      if (is_literal && depth == 0)
+        {
+          g_string_append_c (run, ch);
+          prev_literal = TRUE;
+          continue;
+        }
+
+      if (run->len > 0)
+        {
+          g_ptr_array_add (literals, g_strndup (run->str, run->len));
+          g_string_truncate (run, 0);
+        }
+
+      prev_literal = FALSE;
+    }
+
+  if (run->len > 0)
+    g_ptr_array_add (literals, g_strndup (run->str, run->len));
+
+  if (literals->len == 0)
+    return NULL;
+
+  g_ptr_array_add (literals, NULL);
+
+  return (gchar **)g_ptr_array_free (g_steal_pointer (&literals), FALSE);
+}
+
+static const gchar *
+find_literal (const gchar *txt,
+              const gchar *end,
+              const gchar *literal,
+              gsize        literal_len,
+              gboolean     caseless)
+{
+  if (!caseless)
+    return memmem (txt, end - txt, literal, literal_len);
+
+  for (; txt + literal_len <= end; txt++)
+    {
+      if (g_ascii_tolower (*txt) == g_ascii_tolower (*literal) &&
+          g_ascii_strncasecmp (txt, literal, literal_len) == 0)
+        return txt;
+    }
+
+  return NULL;
+}
+
+/**
+ * ide_build_utils_contains_literals:
+ * @txt: the text to check
+ * @len: the length of @txt in bytes
+ * @literals: (nullable): literals from ide_build_utils_get_required_literals()
+ * @caseless: if the literals should be compared without regard to ASCII case
+ *
+ * Checks that each of @literals is found in @txt, in order and without
+ * overlapping. This does not allocate, so it is cheap to use as a filter
+ * before running the regex the literals were extracted from.
+ *
+ * Returns: %TRUE if @txt may match, or %FALSE if it cannot.
+ */
+gboolean
+ide_build_utils_contains_literals (const gchar         *txt,
+                                   gsize                len,
+                                   const gchar * const *literals,
+                                   gboolean             caseless)
+{
+  const gchar *end = txt + len;
+
+  g_assert (txt != NULL);
+
+  if (literals == NULL)
+    return TRUE;
+
+  for (guint i = 0; literals[i] != NULL; i++)
+    {
+      gsize literal_len = strlen (literals[i]);
+      const gchar *found;
+
+      if (NULL == (found = find_literal (txt, end, literals[i], literal_len, caseless)))
+        return FALSE;
+
+      txt = found + literal_len;
+    }
+
+  return TRUE;
+}
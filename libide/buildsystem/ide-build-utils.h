@@ -23,7 +23,15 @@
 
 G_BEGIN_DECLS
 
-gchar *ide_build_utils_color_codes_filtering (const gchar *txt);
+gchar     *ide_build_utils_color_codes_filtering   (const gchar         *txt);
+gboolean   ide_build_utils_has_color_codes         (const gchar         *txt,
+                                                    gsize                len);
+gchar    **ide_build_utils_get_required_literals   (const gchar         *regex,
+                                                    GRegexCompileFlags   flags);
+gboolean   ide_build_utils_contains_literals       (const gchar         *txt,
+                                                    gsize                len,
+                                                    const gchar * const *literals,
+                                                    gboolean             caseless);
 
 G_END_DECLS
 
@@ -0,0 +1,474 @@
+/* ide-build-log-model.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-build-log-model"
+
+#include <string.h>
+
+#include "ide-build-log-model.h"
+
+/*
+ * IdeBuildLogModel stores build output as a list of lines for display in
+ * a GtkTreeView. Lines are packed into fixed-size chunks so that appending
+ * does not allocate per line, and the model behaves as a ring buffer: once
+ * there are more than max-lines lines, the oldest chunk is dropped as a
+ * whole. That keeps memory bounded for very long builds, at the cost of
+ * holding up to LINES_PER_CHUNK lines more than requested.
+ *
+ * Iters hold the absolute number of the line since the model was created,
+ * so they remain valid as lines are appended or the oldest are dropped.
+ */
+
+#define LINES_PER_CHUNK 1024
+
+typedef struct
+{
+  guint32 offset;
+  guint32 len : 31;
+  guint32 is_stderr : 1;
+} LogLine;
+
+typedef struct
+{
+  GByteArray *data;
+  guint       n_lines;
+  LogLine     lines[LINES_PER_CHUNK];
+} LogChunk;
+
+struct _IdeBuildLogModel
+{
+  GObject    parent_instance;
+
+  /* LogChunk, oldest first. Every chunk but the last is full. */
+  GPtrArray *chunks;
+
+  /* Absolute number of the first line of the first chunk */
+  guint      chunks_first_line;
+
+  /* Absolute number of the first line in the model */
+  guint      first_line;
+
+  guint      n_lines;
+  guint      max_lines;
+  gint       stamp;
+};
+
+static void tree_model_iface_init (GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (IdeBuildLogModel, ide_build_log_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL, tree_model_iface_init))
+
+static void
+log_chunk_free (gpointer data)
+{
+  LogChunk *chunk = data;
+
+  g_byte_array_unref (chunk->data);
+  g_slice_free (LogChunk, chunk);
+}
+
+static const LogLine *
+ide_build_log_model_lookup (IdeBuildLogModel  *self,
+                            guint              absolute,
+                            const LogChunk   **chunk)
+{
+  guint index = absolute - self->chunks_first_line;
+
+  g_assert (IDE_IS_BUILD_LOG_MODEL (self));
+  g_assert (absolute - self->first_line < self->n_lines);
+
+  *chunk = g_ptr_array_index (self->chunks, index / LINES_PER_CHUNK);
+
+  return &(*chunk)->lines[index % LINES_PER_CHUNK];
+}
+
+static void
+ide_build_log_model_trim (IdeBuildLogModel *self)
+{
+  g_assert (IDE_IS_BUILD_LOG_MODEL (self));
+
+  while (self->chunks->len > 1)
+    {
+      LogChunk *oldest = g_ptr_array_index (self->chunks, 0);
+      g_autoptr(GtkTreePath) path = NULL;
+
+      if (self->n_lines - oldest->n_lines < self->max_lines)
+        break;
+
+      /*
+       * Rows are removed one at a time so the view stays consistent, but
+       * the chunk is kept until the last of them has been removed in case
+       * the view looks at the remaining rows in between.
+       */
+      path = gtk_tree_path_new_first ();
+
+      for (guint i = 0; i < oldest->n_lines; i++)
+        {
+          self->first_line++;
+          self->n_lines--;
+          gtk_tree_model_row_deleted (GTK_TREE_MODEL (self), path);
+        }
+
+      self->chunks_first_line += LINES_PER_CHUNK;
+      g_ptr_array_remove_index (self->chunks, 0);
+    }
+}
+
+static void
+ide_build_log_model_finalize (GObject *object)
+{
+  IdeBuildLogModel *self = (IdeBuildLogModel *)object;
+
+  g_clear_pointer (&self->chunks, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (ide_build_log_model_parent_class)->finalize (object);
+}
+
+static void
+ide_build_log_model_class_init (IdeBuildLogModelClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ide_build_log_model_finalize;
+}
+
+static void
+ide_build_log_model_init (IdeBuildLogModel *self)
+{
+  self->chunks = g_ptr_array_new_with_free_func (log_chunk_free);
+  self->max_lines = G_MAXUINT;
+  self->stamp = g_random_int ();
+}
+
+IdeBuildLogModel *
+ide_build_log_model_new (guint max_lines)
+{
+  IdeBuildLogModel *self;
+
+  self = g_object_new (IDE_TYPE_BUILD_LOG_MODEL, NULL);
+  self->max_lines = MAX (1, max_lines);
+
+  return self;
+}
+
+guint
+ide_build_log_model_get_max_lines (IdeBuildLogModel *self)
+{
+  g_return_val_if_fail (IDE_IS_BUILD_LOG_MODEL (self), 0);
+
+  return self->max_lines;
+}
+
+/**
+ * ide_build_log_model_set_max_lines:
+ * @self: a #IdeBuildLogModel
+ * @max_lines: the number of lines to keep
+ *
+ * Sets the number of lines to keep. Older lines are dropped a chunk at a
+ * time, so the model may hold somewhat more than @max_lines lines.
+ */
+void
+ide_build_log_model_set_max_lines (IdeBuildLogModel *self,
+                                   guint             max_lines)
+{
+  g_return_if_fail (IDE_IS_BUILD_LOG_MODEL (self));
+
+  self->max_lines = MAX (1, max_lines);
+  ide_build_log_model_trim (self);
+}
+
+guint
+ide_build_log_model_get_n_lines (IdeBuildLogModel *self)
+{
+  g_return_val_if_fail (IDE_IS_BUILD_LOG_MODEL (self), 0);
+
+  return self->n_lines;
+}
+
+/**
+ * ide_build_log_model_get_line:
+ * @self: a #IdeBuildLogModel
+ * @line: the row of the line, starting from zero
+ * @stream: (out) (optional): the stream the line was written to
+ *
+ * Gets a line of the log, including any color codes.
+ *
+ * Returns: the line, which is only valid until the model is changed.
+ */
+const gchar *
+ide_build_log_model_get_line (IdeBuildLogModel  *self,
+                              guint              line,
+                              IdeBuildLogStream *stream)
+{
+  const LogChunk *chunk;
+  const LogLine *ll;
+
+  g_return_val_if_fail (IDE_IS_BUILD_LOG_MODEL (self), NULL);
+  g_return_val_if_fail (line < self->n_lines, NULL);
+
+  ll = ide_build_log_model_lookup (self, self->first_line + line, &chunk);
+
+  if (stream != NULL)
+    *stream = ll->is_stderr ? IDE_BUILD_LOG_STDERR : IDE_BUILD_LOG_STDOUT;
+
+  return (const gchar *)chunk->data->data + ll->offset;
+}
+
+void
+ide_build_log_model_append (IdeBuildLogModel  *self,
+                            IdeBuildLogStream  stream,
+                            const gchar       *message,
+                            gsize              message_len)
+{
+  g_autoptr(GtkTreePath) path = NULL;
+  LogChunk *chunk = NULL;
+  LogLine *line;
+  GtkTreeIter iter;
+
+  g_return_if_fail (IDE_IS_BUILD_LOG_MODEL (self));
+  g_return_if_fail (message != NULL);
+
+  message_len = MIN (message_len, G_MAXINT32);
+
+  if (self->chunks->len > 0)
+    chunk = g_ptr_array_index (self->chunks, self->chunks->len - 1);
+
+  if (chunk == NULL || chunk->n_lines == LINES_PER_CHUNK)
+    {
+      chunk = g_slice_new (LogChunk);
+      chunk->data = g_byte_array_new ();
+      chunk->n_lines = 0;
+      g_ptr_array_add (self->chunks, chunk);
+    }
+
+  line = &chunk->lines[chunk->n_lines++];
+  line->offset = chunk->data->len;
+  line->len = message_len;
+  line->is_stderr = stream == IDE_BUILD_LOG_STDERR;
+
+  g_byte_array_append (chunk->data, (const guint8 *)message, message_len);
+  g_byte_array_append (chunk->data, (const guint8 *)"", 1);
+
+  self->n_lines++;
+
+  iter.stamp = self->stamp;
+  iter.user_data = GUINT_TO_POINTER (self->first_line + self->n_lines - 1);
+
+  path = gtk_tree_path_new_from_indices (self->n_lines - 1, -1);
+  gtk_tree_model_row_inserted (GTK_TREE_MODEL (self), path, &iter);
+
+  ide_build_log_model_trim (self);
+}
+
+static GtkTreeModelFlags
+ide_build_log_model_get_flags (GtkTreeModel *model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY | GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint
+ide_build_log_model_get_n_columns (GtkTreeModel *model)
+{
+  return IDE_BUILD_LOG_MODEL_N_COLUMNS;
+}
+
+static GType
+ide_build_log_model_get_column_type (GtkTreeModel *model,
+                                     gint          column)
+{
+  switch (column)
+    {
+    case IDE_BUILD_LOG_MODEL_COLUMN_TEXT:
+      return G_TYPE_STRING;
+
+    case IDE_BUILD_LOG_MODEL_COLUMN_STREAM:
+      return G_TYPE_INT;
+
+    default:
+      return G_TYPE_INVALID;
+    }
+}
+
+static gboolean
+ide_build_log_model_iter_nth_child (GtkTreeModel *model,
+                                    GtkTreeIter  *iter,
+                                    GtkTreeIter  *parent,
+                                    gint          n)
+{
+  IdeBuildLogModel *self = (IdeBuildLogModel *)model;
+
+  g_assert (IDE_IS_BUILD_LOG_MODEL (self));
+
+  if (parent != NULL || n < 0 || (guint)n >= self->n_lines)
+    return FALSE;
+
+  iter->stamp = self->stamp;
+  iter->user_data = GUINT_TO_POINTER (self->first_line + n);
+
+  return TRUE;
+}
+
+static gboolean
+ide_build_log_model_get_iter (GtkTreeModel *model,
+                              GtkTreeIter  *iter,
+                              GtkTreePath  *path)
+{
+  if (gtk_tree_path_get_depth (path) != 1)
+    return FALSE;
+
+  return ide_build_log_model_iter_nth_child (model, iter, NULL, gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath *
+ide_build_log_model_get_path (GtkTreeModel *model,
+                              GtkTreeIter  *iter)
+{
+  IdeBuildLogModel *self = (IdeBuildLogModel *)model;
+
+  g_assert (IDE_IS_BUILD_LOG_MODEL (self));
+  g_assert (iter->stamp == self->stamp);
+
+  return gtk_tree_path_new_from_indices (GPOINTER_TO_UINT (iter->user_data) - self->first_line, -1);
+}
+
+static void
+ide_build_log_model_get_value (GtkTreeModel *model,
+                               GtkTreeIter  *iter,
+                               gint          column,
+                               GValue       *value)
+{
+  IdeBuildLogModel *self = (IdeBuildLogModel *)model;
+  const LogChunk *chunk;
+  const LogLine *line;
+
+  g_assert (IDE_IS_BUILD_LOG_MODEL (self));
+  g_assert (iter->stamp == self->stamp);
+
+  line = ide_build_log_model_lookup (self, GPOINTER_TO_UINT (iter->user_data), &chunk);
+
+  switch (column)
+    {
+    case IDE_BUILD_LOG_MODEL_COLUMN_TEXT:
+      g_value_init (value, G_TYPE_STRING);
+      g_value_set_string (value, (const gchar *)chunk->data->data + line->offset);
+      break;
+
+    case IDE_BUILD_LOG_MODEL_COLUMN_STREAM:
+      g_value_init (value, G_TYPE_INT);
+      g_value_set_int (value, line->is_stderr ? IDE_BUILD_LOG_STDERR : IDE_BUILD_LOG_STDOUT);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static gboolean
+ide_build_log_model_iter_next (GtkTreeModel *model,
+                               GtkTreeIter  *iter)
+{
+  IdeBuildLogModel *self = (IdeBuildLogModel *)model;
+  guint next;
+
+  g_assert (IDE_IS_BUILD_LOG_MODEL (self));
+  g_assert (iter->stamp == self->stamp);
+
+  next = GPOINTER_TO_UINT (iter->user_data) + 1;
+
+  if (next - self->first_line >= self->n_lines)
+    return FALSE;
+
+  iter->user_data = GUINT_TO_POINTER (next);
+
+  return TRUE;
+}
+
+static gboolean
+ide_build_log_model_iter_previous (GtkTreeModel *model,
+                                   GtkTreeIter  *iter)
+{
+  IdeBuildLogModel *self = (IdeBuildLogModel *)model;
+  guint absolute;
+
+  g_assert (IDE_IS_BUILD_LOG_MODEL (self));
+  g_assert (iter->stamp == self->stamp);
+
+  absolute = GPOINTER_TO_UINT (iter->user_data);
+
+  if (absolute == self->first_line)
+    return FALSE;
+
+  iter->user_data = GUINT_TO_POINTER (absolute - 1);
+
+  return TRUE;
+}
+
+static gboolean
+ide_build_log_model_iter_children (GtkTreeModel *model,
+                                   GtkTreeIter  *iter,
+                                   GtkTreeIter  *parent)
+{
+  return ide_build_log_model_iter_nth_child (model, iter, parent, 0);
+}
+
+static gboolean
+ide_build_log_model_iter_has_child (GtkTreeModel *model,
+                                    GtkTreeIter  *iter)
+{
+  return FALSE;
+}
+
+static gint
+ide_build_log_model_iter_n_children (GtkTreeModel *model,
+                                     GtkTreeIter  *iter)
+{
+  IdeBuildLogModel *self = (IdeBuildLogModel *)model;
+
+  g_assert (IDE_IS_BUILD_LOG_MODEL (self));
+
+  if (iter != NULL)
+    return 0;
+
+  return MIN (self->n_lines, G_MAXINT);
+}
+
+static gboolean
+ide_build_log_model_iter_parent (GtkTreeModel *model,
+                                 GtkTreeIter  *iter,
+                                 GtkTreeIter  *child)
+{
+  return FALSE;
+}
+
+static void
+tree_model_iface_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = ide_build_log_model_get_flags;
+  iface->get_n_columns = ide_build_log_model_get_n_columns;
+  iface->get_column_type = ide_build_log_model_get_column_type;
+  iface->get_iter = ide_build_log_model_get_iter;
+  iface->get_path = ide_build_log_model_get_path;
+  iface->get_value = ide_build_log_model_get_value;
+  iface->iter_next = ide_build_log_model_iter_next;
+  iface->iter_previous = ide_build_log_model_iter_previous;
+  iface->iter_children = ide_build_log_model_iter_children;
+  iface->iter_has_child = ide_build_log_model_iter_has_child;
+  iface->iter_n_children = ide_build_log_model_iter_n_children;
+  iface->iter_nth_child = ide_build_log_model_iter_nth_child;
+  iface->iter_parent = ide_build_log_model_iter_parent;
+}
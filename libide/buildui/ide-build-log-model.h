@@ -0,0 +1,49 @@
+/* ide-build-log-model.h
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <ide.h>
+
+G_BEGIN_DECLS
+
+#define IDE_TYPE_BUILD_LOG_MODEL (ide_build_log_model_get_type())
+
+G_DECLARE_FINAL_TYPE (IdeBuildLogModel, ide_build_log_model, IDE, BUILD_LOG_MODEL, GObject)
+
+enum {
+  IDE_BUILD_LOG_MODEL_COLUMN_TEXT,
+  IDE_BUILD_LOG_MODEL_COLUMN_STREAM,
+  IDE_BUILD_LOG_MODEL_N_COLUMNS
+};
+
+IdeBuildLogModel *ide_build_log_model_new           (guint              max_lines);
+guint             ide_build_log_model_get_max_lines (IdeBuildLogModel  *self);
+void              ide_build_log_model_set_max_lines (IdeBuildLogModel  *self,
+                                                     guint              max_lines);
+guint             ide_build_log_model_get_n_lines   (IdeBuildLogModel  *self);
+const gchar      *ide_build_log_model_get_line      (IdeBuildLogModel  *self,
+                                                     guint              line,
+                                                     IdeBuildLogStream *stream);
+void              ide_build_log_model_append        (IdeBuildLogModel  *self,
+                                                     IdeBuildLogStream  stream,
+                                                     const gchar       *message,
+                                                     gsize              message_len);
+void              ide_build_log_model_clear         (IdeBuildLogModel  *self);
+
+G_END_DECLS
@@ -22,7 +22,9 @@
 #include <glib/gi18n.h>
 #include <ide.h>
 
-#include "ide-build-log-panel.h"
+#include "buildsystem/ide-build-utils.h"
+#include "buildui/ide-build-log-model.h"
+#include "buildui/ide-build-log-panel.h"
 
 typedef struct _ColorCodeState
 {
@@ -37,6 +39,12 @@ typedef struct _ColorCodeState
   guint  hidden     : 1;
 } ColorCodeState;
 
+/*
+ * The log is kept in an IdeBuildLogModel, which drops the oldest lines past
+ * the "max-log-lines" setting, and displayed with a fixed-height GtkTreeView
+ * so that only the visible rows are ever measured or rendered. Color codes
+ * are converted to Pango attributes as each row is rendered.
+ */
 struct _IdeBuildLogPanel
 {
   DzlDockWidget      parent_instance;
@@ -44,20 +52,14 @@ struct _IdeBuildLogPanel
   IdeBuildPipeline  *pipeline;
   GtkCssProvider    *css;
   GSettings         *settings;
-  GtkTextBuffer     *buffer;
+  GSettings         *build_settings;
+  IdeBuildLogModel  *model;
 
   GtkScrolledWindow *scroller;
-  GtkTextView       *text_view;
-
-  GtkTextTag        *stderr_tag;
-  GPtrArray         *color_codes_foreground_tags;
-  GPtrArray         *color_codes_background_tags;
-  GtkTextTag        *color_codes_bold_tag;
-  GtkTextTag        *color_codes_underlined_tag;
-  ColorCodeState     color_codes_state;
-  ColorCodeState     current_color_codes_state;
+  GtkTreeView       *tree_view;
 
   guint              log_observer;
+  guint              scroll_source;
 };
 
 enum {
@@ -107,46 +109,6 @@ typedef enum
   COLOR_CODE_SKIP,
 } ColorCodeType;
 
-static void
-init_color_tags_from_palette (IdeBuildLogPanel *self)
-{
-  GtkTextTag *tag;
-  GdkRGBA rgba;
-
-  g_assert (IDE_IS_BUILD_LOG_PANEL (self));
-  g_assert (self->buffer != NULL);
-
-  g_clear_pointer (&self->color_codes_foreground_tags, g_ptr_array_unref);
-  g_clear_pointer (&self->color_codes_background_tags, g_ptr_array_unref);
-  g_clear_object (&self->color_codes_bold_tag);
-  g_clear_object (&self->color_codes_underlined_tag);
-
-  self->color_codes_foreground_tags = g_ptr_array_new ();
-  for (gint i = 0; i < COLOR_PALETTE_NB_COLORS; ++i)
-    {
-      rgba = solarized_palette [i];
-      tag = gtk_text_buffer_create_tag (self->buffer, NULL, "foreground-rgba", &rgba, NULL);
-      g_ptr_array_add (self->color_codes_foreground_tags, tag);
-    }
-
-  self->color_codes_background_tags = g_ptr_array_new ();
-  for (gint i = 0; i < COLOR_PALETTE_NB_COLORS; ++i)
-    {
-      rgba = solarized_palette [i];
-      tag = gtk_text_buffer_create_tag (self->buffer, NULL, "background-rgba", &rgba, NULL);
-      g_ptr_array_add (self->color_codes_background_tags, tag);
-    }
-
-  self->color_codes_bold_tag =
-    g_object_ref (gtk_text_buffer_create_tag (self->buffer, NULL,
-                                              "weight", PANGO_WEIGHT_BOLD,
-                                              NULL));
-  self->color_codes_underlined_tag =
-    g_object_ref (gtk_text_buffer_create_tag (self->buffer, NULL,
-                                              "underline", PANGO_UNDERLINE_SINGLE,
-                                              NULL));
-}
-
 static inline gboolean
 is_foreground_color_value (gint value)
 {
@@ -209,8 +171,12 @@ str_to_int (const gchar **cursor_ptr)
 }
 
 static gint
-color_code_value_to_tag_index (gint value)
+color_code_value_to_palette_index (gint value)
 {
+  /* Background colors are offset by 10 from the foreground colors */
+  if (is_background_color_value (value))
+    value -= 10;
+
   if (value >=30 && value <= 37)
     return value - 30;
 
@@ -269,43 +235,57 @@ color_codes_state_update (IdeBuildLogPanel *self,
     }
 }
 
+static inline void
+add_attribute (PangoAttrList  *attrs,
+               PangoAttribute *attr,
+               guint           begin,
+               guint           end)
+{
+  attr->start_index = begin;
+  attr->end_index = end;
+  pango_attr_list_insert (attrs, attr);
+}
+
+static PangoAttribute *
+palette_attribute_new (gint     value,
+                       gboolean background)
+{
+  const GdkRGBA *rgba;
+  gint index;
+
+  index = color_code_value_to_palette_index (value);
+  g_assert (index != -1);
+
+  rgba = &solarized_palette [index];
+
+  if (background)
+    return pango_attr_background_new (rgba->red * 0xFFFF, rgba->green * 0xFFFF, rgba->blue * 0xFFFF);
+  else
+    return pango_attr_foreground_new (rgba->red * 0xFFFF, rgba->green * 0xFFFF, rgba->blue * 0xFFFF);
+}
+
 static void
 color_codes_state_apply (IdeBuildLogPanel *self,
                          ColorCodeState   *color_codes_state,
-                         GtkTextIter      *begin,
-                         GtkTextIter      *end)
+                         PangoAttrList    *attrs,
+                         guint             begin,
+                         guint             end)
 {
-  GtkTextTag *tag;
-  gint tag_index;
-
   g_assert (IDE_IS_BUILD_LOG_PANEL (self));
   g_assert (color_codes_state != NULL);
-  g_assert (begin != NULL);
-  g_assert (end != NULL);
+  g_assert (attrs != NULL);
 
   if (color_codes_state->foreground != -1)
-    {
-      tag_index = color_code_value_to_tag_index (color_codes_state->foreground);
-      g_assert (tag_index != -1);
-
-      tag = g_ptr_array_index (self->color_codes_foreground_tags, tag_index);
-      gtk_text_buffer_apply_tag (self->buffer, tag, begin, end);
-    }
+    add_attribute (attrs, palette_attribute_new (color_codes_state->foreground, FALSE), begin, end);
 
   if (color_codes_state->background != -1)
-    {
-      tag_index = color_code_value_to_tag_index (color_codes_state->background);
-      g_assert (tag_index != -1);
-
-      tag = g_ptr_array_index (self->color_codes_background_tags, tag_index);
-      gtk_text_buffer_apply_tag (self->buffer, tag, begin, end);
-    }
+    add_attribute (attrs, palette_attribute_new (color_codes_state->background, TRUE), begin, end);
 
   if (color_codes_state->bold ==  TRUE)
-    gtk_text_buffer_apply_tag (self->buffer, self->color_codes_bold_tag, begin, end);
+    add_attribute (attrs, pango_attr_weight_new (PANGO_WEIGHT_BOLD), begin, end);
 
   if (color_codes_state->underlined ==  TRUE)
-    gtk_text_buffer_apply_tag (self->buffer, self->color_codes_underlined_tag, begin, end);
+    add_attribute (attrs, pango_attr_underline_new (PANGO_UNDERLINE_SINGLE), begin, end);
 }
 
 static ColorCodeType
@@ -432,49 +412,52 @@ end:
   return COLOR_CODE_NONE;
 }
 
-/* Transform VT color codes into tags before inserting the text */
-static void
-ide_build_log_panel_insert_text (IdeBuildLogPanel  *self,
-                                 const gchar       *message,
-                                 GtkTextIter       *iter,
-                                 IdeBuildLogStream  stream)
+/*
+ * Transform VT color codes into attributes for a single line. Lines are
+ * rendered independently, so color state does not carry over from the
+ * previous line.
+ */
+static gchar *
+ide_build_log_panel_parse_line (IdeBuildLogPanel  *self,
+                                const gchar       *message,
+                                IdeBuildLogStream  stream,
+                                PangoAttrList     *attrs)
 {
   ColorCodeType tag_type;
   ColorCodeType current_tag_type = COLOR_CODE_NONE;
-  GtkTextIter pos = *iter;
+  ColorCodeState color_codes_state;
+  ColorCodeState current_color_codes_state;
   const gchar *cursor = message;
   const gchar *tag_start;
   const gchar *tag_end;
+  GString *str;
   gsize len;
 
   g_assert (IDE_IS_BUILD_LOG_PANEL (self));
-  g_assert (iter != NULL);
+  g_assert (message != NULL);
+  g_assert (attrs != NULL);
 
-  if (ide_str_empty0 (message))
-    return;
+  color_codes_state_reset (&color_codes_state);
+  current_color_codes_state = color_codes_state;
+
+  str = g_string_new (NULL);
 
   while (*cursor != '\0')
     {
-      tag_type = find_color_code (self, cursor, &self->color_codes_state, &tag_start, &tag_end);
+      tag_type = find_color_code (self, cursor, &color_codes_state, &tag_start, &tag_end);
       len = tag_start - cursor;
       if (len > 0)
         {
-          GtkTextIter begin;
-          guint offset;
+          guint begin = str->len;
 
-          offset = gtk_text_iter_get_offset (&pos);
-          gtk_text_buffer_insert (self->buffer, &pos, cursor, len);
-          gtk_text_buffer_get_iter_at_offset (self->buffer, &begin, offset);
+          g_string_append_len (str, cursor, len);
 
           if (current_tag_type == COLOR_CODE_TAG || current_tag_type == COLOR_CODE_SKIP)
-            color_codes_state_apply (self, &self->current_color_codes_state, &begin, &pos);
-
-          if (G_LIKELY (stream != IDE_BUILD_LOG_STDOUT))
-            gtk_text_buffer_apply_tag (self->buffer, self->stderr_tag, &begin, &pos);
+            color_codes_state_apply (self, &current_color_codes_state, attrs, begin, str->len);
         }
 
       current_tag_type = tag_type;
-      self->current_color_codes_state = self->color_codes_state;
+      current_color_codes_state = color_codes_state;
 
       if (tag_type == COLOR_CODE_NONE)
         break;
@@ -482,49 +465,92 @@ ide_build_log_panel_insert_text (IdeBuildLogPanel  *self,
       cursor = tag_end;
     }
 
-  gtk_text_buffer_insert (self->buffer, &pos, "\n", 1);
+  /* Inserted first so that color codes take priority */
+  if (G_LIKELY (stream != IDE_BUILD_LOG_STDOUT))
+    {
+      PangoAttribute *attr = pango_attr_foreground_new (0xFFFF, 0, 0);
+
+      attr->start_index = 0;
+      attr->end_index = G_MAXUINT;
+      pango_attr_list_insert_before (attrs, attr);
+    }
+
+  return g_string_free (str, FALSE);
 }
 
 static void
-ide_build_log_panel_reset_view (IdeBuildLogPanel *self)
+ide_build_log_panel_cell_data_func (GtkTreeViewColumn *column,
+                                    GtkCellRenderer   *cell,
+                                    GtkTreeModel      *model,
+                                    GtkTreeIter       *iter,
+                                    gpointer           user_data)
 {
-  GtkStyleContext *context;
+  IdeBuildLogPanel *self = user_data;
+  g_autofree gchar *message = NULL;
+  g_autofree gchar *text = NULL;
+  PangoAttrList *attrs;
+  gint stream;
+
+  g_assert (IDE_IS_BUILD_LOG_PANEL (self));
+  g_assert (GTK_IS_CELL_RENDERER_TEXT (cell));
+  g_assert (IDE_IS_BUILD_LOG_MODEL (model));
+
+  gtk_tree_model_get (model, iter,
+                      IDE_BUILD_LOG_MODEL_COLUMN_TEXT, &message,
+                      IDE_BUILD_LOG_MODEL_COLUMN_STREAM, &stream,
+                      -1);
+
+  attrs = pango_attr_list_new ();
+  text = ide_build_log_panel_parse_line (self, message, stream, attrs);
+  g_object_set (cell,
+                "attributes", attrs,
+                "text", text,
+                NULL);
+  pango_attr_list_unref (attrs);
+}
+
+static gboolean
+ide_build_log_panel_is_at_end (IdeBuildLogPanel *self)
+{
+  GtkAdjustment *vadj;
 
   g_assert (IDE_IS_BUILD_LOG_PANEL (self));
 
-  g_clear_object (&self->buffer);
+  vadj = gtk_scrolled_window_get_vadjustment (self->scroller);
 
-  if (self->text_view != NULL)
-    gtk_widget_destroy (GTK_WIDGET (self->text_view));
+  return gtk_adjustment_get_value (vadj) + gtk_adjustment_get_page_size (vadj) >=
+         gtk_adjustment_get_upper (vadj) - 1.0;
+}
 
-  self->buffer = gtk_text_buffer_new (NULL);
-  self->stderr_tag = gtk_text_buffer_create_tag (self->buffer,
-                                                 "stderr-tag",
-                                                 "foreground", "#ff0000",
-                                                 "weight", PANGO_WEIGHT_NORMAL,
-                                                 NULL);
+static gboolean
+ide_build_log_panel_scroll_to_end (gpointer data)
+{
+  IdeBuildLogPanel *self = data;
+  guint n_lines;
 
-  /* We set VT color codes tags after stderr_tag so that they have higher priority */
-  init_color_tags_from_palette (self);
-  color_codes_state_reset (&self->current_color_codes_state);
-  color_codes_state_reset (&self->color_codes_state);
-
-  self->text_view = g_object_new (GTK_TYPE_TEXT_VIEW,
-                                  "bottom-margin", 3,
-                                  "buffer", self->buffer,
-                                  "cursor-visible", FALSE,
-                                  "editable", FALSE,
-                                  "left-margin", 3,
-                                  "monospace", TRUE,
-                                  "right-margin", 3,
-                                  "top-margin", 3,
-                                  "visible", TRUE,
-                                  NULL);
-  context = gtk_widget_get_style_context (GTK_WIDGET (self->text_view));
-  gtk_style_context_add_provider (context,
-                                  GTK_STYLE_PROVIDER (self->css),
-                                  GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-  gtk_container_add (GTK_CONTAINER (self->scroller), GTK_WIDGET (self->text_view));
+  g_assert (IDE_IS_BUILD_LOG_PANEL (self));
+
+  self->scroll_source = 0;
+
+  if (0 != (n_lines = ide_build_log_model_get_n_lines (self->model)))
+    {
+      g_autoptr(GtkTreePath) path = gtk_tree_path_new_from_indices (n_lines - 1, -1);
+
+      gtk_tree_view_scroll_to_cell (self->tree_view, path, NULL, FALSE, 0.0, 0.0);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_build_log_panel_reset_view (IdeBuildLogPanel *self)
+{
+  g_assert (IDE_IS_BUILD_LOG_PANEL (self));
+
+  g_clear_object (&self->model);
+
+  self->model = ide_build_log_model_new (g_settings_get_uint (self->build_settings, "max-log-lines"));
+  gtk_tree_view_set_model (self->tree_view, GTK_TREE_MODEL (self->model));
 }
 
 static void
@@ -534,22 +560,34 @@ ide_build_log_panel_log_observer (IdeBuildLogStream  stream,
                                   gpointer           user_data)
 {
   IdeBuildLogPanel *self = user_data;
-  GtkTextMark *insert;
-  GtkTextIter iter, enditer;
 
   g_assert (IDE_IS_BUILD_LOG_PANEL (self));
   g_assert (message != NULL);
   g_assert (message_len >= 0);
   g_assert (message[message_len] == '\0');
 
-  gtk_text_buffer_get_end_iter (self->buffer, &iter);
-  ide_build_log_panel_insert_text (self, message, &iter, stream);
+  /*
+   * Follow the end of the log, unless the user has scrolled up to look at
+   * something. Scrolling is coalesced so a burst of lines scrolls once.
+   */
+  if (self->scroll_source == 0 && ide_build_log_panel_is_at_end (self))
+    self->scroll_source = g_idle_add_full (G_PRIORITY_LOW,
+                                           ide_build_log_panel_scroll_to_end,
+                                           self,
+                                           NULL);
 
-  insert = gtk_text_buffer_get_insert (self->buffer);
-  gtk_text_view_scroll_to_mark (self->text_view, insert, 0.0, TRUE, 1.0, 0.0);
+  ide_build_log_model_append (self->model, stream, message, message_len);
+}
 
-  gtk_text_buffer_get_end_iter (self->buffer, &enditer);
-  gtk_text_buffer_place_cursor (self->buffer, &enditer);
+static void
+ide_build_log_panel_changed_max_log_lines (IdeBuildLogPanel *self,
+                                           const gchar      *key,
+                                           GSettings        *settings)
+{
+  g_assert (IDE_IS_BUILD_LOG_PANEL (self));
+  g_assert (G_IS_SETTINGS (settings));
+
+  ide_build_log_model_set_max_lines (self->model, g_settings_get_uint (settings, key));
 }
 
 void
@@ -601,7 +639,7 @@ ide_build_log_panel_changed_font_name (IdeBuildLogPanel *self,
       gchar *css;
 
       fragment = dzl_pango_font_description_to_css (font_desc);
-      css = g_strdup_printf ("textview { %s }", fragment);
+      css = g_strdup_printf ("treeview { %s }", fragment);
 
       gtk_css_provider_load_from_data (self->css, css, -1, NULL);
 
@@ -618,16 +656,11 @@ ide_build_log_panel_finalize (GObject *object)
 {
   IdeBuildLogPanel *self = (IdeBuildLogPanel *)object;
 
-  self->stderr_tag = NULL;
-
   g_clear_object (&self->pipeline);
   g_clear_object (&self->css);
   g_clear_object (&self->settings);
-
-  g_clear_pointer (&self->color_codes_foreground_tags, g_ptr_array_unref);
-  g_clear_pointer (&self->color_codes_background_tags, g_ptr_array_unref);
-  g_clear_object (&self->color_codes_bold_tag);
-  g_clear_object (&self->color_codes_underlined_tag);
+  g_clear_object (&self->build_settings);
+  g_clear_object (&self->model);
 
   G_OBJECT_CLASS (ide_build_log_panel_parent_class)->finalize (object);
 }
@@ -639,6 +672,8 @@ ide_build_log_panel_dispose (GObject *object)
 
   ide_build_log_panel_set_pipeline (self, NULL);
 
+  ide_clear_source (&self->scroll_source);
+
   G_OBJECT_CLASS (ide_build_log_panel_parent_class)->dispose (object);
 }
 
@@ -715,7 +750,7 @@ ide_build_log_panel_clear_activate (GSimpleAction *action,
   g_assert (G_IS_SIMPLE_ACTION (action));
   g_assert (IDE_IS_BUILD_LOG_PANEL (self));
 
-  gtk_text_buffer_set_text (self->buffer, "", 0);
+  ide_build_log_panel_reset_view (self);
 }
 
 static void
@@ -745,13 +780,19 @@ ide_build_log_panel_save_in_file (GSimpleAction *action,
   if (res == GTK_RESPONSE_ACCEPT)
     {
       g_autofree gchar *filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (native));
-      g_autofree gchar *text = NULL;
-      GtkTextIter begin;
-      GtkTextIter end;
+      g_autoptr(GString) text = g_string_new (NULL);
+      guint n_lines = ide_build_log_model_get_n_lines (self->model);
 
-      gtk_text_buffer_get_bounds (self->buffer, &begin, &end);
-      text = gtk_text_buffer_get_text (self->buffer, &begin, &end, FALSE);
-      g_file_set_contents (filename, text, -1, NULL);
+      for (guint i = 0; i < n_lines; i++)
+        {
+          const gchar *line = ide_build_log_model_get_line (self->model, i, NULL);
+          g_autofree gchar *filtered = ide_build_utils_color_codes_filtering (line);
+
+          g_string_append (text, filtered);
+          g_string_append_c (text, '\n');
+        }
+
+      g_file_set_contents (filename, text->str, text->len, NULL);
     }
 
   IDE_EXIT;
@@ -765,6 +806,9 @@ ide_build_log_panel_init (IdeBuildLogPanel *self)
     { "save", ide_build_log_panel_save_in_file },
   };
   g_autoptr(GSimpleActionGroup) actions = NULL;
+  GtkStyleContext *context;
+  GtkTreeViewColumn *column;
+  GtkCellRenderer *cell;
 
   self->css = gtk_css_provider_new ();
 
@@ -772,6 +816,39 @@ ide_build_log_panel_init (IdeBuildLogPanel *self)
 
   g_object_set (self, "title", _("Build Output"), NULL);
 
+  self->tree_view = g_object_new (GTK_TYPE_TREE_VIEW,
+                                  "enable-search", FALSE,
+                                  "fixed-height-mode", TRUE,
+                                  "headers-visible", FALSE,
+                                  "visible", TRUE,
+                                  NULL);
+  context = gtk_widget_get_style_context (GTK_WIDGET (self->tree_view));
+  gtk_style_context_add_provider (context,
+                                  GTK_STYLE_PROVIDER (self->css),
+                                  GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+  gtk_container_add (GTK_CONTAINER (self->scroller), GTK_WIDGET (self->tree_view));
+
+  column = g_object_new (GTK_TYPE_TREE_VIEW_COLUMN,
+                         "expand", TRUE,
+                         "sizing", GTK_TREE_VIEW_COLUMN_FIXED,
+                         "visible", TRUE,
+                         NULL);
+  cell = g_object_new (GTK_TYPE_CELL_RENDERER_TEXT,
+                       "xpad", 3,
+                       "ypad", 0,
+                       "visible", TRUE,
+                       NULL);
+  gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (column), cell, TRUE);
+  gtk_tree_view_column_set_cell_data_func (column, cell, ide_build_log_panel_cell_data_func, self, NULL);
+  gtk_tree_view_append_column (self->tree_view, column);
+
+  self->build_settings = g_settings_new ("org.gnome.builder.build");
+  g_signal_connect_object (self->build_settings,
+                           "changed::max-log-lines",
+                           G_CALLBACK (ide_build_log_panel_changed_max_log_lines),
+                           self,
+                           G_CONNECT_SWAPPED);
+
   ide_build_log_panel_reset_view (self);
 
   self->settings = g_settings_new ("org.gnome.builder.terminal");
@@ -0,0 +1,60 @@
+/* ide-diagnostics-index-private.h
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "diagnostics/ide-diagnostic.h"
+#include "diagnostics/ide-diagnostics.h"
+
+G_BEGIN_DECLS
+
+typedef struct _IdeDiagnosticsIndex IdeDiagnosticsIndex;
+
+IdeDiagnosticsIndex *_ide_diagnostics_index_new             (void);
+void                 _ide_diagnostics_index_free            (IdeDiagnosticsIndex   *self);
+guint                _ide_diagnostics_index_get_sequence    (IdeDiagnosticsIndex   *self);
+gboolean             _ide_diagnostics_index_set             (IdeDiagnosticsIndex   *self,
+                                                             const gchar           *source,
+                                                             GFile                 *file,
+                                                             IdeDiagnostics        *diagnostics);
+void                 _ide_diagnostics_index_add             (IdeDiagnosticsIndex   *self,
+                                                             const gchar           *source,
+                                                             GFile                 *file,
+                                                             IdeDiagnostic         *diagnostic);
+void                 _ide_diagnostics_index_add_all         (IdeDiagnosticsIndex   *self,
+                                                             const gchar           *source,
+                                                             GFile                 *file,
+                                                             IdeDiagnostics        *diagnostics);
+gboolean             _ide_diagnostics_index_remove_source   (IdeDiagnosticsIndex   *self,
+                                                             const gchar           *source);
+guint                _ide_diagnostics_index_count           (IdeDiagnosticsIndex   *self,
+                                                             GFile                 *directory,
+                                                             IdeDiagnosticSeverity  min_severity);
+GPtrArray           *_ide_diagnostics_index_list_files      (IdeDiagnosticsIndex   *self,
+                                                             GFile                 *directory,
+                                                             IdeDiagnosticSeverity  min_severity,
+                                                             guint                  since_sequence);
+IdeDiagnostics      *_ide_diagnostics_index_get_diagnostics (IdeDiagnosticsIndex   *self,
+                                                             GFile                 *file,
+                                                             IdeDiagnosticSeverity  min_severity);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeDiagnosticsIndex, _ide_diagnostics_index_free)
+
+G_END_DECLS
@@ -0,0 +1,713 @@
+/* ide-diagnostics-index.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-diagnostics-index"
+
+#include <string.h>
+
+#include "diagnostics/ide-diagnostics-index-private.h"
+
+/*
+ * The diagnostics index holds the diagnostics for every file in the
+ * project that a source has reported, whether or not the file is open.
+ * A source is a short string naming what produced the diagnostics, such
+ * as the build pipeline or the type name of a diagnostic provider, and
+ * each source replaces only its own diagnostics for a file.
+ *
+ * Besides the table of files, we keep the files sorted by URI so that
+ * the files below a directory are contiguous, and the number of
+ * diagnostics of each severity for every directory containing a file,
+ * so that counting the problems below a directory is a single lookup.
+ */
+
+#define N_SEVERITIES (IDE_DIAGNOSTIC_FATAL + 1)
+
+typedef struct
+{
+  guint counts[N_SEVERITIES];
+} Counts;
+
+typedef struct
+{
+  /* Interned */
+  const gchar    *source;
+  IdeDiagnostics *diagnostics;
+  Counts          counts;
+} SourceEntry;
+
+typedef struct
+{
+  GFile         *file;
+  gchar         *uri;
+  GSequenceIter *iter;
+  GArray        *sources;
+  Counts         counts;
+  guint          sequence;
+} FileEntry;
+
+struct _IdeDiagnosticsIndex
+{
+  /* GFile → FileEntry, which owns the entries */
+  GHashTable *files;
+
+  /* FileEntry sorted by URI */
+  GSequence  *sorted;
+
+  /* Directory URI without trailing slash → Counts */
+  GHashTable *directories;
+
+  Counts      totals;
+  guint       sequence;
+};
+
+static inline IdeDiagnosticSeverity
+get_severity (IdeDiagnostic *diagnostic)
+{
+  return MIN (ide_diagnostic_get_severity (diagnostic), IDE_DIAGNOSTIC_FATAL);
+}
+
+static guint
+counts_sum (const Counts          *counts,
+            IdeDiagnosticSeverity  min_severity)
+{
+  guint sum = 0;
+
+  for (guint i = MIN (min_severity, IDE_DIAGNOSTIC_FATAL); i < N_SEVERITIES; i++)
+    sum += counts->counts[i];
+
+  return sum;
+}
+
+static gboolean
+counts_is_empty (const Counts *counts)
+{
+  return counts_sum (counts, IDE_DIAGNOSTIC_IGNORED) == 0;
+}
+
+static void
+counts_apply (Counts       *counts,
+              const Counts *delta,
+              gboolean      add)
+{
+  for (guint i = 0; i < N_SEVERITIES; i++)
+    {
+      if (add)
+        counts->counts[i] += delta->counts[i];
+      else
+        counts->counts[i] -= delta->counts[i];
+    }
+}
+
+static void
+free_counts (gpointer data)
+{
+  g_slice_free (Counts, data);
+}
+
+static void
+source_entry_clear (gpointer data)
+{
+  SourceEntry *source = data;
+
+  g_clear_pointer (&source->diagnostics, ide_diagnostics_unref);
+}
+
+static void
+file_entry_free (gpointer data)
+{
+  FileEntry *entry = data;
+
+  g_clear_pointer (&entry->sources, g_array_unref);
+  g_clear_pointer (&entry->uri, g_free);
+  g_clear_object (&entry->file);
+  g_slice_free (FileEntry, entry);
+}
+
+static gint
+file_entry_compare (gconstpointer a,
+                    gconstpointer b,
+                    gpointer      user_data)
+{
+  const FileEntry *entry_a = a;
+  const FileEntry *entry_b = b;
+
+  return strcmp (entry_a->uri, entry_b->uri);
+}
+
+/*
+ * Gets the URI for @directory without a trailing slash, which is how the
+ * ancestors of each file are keyed.
+ */
+static gchar *
+get_directory_key (GFile *directory)
+{
+  gchar *uri = g_file_get_uri (directory);
+  gsize len = strlen (uri);
+
+  if (len > 0 && uri[len - 1] == '/')
+    uri[len - 1] = '\0';
+
+  return uri;
+}
+
+static void
+ide_diagnostics_index_apply (IdeDiagnosticsIndex *self,
+                             FileEntry           *entry,
+                             const Counts        *delta,
+                             gboolean             add)
+{
+  g_autofree gchar *dir = NULL;
+  const gchar *min;
+  gchar *slash;
+
+  g_assert (self != NULL);
+  g_assert (entry != NULL);
+  g_assert (delta != NULL);
+
+  counts_apply (&entry->counts, delta, add);
+  counts_apply (&self->totals, delta, add);
+
+  /*
+   * Walk up the URI of the file, stopping before we cut into the
+   * "scheme://" prefix. The root of "file:///foo" is keyed as "file://".
+   */
+  dir = g_strdup (entry->uri);
+
+  if (NULL == (min = strstr (dir, "://")))
+    return;
+
+  min += 2;
+
+  while (NULL != (slash = strrchr (dir, '/')) && slash > min)
+    {
+      Counts *counts;
+
+      *slash = '\0';
+
+      if (NULL == (counts = g_hash_table_lookup (self->directories, dir)))
+        {
+          if (!add)
+            continue;
+
+          counts = g_slice_new0 (Counts);
+          g_hash_table_insert (self->directories, g_strdup (dir), counts);
+        }
+
+      counts_apply (counts, delta, add);
+
+      if (!add && counts_is_empty (counts))
+        g_hash_table_remove (self->directories, dir);
+    }
+}
+
+static FileEntry *
+ide_diagnostics_index_get_entry (IdeDiagnosticsIndex *self,
+                                 GFile               *file,
+                                 gboolean             create)
+{
+  FileEntry *entry;
+
+  g_assert (self != NULL);
+  g_assert (G_IS_FILE (file));
+
+  if (NULL == (entry = g_hash_table_lookup (self->files, file)) && create)
+    {
+      entry = g_slice_new0 (FileEntry);
+      entry->file = g_object_ref (file);
+      entry->uri = g_file_get_uri (file);
+      entry->sources = g_array_new (FALSE, FALSE, sizeof (SourceEntry));
+      g_array_set_clear_func (entry->sources, source_entry_clear);
+      entry->iter = g_sequence_insert_sorted (self->sorted, entry, file_entry_compare, NULL);
+
+      g_hash_table_insert (self->files, entry->file, entry);
+    }
+
+  return entry;
+}
+
+static void
+ide_diagnostics_index_remove_entry (IdeDiagnosticsIndex *self,
+                                    FileEntry           *entry)
+{
+  g_assert (self != NULL);
+  g_assert (entry != NULL);
+  g_assert (entry->sources->len == 0);
+
+  g_sequence_remove (entry->iter);
+  g_hash_table_remove (self->files, entry->file);
+}
+
+static SourceEntry *
+file_entry_get_source (FileEntry   *entry,
+                       const gchar *source,
+                       guint       *position)
+{
+  g_assert (entry != NULL);
+  g_assert (source == g_intern_string (source));
+
+  for (guint i = 0; i < entry->sources->len; i++)
+    {
+      SourceEntry *ele = &g_array_index (entry->sources, SourceEntry, i);
+
+      if (ele->source == source)
+        {
+          if (position != NULL)
+            *position = i;
+          return ele;
+        }
+    }
+
+  return NULL;
+}
+
+static gboolean
+ide_diagnostics_index_remove_source_from_entry (IdeDiagnosticsIndex *self,
+                                                FileEntry           *entry,
+                                                const gchar         *source)
+{
+  SourceEntry *ele;
+  guint position;
+
+  g_assert (self != NULL);
+  g_assert (entry != NULL);
+
+  if (NULL == (ele = file_entry_get_source (entry, source, &position)))
+    return FALSE;
+
+  ide_diagnostics_index_apply (self, entry, &ele->counts, FALSE);
+  g_array_remove_index_fast (entry->sources, position);
+
+  return TRUE;
+}
+
+IdeDiagnosticsIndex *
+_ide_diagnostics_index_new (void)
+{
+  IdeDiagnosticsIndex *self;
+
+  self = g_slice_new0 (IdeDiagnosticsIndex);
+  self->files = g_hash_table_new_full (g_file_hash,
+                                       (GEqualFunc)g_file_equal,
+                                       NULL,
+                                       file_entry_free);
+  self->sorted = g_sequence_new (NULL);
+  self->directories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, free_counts);
+
+  return self;
+}
+
+void
+_ide_diagnostics_index_free (IdeDiagnosticsIndex *self)
+{
+  if (self == NULL)
+    return;
+
+  g_clear_pointer (&self->sorted, g_sequence_free);
+  g_clear_pointer (&self->files, g_hash_table_unref);
+  g_clear_pointer (&self->directories, g_hash_table_unref);
+
+  g_slice_free (IdeDiagnosticsIndex, self);
+}
+
+/**
+ * _ide_diagnostics_index_get_sequence:
+ *
+ * Gets the sequence number of the index, which is incremented for every
+ * change. Each file is stamped with the sequence of its last change so
+ * that _ide_diagnostics_index_list_files() can return only the files
+ * that changed since a previous query.
+ */
+guint
+_ide_diagnostics_index_get_sequence (IdeDiagnosticsIndex *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->sequence;
+}
+
+/**
+ * _ide_diagnostics_index_set:
+ * @self: An #IdeDiagnosticsIndex
+ * @source: the name of the source of the diagnostics
+ * @file: a #GFile
+ * @diagnostics: (nullable): the diagnostics for @file
+ *
+ * Replaces the diagnostics @source previously reported for @file. The
+ * diagnostics are copied, so later changes to @diagnostics are not
+ * reflected in the index.
+ *
+ * Returns: %TRUE if the index changed.
+ */
+gboolean
+_ide_diagnostics_index_set (IdeDiagnosticsIndex *self,
+                            const gchar         *source,
+                            GFile               *file,
+                            IdeDiagnostics      *diagnostics)
+{
+  FileEntry *entry;
+  gboolean changed;
+  gsize size = 0;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (source != NULL, FALSE);
+  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+
+  source = g_intern_string (source);
+
+  if (diagnostics != NULL)
+    size = ide_diagnostics_get_size (diagnostics);
+
+  if (NULL == (entry = ide_diagnostics_index_get_entry (self, file, size > 0)))
+    return FALSE;
+
+  changed = ide_diagnostics_index_remove_source_from_entry (self, entry, source);
+
+  if (size > 0)
+    {
+      SourceEntry ele = { 0 };
+
+      ele.source = source;
+      ele.diagnostics = ide_diagnostics_new (NULL);
+      ide_diagnostics_merge (ele.diagnostics, diagnostics);
+
+      for (gsize i = 0; i < size; i++)
+        ele.counts.counts[get_severity (ide_diagnostics_index (diagnostics, i))]++;
+
+      g_array_append_val (entry->sources, ele);
+      ide_diagnostics_index_apply (self, entry, &ele.counts, TRUE);
+
+      changed = TRUE;
+    }
+
+  if (!changed)
+    return FALSE;
+
+  self->sequence++;
+
+  if (entry->sources->len == 0)
+    ide_diagnostics_index_remove_entry (self, entry);
+  else
+    entry->sequence = self->sequence;
+
+  return TRUE;
+}
+
+static SourceEntry *
+ide_diagnostics_index_ensure_source (FileEntry   *entry,
+                                     const gchar *source)
+{
+  SourceEntry *ele;
+
+  g_assert (entry != NULL);
+  g_assert (source == g_intern_string (source));
+
+  if (NULL == (ele = file_entry_get_source (entry, source, NULL)))
+    {
+      SourceEntry new_ele = { 0 };
+
+      new_ele.source = source;
+      new_ele.diagnostics = ide_diagnostics_new (NULL);
+      g_array_append_val (entry->sources, new_ele);
+
+      ele = &g_array_index (entry->sources, SourceEntry, entry->sources->len - 1);
+    }
+
+  return ele;
+}
+
+/**
+ * _ide_diagnostics_index_add:
+ * @self: An #IdeDiagnosticsIndex
+ * @source: the name of the source of the diagnostics
+ * @file: a #GFile
+ * @diagnostic: an #IdeDiagnostic
+ *
+ * Adds a single diagnostic for @file from @source. This is useful for
+ * sources such as the build pipeline, which discover diagnostics one at
+ * a time and clear them with _ide_diagnostics_index_remove_source().
+ */
+void
+_ide_diagnostics_index_add (IdeDiagnosticsIndex *self,
+                            const gchar         *source,
+                            GFile               *file,
+                            IdeDiagnostic       *diagnostic)
+{
+  Counts delta = { { 0 } };
+  FileEntry *entry;
+  SourceEntry *ele;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (source != NULL);
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (diagnostic != NULL);
+
+  source = g_intern_string (source);
+  entry = ide_diagnostics_index_get_entry (self, file, TRUE);
+  ele = ide_diagnostics_index_ensure_source (entry, source);
+
+  ide_diagnostics_add (ele->diagnostics, diagnostic);
+
+  delta.counts[get_severity (diagnostic)] = 1;
+  counts_apply (&ele->counts, &delta, TRUE);
+  ide_diagnostics_index_apply (self, entry, &delta, TRUE);
+
+  entry->sequence = ++self->sequence;
+}
+
+/**
+ * _ide_diagnostics_index_add_all:
+ * @self: An #IdeDiagnosticsIndex
+ * @source: the name of the source of the diagnostics
+ * @file: a #GFile
+ * @diagnostics: an #IdeDiagnostics
+ *
+ * Like _ide_diagnostics_index_add() for each of @diagnostics, but the
+ * directory counts are only walked once for the whole batch.
+ */
+void
+_ide_diagnostics_index_add_all (IdeDiagnosticsIndex *self,
+                                const gchar         *source,
+                                GFile               *file,
+                                IdeDiagnostics      *diagnostics)
+{
+  Counts delta = { { 0 } };
+  FileEntry *entry;
+  SourceEntry *ele;
+  gsize size;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (source != NULL);
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (diagnostics != NULL);
+
+  if (0 == (size = ide_diagnostics_get_size (diagnostics)))
+    return;
+
+  source = g_intern_string (source);
+  entry = ide_diagnostics_index_get_entry (self, file, TRUE);
+  ele = ide_diagnostics_index_ensure_source (entry, source);
+
+  for (gsize i = 0; i < size; i++)
+    {
+      IdeDiagnostic *diagnostic = ide_diagnostics_index (diagnostics, i);
+
+      ide_diagnostics_add (ele->diagnostics, diagnostic);
+      delta.counts[get_severity (diagnostic)]++;
+    }
+
+  counts_apply (&ele->counts, &delta, TRUE);
+  ide_diagnostics_index_apply (self, entry, &delta, TRUE);
+
+  entry->sequence = ++self->sequence;
+}
+
+/**
+ * _ide_diagnostics_index_remove_source:
+ * @self: An #IdeDiagnosticsIndex
+ * @source: the name of the source of the diagnostics
+ *
+ * Removes every diagnostic reported by @source, for all files.
+ *
+ * Returns: %TRUE if the index changed.
+ */
+gboolean
+_ide_diagnostics_index_remove_source (IdeDiagnosticsIndex *self,
+                                      const gchar         *source)
+{
+  GHashTableIter iter;
+  gpointer value;
+  gboolean changed = FALSE;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (source != NULL, FALSE);
+
+  source = g_intern_string (source);
+
+  g_hash_table_iter_init (&iter, self->files);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      FileEntry *entry = value;
+
+      if (!ide_diagnostics_index_remove_source_from_entry (self, entry, source))
+        continue;
+
+      changed = TRUE;
+
+      if (entry->sources->len == 0)
+        {
+          g_sequence_remove (entry->iter);
+          g_hash_table_iter_remove (&iter);
+        }
+      else
+        {
+          entry->sequence = self->sequence + 1;
+        }
+    }
+
+  if (changed)
+    self->sequence++;
+
+  return changed;
+}
+
+/**
+ * _ide_diagnostics_index_count:
+ * @self: An #IdeDiagnosticsIndex
+ * @directory: (nullable): a directory, or %NULL for the whole index
+ * @min_severity: the lowest severity to count
+ *
+ * Counts the diagnostics found below @directory with a severity of at
+ * least @min_severity. If @directory is a file, only the diagnostics of
+ * that file are counted.
+ *
+ * Returns: the number of diagnostics.
+ */
+guint
+_ide_diagnostics_index_count (IdeDiagnosticsIndex   *self,
+                              GFile                 *directory,
+                              IdeDiagnosticSeverity  min_severity)
+{
+  g_autofree gchar *key = NULL;
+  const Counts *counts;
+  FileEntry *entry;
+
+  g_return_val_if_fail (self != NULL, 0);
+  g_return_val_if_fail (!directory || G_IS_FILE (directory), 0);
+
+  if (directory == NULL)
+    return counts_sum (&self->totals, min_severity);
+
+  if (NULL != (entry = g_hash_table_lookup (self->files, directory)))
+    return counts_sum (&entry->counts, min_severity);
+
+  key = get_directory_key (directory);
+
+  if (NULL != (counts = g_hash_table_lookup (self->directories, key)))
+    return counts_sum (counts, min_severity);
+
+  return 0;
+}
+
+/**
+ * _ide_diagnostics_index_list_files:
+ * @self: An #IdeDiagnosticsIndex
+ * @directory: (nullable): a directory, or %NULL for the whole index
+ * @min_severity: the lowest severity to consider
+ * @since_sequence: only list files changed after this sequence, or 0
+ *
+ * Lists the files below @directory that have diagnostics of at least
+ * @min_severity, sorted by URI.
+ *
+ * Files that no longer have any diagnostics are removed from the index
+ * and therefore never listed, so callers tracking changes should drop
+ * files that are missing from a full listing.
+ *
+ * Returns: (transfer container) (element-type Gio.File): a #GPtrArray
+ *   of #GFile.
+ */
+GPtrArray *
+_ide_diagnostics_index_list_files (IdeDiagnosticsIndex   *self,
+                                   GFile                 *directory,
+                                   IdeDiagnosticSeverity  min_severity,
+                                   guint                  since_sequence)
+{
+  g_autofree gchar *prefix = NULL;
+  GSequenceIter *iter;
+  GPtrArray *ret;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (!directory || G_IS_FILE (directory), NULL);
+
+  ret = g_ptr_array_new_with_free_func (g_object_unref);
+
+  if (directory != NULL)
+    {
+      g_autofree gchar *key = get_directory_key (directory);
+      FileEntry lookup = { 0 };
+
+      /* Skip directories without any files in the index */
+      if (!g_hash_table_contains (self->directories, key))
+        return ret;
+
+      prefix = g_strconcat (key, "/", NULL);
+      lookup.uri = prefix;
+
+      iter = g_sequence_search (self->sorted, &lookup, file_entry_compare, NULL);
+    }
+  else
+    {
+      iter = g_sequence_get_begin_iter (self->sorted);
+    }
+
+  for (; !g_sequence_iter_is_end (iter); iter = g_sequence_iter_next (iter))
+    {
+      FileEntry *entry = g_sequence_get (iter);
+
+      if (prefix != NULL && !g_str_has_prefix (entry->uri, prefix))
+        break;
+
+      if (entry->sequence > since_sequence && counts_sum (&entry->counts, min_severity) > 0)
+        g_ptr_array_add (ret, g_object_ref (entry->file));
+    }
+
+  return ret;
+}
+
+/**
+ * _ide_diagnostics_index_get_diagnostics:
+ * @self: An #IdeDiagnosticsIndex
+ * @file: a #GFile
+ * @min_severity: the lowest severity to include
+ *
+ * Gets the diagnostics of every source for @file.
+ *
+ * Returns: (transfer full): a new #IdeDiagnostics
+ */
+IdeDiagnostics *
+_ide_diagnostics_index_get_diagnostics (IdeDiagnosticsIndex   *self,
+                                        GFile                 *file,
+                                        IdeDiagnosticSeverity  min_severity)
+{
+  IdeDiagnostics *ret;
+  FileEntry *entry;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+  ret = ide_diagnostics_new (NULL);
+
+  if (NULL == (entry = g_hash_table_lookup (self->files, file)))
+    return ret;
+
+  for (guint i = 0; i < entry->sources->len; i++)
+    {
+      const SourceEntry *ele = &g_array_index (entry->sources, SourceEntry, i);
+      gsize size = ide_diagnostics_get_size (ele->diagnostics);
+
+      for (gsize j = 0; j < size; j++)
+        {
+          IdeDiagnostic *diagnostic = ide_diagnostics_index (ele->diagnostics, j);
+
+          if (get_severity (diagnostic) >= min_severity)
+            ide_diagnostics_add (ret, diagnostic);
+        }
+    }
+
+  return ret;
+}
@@ -0,0 +1,70 @@
+/* ide-diagnostics-intervals-private.h
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "diagnostics/ide-diagnostic.h"
+
+G_BEGIN_DECLS
+
+typedef struct _IdeDiagnosticsIntervals IdeDiagnosticsIntervals;
+
+/**
+ * IdeDiagnosticsIntervalsForeach:
+ * @begin_line: the first line of the interval
+ * @end_line: the last line of the interval, inclusive
+ * @severity: the severity of the diagnostic
+ * @data: the data provided to _ide_diagnostics_intervals_add()
+ * @user_data: closure data
+ */
+typedef void (*IdeDiagnosticsIntervalsForeach) (guint                  begin_line,
+                                                guint                  end_line,
+                                                IdeDiagnosticSeverity  severity,
+                                                gpointer               data,
+                                                gpointer               user_data);
+
+IdeDiagnosticsIntervals *_ide_diagnostics_intervals_new          (void);
+void                     _ide_diagnostics_intervals_free         (IdeDiagnosticsIntervals        *self);
+void                     _ide_diagnostics_intervals_clear        (IdeDiagnosticsIntervals        *self);
+guint                    _ide_diagnostics_intervals_get_size     (IdeDiagnosticsIntervals        *self);
+void                     _ide_diagnostics_intervals_add          (IdeDiagnosticsIntervals        *self,
+                                                                  guint                           begin_line,
+                                                                  guint                           end_line,
+                                                                  IdeDiagnosticSeverity           severity,
+                                                                  gpointer                        data);
+void                     _ide_diagnostics_intervals_insert_lines (IdeDiagnosticsIntervals        *self,
+                                                                  guint                           line,
+                                                                  guint                           n_lines);
+void                     _ide_diagnostics_intervals_delete_lines (IdeDiagnosticsIntervals        *self,
+                                                                  guint                           line,
+                                                                  guint                           n_lines);
+IdeDiagnosticSeverity    _ide_diagnostics_intervals_get_severity (IdeDiagnosticsIntervals        *self,
+                                                                  guint                           line);
+void                     _ide_diagnostics_intervals_get_range    (IdeDiagnosticsIntervals        *self,
+                                                                  guint                           begin_line,
+                                                                  guint                           end_line,
+                                                                  IdeDiagnosticSeverity          *severities);
+void                     _ide_diagnostics_intervals_foreach      (IdeDiagnosticsIntervals        *self,
+                                                                  guint                           begin_line,
+                                                                  guint                           end_line,
+                                                                  IdeDiagnosticsIntervalsForeach  func,
+                                                                  gpointer                        user_data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeDiagnosticsIntervals, _ide_diagnostics_intervals_free)
+
+G_END_DECLS
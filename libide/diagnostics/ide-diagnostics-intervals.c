@@ -0,0 +1,389 @@
+/* ide-diagnostics-intervals.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-diagnostics-intervals"
+
+#include "diagnostics/ide-diagnostics-intervals-private.h"
+
+/*
+ * This is a line-indexed interval set used by IdeBuffer to answer
+ * "which diagnostics touch these lines" without walking every diagnostic.
+ *
+ * Intervals are kept in an array sorted by their first line. Each item
+ * also stores the largest end line of every item up to and including
+ * itself, which lets a query walk backwards from the last interval that
+ * starts before the end of the range and stop as soon as no earlier
+ * interval can reach the range. This is the flattened form of an
+ * augmented interval tree, which is simpler and more cache friendly for
+ * the few thousand items we see in practice.
+ *
+ * Buffer edits only move lines up or down, which never changes the
+ * relative order of the intervals, so they are applied in place without
+ * resorting.
+ */
+
+typedef struct
+{
+  guint    begin;
+  guint    end;
+  guint    max_end;
+  guint    severity;
+  gpointer data;
+} Interval;
+
+struct _IdeDiagnosticsIntervals
+{
+  GArray *items;
+  guint   needs_sort : 1;
+};
+
+static gint
+compare_interval (gconstpointer a,
+                  gconstpointer b)
+{
+  const Interval *ia = a;
+  const Interval *ib = b;
+
+  if (ia->begin < ib->begin)
+    return -1;
+  else if (ia->begin > ib->begin)
+    return 1;
+  else if (ia->end < ib->end)
+    return -1;
+  else if (ia->end > ib->end)
+    return 1;
+  else
+    return 0;
+}
+
+static void
+update_max_end (IdeDiagnosticsIntervals *self)
+{
+  guint max_end = 0;
+
+  for (guint i = 0; i < self->items->len; i++)
+    {
+      Interval *item = &g_array_index (self->items, Interval, i);
+
+      max_end = MAX (max_end, item->end);
+      item->max_end = max_end;
+    }
+}
+
+static void
+ensure_sorted (IdeDiagnosticsIntervals *self)
+{
+  if (self->needs_sort)
+    {
+      g_array_sort (self->items, compare_interval);
+      update_max_end (self);
+      self->needs_sort = FALSE;
+    }
+}
+
+/*
+ * Returns the number of intervals that begin on or before @line, which
+ * is also the index of the first interval that begins after it.
+ */
+static guint
+count_beginning_before (IdeDiagnosticsIntervals *self,
+                        guint                    line)
+{
+  guint lo = 0;
+  guint hi = self->items->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      const Interval *item = &g_array_index (self->items, Interval, mid);
+
+      if (item->begin <= line)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+IdeDiagnosticsIntervals *
+_ide_diagnostics_intervals_new (void)
+{
+  IdeDiagnosticsIntervals *self;
+
+  self = g_slice_new0 (IdeDiagnosticsIntervals);
+  self->items = g_array_new (FALSE, FALSE, sizeof (Interval));
+
+  return self;
+}
+
+void
+_ide_diagnostics_intervals_free (IdeDiagnosticsIntervals *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->items, g_array_unref);
+      g_slice_free (IdeDiagnosticsIntervals, self);
+    }
+}
+
+void
+_ide_diagnostics_intervals_clear (IdeDiagnosticsIntervals *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_array_set_size (self->items, 0);
+  self->needs_sort = FALSE;
+}
+
+guint
+_ide_diagnostics_intervals_get_size (IdeDiagnosticsIntervals *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->items->len;
+}
+
+/**
+ * _ide_diagnostics_intervals_add:
+ * @self: An #IdeDiagnosticsIntervals
+ * @begin_line: the first line of the diagnostic
+ * @end_line: the last line of the diagnostic, inclusive
+ * @severity: the diagnostic severity
+ * @data: (nullable): borrowed data to provide to
+ *   _ide_diagnostics_intervals_foreach(), such as the #IdeDiagnostic
+ *
+ * Adds an interval. The lines may be provided in either order.
+ *
+ * Adding is cheap, the index is sorted lazily on the next query so that
+ * publishing a large set of diagnostics is a single sort.
+ */
+void
+_ide_diagnostics_intervals_add (IdeDiagnosticsIntervals *self,
+                                guint                    begin_line,
+                                guint                    end_line,
+                                IdeDiagnosticSeverity    severity,
+                                gpointer                 data)
+{
+  Interval item = { 0 };
+
+  g_return_if_fail (self != NULL);
+
+  item.begin = MIN (begin_line, end_line);
+  item.end = MAX (begin_line, end_line);
+  item.severity = severity;
+  item.data = data;
+
+  g_array_append_val (self->items, item);
+
+  self->needs_sort = TRUE;
+}
+
+/**
+ * _ide_diagnostics_intervals_insert_lines:
+ * @self: An #IdeDiagnosticsIntervals
+ * @line: the first line that is pushed down by the insertion
+ * @n_lines: the number of lines inserted
+ *
+ * Adjusts the intervals after @n_lines were inserted into the buffer.
+ * Intervals starting on or after @line move down, while intervals that
+ * started before @line but reach it grow to cover the inserted lines.
+ */
+void
+_ide_diagnostics_intervals_insert_lines (IdeDiagnosticsIntervals *self,
+                                         guint                    line,
+                                         guint                    n_lines)
+{
+  g_return_if_fail (self != NULL);
+
+  if (n_lines == 0 || self->items->len == 0)
+    return;
+
+  for (guint i = 0; i < self->items->len; i++)
+    {
+      Interval *item = &g_array_index (self->items, Interval, i);
+
+      if (item->begin >= line)
+        item->begin += n_lines;
+
+      if (item->end >= line)
+        item->end += n_lines;
+    }
+
+  if (!self->needs_sort)
+    update_max_end (self);
+}
+
+/**
+ * _ide_diagnostics_intervals_delete_lines:
+ * @self: An #IdeDiagnosticsIntervals
+ * @line: the line where the deletion starts
+ * @n_lines: the number of line breaks removed
+ *
+ * Adjusts the intervals after a deletion joined the lines from @line to
+ * @line + @n_lines into @line. Intervals within the deleted region
+ * collapse onto @line, and intervals after it move up.
+ */
+void
+_ide_diagnostics_intervals_delete_lines (IdeDiagnosticsIntervals *self,
+                                         guint                    line,
+                                         guint                    n_lines)
+{
+  guint last;
+
+  g_return_if_fail (self != NULL);
+
+  if (n_lines == 0 || self->items->len == 0)
+    return;
+
+  last = line + n_lines;
+
+  for (guint i = 0; i < self->items->len; i++)
+    {
+      Interval *item = &g_array_index (self->items, Interval, i);
+
+      if (item->begin > last)
+        item->begin -= n_lines;
+      else if (item->begin > line)
+        item->begin = line;
+
+      if (item->end > last)
+        item->end -= n_lines;
+      else if (item->end > line)
+        item->end = line;
+    }
+
+  if (!self->needs_sort)
+    update_max_end (self);
+}
+
+/**
+ * _ide_diagnostics_intervals_foreach:
+ * @self: An #IdeDiagnosticsIntervals
+ * @begin_line: the first line of the range
+ * @end_line: the last line of the range, inclusive
+ * @func: (scope call): a callback for each interval
+ * @user_data: closure data for @func
+ *
+ * Calls @func for every interval that overlaps the range of lines. The
+ * intervals are visited in decreasing order of their first line.
+ */
+void
+_ide_diagnostics_intervals_foreach (IdeDiagnosticsIntervals        *self,
+                                    guint                           begin_line,
+                                    guint                           end_line,
+                                    IdeDiagnosticsIntervalsForeach  func,
+                                    gpointer                        user_data)
+{
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (func != NULL);
+  g_return_if_fail (begin_line <= end_line);
+
+  ensure_sorted (self);
+
+  i = count_beginning_before (self, end_line);
+
+  while (i > 0)
+    {
+      const Interval *item = &g_array_index (self->items, Interval, --i);
+
+      if (item->max_end < begin_line)
+        break;
+
+      if (item->end >= begin_line)
+        func (item->begin, item->end, item->severity, item->data, user_data);
+    }
+}
+
+/**
+ * _ide_diagnostics_intervals_get_severity:
+ * @self: An #IdeDiagnosticsIntervals
+ * @line: a line number
+ *
+ * Gets the highest severity of the intervals containing @line.
+ *
+ * Returns: an #IdeDiagnosticSeverity, or %IDE_DIAGNOSTIC_IGNORED if
+ *   no interval contains @line.
+ */
+IdeDiagnosticSeverity
+_ide_diagnostics_intervals_get_severity (IdeDiagnosticsIntervals *self,
+                                         guint                    line)
+{
+  IdeDiagnosticSeverity severity = IDE_DIAGNOSTIC_IGNORED;
+
+  _ide_diagnostics_intervals_get_range (self, line, line, &severity);
+
+  return severity;
+}
+
+/**
+ * _ide_diagnostics_intervals_get_range:
+ * @self: An #IdeDiagnosticsIntervals
+ * @begin_line: the first line of the range
+ * @end_line: the last line of the range, inclusive
+ * @severities: (array): an array of @end_line - @begin_line + 1 elements
+ *
+ * Fills @severities with the highest severity found on each line of the
+ * range. This is meant for the gutter, which needs every visible line at
+ * once.
+ */
+void
+_ide_diagnostics_intervals_get_range (IdeDiagnosticsIntervals *self,
+                                      guint                    begin_line,
+                                      guint                    end_line,
+                                      IdeDiagnosticSeverity   *severities)
+{
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (begin_line <= end_line);
+  g_return_if_fail (severities != NULL);
+
+  for (guint line = begin_line; line <= end_line; line++)
+    severities[line - begin_line] = IDE_DIAGNOSTIC_IGNORED;
+
+  ensure_sorted (self);
+
+  i = count_beginning_before (self, end_line);
+
+  while (i > 0)
+    {
+      const Interval *item = &g_array_index (self->items, Interval, --i);
+      guint first;
+      guint last;
+
+      if (item->max_end < begin_line)
+        break;
+
+      if (item->end < begin_line)
+        continue;
+
+      first = MAX (item->begin, begin_line);
+      last = MIN (item->end, end_line);
+
+      for (guint line = first; line <= last; line++)
+        {
+          IdeDiagnosticSeverity *severity = &severities[line - begin_line];
+
+          if (item->severity > *severity)
+            *severity = item->severity;
+        }
+    }
+}
@@ -18,6 +18,7 @@
 
 #define G_LOG_DOMAIN "ide-diagnostics-manager"
 
+#include <dazzle.h>
 #include <gtksourceview/gtksource.h>
 
 #include "ide-context.h"
@@ -29,10 +30,90 @@
 #include "diagnostics/ide-diagnostic.h"
 #include "diagnostics/ide-diagnostic-provider.h"
 #include "diagnostics/ide-diagnostics.h"
+#include "diagnostics/ide-diagnostics-index-private.h"
 #include "diagnostics/ide-diagnostics-manager.h"
+#include "diagnostics/ide-diagnostics-pool-private.h"
 #include "plugins/ide-extension-set-adapter.h"
+#include "util/ide-battery-monitor.h"
 
-#define DEFAULT_DIAGNOSE_DELAY 100
+/*
+ * Delays are in msec. Providers that we have not measured yet use the
+ * default, and measured providers are debounced proportionally to how
+ * long they take to run so that fast linters stay live while expensive
+ * providers wait for the user to pause.
+ */
+#define DEFAULT_DIAGNOSE_DELAY  100
+#define MIN_DIAGNOSE_DELAY      50
+#define MAX_DIAGNOSE_DELAY      750
+#define CONSERVE_DIAGNOSE_DELAY 1000
+
+/*
+ * Continuous typing keeps pushing back the debounce, but we still want
+ * results eventually, so a request is never delayed by more than this
+ * many multiples of the provider's delay.
+ */
+#define MAX_DIAGNOSE_DELAY_FACTOR 3
+
+#define N_HISTOGRAM_BUCKETS 5
+
+static const struct {
+  gint64       max_usec;
+  const gchar *name;
+} histogram_buckets[N_HISTOGRAM_BUCKETS] = {
+  { G_USEC_PER_SEC / 100, "Runs under 10 msec" },
+  { G_USEC_PER_SEC / 20,  "Runs under 50 msec" },
+  { G_USEC_PER_SEC / 4,   "Runs under 250 msec" },
+  { G_USEC_PER_SEC,       "Runs under 1 sec" },
+  { G_MAXINT64,           "Runs over 1 sec" },
+};
+
+typedef struct
+{
+  /*
+   * Run times are tracked per provider type and language since the same
+   * provider may be much more expensive for one language than another.
+   * The statistics live for the life of the process, as the counters
+   * cannot be unregistered from the counter arena.
+   */
+  gchar      *category;
+
+  /* Exponentially weighted moving average of run time in usec */
+  gint64      average;
+  guint       n_runs;
+
+  DzlCounter  average_counter;
+  DzlCounter  skipped_counter;
+  DzlCounter  histogram[N_HISTOGRAM_BUCKETS];
+} ProviderStats;
+
+typedef struct
+{
+  /*
+   * The statistics for the provider and the language they were looked up
+   * for. The language is an interned string so we can cheaply detect when
+   * the buffer language has changed.
+   */
+  ProviderStats *stats;
+  const gchar   *language_id;
+
+  /*
+   * When the pending request was first queued and the monotonic time at
+   * which it should be dispatched.
+   */
+  gint64         queued_at;
+  gint64         due;
+
+  /* When the in-flight request was started */
+  gint64         begin_time;
+
+  /*
+   * The provider is running a diagnosis. We never start another one for
+   * the same provider until it completes, we just note that another is
+   * needed and dispatch it upon completion.
+   */
+  guint          in_diagnose : 1;
+  guint          needs_diagnose : 1;
+} ProviderState;
 
 typedef struct
 {
@@ -84,18 +165,11 @@ typedef struct
   guint sequence;
 
   /*
-   * If we are currently diagnosing, then this will be set to a
-   * number greater than zero.
+   * The number of providers currently diagnosing the file. Each provider
+   * tracks whether it needs another diagnosis in its ProviderState.
    */
   guint in_diagnose;
 
-  /*
-   * If we need a diagnose this bit will be set. If we complete a
-   * diagnosis and this bit is set, then we will automatically queue
-   * another diagnose upon completion.
-   */
-  guint needs_diagnose : 1;
-
   /*
    * This bit is set if we know the file or buffer has diagnostics. This
    * is useful when we've cleaned up our extensions and no longer have
@@ -126,10 +200,36 @@ struct _IdeDiagnosticsManager
   GHashTable *groups_by_file;
 
   /*
-   * If any group has a queued diagnose in process, this will be set so
-   * we can coalesce the dispatch of everything at the same time.
+   * If any provider has a queued diagnose, this will be set so we can
+   * coalesce the dispatch of everything due at the same time. The source
+   * is armed for the earliest due time of all the queued providers.
    */
   guint queued_diagnose_source;
+  gint64 queued_diagnose_due;
+
+  /*
+   * The project-wide index of diagnostics. Unlike the groups, this is not
+   * tied to open buffers, so diagnostics from the build pipeline or from
+   * buffers that have since been closed remain available to problem views.
+   */
+  IdeDiagnosticsIndex *index;
+
+  /*
+   * Diagnostics from ide_diagnostics_manager_add_indexed_diagnostic() that
+   * have not been applied to @index yet. The build pipeline reports them
+   * one at a time, so they are batched per file and applied together from
+   * an idle callback, which emits ::index-changed once for the batch. This
+   * maps an interned source to a GHashTable of GFile to IdeDiagnostics.
+   * Readers of the index apply the pending diagnostics first.
+   */
+  GHashTable *pending_index;
+  guint pending_index_source;
+
+  /*
+   * Runs the providers over files that are not open while the user is
+   * idle, publishing the results to the index.
+   */
+  IdeDiagnosticsPool *pool;
 };
 
 enum {
@@ -140,6 +240,7 @@ enum {
 
 enum {
   CHANGED,
+  INDEX_CHANGED,
   N_SIGNALS
 };
 
@@ -152,6 +253,10 @@ static void     ide_diagnostics_manager_add_diagnostic    (IdeDiagnosticsManager
                                                            IdeDiagnostic         *diagnostic);
 static void     ide_diagnostics_group_queue_diagnose      (IdeDiagnosticsGroup   *group,
                                                            IdeDiagnosticsManager *self);
+static void     ide_diagnostics_group_queue_provider      (IdeDiagnosticsGroup   *group,
+                                                           IdeDiagnosticProvider *provider,
+                                                           IdeDiagnosticsManager *self);
+static gboolean ide_diagnostics_manager_begin_diagnose    (gpointer               data);
 
 
 static GParamSpec *properties [N_PROPS];
@@ -297,6 +402,194 @@ ide_diagnostics_group_add (IdeDiagnosticsGroup   *group,
   group->sequence++;
 }
 
+static void
+register_counter (DzlCounter  *counter,
+                  const gchar *category,
+                  const gchar *name,
+                  const gchar *description)
+{
+  counter->category = category;
+  counter->name = name;
+  counter->description = description;
+
+  dzl_counter_arena_register (dzl_counter_arena_get_default (), counter);
+}
+
+static ProviderStats *
+provider_stats_lookup (IdeDiagnosticProvider *provider,
+                       const gchar           *language_id)
+{
+  static GHashTable *stats_by_category;
+  g_autofree gchar *category = NULL;
+  ProviderStats *stats;
+
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+
+  if (stats_by_category == NULL)
+    stats_by_category = g_hash_table_new (g_str_hash, g_str_equal);
+
+  category = g_strdup_printf ("Diagnostics (%s, %s)",
+                              G_OBJECT_TYPE_NAME (provider),
+                              language_id ? language_id : "none");
+
+  if (NULL == (stats = g_hash_table_lookup (stats_by_category, category)))
+    {
+      stats = g_new0 (ProviderStats, 1);
+      stats->category = g_steal_pointer (&category);
+
+      register_counter (&stats->average_counter,
+                        stats->category,
+                        "Average run time",
+                        "Moving average of the time to diagnose a file, in usec");
+      register_counter (&stats->skipped_counter,
+                        stats->category,
+                        "Requests while running",
+                        "Requests deferred because a diagnosis was in flight");
+
+      for (guint i = 0; i < N_HISTOGRAM_BUCKETS; i++)
+        register_counter (&stats->histogram[i],
+                          stats->category,
+                          histogram_buckets[i].name,
+                          "Number of diagnoses completing in the time range");
+
+      g_hash_table_insert (stats_by_category, stats->category, stats);
+    }
+
+  return stats;
+}
+
+static void
+provider_stats_record (ProviderStats *stats,
+                       gint64         run_time)
+{
+  gint64 average;
+
+  g_assert (stats != NULL);
+
+  run_time = MAX (0, run_time);
+
+  if (stats->n_runs == 0)
+    average = run_time;
+  else
+    average = (stats->average * 3 + run_time) / 4;
+
+  dzl_counter_add (&stats->average_counter, average - stats->average);
+
+  stats->average = average;
+  stats->n_runs++;
+
+  for (guint i = 0; i < N_HISTOGRAM_BUCKETS; i++)
+    {
+      if (run_time < histogram_buckets[i].max_usec)
+        {
+          dzl_counter_add (&stats->histogram[i], 1);
+          break;
+        }
+    }
+}
+
+/*
+ * Gets the debounce delay in msec. Starting a provider more often than it
+ * can complete only produces results that are already stale, so the delay
+ * follows the measured run time.
+ */
+static guint
+provider_stats_get_delay (ProviderStats *stats)
+{
+  guint delay = DEFAULT_DIAGNOSE_DELAY;
+
+  if (stats != NULL && stats->n_runs > 0)
+    delay = CLAMP (stats->average / 2 / 1000, MIN_DIAGNOSE_DELAY, MAX_DIAGNOSE_DELAY);
+
+  if (ide_battery_monitor_get_should_conserve ())
+    delay = MAX (delay, CONSERVE_DIAGNOSE_DELAY);
+
+  return delay;
+}
+
+static void
+provider_state_free (gpointer data)
+{
+  ProviderState *state = data;
+
+  g_slice_free (ProviderState, state);
+}
+
+static inline ProviderState *
+get_provider_state (IdeDiagnosticProvider *provider)
+{
+  return g_object_get_data (G_OBJECT (provider), "IDE_DIAGNOSTICS_STATE");
+}
+
+static const gchar *
+ide_diagnostics_group_get_language_id (IdeDiagnosticsGroup *group)
+{
+  g_autoptr(IdeBuffer) buffer = NULL;
+
+  g_assert (group != NULL);
+
+  if (NULL != (buffer = g_weak_ref_get (&group->buffer_wr)))
+    {
+      GtkSourceLanguage *language;
+
+      language = gtk_source_buffer_get_language (GTK_SOURCE_BUFFER (buffer));
+
+      if (language != NULL)
+        return g_intern_string (gtk_source_language_get_id (language));
+    }
+
+  return NULL;
+}
+
+static void
+provider_state_update_stats (ProviderState         *state,
+                             IdeDiagnosticProvider *provider,
+                             IdeDiagnosticsGroup   *group)
+{
+  const gchar *language_id;
+
+  g_assert (state != NULL);
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+  g_assert (group != NULL);
+
+  language_id = ide_diagnostics_group_get_language_id (group);
+
+  /* Interned, so we can compare pointers */
+  if (state->stats == NULL || state->language_id != language_id)
+    {
+      state->stats = provider_stats_lookup (provider, language_id);
+      state->language_id = language_id;
+    }
+}
+
+static void
+ide_diagnostics_manager_schedule (IdeDiagnosticsManager *self,
+                                  gint64                 due)
+{
+  gint64 now;
+  guint delay = 0;
+
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  if (self->queued_diagnose_source != 0 && self->queued_diagnose_due <= due)
+    return;
+
+  ide_clear_source (&self->queued_diagnose_source);
+
+  now = g_get_monotonic_time ();
+
+  /* Round up so that we never wake up before the provider is due */
+  if (due > now)
+    delay = (due - now + 999) / 1000;
+
+  self->queued_diagnose_due = due;
+  self->queued_diagnose_source = g_timeout_add_full (G_PRIORITY_LOW,
+                                                     delay,
+                                                     ide_diagnostics_manager_begin_diagnose,
+                                                     g_object_ref (self),
+                                                     g_object_unref);
+}
+
 static void
 ide_diagnostics_group_diagnose_cb (GObject      *object,
                                    GAsyncResult *result,
@@ -305,8 +598,10 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
   IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)object;
   g_autoptr(IdeDiagnosticsManager) self = user_data;
   g_autoptr(IdeDiagnostics) diagnostics = NULL;
+  g_autoptr(IdeDiagnostics) indexed = NULL;
   g_autoptr(GError) error = NULL;
   IdeDiagnosticsGroup *group;
+  ProviderState *state;
   gboolean changed;
 
   IDE_ENTRY;
@@ -330,6 +625,15 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
   group = g_object_get_data (G_OBJECT (provider), "IDE_DIAGNOSTICS_GROUP");
   g_assert (group != NULL);
 
+  state = get_provider_state (provider);
+  g_assert (state != NULL);
+  g_assert (state->in_diagnose);
+
+  state->in_diagnose = FALSE;
+
+  if (state->stats != NULL)
+    provider_stats_record (state->stats, g_get_monotonic_time () - state->begin_time);
+
   /*
    * Clear all of our old diagnostics no matter where they ended up.
    */
@@ -341,6 +645,8 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
    * the case, except when a diagnostic came up for a header or something
    * while parsing a given file.
    */
+  indexed = ide_diagnostics_new (NULL);
+
   if (diagnostics != NULL)
     {
       guint length = ide_diagnostics_get_size (diagnostics);
@@ -353,9 +659,14 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
           if G_LIKELY (file != NULL)
             {
               if G_LIKELY (g_file_equal (file, group->file))
-                ide_diagnostics_group_add (group, provider, diagnostic);
+                {
+                  ide_diagnostics_group_add (group, provider, diagnostic);
+                  ide_diagnostics_add (indexed, diagnostic);
+                }
               else
-                ide_diagnostics_manager_add_diagnostic (self, provider, diagnostic);
+                {
+                  ide_diagnostics_manager_add_diagnostic (self, provider, diagnostic);
+                }
             }
         }
 
@@ -363,6 +674,15 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
         changed = TRUE;
     }
 
+  /*
+   * Keep the project-wide index up to date with what the provider found
+   * for this file, so the results outlive the buffer. Diagnostics for
+   * other files (such as headers) are only shown while those are open, as
+   * we cannot tell when this provider stops reporting them.
+   */
+  if (_ide_diagnostics_index_set (self->index, G_OBJECT_TYPE_NAME (provider), group->file, indexed))
+    g_signal_emit (self, signals [INDEX_CHANGED], 0);
+
   group->in_diagnose--;
 
   /*
@@ -382,18 +702,21 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
     g_signal_emit (self, signals [CHANGED], 0);
 
   /*
-   * If there are no more diagnostics providers active and the group needs
-   * another diagnosis, then we can start the next one now.
+   * If the buffer changed while this provider was running, we deferred the
+   * request until now. It was debounced as usual in the mean time, so it
+   * might already be due.
    *
    * If we are completing this diagnosis and the buffer was already released
    * (and other diagnose providers have unloaded), we might be able to clean
    * up the group and be done with things.
    */
-  if (group->was_removed == FALSE && group->in_diagnose == 0 && group->needs_diagnose)
+  if (group->was_removed == FALSE && group->adapter != NULL && state->needs_diagnose)
     {
-      ide_diagnostics_group_queue_diagnose (group, self);
+      ide_diagnostics_manager_schedule (self, state->due);
     }
-  else if (ide_diagnostics_group_can_dispose (group))
+  else if (group->was_removed == FALSE &&
+           group->in_diagnose == 0 &&
+           ide_diagnostics_group_can_dispose (group))
     {
       group->was_removed = TRUE;
       g_hash_table_remove (self->groups_by_file, group->file);
@@ -404,26 +727,34 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
 }
 
 static void
-ide_diagnostics_group_diagnose_foreach (IdeExtensionSetAdapter *adapter,
-                                        PeasPluginInfo         *plugin_info,
-                                        PeasExtension          *exten,
-                                        gpointer                user_data)
+ide_diagnostics_group_diagnose_provider (IdeDiagnosticsGroup   *group,
+                                         IdeDiagnosticProvider *provider,
+                                         IdeDiagnosticsManager *self)
 {
-  IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)exten;
-  IdeDiagnosticsManager *self = user_data;
-  IdeDiagnosticsGroup *group;
-  IdeContext *context;
-  g_autoptr (IdeBuffer) buffer = NULL;
+  g_autoptr(IdeBuffer) buffer = NULL;
   g_autoptr(IdeFile) file = NULL;
+  ProviderState *state;
+  IdeContext *context;
 
   IDE_ENTRY;
 
-  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
-  g_assert (IDE_IS_EXTENSION_SET_ADAPTER (adapter));
-  g_assert (plugin_info != NULL);
+  g_assert (group != NULL);
   g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  state = get_provider_state (provider);
+
+  g_assert (state != NULL);
+  g_assert (!state->in_diagnose);
+
+  provider_state_update_stats (state, provider, group);
+
+  state->in_diagnose = TRUE;
+  state->needs_diagnose = FALSE;
+  state->queued_at = 0;
+  state->due = 0;
+  state->begin_time = g_get_monotonic_time ();
 
-  group = g_object_get_data (G_OBJECT (provider), "IDE_DIAGNOSTICS_GROUP");
   group->in_diagnose++;
 
   context = ide_object_get_context (IDE_OBJECT (self));
@@ -448,45 +779,75 @@ ide_diagnostics_group_diagnose_foreach (IdeExtensionSetAdapter *adapter,
                                           NULL,
                                           ide_diagnostics_group_diagnose_cb,
                                           g_object_ref (self));
+
+  IDE_EXIT;
 }
 
+typedef struct
+{
+  IdeDiagnosticsManager *self;
+  IdeDiagnosticsGroup   *group;
+  gint64                 now;
+  gint64                 next_due;
+  guint                  synced : 1;
+  guint                  started : 1;
+} Dispatch;
+
 static void
-ide_diagnostics_group_diagnose (IdeDiagnosticsGroup   *group,
-                                IdeDiagnosticsManager *self)
+ide_diagnostics_group_dispatch_foreach (IdeExtensionSetAdapter *adapter,
+                                        PeasPluginInfo         *plugin_info,
+                                        PeasExtension          *exten,
+                                        gpointer                user_data)
 {
-  g_autoptr(IdeBuffer) buffer = NULL;
+  IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)exten;
+  Dispatch *dispatch = user_data;
+  ProviderState *state;
 
-  IDE_ENTRY;
+  g_assert (IDE_IS_EXTENSION_SET_ADAPTER (adapter));
+  g_assert (plugin_info != NULL);
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+  g_assert (dispatch != NULL);
 
-  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
-  g_assert (group != NULL);
-  g_assert (group->in_diagnose == FALSE);
-  g_assert (IDE_IS_EXTENSION_SET_ADAPTER (group->adapter));
+  state = get_provider_state (provider);
+
+  /*
+   * Providers that are still running will be dispatched again upon
+   * completion, we never want overlapping runs of the same provider.
+   */
+  if (state == NULL || !state->needs_diagnose || state->in_diagnose)
+    return;
 
-  group->needs_diagnose = FALSE;
-  group->has_diagnostics = FALSE;
+  if (state->due > dispatch->now)
+    {
+      dispatch->next_due = MIN (dispatch->next_due, state->due);
+      return;
+    }
 
   /*
    * We need to ensure that all the diagnostic providers have access to the
    * proper data within the unsaved files. So sync the content once to avoid
    * all providers from having to do this manually.
    */
-  if (NULL != (buffer = g_weak_ref_get (&group->buffer_wr)))
-    ide_buffer_sync_to_unsaved_files (buffer);
+  if (!dispatch->synced)
+    {
+      g_autoptr(IdeBuffer) buffer = NULL;
 
-  ide_extension_set_adapter_foreach (group->adapter,
-                                     ide_diagnostics_group_diagnose_foreach,
-                                     self);
+      if (NULL != (buffer = g_weak_ref_get (&dispatch->group->buffer_wr)))
+        ide_buffer_sync_to_unsaved_files (buffer);
 
-  g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BUSY]);
+      dispatch->synced = TRUE;
+    }
 
-  IDE_EXIT;
+  ide_diagnostics_group_diagnose_provider (dispatch->group, provider, dispatch->self);
+
+  dispatch->started = TRUE;
 }
 
 static gboolean
 ide_diagnostics_manager_begin_diagnose (gpointer data)
 {
   IdeDiagnosticsManager *self = data;
+  Dispatch dispatch = { 0 };
   GHashTableIter iter;
   gpointer value;
 
@@ -495,6 +856,13 @@ ide_diagnostics_manager_begin_diagnose (gpointer data)
   g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
 
   self->queued_diagnose_source = 0;
+  self->queued_diagnose_due = 0;
+
+  dispatch.self = self;
+  dispatch.next_due = G_MAXINT64;
+
+  /* Allow for timer granularity so we don't wake up again immediately */
+  dispatch.now = g_get_monotonic_time () + (G_USEC_PER_SEC / 1000);
 
   g_hash_table_iter_init (&iter, self->groups_by_file);
 
@@ -502,34 +870,124 @@ ide_diagnostics_manager_begin_diagnose (gpointer data)
     {
       IdeDiagnosticsGroup *group = value;
 
-      if (group->needs_diagnose && group->adapter != NULL && group->in_diagnose == 0)
-        ide_diagnostics_group_diagnose (group, self);
+      if (group->adapter == NULL)
+        continue;
+
+      dispatch.group = group;
+      dispatch.synced = FALSE;
+
+      ide_extension_set_adapter_foreach (group->adapter,
+                                         ide_diagnostics_group_dispatch_foreach,
+                                         &dispatch);
     }
 
+  if (dispatch.started)
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BUSY]);
+
+  if (dispatch.next_due != G_MAXINT64)
+    ide_diagnostics_manager_schedule (self, dispatch.next_due);
+
   IDE_RETURN (G_SOURCE_REMOVE);
 }
 
 static void
-ide_diagnostics_group_queue_diagnose (IdeDiagnosticsGroup   *group,
+ide_diagnostics_group_queue_provider (IdeDiagnosticsGroup   *group,
+                                      IdeDiagnosticProvider *provider,
                                       IdeDiagnosticsManager *self)
 {
+  ProviderState *state;
+  gint64 delay;
+  gint64 now;
+
   g_assert (group != NULL);
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  if (NULL == (state = get_provider_state (provider)))
+    return;
+
+  /*
+   * Each request pushes back the time the provider is due, so that a burst
+   * of edits results in a single diagnosis, but never past a multiple of
+   * the delay from the first request so that continuous typing still gets
+   * updates.
+   */
+
+  now = g_get_monotonic_time ();
+
+  provider_state_update_stats (state, provider, group);
+  delay = provider_stats_get_delay (state->stats) * (G_USEC_PER_SEC / 1000);
+
+  if (!state->needs_diagnose)
+    {
+      state->needs_diagnose = TRUE;
+      state->queued_at = now;
+    }
+
+  state->due = MIN (now + delay, state->queued_at + delay * MAX_DIAGNOSE_DELAY_FACTOR);
 
   /*
-   * This checks to see if we are diagnosing and if not queues a diagnose.
    * If a diagnosis is already running, we don't need to do anything now
    * because the completion of the diagnose will tick off the next diagnose
-   * upon seening group->needs_diagnose==TRUE.
+   * upon seeing state->needs_diagnose==TRUE.
    */
+  if (state->in_diagnose)
+    {
+      dzl_counter_add (&state->stats->skipped_counter, 1);
+      return;
+    }
 
-  group->needs_diagnose = TRUE;
+  ide_diagnostics_manager_schedule (self, state->due);
+}
+
+static void
+ide_diagnostics_group_queue_diagnose_foreach (IdeExtensionSetAdapter *adapter,
+                                              PeasPluginInfo         *plugin_info,
+                                              PeasExtension          *exten,
+                                              gpointer                user_data)
+{
+  IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)exten;
+  IdeDiagnosticsManager *self = user_data;
+  IdeDiagnosticsGroup *group;
 
-  if (group->in_diagnose == 0 && self->queued_diagnose_source == 0)
-    self->queued_diagnose_source = g_timeout_add_full (G_PRIORITY_LOW,
-                                                       DEFAULT_DIAGNOSE_DELAY,
-                                                       ide_diagnostics_manager_begin_diagnose,
-                                                       g_object_ref (self),
-                                                       g_object_unref);
+  g_assert (IDE_IS_EXTENSION_SET_ADAPTER (adapter));
+  g_assert (plugin_info != NULL);
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  if (NULL != (group = g_object_get_data (G_OBJECT (provider), "IDE_DIAGNOSTICS_GROUP")))
+    ide_diagnostics_group_queue_provider (group, provider, self);
+}
+
+static void
+ide_diagnostics_group_queue_diagnose (IdeDiagnosticsGroup   *group,
+                                      IdeDiagnosticsManager *self)
+{
+  g_assert (group != NULL);
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  if (group->adapter != NULL)
+    ide_extension_set_adapter_foreach (group->adapter,
+                                       ide_diagnostics_group_queue_diagnose_foreach,
+                                       self);
+}
+
+static void
+ide_diagnostics_manager_dispose (GObject *object)
+{
+  IdeDiagnosticsManager *self = (IdeDiagnosticsManager *)object;
+
+  /*
+   * Files being diagnosed in the background hold a reference to the pool,
+   * so it would outlive us (and the context). Make sure it stops.
+   */
+  if (self->pool != NULL)
+    {
+      ide_diagnostics_pool_shutdown (self->pool);
+      g_clear_object (&self->pool);
+    }
+
+  G_OBJECT_CLASS (ide_diagnostics_manager_parent_class)->dispose (object);
 }
 
 static void
@@ -538,7 +996,10 @@ ide_diagnostics_manager_finalize (GObject *object)
   IdeDiagnosticsManager *self = (IdeDiagnosticsManager *)object;
 
   ide_clear_source (&self->queued_diagnose_source);
+  ide_clear_source (&self->pending_index_source);
   g_clear_pointer (&self->groups_by_file, g_hash_table_unref);
+  g_clear_pointer (&self->pending_index, g_hash_table_unref);
+  g_clear_pointer (&self->index, _ide_diagnostics_index_free);
 
   G_OBJECT_CLASS (ide_diagnostics_manager_parent_class)->finalize (object);
 }
@@ -567,6 +1028,7 @@ ide_diagnostics_manager_class_init (IdeDiagnosticsManagerClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+  object_class->dispose = ide_diagnostics_manager_dispose;
   object_class->finalize = ide_diagnostics_manager_finalize;
   object_class->get_property = ide_diagnostics_manager_get_property;
 
@@ -591,6 +1053,21 @@ ide_diagnostics_manager_class_init (IdeDiagnosticsManagerClass *klass)
                   G_TYPE_FROM_CLASS (klass),
                   G_SIGNAL_RUN_LAST,
                   0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+
+  /**
+   * IdeDiagnosticsManager::index-changed:
+   * @self: A #IdeDiagnosticsManager
+   *
+   * This signal is emitted when the project-wide index of diagnostics has
+   * changed. Use ide_diagnostics_manager_list_indexed_files() with the
+   * previous value of ide_diagnostics_manager_get_index_sequence() to find
+   * the files that need to be refreshed.
+   */
+  signals [INDEX_CHANGED] =
+    g_signal_new ("index-changed",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL, NULL, G_TYPE_NONE, 0);
 }
 
 static void
@@ -600,6 +1077,8 @@ ide_diagnostics_manager_init (IdeDiagnosticsManager *self)
                                                 (GEqualFunc)g_file_equal,
                                                 NULL,
                                                 (GDestroyNotify)ide_diagnostics_group_unref);
+  self->index = _ide_diagnostics_index_new ();
+  self->pending_index = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify)g_hash_table_unref);
 }
 
 static void
@@ -698,7 +1177,7 @@ ide_diagnostics_manager_provider_invalidated (IdeDiagnosticsManager *self,
 
   group = g_object_get_data (G_OBJECT (provider), "IDE_DIAGNOSTICS_GROUP");
 
-  ide_diagnostics_group_queue_diagnose (group, self);
+  ide_diagnostics_group_queue_provider (group, provider, self);
 
   IDE_EXIT;
 }
@@ -739,6 +1218,15 @@ ide_diagnostics_manager_extension_added (IdeExtensionSetAdapter *adapter,
    */
   g_hash_table_insert (group->diagnostics_by_provider, provider, NULL);
 
+  /*
+   * Scheduling state for the provider, so that each provider is debounced
+   * according to its own run time and never runs concurrently with itself.
+   */
+  g_object_set_data_full (G_OBJECT (provider),
+                          "IDE_DIAGNOSTICS_STATE",
+                          g_slice_new0 (ProviderState),
+                          provider_state_free);
+
   /*
    * We need to keep track of when the provider has been invalidated so
    * that we can queue another request to fetch the diagnostics.
@@ -751,7 +1239,7 @@ ide_diagnostics_manager_extension_added (IdeExtensionSetAdapter *adapter,
 
   ide_diagnostic_provider_load (provider);
 
-  ide_diagnostics_group_queue_diagnose (group, self);
+  ide_diagnostics_group_queue_provider (group, provider, self);
 
   IDE_EXIT;
 }
@@ -842,6 +1330,9 @@ ide_diagnostics_manager_buffer_changed (IdeDiagnosticsManager *self,
   group = ide_diagnostics_manager_find_group_from_buffer (self, buffer);
   ide_diagnostics_group_queue_diagnose (group, self);
 
+  if (self->pool != NULL)
+    ide_diagnostics_pool_notify_activity (self->pool);
+
   IDE_EXIT;
 }
 
@@ -1158,6 +1649,8 @@ ide_diagnostics_manager_initable_init (GInitable     *initable,
       ide_diagnostics_manager_buffer_loaded (self, buffer, buffer_manager);
     }
 
+  self->pool = ide_diagnostics_pool_new (context);
+
   IDE_RETURN (TRUE);
 }
 
@@ -1268,3 +1761,256 @@ ide_diagnostics_manager_get_sequence_for_file (IdeDiagnosticsManager *self,
 
   return 0;
 }
+
+static void
+ide_diagnostics_manager_apply_pending_index (IdeDiagnosticsManager *self)
+{
+  g_autoptr(GHashTable) pending = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  if (g_hash_table_size (self->pending_index) == 0)
+    return;
+
+  pending = g_steal_pointer (&self->pending_index);
+  self->pending_index = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify)g_hash_table_unref);
+
+  g_hash_table_iter_init (&iter, pending);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const gchar *source = key;
+      GHashTable *by_file = value;
+      GHashTableIter file_iter;
+      gpointer file;
+      gpointer diagnostics;
+
+      g_hash_table_iter_init (&file_iter, by_file);
+
+      while (g_hash_table_iter_next (&file_iter, &file, &diagnostics))
+        _ide_diagnostics_index_add_all (self->index, source, file, diagnostics);
+    }
+}
+
+static gboolean
+ide_diagnostics_manager_pending_index_cb (gpointer user_data)
+{
+  IdeDiagnosticsManager *self = user_data;
+
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  self->pending_index_source = 0;
+
+  /* A reader may have applied them already, but the index still changed */
+  ide_diagnostics_manager_apply_pending_index (self);
+  g_signal_emit (self, signals [INDEX_CHANGED], 0);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * ide_diagnostics_manager_get_index_sequence:
+ * @self: An #IdeDiagnosticsManager
+ *
+ * Gets a counter that is incremented every time the project-wide index of
+ * diagnostics changes. Problem views can keep the value they last synced
+ * to and use ide_diagnostics_manager_list_indexed_files() to only refresh
+ * the files that changed since.
+ *
+ * Returns: the sequence number of the index
+ */
+guint
+ide_diagnostics_manager_get_index_sequence (IdeDiagnosticsManager *self)
+{
+  g_return_val_if_fail (IDE_IS_DIAGNOSTICS_MANAGER (self), 0);
+
+  ide_diagnostics_manager_apply_pending_index (self);
+
+  return _ide_diagnostics_index_get_sequence (self->index);
+}
+
+/**
+ * ide_diagnostics_manager_set_indexed_diagnostics:
+ * @self: An #IdeDiagnosticsManager
+ * @source: an identifier for the producer of the diagnostics, such as "build"
+ * @file: a #GFile
+ * @diagnostics: (nullable): an #IdeDiagnostics or %NULL
+ *
+ * Replaces the diagnostics that @source previously indexed for @file.
+ * Passing %NULL or an empty set removes them.
+ */
+void
+ide_diagnostics_manager_set_indexed_diagnostics (IdeDiagnosticsManager *self,
+                                                 const gchar           *source,
+                                                 GFile                 *file,
+                                                 IdeDiagnostics        *diagnostics)
+{
+  g_return_if_fail (IDE_IS_DIAGNOSTICS_MANAGER (self));
+  g_return_if_fail (source != NULL);
+  g_return_if_fail (G_IS_FILE (file));
+
+  ide_diagnostics_manager_apply_pending_index (self);
+
+  if (_ide_diagnostics_index_set (self->index, source, file, diagnostics))
+    g_signal_emit (self, signals [INDEX_CHANGED], 0);
+}
+
+/**
+ * ide_diagnostics_manager_add_indexed_diagnostic:
+ * @self: An #IdeDiagnosticsManager
+ * @source: an identifier for the producer of the diagnostic, such as "build"
+ * @diagnostic: an #IdeDiagnostic
+ *
+ * Adds @diagnostic to the project-wide index under @source. This is meant
+ * for producers that discover diagnostics incrementally, such as the build
+ * pipeline. Diagnostics without a file are ignored.
+ *
+ * Diagnostics added in quick succession are applied together, and
+ * #IdeDiagnosticsManager::index-changed is emitted once for them from an
+ * idle callback.
+ */
+void
+ide_diagnostics_manager_add_indexed_diagnostic (IdeDiagnosticsManager *self,
+                                                const gchar           *source,
+                                                IdeDiagnostic         *diagnostic)
+{
+  IdeDiagnostics *diagnostics;
+  GHashTable *by_file;
+  GFile *file;
+
+  g_return_if_fail (IDE_IS_DIAGNOSTICS_MANAGER (self));
+  g_return_if_fail (source != NULL);
+  g_return_if_fail (diagnostic != NULL);
+
+  if (NULL == (file = ide_diagnostic_get_file (diagnostic)))
+    return;
+
+  source = g_intern_string (source);
+
+  if (NULL == (by_file = g_hash_table_lookup (self->pending_index, source)))
+    {
+      by_file = g_hash_table_new_full (g_file_hash,
+                                       (GEqualFunc)g_file_equal,
+                                       g_object_unref,
+                                       (GDestroyNotify)ide_diagnostics_unref);
+      g_hash_table_insert (self->pending_index, (gchar *)source, by_file);
+    }
+
+  if (NULL == (diagnostics = g_hash_table_lookup (by_file, file)))
+    {
+      diagnostics = ide_diagnostics_new (NULL);
+      g_hash_table_insert (by_file, g_object_ref (file), diagnostics);
+    }
+
+  ide_diagnostics_add (diagnostics, diagnostic);
+
+  if (self->pending_index_source == 0)
+    self->pending_index_source =
+      g_idle_add_full (G_PRIORITY_LOW,
+                       ide_diagnostics_manager_pending_index_cb,
+                       self,
+                       NULL);
+}
+
+/**
+ * ide_diagnostics_manager_clear_indexed_source:
+ * @self: An #IdeDiagnosticsManager
+ * @source: an identifier for the producer of the diagnostics
+ *
+ * Removes every diagnostic that @source added to the project-wide index,
+ * such as when a new build is started.
+ */
+void
+ide_diagnostics_manager_clear_indexed_source (IdeDiagnosticsManager *self,
+                                              const gchar           *source)
+{
+  g_return_if_fail (IDE_IS_DIAGNOSTICS_MANAGER (self));
+  g_return_if_fail (source != NULL);
+
+  /* Anything still pending for @source belongs to what is being cleared */
+  g_hash_table_remove (self->pending_index, g_intern_string (source));
+
+  if (_ide_diagnostics_index_remove_source (self->index, source))
+    g_signal_emit (self, signals [INDEX_CHANGED], 0);
+}
+
+/**
+ * ide_diagnostics_manager_count_indexed:
+ * @self: An #IdeDiagnosticsManager
+ * @directory: (nullable): a #GFile or %NULL for the whole project
+ * @min_severity: the lowest #IdeDiagnosticSeverity to count
+ *
+ * Counts the indexed diagnostics found within @directory, recursively.
+ * The counts are maintained as diagnostics are indexed, so this is cheap
+ * enough to call for every row of a project tree.
+ *
+ * Returns: the number of diagnostics
+ */
+guint
+ide_diagnostics_manager_count_indexed (IdeDiagnosticsManager *self,
+                                       GFile                 *directory,
+                                       IdeDiagnosticSeverity  min_severity)
+{
+  g_return_val_if_fail (IDE_IS_DIAGNOSTICS_MANAGER (self), 0);
+  g_return_val_if_fail (!directory || G_IS_FILE (directory), 0);
+
+  ide_diagnostics_manager_apply_pending_index (self);
+
+  return _ide_diagnostics_index_count (self->index, directory, min_severity);
+}
+
+/**
+ * ide_diagnostics_manager_list_indexed_files:
+ * @self: An #IdeDiagnosticsManager
+ * @directory: (nullable): a #GFile or %NULL for the whole project
+ * @min_severity: the lowest #IdeDiagnosticSeverity to consider
+ * @since_sequence: only list files changed after this sequence, or 0
+ *
+ * Lists the files within @directory that have diagnostics of at least
+ * @min_severity, sorted by their URI. If @since_sequence is non-zero, files
+ * that have not changed since are skipped. Files that no longer have any
+ * diagnostics are never listed, use ide_diagnostics_manager_count_indexed()
+ * or a full listing to notice that they were removed.
+ *
+ * Returns: (transfer container) (element-type Gio.File): a #GPtrArray
+ */
+GPtrArray *
+ide_diagnostics_manager_list_indexed_files (IdeDiagnosticsManager *self,
+                                            GFile                 *directory,
+                                            IdeDiagnosticSeverity  min_severity,
+                                            guint                  since_sequence)
+{
+  g_return_val_if_fail (IDE_IS_DIAGNOSTICS_MANAGER (self), NULL);
+  g_return_val_if_fail (!directory || G_IS_FILE (directory), NULL);
+
+  ide_diagnostics_manager_apply_pending_index (self);
+
+  return _ide_diagnostics_index_list_files (self->index, directory, min_severity, since_sequence);
+}
+
+/**
+ * ide_diagnostics_manager_get_indexed_diagnostics:
+ * @self: An #IdeDiagnosticsManager
+ * @file: a #GFile
+ * @min_severity: the lowest #IdeDiagnosticSeverity to include
+ *
+ * Gets the diagnostics indexed for @file from every source, including
+ * files that are not open.
+ *
+ * Returns: (transfer full): an #IdeDiagnostics
+ */
+IdeDiagnostics *
+ide_diagnostics_manager_get_indexed_diagnostics (IdeDiagnosticsManager *self,
+                                                 GFile                 *file,
+                                                 IdeDiagnosticSeverity  min_severity)
+{
+  g_return_val_if_fail (IDE_IS_DIAGNOSTICS_MANAGER (self), NULL);
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+  ide_diagnostics_manager_apply_pending_index (self);
+
+  return _ide_diagnostics_index_get_diagnostics (self->index, file, min_severity);
+}
@@ -23,6 +23,8 @@
 
 #include "ide-object.h"
 
+#include "diagnostics/ide-diagnostic.h"
+
 G_BEGIN_DECLS
 
 #define IDE_TYPE_DIAGNOSTICS_MANAGER (ide_diagnostics_manager_get_type())
@@ -37,6 +39,26 @@ guint           ide_diagnostics_manager_get_sequence_for_file    (IdeDiagnostics
 void            ide_diagnostics_manager_update_group_by_file     (IdeDiagnosticsManager *self,
                                                                   IdeBuffer             *buffer,
                                                                   GFile                 *new_file);
+guint           ide_diagnostics_manager_get_index_sequence       (IdeDiagnosticsManager *self);
+void            ide_diagnostics_manager_set_indexed_diagnostics  (IdeDiagnosticsManager *self,
+                                                                  const gchar           *source,
+                                                                  GFile                 *file,
+                                                                  IdeDiagnostics        *diagnostics);
+void            ide_diagnostics_manager_add_indexed_diagnostic   (IdeDiagnosticsManager *self,
+                                                                  const gchar           *source,
+                                                                  IdeDiagnostic         *diagnostic);
+void            ide_diagnostics_manager_clear_indexed_source     (IdeDiagnosticsManager *self,
+                                                                  const gchar           *source);
+guint           ide_diagnostics_manager_count_indexed            (IdeDiagnosticsManager *self,
+                                                                  GFile                 *directory,
+                                                                  IdeDiagnosticSeverity  min_severity);
+GPtrArray      *ide_diagnostics_manager_list_indexed_files       (IdeDiagnosticsManager *self,
+                                                                  GFile                 *directory,
+                                                                  IdeDiagnosticSeverity  min_severity,
+                                                                  guint                  since_sequence);
+IdeDiagnostics *ide_diagnostics_manager_get_indexed_diagnostics  (IdeDiagnosticsManager *self,
+                                                                  GFile                 *file,
+                                                                  IdeDiagnosticSeverity  min_severity);
 
 G_END_DECLS
 
@@ -0,0 +1,33 @@
+/* ide-diagnostics-pool-private.h
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "ide-object.h"
+
+G_BEGIN_DECLS
+
+#define IDE_TYPE_DIAGNOSTICS_POOL (ide_diagnostics_pool_get_type())
+
+G_DECLARE_FINAL_TYPE (IdeDiagnosticsPool, ide_diagnostics_pool, IDE, DIAGNOSTICS_POOL, IdeObject)
+
+IdeDiagnosticsPool *ide_diagnostics_pool_new             (IdeContext         *context);
+void                ide_diagnostics_pool_notify_activity (IdeDiagnosticsPool *self);
+void                ide_diagnostics_pool_shutdown        (IdeDiagnosticsPool *self);
+
+G_END_DECLS
@@ -0,0 +1,763 @@
+/* ide-diagnostics-pool.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-diagnostics-pool"
+
+#include <dazzle.h>
+#include <gtksourceview/gtksource.h>
+#include <libpeas/peas.h>
+
+#include "ide-context.h"
+#include "ide-debug.h"
+#include "ide-macros.h"
+
+#include "buffers/ide-buffer-manager.h"
+#include "diagnostics/ide-diagnostic.h"
+#include "diagnostics/ide-diagnostic-provider.h"
+#include "diagnostics/ide-diagnostics.h"
+#include "diagnostics/ide-diagnostics-manager.h"
+#include "diagnostics/ide-diagnostics-pool-private.h"
+#include "files/ide-directory-crawler.h"
+#include "files/ide-file.h"
+#include "plugins/ide-extension-set-adapter.h"
+#include "threading/ide-thread-pool.h"
+#include "util/ide-battery-monitor.h"
+#include "vcs/ide-vcs.h"
+
+/*
+ * IdeDiagnosticsPool runs the diagnostic providers over the files of the
+ * project that are not open, so that breakage elsewhere in the tree shows
+ * up in the diagnostics index without running a full build.
+ *
+ * This is expensive, so it only happens once the user has stopped typing
+ * for IDLE_TIMEOUT_SEC and we are not running on battery. The project is
+ * crawled on the compiler thread pool and the files are then diagnosed a
+ * few at a time. Any buffer activity cancels the files in flight, which
+ * are put back at the head of the queue, and the sweep resumes from where
+ * it stopped once the user is idle again. Activity after a sweep completed
+ * means files may have changed, so the next idle period starts a new one.
+ */
+
+#define IDLE_TIMEOUT_SEC 30
+#define MAX_ACTIVE       4
+
+struct _IdeDiagnosticsPool
+{
+  IdeObject     parent_instance;
+
+  GSettings    *settings;
+
+  /*
+   * Cancelled on user activity, which stops both the crawl and the files
+   * that are being diagnosed. This is %NULL while we are not running.
+   */
+  GCancellable *cancellable;
+
+  /*
+   * The cancellable of files still being diagnosed after we paused for
+   * the battery. Activity must still be able to cancel them, and it is
+   * reused if we resume before they complete.
+   */
+  GCancellable *in_flight_cancellable;
+
+  /* The GFile that are waiting to be diagnosed */
+  GQueue        pending;
+
+  /* Interned language id → IdeExtensionSetAdapter of providers */
+  GHashTable   *adapters;
+
+  gint64        last_activity;
+  guint         start_source;
+
+  /* The number of files being diagnosed, bounded by max_active */
+  guint         n_active;
+  guint         max_active;
+
+  guint         needs_crawl : 1;
+  guint         crawling : 1;
+  guint         shutdown : 1;
+};
+
+typedef struct
+{
+  IdeDiagnosticsPool *self;
+  GCancellable       *cancellable;
+  GFile              *file;
+  IdeFile            *ifile;
+  guint               n_active;
+  guint               requeued : 1;
+} Diagnose;
+
+typedef struct
+{
+  GFile     *workdir;
+  IdeVcs    *vcs;
+  GPtrArray *files;
+} Crawl;
+
+G_DEFINE_TYPE (IdeDiagnosticsPool, ide_diagnostics_pool, IDE_TYPE_OBJECT)
+
+DZL_DEFINE_COUNTER (diagnosed, "IdeDiagnosticsPool", "Diagnosed",
+                    "Number of unopened files diagnosed in the background")
+
+static void ide_diagnostics_pool_run         (IdeDiagnosticsPool *self);
+static void ide_diagnostics_pool_queue_start (IdeDiagnosticsPool *self);
+
+static void
+diagnose_release (Diagnose *diagnose)
+{
+  IdeDiagnosticsPool *self = diagnose->self;
+
+  g_assert (diagnose->n_active > 0);
+
+  if (--diagnose->n_active > 0)
+    return;
+
+  g_clear_object (&diagnose->cancellable);
+  g_clear_object (&diagnose->file);
+  g_clear_object (&diagnose->ifile);
+  g_slice_free (Diagnose, diagnose);
+
+  if (--self->n_active == 0)
+    g_clear_object (&self->in_flight_cancellable);
+
+  ide_diagnostics_pool_run (self);
+
+  g_object_unref (self);
+}
+
+static void
+crawl_free (gpointer data)
+{
+  Crawl *crawl = data;
+
+  g_clear_object (&crawl->workdir);
+  g_clear_object (&crawl->vcs);
+  g_clear_pointer (&crawl->files, g_ptr_array_unref);
+  g_slice_free (Crawl, crawl);
+}
+
+static gboolean
+ide_diagnostics_pool_get_enabled (IdeDiagnosticsPool *self)
+{
+  return g_settings_get_boolean (self->settings, "background-diagnostics");
+}
+
+static void
+ide_diagnostics_pool_stop (IdeDiagnosticsPool *self)
+{
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (self));
+
+  if (self->cancellable != NULL)
+    {
+      g_cancellable_cancel (self->cancellable);
+      g_clear_object (&self->cancellable);
+    }
+
+  if (self->in_flight_cancellable != NULL)
+    {
+      g_cancellable_cancel (self->in_flight_cancellable);
+      g_clear_object (&self->in_flight_cancellable);
+    }
+}
+
+static void
+ide_diagnostics_pool_publish (IdeDiagnosticsPool    *self,
+                              IdeDiagnosticProvider *provider,
+                              GFile                 *file,
+                              IdeDiagnostics        *diagnostics)
+{
+  g_autoptr(IdeDiagnostics) filtered = NULL;
+  IdeContext *context;
+  gsize size = 0;
+
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (self));
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+  g_assert (G_IS_FILE (file));
+
+  if (NULL == (context = ide_object_get_context (IDE_OBJECT (self))))
+    return;
+
+  /*
+   * If the file was opened while we were diagnosing it, the providers of
+   * the buffer own its entry in the index and have fresher results.
+   */
+  if (ide_buffer_manager_has_file (ide_context_get_buffer_manager (context), file))
+    return;
+
+  filtered = ide_diagnostics_new (NULL);
+
+  if (diagnostics != NULL)
+    size = ide_diagnostics_get_size (diagnostics);
+
+  for (gsize i = 0; i < size; i++)
+    {
+      IdeDiagnostic *diagnostic = ide_diagnostics_index (diagnostics, i);
+      GFile *diagnostic_file = ide_diagnostic_get_file (diagnostic);
+
+      if (diagnostic_file != NULL && g_file_equal (diagnostic_file, file))
+        ide_diagnostics_add (filtered, diagnostic);
+    }
+
+  /* Use the same source as the providers of open buffers */
+  ide_diagnostics_manager_set_indexed_diagnostics (ide_context_get_diagnostics_manager (context),
+                                                   G_OBJECT_TYPE_NAME (provider),
+                                                   file,
+                                                   filtered);
+}
+
+static void
+ide_diagnostics_pool_diagnose_cb (GObject      *object,
+                                  GAsyncResult *result,
+                                  gpointer      user_data)
+{
+  IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)object;
+  g_autoptr(IdeDiagnostics) diagnostics = NULL;
+  g_autoptr(GError) error = NULL;
+  Diagnose *diagnose = user_data;
+  IdeDiagnosticsPool *self = diagnose->self;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (self));
+
+  diagnostics = ide_diagnostic_provider_diagnose_finish (provider, result, &error);
+
+  if (g_cancellable_is_cancelled (diagnose->cancellable))
+    {
+      /* Try again once the user is idle */
+      if (!diagnose->requeued && !self->shutdown)
+        {
+          diagnose->requeued = TRUE;
+          g_queue_push_head (&self->pending, g_object_ref (diagnose->file));
+        }
+    }
+  else if (error != NULL)
+    {
+      g_autofree gchar *uri = g_file_get_uri (diagnose->file);
+
+      g_debug ("%s failed to diagnose %s: %s",
+               G_OBJECT_TYPE_NAME (provider), uri, error->message);
+    }
+  else
+    {
+      ide_diagnostics_pool_publish (self, provider, diagnose->file, diagnostics);
+    }
+
+  diagnose_release (diagnose);
+
+  IDE_EXIT;
+}
+
+static void
+ide_diagnostics_pool_diagnose_foreach (IdeExtensionSetAdapter *adapter,
+                                       PeasPluginInfo         *plugin_info,
+                                       PeasExtension          *exten,
+                                       gpointer                user_data)
+{
+  IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)exten;
+  Diagnose *diagnose = user_data;
+
+  g_assert (IDE_IS_EXTENSION_SET_ADAPTER (adapter));
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+
+  diagnose->n_active++;
+
+  ide_diagnostic_provider_diagnose_async (provider,
+                                          diagnose->ifile,
+                                          NULL,
+                                          diagnose->cancellable,
+                                          ide_diagnostics_pool_diagnose_cb,
+                                          diagnose);
+}
+
+static void
+ide_diagnostics_pool_extension_added (IdeExtensionSetAdapter *adapter,
+                                      PeasPluginInfo         *plugin_info,
+                                      PeasExtension          *exten,
+                                      gpointer                user_data)
+{
+  g_assert (IDE_IS_EXTENSION_SET_ADAPTER (adapter));
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (exten));
+
+  ide_diagnostic_provider_load (IDE_DIAGNOSTIC_PROVIDER (exten));
+}
+
+static IdeExtensionSetAdapter *
+ide_diagnostics_pool_get_adapter (IdeDiagnosticsPool *self,
+                                  GFile              *file)
+{
+  IdeExtensionSetAdapter *adapter;
+  GtkSourceLanguageManager *manager;
+  GtkSourceLanguage *language;
+  g_autofree gchar *name = NULL;
+  const gchar *language_id;
+
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (self));
+  g_assert (G_IS_FILE (file));
+
+  /*
+   * Guessing by name alone avoids reading the file, which is good enough
+   * to decide which providers to run on source files.
+   */
+  name = g_file_get_basename (file);
+  manager = gtk_source_language_manager_get_default ();
+
+  if (NULL == (language = gtk_source_language_manager_guess_language (manager, name, NULL)))
+    return NULL;
+
+  language_id = g_intern_string (gtk_source_language_get_id (language));
+
+  if (NULL == (adapter = g_hash_table_lookup (self->adapters, language_id)))
+    {
+      IdeContext *context = ide_object_get_context (IDE_OBJECT (self));
+
+      adapter = ide_extension_set_adapter_new (context,
+                                               peas_engine_get_default (),
+                                               IDE_TYPE_DIAGNOSTIC_PROVIDER,
+                                               "Diagnostic-Provider-Languages",
+                                               language_id);
+
+      g_signal_connect_object (adapter,
+                               "extension-added",
+                               G_CALLBACK (ide_diagnostics_pool_extension_added),
+                               self,
+                               0);
+
+      ide_extension_set_adapter_foreach (adapter,
+                                         ide_diagnostics_pool_extension_added,
+                                         self);
+
+      g_hash_table_insert (self->adapters, (gchar *)language_id, adapter);
+    }
+
+  return adapter;
+}
+
+static void
+ide_diagnostics_pool_pump (IdeDiagnosticsPool *self)
+{
+  IdeBufferManager *buffer_manager;
+  IdeContext *context;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (self));
+  g_assert (self->cancellable != NULL);
+
+  /* The context is gone, there is nothing left to publish to */
+  if (NULL == (context = ide_object_get_context (IDE_OBJECT (self))))
+    {
+      ide_diagnostics_pool_stop (self);
+      IDE_EXIT;
+    }
+
+  /* Let the files in flight finish, but check again later */
+  if (ide_battery_monitor_get_on_battery ())
+    {
+      if (self->n_active > 0)
+        self->in_flight_cancellable = g_steal_pointer (&self->cancellable);
+      else
+        g_clear_object (&self->cancellable);
+      ide_diagnostics_pool_queue_start (self);
+      IDE_EXIT;
+    }
+
+  buffer_manager = ide_context_get_buffer_manager (context);
+
+  while (self->n_active < self->max_active && self->pending.length > 0)
+    {
+      g_autoptr(GFile) file = g_queue_pop_head (&self->pending);
+      IdeExtensionSetAdapter *adapter;
+      Diagnose *diagnose;
+
+      if (ide_buffer_manager_has_file (buffer_manager, file))
+        continue;
+
+      if (NULL == (adapter = ide_diagnostics_pool_get_adapter (self, file)) ||
+          ide_extension_set_adapter_get_n_extensions (adapter) == 0)
+        continue;
+
+      DZL_COUNTER_INC (diagnosed);
+
+      diagnose = g_slice_new0 (Diagnose);
+      diagnose->self = g_object_ref (self);
+      diagnose->cancellable = g_object_ref (self->cancellable);
+      diagnose->file = g_steal_pointer (&file);
+      diagnose->ifile = ide_file_new (context, diagnose->file);
+
+      /* Hold a reference while dispatching in case a provider completes immediately */
+      diagnose->n_active = 1;
+      self->n_active++;
+
+      ide_extension_set_adapter_foreach (adapter,
+                                         ide_diagnostics_pool_diagnose_foreach,
+                                         diagnose);
+
+      diagnose_release (diagnose);
+    }
+
+  if (self->n_active == 0 && self->pending.length == 0)
+    {
+      IDE_TRACE_MSG ("Background diagnostics sweep completed");
+      g_clear_object (&self->cancellable);
+    }
+
+  IDE_EXIT;
+}
+
+static void
+ide_diagnostics_pool_crawl_cb (GFile       *directory,
+                               const gchar *relative_path,
+                               GFileInfo   *directory_info,
+                               GPtrArray   *children,
+                               gpointer     user_data)
+{
+  Crawl *crawl = user_data;
+
+  g_assert (G_IS_FILE (directory));
+
+  if (children == NULL)
+    return;
+
+  for (guint i = 0; i < children->len; i++)
+    {
+      GFileInfo *info = g_ptr_array_index (children, i);
+
+      if (g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR)
+        g_ptr_array_add (crawl->files, g_file_get_child (directory, g_file_info_get_name (info)));
+    }
+}
+
+static void
+ide_diagnostics_pool_crawl_worker (GTask        *task,
+                                   gpointer      source_object,
+                                   gpointer      task_data,
+                                   GCancellable *cancellable)
+{
+  g_autoptr(IdeDirectoryCrawler) crawler = NULL;
+  g_autoptr(GError) error = NULL;
+  Crawl *crawl = task_data;
+
+  IDE_ENTRY;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (source_object));
+  g_assert (crawl != NULL);
+
+  crawler = ide_directory_crawler_new (crawl->workdir);
+  ide_directory_crawler_set_vcs (crawler, crawl->vcs);
+
+  if (!ide_directory_crawler_run (crawler, cancellable, ide_diagnostics_pool_crawl_cb, crawl, &error))
+    g_task_return_error (task, g_steal_pointer (&error));
+  else
+    g_task_return_pointer (task,
+                           g_steal_pointer (&crawl->files),
+                           (GDestroyNotify)g_ptr_array_unref);
+
+  IDE_EXIT;
+}
+
+static void
+ide_diagnostics_pool_crawl_done (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
+{
+  IdeDiagnosticsPool *self = (IdeDiagnosticsPool *)object;
+  g_autoptr(GPtrArray) files = NULL;
+  g_autoptr(GError) error = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (self));
+  g_assert (G_IS_TASK (result));
+
+  self->crawling = FALSE;
+
+  if (NULL == (files = g_task_propagate_pointer (G_TASK (result), &error)))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("Failed to crawl project for diagnostics: %s", error->message);
+    }
+  else
+    {
+      IDE_TRACE_MSG ("Queued %u files for background diagnostics", files->len);
+
+      g_queue_clear_full (&self->pending, g_object_unref);
+
+      for (guint i = 0; i < files->len; i++)
+        g_queue_push_tail (&self->pending, g_object_ref (g_ptr_array_index (files, i)));
+
+      self->needs_crawl = FALSE;
+    }
+
+  /* We may have been restarted while crawling */
+  ide_diagnostics_pool_run (self);
+
+  IDE_EXIT;
+}
+
+static void
+ide_diagnostics_pool_crawl (IdeDiagnosticsPool *self)
+{
+  g_autoptr(GTask) task = NULL;
+  IdeContext *context;
+  Crawl *crawl;
+  IdeVcs *vcs;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (self));
+  g_assert (self->cancellable != NULL);
+  g_assert (!self->crawling);
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  vcs = ide_context_get_vcs (context);
+
+  crawl = g_slice_new0 (Crawl);
+  crawl->workdir = g_object_ref (ide_vcs_get_working_directory (vcs));
+  crawl->vcs = g_object_ref (vcs);
+  crawl->files = g_ptr_array_new_with_free_func (g_object_unref);
+
+  self->crawling = TRUE;
+
+  task = g_task_new (self, self->cancellable, ide_diagnostics_pool_crawl_done, NULL);
+  g_task_set_source_tag (task, ide_diagnostics_pool_crawl);
+  g_task_set_priority (task, G_PRIORITY_LOW);
+  g_task_set_task_data (task, crawl, crawl_free);
+  ide_thread_pool_push_task (IDE_THREAD_POOL_COMPILER,
+                             task,
+                             ide_diagnostics_pool_crawl_worker);
+
+  IDE_EXIT;
+}
+
+static void
+ide_diagnostics_pool_run (IdeDiagnosticsPool *self)
+{
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (self));
+
+  if (self->cancellable == NULL || self->crawling)
+    return;
+
+  if (ide_object_get_context (IDE_OBJECT (self)) == NULL)
+    {
+      ide_diagnostics_pool_stop (self);
+      return;
+    }
+
+  if (self->needs_crawl)
+    ide_diagnostics_pool_crawl (self);
+  else
+    ide_diagnostics_pool_pump (self);
+}
+
+static gboolean
+ide_diagnostics_pool_start_timeout (gpointer data)
+{
+  IdeDiagnosticsPool *self = data;
+  gint64 remaining;
+
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (self));
+
+  self->start_source = 0;
+
+  remaining = self->last_activity + (IDLE_TIMEOUT_SEC * G_USEC_PER_SEC) - g_get_monotonic_time ();
+
+  /* Rather than resetting the timeout on every keystroke, check when it fires */
+  if (remaining > 0)
+    {
+      self->start_source = g_timeout_add_full (G_PRIORITY_LOW,
+                                               remaining / 1000 + 1,
+                                               ide_diagnostics_pool_start_timeout,
+                                               self,
+                                               NULL);
+      return G_SOURCE_REMOVE;
+    }
+
+  if (ide_battery_monitor_get_on_battery ())
+    {
+      ide_diagnostics_pool_queue_start (self);
+      return G_SOURCE_REMOVE;
+    }
+
+  if (self->cancellable == NULL && (self->needs_crawl || self->pending.length > 0))
+    {
+      if (self->in_flight_cancellable != NULL)
+        self->cancellable = g_steal_pointer (&self->in_flight_cancellable);
+      else
+        self->cancellable = g_cancellable_new ();
+      ide_diagnostics_pool_run (self);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_diagnostics_pool_queue_start (IdeDiagnosticsPool *self)
+{
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (self));
+
+  if (self->start_source == 0 && !self->shutdown && ide_diagnostics_pool_get_enabled (self))
+    self->start_source = g_timeout_add_seconds_full (G_PRIORITY_LOW,
+                                                     IDLE_TIMEOUT_SEC,
+                                                     ide_diagnostics_pool_start_timeout,
+                                                     self,
+                                                     NULL);
+}
+
+static void
+ide_diagnostics_pool_settings_changed (IdeDiagnosticsPool *self,
+                                       const gchar        *key,
+                                       GSettings          *settings)
+{
+  g_assert (IDE_IS_DIAGNOSTICS_POOL (self));
+  g_assert (G_IS_SETTINGS (settings));
+
+  if (ide_diagnostics_pool_get_enabled (self))
+    {
+      self->last_activity = g_get_monotonic_time ();
+      ide_diagnostics_pool_queue_start (self);
+    }
+  else
+    {
+      ide_diagnostics_pool_stop (self);
+      ide_clear_source (&self->start_source);
+      g_queue_clear_full (&self->pending, g_object_unref);
+      self->needs_crawl = TRUE;
+    }
+}
+
+static void
+ide_diagnostics_pool_constructed (GObject *object)
+{
+  IdeDiagnosticsPool *self = (IdeDiagnosticsPool *)object;
+
+  G_OBJECT_CLASS (ide_diagnostics_pool_parent_class)->constructed (object);
+
+  self->settings = g_settings_new ("org.gnome.builder.code-insight");
+
+  g_signal_connect_object (self->settings,
+                           "changed::background-diagnostics",
+                           G_CALLBACK (ide_diagnostics_pool_settings_changed),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  self->last_activity = g_get_monotonic_time ();
+  ide_diagnostics_pool_queue_start (self);
+}
+
+static void
+ide_diagnostics_pool_dispose (GObject *object)
+{
+  IdeDiagnosticsPool *self = (IdeDiagnosticsPool *)object;
+
+  ide_diagnostics_pool_stop (self);
+  ide_clear_source (&self->start_source);
+  g_clear_pointer (&self->adapters, g_hash_table_unref);
+
+  G_OBJECT_CLASS (ide_diagnostics_pool_parent_class)->dispose (object);
+}
+
+static void
+ide_diagnostics_pool_finalize (GObject *object)
+{
+  IdeDiagnosticsPool *self = (IdeDiagnosticsPool *)object;
+
+  g_queue_clear_full (&self->pending, g_object_unref);
+  g_clear_object (&self->settings);
+
+  G_OBJECT_CLASS (ide_diagnostics_pool_parent_class)->finalize (object);
+}
+
+static void
+ide_diagnostics_pool_class_init (IdeDiagnosticsPoolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = ide_diagnostics_pool_constructed;
+  object_class->dispose = ide_diagnostics_pool_dispose;
+  object_class->finalize = ide_diagnostics_pool_finalize;
+}
+
+static void
+ide_diagnostics_pool_init (IdeDiagnosticsPool *self)
+{
+  g_queue_init (&self->pending);
+
+  self->adapters = g_hash_table_new_full (NULL, NULL, NULL, g_object_unref);
+  self->max_active = CLAMP (g_get_num_processors () / 2, 1, MAX_ACTIVE);
+  self->needs_crawl = TRUE;
+}
+
+IdeDiagnosticsPool *
+ide_diagnostics_pool_new (IdeContext *context)
+{
+  g_return_val_if_fail (IDE_IS_CONTEXT (context), NULL);
+
+  return g_object_new (IDE_TYPE_DIAGNOSTICS_POOL,
+                       "context", context,
+                       NULL);
+}
+
+/**
+ * ide_diagnostics_pool_shutdown:
+ * @self: An #IdeDiagnosticsPool
+ *
+ * Cancels any background work and prevents new work from starting. Files
+ * that are still being diagnosed complete without being requeued, after
+ * which nothing references the context anymore.
+ */
+void
+ide_diagnostics_pool_shutdown (IdeDiagnosticsPool *self)
+{
+  g_return_if_fail (IDE_IS_DIAGNOSTICS_POOL (self));
+
+  self->shutdown = TRUE;
+
+  ide_diagnostics_pool_stop (self);
+  ide_clear_source (&self->start_source);
+  g_queue_clear_full (&self->pending, g_object_unref);
+  self->needs_crawl = FALSE;
+}
+
+/**
+ * ide_diagnostics_pool_notify_activity:
+ * @self: An #IdeDiagnosticsPool
+ *
+ * Notes that the user is busy editing. Any background work is cancelled
+ * and resumes once the user has been idle for a while.
+ */
+void
+ide_diagnostics_pool_notify_activity (IdeDiagnosticsPool *self)
+{
+  g_return_if_fail (IDE_IS_DIAGNOSTICS_POOL (self));
+
+  self->last_activity = g_get_monotonic_time ();
+
+  /*
+   * Files might change while the user is working, so once a sweep has
+   * completed, the next one needs to start over from the crawl.
+   */
+  if (self->cancellable == NULL && !self->crawling && self->n_active == 0 && self->pending.length == 0)
+    self->needs_crawl = TRUE;
+
+  ide_diagnostics_pool_stop (self);
+  ide_diagnostics_pool_queue_start (self);
+}
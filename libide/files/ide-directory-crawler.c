@@ -0,0 +1,537 @@
+/* ide-directory-crawler.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-directory-crawler"
+
+#include <dazzle.h>
+#include <string.h>
+
+#include "ide-debug.h"
+
+#include "files/ide-directory-crawler.h"
+#include "vcs/ide-vcs.h"
+
+/*
+ * IdeDirectoryCrawler walks a directory tree using a small set of worker
+ * threads. Enumerating directories is mostly latency bound (especially on
+ * network file-systems) so keeping a few requests in flight is much faster
+ * than a recursive walk, even though the work is not CPU bound.
+ *
+ * Each worker has its own deque of directories. Subdirectories discovered
+ * by a worker are pushed to the head of its own deque and processed in LIFO
+ * order (keeping the walk mostly depth-first and the deques short), while
+ * idle workers steal from the tail of other deques.
+ *
+ * Results are handed back to the thread that called
+ * ide_directory_crawler_run() in per-directory batches, so consumers do not
+ * need any locking of their own. The number of batches waiting for the
+ * consumer is bounded so that a slow consumer applies back-pressure to the
+ * workers rather than letting the results grow without limit.
+ */
+
+#define DEFAULT_ATTRIBUTES  G_FILE_ATTRIBUTE_STANDARD_NAME","G_FILE_ATTRIBUTE_STANDARD_TYPE
+#define MAX_WORKERS         16
+#define MAX_PENDING_BATCHES 256
+
+struct _IdeDirectoryCrawler
+{
+  GObject                       parent_instance;
+
+  GFile                        *root_directory;
+  IdeVcs                       *vcs;
+  gchar                        *attributes;
+
+  IdeDirectoryCrawlerReuseFunc  reuse_func;
+  gpointer                      reuse_data;
+  GDestroyNotify                reuse_data_destroy;
+
+  guint                         n_workers;
+};
+
+typedef struct
+{
+  GFile     *directory;
+  gchar     *relative_path;
+  GFileInfo *info;
+  GPtrArray *children;
+} WorkItem;
+
+typedef struct
+{
+  IdeDirectoryCrawler *self;
+  GCancellable        *cancellable;
+  gchar               *attributes;
+
+  /* Everything below is protected by @mutex */
+  GMutex               mutex;
+  GCond                cond;
+  GQueue              *deques;
+  GQueue               batches;
+  guint                pending;
+  guint                n_steals;
+} Crawl;
+
+typedef struct
+{
+  Crawl   *crawl;
+  GThread *thread;
+  guint    id;
+} Worker;
+
+G_DEFINE_TYPE (IdeDirectoryCrawler, ide_directory_crawler, G_TYPE_OBJECT)
+
+DZL_DEFINE_COUNTER (directories, "IdeDirectoryCrawler", "Directories", "Number of directories crawled")
+
+static void
+work_item_free (gpointer data)
+{
+  WorkItem *item = data;
+
+  g_clear_object (&item->directory);
+  g_clear_pointer (&item->relative_path, g_free);
+  g_clear_object (&item->info);
+  g_clear_pointer (&item->children, g_ptr_array_unref);
+  g_slice_free (WorkItem, item);
+}
+
+static WorkItem *
+work_item_new (GFile       *directory,
+               const gchar *relative_path,
+               GFileInfo   *info)
+{
+  WorkItem *item;
+
+  item = g_slice_new0 (WorkItem);
+  item->directory = g_object_ref (directory);
+  item->relative_path = g_strdup (relative_path);
+  item->info = info ? g_object_ref (info) : NULL;
+
+  return item;
+}
+
+static gchar *
+build_relative_path (const gchar *parent,
+                     const gchar *name)
+{
+  if (*parent == '\0')
+    return g_strdup (name);
+  return g_build_filename (parent, name, NULL);
+}
+
+static WorkItem *
+crawl_take_locked (Crawl *crawl,
+                   guint  id)
+{
+  IdeDirectoryCrawler *self = crawl->self;
+  WorkItem *item;
+
+  /* Our own work first, newest first */
+  if (NULL != (item = g_queue_pop_head (&crawl->deques[id])))
+    return item;
+
+  /* Otherwise steal the oldest (and likely largest) work from a peer */
+  for (guint i = 1; i < self->n_workers; i++)
+    {
+      guint victim = (id + i) % self->n_workers;
+
+      if (NULL != (item = g_queue_pop_tail (&crawl->deques[victim])))
+        {
+          crawl->n_steals++;
+          return item;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+crawl_process (Crawl    *crawl,
+               guint     id,
+               WorkItem *item)
+{
+  IdeDirectoryCrawler *self = crawl->self;
+  g_autoptr(GFileEnumerator) enumerator = NULL;
+  g_autoptr(GPtrArray) subdirs = NULL;
+  g_auto(GStrv) reused = NULL;
+  gpointer infoptr;
+
+  g_assert (crawl != NULL);
+  g_assert (item != NULL);
+
+  if (g_cancellable_is_cancelled (crawl->cancellable))
+    return;
+
+  if (item->info == NULL)
+    item->info = g_file_query_info (item->directory,
+                                    crawl->attributes,
+                                    G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                    crawl->cancellable,
+                                    NULL);
+
+  subdirs = g_ptr_array_new_with_free_func (work_item_free);
+
+  if (self->reuse_func != NULL && item->info != NULL)
+    reused = self->reuse_func (item->directory, item->relative_path, item->info, self->reuse_data);
+
+  if (reused != NULL)
+    {
+      for (guint i = 0; reused[i] != NULL; i++)
+        {
+          g_autoptr(GFile) child = g_file_get_child (item->directory, reused[i]);
+          g_autofree gchar *relative_path = build_relative_path (item->relative_path, reused[i]);
+
+          g_ptr_array_add (subdirs, work_item_new (child, relative_path, NULL));
+        }
+    }
+  else
+    {
+      item->children = g_ptr_array_new_with_free_func (g_object_unref);
+
+      enumerator = g_file_enumerate_children (item->directory,
+                                              crawl->attributes,
+                                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                              crawl->cancellable,
+                                              NULL);
+
+      while (enumerator != NULL &&
+             NULL != (infoptr = g_file_enumerator_next_file (enumerator, crawl->cancellable, NULL)))
+        g_ptr_array_add (item->children, infoptr);
+
+      /* Classify the whole directory at once rather than per child */
+      if (self->vcs != NULL && item->children->len > 0)
+        {
+          g_autofree const gchar **names = g_new (const gchar *, item->children->len);
+          g_autofree gboolean *ignored = g_new (gboolean, item->children->len);
+          GPtrArray *filtered = g_ptr_array_new_with_free_func (g_object_unref);
+
+          for (guint i = 0; i < item->children->len; i++)
+            names[i] = g_file_info_get_name (g_ptr_array_index (item->children, i));
+
+          ide_vcs_classify_ignored (self->vcs, item->directory, names, item->children->len, ignored);
+
+          for (guint i = 0; i < item->children->len; i++)
+            {
+              if (!ignored[i])
+                g_ptr_array_add (filtered, g_object_ref (g_ptr_array_index (item->children, i)));
+            }
+
+          g_ptr_array_unref (item->children);
+          item->children = filtered;
+        }
+
+      for (guint i = 0; i < item->children->len; i++)
+        {
+          GFileInfo *info = g_ptr_array_index (item->children, i);
+
+          if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+            {
+              const gchar *name = g_file_info_get_name (info);
+              g_autoptr(GFile) child = g_file_get_child (item->directory, name);
+              g_autofree gchar *relative_path = build_relative_path (item->relative_path, name);
+
+              g_ptr_array_add (subdirs, work_item_new (child, relative_path, info));
+            }
+        }
+    }
+
+  if (subdirs->len > 0)
+    {
+      g_mutex_lock (&crawl->mutex);
+      for (guint i = 0; i < subdirs->len; i++)
+        g_queue_push_head (&crawl->deques[id], g_ptr_array_index (subdirs, i));
+      crawl->pending += subdirs->len;
+      g_cond_broadcast (&crawl->cond);
+      g_mutex_unlock (&crawl->mutex);
+
+      /* Ownership was transferred to the deque */
+      g_ptr_array_set_free_func (subdirs, NULL);
+    }
+}
+
+static gpointer
+crawl_worker (gpointer data)
+{
+  Worker *worker = data;
+  Crawl *crawl = worker->crawl;
+
+  g_assert (worker != NULL);
+  g_assert (crawl != NULL);
+
+  g_mutex_lock (&crawl->mutex);
+
+  for (;;)
+    {
+      WorkItem *item = NULL;
+
+      while (crawl->pending > 0 && NULL == (item = crawl_take_locked (crawl, worker->id)))
+        g_cond_wait (&crawl->cond, &crawl->mutex);
+
+      if (item == NULL)
+        break;
+
+      g_mutex_unlock (&crawl->mutex);
+      crawl_process (crawl, worker->id, item);
+      g_mutex_lock (&crawl->mutex);
+
+      while (crawl->batches.length >= MAX_PENDING_BATCHES &&
+             !g_cancellable_is_cancelled (crawl->cancellable))
+        g_cond_wait (&crawl->cond, &crawl->mutex);
+
+      g_queue_push_tail (&crawl->batches, item);
+      crawl->pending--;
+      g_cond_broadcast (&crawl->cond);
+    }
+
+  g_mutex_unlock (&crawl->mutex);
+
+  return NULL;
+}
+
+static void
+ide_directory_crawler_finalize (GObject *object)
+{
+  IdeDirectoryCrawler *self = (IdeDirectoryCrawler *)object;
+
+  if (self->reuse_data_destroy != NULL)
+    g_clear_pointer (&self->reuse_data, self->reuse_data_destroy);
+
+  g_clear_object (&self->root_directory);
+  g_clear_object (&self->vcs);
+  g_clear_pointer (&self->attributes, g_free);
+
+  G_OBJECT_CLASS (ide_directory_crawler_parent_class)->finalize (object);
+}
+
+static void
+ide_directory_crawler_class_init (IdeDirectoryCrawlerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ide_directory_crawler_finalize;
+}
+
+static void
+ide_directory_crawler_init (IdeDirectoryCrawler *self)
+{
+  self->n_workers = CLAMP (g_get_num_processors (), 2, 8);
+}
+
+/**
+ * ide_directory_crawler_new:
+ * @root_directory: the directory to crawl
+ *
+ * Creates a new #IdeDirectoryCrawler. Symbolic links are never followed.
+ *
+ * Returns: (transfer full): A newly created #IdeDirectoryCrawler
+ */
+IdeDirectoryCrawler *
+ide_directory_crawler_new (GFile *root_directory)
+{
+  IdeDirectoryCrawler *self;
+
+  g_return_val_if_fail (G_IS_FILE (root_directory), NULL);
+
+  self = g_object_new (IDE_TYPE_DIRECTORY_CRAWLER, NULL);
+  self->root_directory = g_object_ref (root_directory);
+
+  return self;
+}
+
+/**
+ * ide_directory_crawler_set_vcs:
+ * @self: An #IdeDirectoryCrawler
+ * @vcs: (nullable): An #IdeVcs or %NULL
+ *
+ * Sets the #IdeVcs used to filter out ignored files and directories. The
+ * filter is applied in the worker threads, so ignored entries are never
+ * delivered to the consumer and ignored directories are not descended into.
+ */
+void
+ide_directory_crawler_set_vcs (IdeDirectoryCrawler *self,
+                               IdeVcs              *vcs)
+{
+  g_return_if_fail (IDE_IS_DIRECTORY_CRAWLER (self));
+  g_return_if_fail (!vcs || IDE_IS_VCS (vcs));
+
+  g_set_object (&self->vcs, vcs);
+}
+
+/**
+ * ide_directory_crawler_set_attributes:
+ * @self: An #IdeDirectoryCrawler
+ * @attributes: (nullable): additional #GFileInfo attributes to query
+ *
+ * Sets additional attributes to query for each file and directory. The
+ * name and type of each file are always available.
+ */
+void
+ide_directory_crawler_set_attributes (IdeDirectoryCrawler *self,
+                                      const gchar         *attributes)
+{
+  g_return_if_fail (IDE_IS_DIRECTORY_CRAWLER (self));
+
+  g_free (self->attributes);
+  self->attributes = g_strdup (attributes);
+}
+
+/**
+ * ide_directory_crawler_set_n_workers:
+ * @self: An #IdeDirectoryCrawler
+ * @n_workers: the number of worker threads, or 0 for the default
+ *
+ * Sets the number of threads used to enumerate directories.
+ */
+void
+ide_directory_crawler_set_n_workers (IdeDirectoryCrawler *self,
+                                     guint                n_workers)
+{
+  g_return_if_fail (IDE_IS_DIRECTORY_CRAWLER (self));
+
+  if (n_workers == 0)
+    n_workers = CLAMP (g_get_num_processors (), 2, 8);
+
+  self->n_workers = MIN (n_workers, MAX_WORKERS);
+}
+
+/**
+ * ide_directory_crawler_set_reuse_func:
+ * @self: An #IdeDirectoryCrawler
+ * @reuse_func: (nullable): An #IdeDirectoryCrawlerReuseFunc or %NULL
+ * @reuse_data: closure data for @reuse_func
+ * @reuse_data_destroy: (nullable): A #GDestroyNotify for @reuse_data
+ *
+ * Sets a function which may be used to avoid enumerating directories
+ * whose contents are already known to the consumer.
+ */
+void
+ide_directory_crawler_set_reuse_func (IdeDirectoryCrawler          *self,
+                                      IdeDirectoryCrawlerReuseFunc  reuse_func,
+                                      gpointer                      reuse_data,
+                                      GDestroyNotify                reuse_data_destroy)
+{
+  g_return_if_fail (IDE_IS_DIRECTORY_CRAWLER (self));
+
+  if (self->reuse_data_destroy != NULL)
+    g_clear_pointer (&self->reuse_data, self->reuse_data_destroy);
+
+  self->reuse_func = reuse_func;
+  self->reuse_data = reuse_data;
+  self->reuse_data_destroy = reuse_data_destroy;
+}
+
+/**
+ * ide_directory_crawler_run:
+ * @self: An #IdeDirectoryCrawler
+ * @cancellable: (nullable): A #GCancellable or %NULL
+ * @func: (scope call): An #IdeDirectoryCrawlerFunc to receive results
+ * @user_data: closure data for @func
+ * @error: A location for a #GError, or %NULL
+ *
+ * Crawls the directory tree, blocking until complete. @func is called
+ * from the calling thread for every directory that was crawled, so this
+ * is meant to be used from a worker thread such as in a #GTask.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+ide_directory_crawler_run (IdeDirectoryCrawler      *self,
+                           GCancellable             *cancellable,
+                           IdeDirectoryCrawlerFunc   func,
+                           gpointer                  user_data,
+                           GError                  **error)
+{
+  g_autoptr(GTimer) timer = NULL;
+  Worker *workers;
+  Crawl crawl = { 0 };
+  guint n_batches = 0;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (IDE_IS_DIRECTORY_CRAWLER (self), FALSE);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
+
+  timer = g_timer_new ();
+
+  crawl.self = self;
+  crawl.cancellable = cancellable;
+  crawl.attributes = self->attributes
+    ? g_strconcat (DEFAULT_ATTRIBUTES",", self->attributes, NULL)
+    : g_strdup (DEFAULT_ATTRIBUTES);
+  crawl.deques = g_new0 (GQueue, self->n_workers);
+  g_mutex_init (&crawl.mutex);
+  g_cond_init (&crawl.cond);
+
+  g_queue_push_head (&crawl.deques[0], work_item_new (self->root_directory, "", NULL));
+  crawl.pending = 1;
+
+  workers = g_new0 (Worker, self->n_workers);
+
+  for (guint i = 0; i < self->n_workers; i++)
+    {
+      workers[i].crawl = &crawl;
+      workers[i].id = i;
+      workers[i].thread = g_thread_new ("ide-directory-crawler", crawl_worker, &workers[i]);
+    }
+
+  g_mutex_lock (&crawl.mutex);
+
+  for (;;)
+    {
+      WorkItem *item;
+
+      while (crawl.batches.length == 0 && crawl.pending > 0)
+        g_cond_wait (&crawl.cond, &crawl.mutex);
+
+      if (NULL == (item = g_queue_pop_head (&crawl.batches)))
+        break;
+
+      /* Wake any workers waiting on back-pressure */
+      g_cond_broadcast (&crawl.cond);
+      g_mutex_unlock (&crawl.mutex);
+
+      if (!g_cancellable_is_cancelled (cancellable))
+        func (item->directory, item->relative_path, item->info, item->children, user_data);
+
+      work_item_free (item);
+      n_batches++;
+
+      g_mutex_lock (&crawl.mutex);
+    }
+
+  g_mutex_unlock (&crawl.mutex);
+
+  for (guint i = 0; i < self->n_workers; i++)
+    g_thread_join (workers[i].thread);
+
+  DZL_COUNTER_ADD (directories, n_batches);
+
+  IDE_TRACE_MSG ("Crawled %u directories with %u workers (%u steals) in %lf seconds",
+                 n_batches, self->n_workers, crawl.n_steals, g_timer_elapsed (timer, NULL));
+
+  g_free (workers);
+  g_free (crawl.deques);
+  g_free (crawl.attributes);
+  g_mutex_clear (&crawl.mutex);
+  g_cond_clear (&crawl.cond);
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    IDE_RETURN (FALSE);
+
+  IDE_RETURN (TRUE);
+}
@@ -0,0 +1,91 @@
+/* ide-directory-crawler.h
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_DIRECTORY_CRAWLER_H
+#define IDE_DIRECTORY_CRAWLER_H
+
+#include <gio/gio.h>
+
+#include "ide-types.h"
+
+G_BEGIN_DECLS
+
+#define IDE_TYPE_DIRECTORY_CRAWLER (ide_directory_crawler_get_type())
+
+G_DECLARE_FINAL_TYPE (IdeDirectoryCrawler, ide_directory_crawler, IDE, DIRECTORY_CRAWLER, GObject)
+
+/**
+ * IdeDirectoryCrawlerFunc:
+ * @directory: the #GFile of the directory
+ * @relative_path: the path of @directory relative to the root, or "" for
+ *   the root directory itself
+ * @directory_info: (nullable): the #GFileInfo for @directory
+ * @children: (nullable) (element-type GFileInfo): the non-ignored children
+ *   of @directory, or %NULL if the directory was not enumerated because
+ *   the reuse function provided its subdirectories
+ * @user_data: closure data for the callback
+ *
+ * Called once for each directory that was crawled. This is always called
+ * from the thread that called ide_directory_crawler_run(), one directory at
+ * a time, in no particular order.
+ */
+typedef void (*IdeDirectoryCrawlerFunc) (GFile       *directory,
+                                         const gchar *relative_path,
+                                         GFileInfo   *directory_info,
+                                         GPtrArray   *children,
+                                         gpointer     user_data);
+
+/**
+ * IdeDirectoryCrawlerReuseFunc:
+ * @directory: the #GFile of the directory
+ * @relative_path: the path of @directory relative to the root
+ * @directory_info: the #GFileInfo for @directory
+ * @user_data: closure data for the callback
+ *
+ * Allows the consumer to skip enumerating a directory whose contents it
+ * already knows, such as from a cache which is still valid according to
+ * @directory_info. This is called from worker threads.
+ *
+ * Returns: (transfer full) (nullable): the names of the subdirectories
+ *   to descend into, or %NULL to enumerate @directory.
+ */
+typedef gchar **(*IdeDirectoryCrawlerReuseFunc) (GFile       *directory,
+                                                 const gchar *relative_path,
+                                                 GFileInfo   *directory_info,
+                                                 gpointer     user_data);
+
+IdeDirectoryCrawler *ide_directory_crawler_new            (GFile                         *root_directory);
+void                 ide_directory_crawler_set_vcs        (IdeDirectoryCrawler           *self,
+                                                           IdeVcs                        *vcs);
+void                 ide_directory_crawler_set_attributes (IdeDirectoryCrawler           *self,
+                                                           const gchar                   *attributes);
+void                 ide_directory_crawler_set_n_workers  (IdeDirectoryCrawler           *self,
+                                                           guint                          n_workers);
+void                 ide_directory_crawler_set_reuse_func (IdeDirectoryCrawler           *self,
+                                                           IdeDirectoryCrawlerReuseFunc   reuse_func,
+                                                           gpointer                       reuse_data,
+                                                           GDestroyNotify                 reuse_data_destroy);
+gboolean             ide_directory_crawler_run            (IdeDirectoryCrawler           *self,
+                                                           GCancellable                  *cancellable,
+                                                           IdeDirectoryCrawlerFunc        func,
+                                                           gpointer                       user_data,
+                                                           GError                       **error);
+
+G_END_DECLS
+
+#endif /* IDE_DIRECTORY_CRAWLER_H */
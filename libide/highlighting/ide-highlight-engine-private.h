@@ -0,0 +1,33 @@
+/* ide-highlight-engine-private.h
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+#include "highlighting/ide-highlight-engine.h"
+
+G_BEGIN_DECLS
+
+void _ide_highlight_engine_add_view      (IdeHighlightEngine *self,
+                                          GtkTextView        *view);
+void _ide_highlight_engine_remove_view   (IdeHighlightEngine *self,
+                                          GtkTextView        *view);
+void _ide_highlight_engine_queue_visible (IdeHighlightEngine *self);
+
+G_END_DECLS
@@ -27,10 +27,14 @@
 #include "ide-types.h"
 
 #include "highlighting/ide-highlight-engine.h"
+#include "highlighting/ide-highlight-engine-private.h"
 #include "plugins/ide-extension-adapter.h"
 
 #define HIGHLIGHT_QUANTA_USEC 5000
 #define PRIVATE_TAG_PREFIX    "gb-private-tag"
+#define PRIORITY_LINES        150
+#define VISIBLE_PRIORITY      (G_PRIORITY_HIGH_IDLE + 15)
+#define OFFSCREEN_PRIORITY    (G_PRIORITY_LOW + 1)
 
 struct _IdeHighlightEngine
 {
@@ -46,16 +50,51 @@ struct _IdeHighlightEngine
   GtkTextMark         *invalid_begin;
   GtkTextMark         *invalid_end;
 
+  /*
+   * Views showing the buffer, so that the visible part of the invalid
+   * region can be highlighted first. The clean marks cover a range within
+   * the invalid region which has already been highlighted out of order.
+   */
+  GPtrArray           *views;
+  GtkTextMark         *clean_begin;
+  GtkTextMark         *clean_end;
+  gint64               visible_invalid_at;
+
   GSList              *private_tags;
   GSList              *public_tags;
 
   gint64               quanta_expiration;
 
   guint                work_timeout;
+  gint                 work_priority;
+
+  /*
+   * State for highlighters implementing update_async(). The runs are
+   * computed from a snapshot of [snapshot_begin, snapshot_end), and
+   * dirty_offset tracks the lowest offset invalidated since then. Runs
+   * ending before dirty_offset are still valid and may be applied.
+   */
+  GCancellable        *cancellable;
+  GArray              *runs;
+  GHashTable          *run_tags;
+  guint                run_pos;
+  guint                run_priority_begin;
+  guint                run_priority_end;
+  guint                snapshot_begin;
+  guint                snapshot_end;
+  guint                dirty_offset;
+  guint                generation;
 
   guint                enabled : 1;
+  guint                computing : 1;
 };
 
+typedef struct
+{
+  IdeHighlightEngine *self;
+  guint               generation;
+} UpdateRequest;
+
 G_DEFINE_TYPE (IdeHighlightEngine, ide_highlight_engine, IDE_TYPE_OBJECT)
 
 enum {
@@ -68,6 +107,11 @@ enum {
 static GParamSpec *properties [LAST_PROP];
 static GQuark      engineQuark;
 
+DZL_DEFINE_COUNTER (visible_updates, "IdeHighlightEngine", "Visible Updates", "Number of times the visible region was brought up to date")
+DZL_DEFINE_COUNTER (visible_latency, "IdeHighlightEngine", "Visible Latency", "Total microseconds from invalidation until the visible region was highlighted")
+
+static void ide_highlight_engine_queue_work (IdeHighlightEngine *self);
+
 static gboolean
 get_invalidation_area (GtkTextIter *begin,
                        GtkTextIter *end)
@@ -295,6 +339,537 @@ ide_highlight_engine_apply_style (const GtkTextIter *begin,
   return IDE_HIGHLIGHT_CONTINUE;
 }
 
+static gboolean
+get_visible_range (IdeHighlightEngine *self,
+                   GtkTextView        *view,
+                   GtkTextIter        *begin,
+                   GtkTextIter        *end)
+{
+  GdkRectangle rect;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (GTK_IS_TEXT_VIEW (view));
+
+  if (!gtk_widget_get_mapped (GTK_WIDGET (view)) ||
+      gtk_text_view_get_buffer (view) != GTK_TEXT_BUFFER (self->buffer))
+    return FALSE;
+
+  gtk_text_view_get_visible_rect (view, &rect);
+  gtk_text_view_get_line_at_y (view, begin, rect.y, NULL);
+  gtk_text_view_get_line_at_y (view, end, rect.y + rect.height, NULL);
+  gtk_text_iter_forward_line (end);
+
+  return TRUE;
+}
+
+static void
+ide_highlight_engine_clear_clean (IdeHighlightEngine *self)
+{
+  GtkTextIter iter;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (self->clean_begin == NULL)
+    return;
+
+  gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (self->buffer), &iter, self->clean_begin);
+  gtk_text_buffer_move_mark (GTK_TEXT_BUFFER (self->buffer), self->clean_end, &iter);
+}
+
+static void
+ide_highlight_engine_invalidate_clean (IdeHighlightEngine *self,
+                                       const GtkTextIter  *begin,
+                                       const GtkTextIter  *end)
+{
+  GtkTextBuffer *buffer;
+  GtkTextIter clean_begin;
+  GtkTextIter clean_end;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (self->clean_begin == NULL)
+    return;
+
+  buffer = GTK_TEXT_BUFFER (self->buffer);
+  gtk_text_buffer_get_iter_at_mark (buffer, &clean_begin, self->clean_begin);
+  gtk_text_buffer_get_iter_at_mark (buffer, &clean_end, self->clean_end);
+
+  if (gtk_text_iter_compare (end, &clean_begin) >= 0 &&
+      gtk_text_iter_compare (begin, &clean_end) <= 0)
+    ide_highlight_engine_clear_clean (self);
+}
+
+/*
+ * Finds the first visible range which is invalid and has not already been
+ * highlighted ahead of the rest of the invalid region.
+ */
+static gboolean
+ide_highlight_engine_get_visible_work (IdeHighlightEngine *self,
+                                       GtkTextIter        *begin,
+                                       GtkTextIter        *end)
+{
+  GtkTextBuffer *buffer;
+  GtkTextIter invalid_begin;
+  GtkTextIter invalid_end;
+  GtkTextIter clean_begin;
+  GtkTextIter clean_end;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (begin != NULL);
+  g_assert (end != NULL);
+
+  /* Asynchronous updates apply the visible runs first on their own */
+  if (self->buffer == NULL || self->views->len == 0 || self->computing || self->runs != NULL)
+    return FALSE;
+
+  buffer = GTK_TEXT_BUFFER (self->buffer);
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &invalid_begin, self->invalid_begin);
+  gtk_text_buffer_get_iter_at_mark (buffer, &invalid_end, self->invalid_end);
+
+  if (gtk_text_iter_compare (&invalid_begin, &invalid_end) >= 0)
+    return FALSE;
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &clean_begin, self->clean_begin);
+  gtk_text_buffer_get_iter_at_mark (buffer, &clean_end, self->clean_end);
+
+  for (guint i = 0; i < self->views->len; i++)
+    {
+      GtkTextView *view = g_ptr_array_index (self->views, i);
+
+      if (!get_visible_range (self, view, begin, end))
+        continue;
+
+      if (gtk_text_iter_compare (begin, &invalid_begin) < 0)
+        *begin = invalid_begin;
+
+      if (gtk_text_iter_compare (end, &invalid_end) > 0)
+        *end = invalid_end;
+
+      /* Continue from where a previous pass over this range stopped */
+      if (gtk_text_iter_compare (&clean_begin, begin) <= 0 &&
+          gtk_text_iter_compare (begin, &clean_end) <= 0)
+        *begin = clean_end;
+
+      if (gtk_text_iter_compare (begin, end) < 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+ide_highlight_engine_visible_done (IdeHighlightEngine *self)
+{
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (self->visible_invalid_at != 0)
+    {
+      DZL_COUNTER_INC (visible_updates);
+      DZL_COUNTER_ADD (visible_latency, g_get_monotonic_time () - self->visible_invalid_at);
+      self->visible_invalid_at = 0;
+    }
+}
+
+static void
+ide_highlight_engine_cancel_async (IdeHighlightEngine *self)
+{
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  self->generation++;
+  self->computing = FALSE;
+
+  if (self->cancellable != NULL)
+    {
+      g_cancellable_cancel (self->cancellable);
+      g_clear_object (&self->cancellable);
+    }
+
+  g_clear_pointer (&self->runs, g_array_unref);
+
+  if (self->run_tags != NULL)
+    g_hash_table_remove_all (self->run_tags);
+}
+
+static void
+ide_highlight_engine_mark_dirty (IdeHighlightEngine *self,
+                                 guint               offset)
+{
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  self->dirty_offset = MIN (self->dirty_offset, offset);
+}
+
+static void
+coalesce_runs (GArray *runs)
+{
+  guint j = 0;
+
+  g_assert (runs != NULL);
+
+  for (guint i = 0; i < runs->len; i++)
+    {
+      const IdeHighlightRun *run = &g_array_index (runs, IdeHighlightRun, i);
+
+      if (j > 0)
+        {
+          IdeHighlightRun *prev = &g_array_index (runs, IdeHighlightRun, j - 1);
+
+          if (prev->offset + prev->length == run->offset &&
+              g_strcmp0 (prev->style_name, run->style_name) == 0)
+            {
+              prev->length += run->length;
+              continue;
+            }
+        }
+
+      g_array_index (runs, IdeHighlightRun, j++) = *run;
+    }
+
+  g_array_set_size (runs, j);
+}
+
+static guint
+find_run (GArray *runs,
+          guint   offset)
+{
+  guint lo = 0;
+  guint hi = runs->len;
+
+  /* Index of the first run beginning at or after @offset */
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (g_array_index (runs, IdeHighlightRun, mid).offset < offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static void
+ide_highlight_engine_get_priority_range (IdeHighlightEngine *self,
+                                         guint              *begin,
+                                         guint              *end)
+{
+  GtkTextBuffer *buffer;
+  GtkTextIter iter;
+  gboolean found = FALSE;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (begin != NULL);
+  g_assert (end != NULL);
+
+  *begin = G_MAXUINT;
+  *end = 0;
+
+  for (guint i = 0; i < self->views->len; i++)
+    {
+      GtkTextView *view = g_ptr_array_index (self->views, i);
+      GtkTextIter view_begin;
+      GtkTextIter view_end;
+
+      if (get_visible_range (self, view, &view_begin, &view_end))
+        {
+          *begin = MIN (*begin, (guint)gtk_text_iter_get_offset (&view_begin));
+          *end = MAX (*end, (guint)gtk_text_iter_get_offset (&view_end));
+          found = TRUE;
+        }
+    }
+
+  if (found)
+    return;
+
+  /* Without a visible view, the area around the cursor is the best guess */
+  buffer = GTK_TEXT_BUFFER (self->buffer);
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter, gtk_text_buffer_get_insert (buffer));
+  gtk_text_iter_backward_lines (&iter, PRIORITY_LINES);
+  *begin = gtk_text_iter_get_offset (&iter);
+  gtk_text_iter_forward_lines (&iter, PRIORITY_LINES * 2);
+  *end = gtk_text_iter_get_offset (&iter);
+}
+
+static void
+ide_highlight_engine_apply_run (IdeHighlightEngine    *self,
+                                const IdeHighlightRun *run)
+{
+  GtkSourceBuffer *source_buffer;
+  GtkTextBuffer *buffer;
+  GtkTextTag *tag;
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (run != NULL);
+
+  /* The text for this run has changed since the snapshot */
+  if (run->offset + run->length > self->dirty_offset)
+    return;
+
+  buffer = GTK_TEXT_BUFFER (self->buffer);
+  source_buffer = GTK_SOURCE_BUFFER (self->buffer);
+
+  gtk_text_buffer_get_iter_at_offset (buffer, &begin, run->offset);
+
+  if (gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "string") ||
+      gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "path") ||
+      gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "comment"))
+    return;
+
+  end = begin;
+  gtk_text_iter_forward_chars (&end, run->length);
+
+  /* Avoid building the private tag name for every run */
+  if (!(tag = g_hash_table_lookup (self->run_tags, run->style_name)))
+    {
+      tag = get_tag_from_style (self, run->style_name, TRUE);
+      g_hash_table_insert (self->run_tags, (gpointer)run->style_name, tag);
+    }
+
+  gtk_text_buffer_apply_tag (buffer, tag, &begin, &end);
+}
+
+static gboolean
+ide_highlight_engine_finish_apply (IdeHighlightEngine *self)
+{
+  GtkTextBuffer *buffer;
+  GtkTextIter iter;
+  guint valid_end;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  buffer = GTK_TEXT_BUFFER (self->buffer);
+  valid_end = MIN (self->snapshot_end, self->dirty_offset);
+
+  g_clear_pointer (&self->runs, g_array_unref);
+
+  if (self->dirty_offset == G_MAXUINT)
+    {
+      gtk_text_buffer_get_start_iter (buffer, &iter);
+      gtk_text_buffer_move_mark (buffer, self->invalid_begin, &iter);
+      gtk_text_buffer_move_mark (buffer, self->invalid_end, &iter);
+      return FALSE;
+    }
+
+  /*
+   * Something was invalidated while we were working. Everything before
+   * valid_end has been highlighted, so only the remainder needs another pass.
+   */
+  if (valid_end > self->snapshot_begin)
+    {
+      gtk_text_buffer_get_iter_at_offset (buffer, &iter, valid_end);
+      gtk_text_buffer_move_mark (buffer, self->invalid_begin, &iter);
+    }
+
+  return TRUE;
+}
+
+static void
+ide_highlight_engine_begin_apply (IdeHighlightEngine *self,
+                                  GArray             *runs)
+{
+  GtkTextBuffer *buffer;
+  GtkTextIter begin;
+  GtkTextIter end;
+  guint valid_end;
+  guint priority_begin;
+  guint priority_end;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (runs != NULL);
+  g_assert (self->runs == NULL);
+
+  buffer = GTK_TEXT_BUFFER (self->buffer);
+  valid_end = MIN (self->snapshot_end, self->dirty_offset);
+
+  /*
+   * The previous styling is left in place while computing so that the
+   * buffer does not flicker. Clear it now for the part of the snapshot
+   * which has not been modified since.
+   */
+  if (valid_end > self->snapshot_begin)
+    {
+      gtk_text_buffer_get_iter_at_offset (buffer, &begin, self->snapshot_begin);
+      gtk_text_buffer_get_iter_at_offset (buffer, &end, valid_end);
+
+      for (const GSList *iter = self->private_tags; iter; iter = iter->next)
+        gtk_text_buffer_remove_tag (buffer, iter->data, &begin, &end);
+    }
+
+  coalesce_runs (runs);
+
+  self->runs = runs;
+  self->run_pos = 0;
+
+  /* Apply the runs the user is most likely looking at immediately */
+  ide_highlight_engine_get_priority_range (self, &priority_begin, &priority_end);
+  self->run_priority_begin = find_run (runs, priority_begin);
+  self->run_priority_end = find_run (runs, priority_end);
+
+  for (guint i = self->run_priority_begin; i < self->run_priority_end; i++)
+    ide_highlight_engine_apply_run (self, &g_array_index (runs, IdeHighlightRun, i));
+
+  ide_highlight_engine_visible_done (self);
+
+  IDE_TRACE_MSG ("Applied %u of %u runs immediately",
+                 self->run_priority_end - self->run_priority_begin,
+                 runs->len);
+
+  IDE_EXIT;
+}
+
+static void
+ide_highlight_engine_update_cb (GObject      *object,
+                                GAsyncResult *result,
+                                gpointer      user_data)
+{
+  IdeHighlighter *highlighter = (IdeHighlighter *)object;
+  UpdateRequest *request = user_data;
+  g_autoptr(IdeHighlightEngine) self = request->self;
+  g_autoptr(GArray) runs = NULL;
+  g_autoptr(GError) error = NULL;
+  guint generation = request->generation;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_HIGHLIGHTER (highlighter));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  g_slice_free (UpdateRequest, request);
+
+  runs = ide_highlighter_update_finish (highlighter, result, &error);
+
+  /* The buffer or highlighter changed, or we were cancelled */
+  if (generation != self->generation)
+    IDE_EXIT;
+
+  self->computing = FALSE;
+  g_clear_object (&self->cancellable);
+
+  if (runs == NULL)
+    {
+      g_debug ("%s: %s", G_OBJECT_TYPE_NAME (highlighter), error->message);
+      IDE_EXIT;
+    }
+
+  if (!self->enabled || self->buffer == NULL)
+    IDE_EXIT;
+
+  ide_highlight_engine_begin_apply (self, g_steal_pointer (&runs));
+  ide_highlight_engine_queue_work (self);
+
+  IDE_EXIT;
+}
+
+static gboolean
+ide_highlight_engine_tick_async (IdeHighlightEngine *self)
+{
+  g_autoptr(GBytes) bytes = NULL;
+  g_autofree gchar *text = NULL;
+  UpdateRequest *request;
+  GtkTextBuffer *buffer;
+  gsize length;
+  GtkTextIter invalid_begin;
+  GtkTextIter invalid_end;
+  GtkTextIter iter;
+
+  IDE_PROBE;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  buffer = GTK_TEXT_BUFFER (self->buffer);
+
+  /* Continue applying the runs from the last update */
+  if (self->runs != NULL)
+    {
+      self->quanta_expiration = g_get_monotonic_time () + HIGHLIGHT_QUANTA_USEC;
+
+      while (self->run_pos < self->runs->len)
+        {
+          if (self->run_pos == self->run_priority_begin &&
+              self->run_priority_end > self->run_priority_begin)
+            {
+              self->run_pos = self->run_priority_end;
+              continue;
+            }
+
+          ide_highlight_engine_apply_run (self, &g_array_index (self->runs, IdeHighlightRun, self->run_pos));
+          self->run_pos++;
+
+          if ((self->run_pos & 0x3F) == 0 && g_get_monotonic_time () >= self->quanta_expiration)
+            return TRUE;
+        }
+
+      return ide_highlight_engine_finish_apply (self);
+    }
+
+  /* Wait for the highlighter, the callback will queue more work */
+  if (self->computing)
+    return FALSE;
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &invalid_begin, self->invalid_begin);
+  gtk_text_buffer_get_iter_at_mark (buffer, &invalid_end, self->invalid_end);
+
+  if (gtk_text_iter_compare (&invalid_begin, &invalid_end) >= 0)
+    {
+      gtk_text_buffer_get_start_iter (buffer, &iter);
+      gtk_text_buffer_move_mark (buffer, self->invalid_begin, &iter);
+      gtk_text_buffer_move_mark (buffer, self->invalid_end, &iter);
+      return FALSE;
+    }
+
+  IDE_TRACE_MSG ("Highlight Range [%u:%u,%u:%u] (%s) asynchronously",
+                 gtk_text_iter_get_line (&invalid_begin),
+                 gtk_text_iter_get_line_offset (&invalid_begin),
+                 gtk_text_iter_get_line (&invalid_end),
+                 gtk_text_iter_get_line_offset (&invalid_end),
+                 G_OBJECT_TYPE_NAME (self->highlighter));
+
+  /* Include hidden characters so that offsets match the buffer */
+  text = gtk_text_buffer_get_slice (buffer, &invalid_begin, &invalid_end, TRUE);
+  length = strlen (text);
+  bytes = g_bytes_new_take (g_steal_pointer (&text), length);
+
+  self->snapshot_begin = gtk_text_iter_get_offset (&invalid_begin);
+  self->snapshot_end = gtk_text_iter_get_offset (&invalid_end);
+  self->dirty_offset = G_MAXUINT;
+  self->computing = TRUE;
+  self->cancellable = g_cancellable_new ();
+
+  request = g_slice_new0 (UpdateRequest);
+  request->self = g_object_ref (self);
+  request->generation = self->generation;
+
+  ide_highlighter_update_async (self->highlighter,
+                                bytes,
+                                self->snapshot_begin,
+                                self->cancellable,
+                                ide_highlight_engine_update_cb,
+                                request);
+
+  return FALSE;
+}
+
+static void
+ide_highlight_engine_remove_private_tags (IdeHighlightEngine *self,
+                                          const GtkTextIter  *begin,
+                                          const GtkTextIter  *end)
+{
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  for (const GSList *iter = self->private_tags; iter; iter = iter->next)
+    gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self->buffer),
+                                GTK_TEXT_TAG (iter->data),
+                                begin,
+                                end);
+}
+
 static gboolean
 ide_highlight_engine_tick (IdeHighlightEngine *self)
 {
@@ -302,7 +877,11 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
   GtkTextIter iter;
   GtkTextIter invalid_begin;
   GtkTextIter invalid_end;
-  GSList *tags_iter;
+  GtkTextIter visible_begin;
+  GtkTextIter visible_end;
+  GtkTextIter clean_begin;
+  GtkTextIter clean_end;
+  GtkTextIter stop;
 
   IDE_PROBE;
 
@@ -312,6 +891,9 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
   g_assert (self->invalid_begin != NULL);
   g_assert (self->invalid_end != NULL);
 
+  if (ide_highlighter_can_update_async (self->highlighter))
+    return ide_highlight_engine_tick_async (self);
+
   self->quanta_expiration = g_get_monotonic_time () + HIGHLIGHT_QUANTA_USEC;
 
   buffer = GTK_TEXT_BUFFER (self->buffer);
@@ -329,17 +911,70 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
   if (gtk_text_iter_compare (&invalid_begin, &invalid_end) >= 0)
     IDE_GOTO (up_to_date);
 
-  /* Clear all our tags */
-  for (tags_iter = self->private_tags; tags_iter; tags_iter = tags_iter->next)
-    gtk_text_buffer_remove_tag (buffer,
-                                GTK_TEXT_TAG (tags_iter->data),
-                                &invalid_begin,
-                                &invalid_end);
+  /*
+   * Highlight whatever is on screen before the rest of the invalid region.
+   * The range that was processed is tracked by the clean marks so that the
+   * sweep below can skip over it.
+   */
+  if (ide_highlight_engine_get_visible_work (self, &visible_begin, &visible_end))
+    {
+      gtk_text_buffer_get_iter_at_mark (buffer, &clean_end, self->clean_end);
+
+      if (!gtk_text_iter_equal (&visible_begin, &clean_end))
+        {
+          gtk_text_buffer_move_mark (buffer, self->clean_begin, &visible_begin);
+          gtk_text_buffer_move_mark (buffer, self->clean_end, &visible_begin);
+        }
+
+      ide_highlight_engine_remove_private_tags (self, &visible_begin, &visible_end);
+
+      iter = visible_begin;
+
+      ide_highlighter_update (self->highlighter, ide_highlight_engine_apply_style,
+                              &visible_begin, &visible_end, &iter);
+
+      if (gtk_text_iter_equal (&iter, &visible_begin))
+        return FALSE;
+
+      gtk_text_buffer_move_mark (buffer, self->clean_end, &iter);
+
+      return TRUE;
+    }
+
+  ide_highlight_engine_visible_done (self);
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &clean_begin, self->clean_begin);
+  gtk_text_buffer_get_iter_at_mark (buffer, &clean_end, self->clean_end);
+
+  /* Skip past anything which was already highlighted out of order */
+  if (!gtk_text_iter_equal (&clean_begin, &clean_end) &&
+      gtk_text_iter_compare (&invalid_begin, &clean_begin) >= 0)
+    {
+      if (gtk_text_iter_compare (&invalid_begin, &clean_end) < 0)
+        invalid_begin = clean_end;
+
+      ide_highlight_engine_clear_clean (self);
+      gtk_text_buffer_move_mark (buffer, self->invalid_begin, &invalid_begin);
+
+      if (gtk_text_iter_compare (&invalid_begin, &invalid_end) >= 0)
+        IDE_GOTO (up_to_date);
+
+      gtk_text_buffer_get_iter_at_mark (buffer, &clean_begin, self->clean_begin);
+      clean_end = clean_begin;
+    }
+
+  /* Stop at the clean range, if any, so it is not highlighted twice */
+  stop = invalid_end;
+  if (!gtk_text_iter_equal (&clean_begin, &clean_end) &&
+      gtk_text_iter_compare (&clean_begin, &stop) < 0)
+    stop = clean_begin;
+
+  ide_highlight_engine_remove_private_tags (self, &invalid_begin, &stop);
 
   iter = invalid_begin;
 
   ide_highlighter_update (self->highlighter, ide_highlight_engine_apply_style,
-                          &invalid_begin, &invalid_end, &iter);
+                          &invalid_begin, &stop, &iter);
 
   if (gtk_text_iter_compare (&iter, &invalid_end) >= 0)
     IDE_GOTO (up_to_date);
@@ -353,13 +988,31 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
   return TRUE;
 
 up_to_date:
+  ide_highlight_engine_visible_done (self);
+
   gtk_text_buffer_get_start_iter (buffer, &iter);
   gtk_text_buffer_move_mark (buffer, self->invalid_begin, &iter);
   gtk_text_buffer_move_mark (buffer, self->invalid_end, &iter);
+  gtk_text_buffer_move_mark (buffer, self->clean_begin, &iter);
+  gtk_text_buffer_move_mark (buffer, self->clean_end, &iter);
 
   return FALSE;
 }
 
+static gint
+ide_highlight_engine_get_work_priority (IdeHighlightEngine *self)
+{
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (ide_highlight_engine_get_visible_work (self, &begin, &end))
+    return VISIBLE_PRIORITY;
+
+  return OFFSCREEN_PRIORITY;
+}
+
 static gboolean
 ide_highlight_engine_work_timeout_handler (gpointer data)
 {
@@ -370,7 +1023,16 @@ ide_highlight_engine_work_timeout_handler (gpointer data)
   if (self->enabled)
     {
       if (ide_highlight_engine_tick (self))
-        return G_SOURCE_CONTINUE;
+        {
+          /* Requeue if the visible region was finished or became invalid */
+          if (ide_highlight_engine_get_work_priority (self) == self->work_priority)
+            return G_SOURCE_CONTINUE;
+
+          self->work_timeout = 0;
+          ide_highlight_engine_queue_work (self);
+
+          return G_SOURCE_REMOVE;
+        }
     }
 
   self->work_timeout = 0;
@@ -381,11 +1043,32 @@ ide_highlight_engine_work_timeout_handler (gpointer data)
 static void
 ide_highlight_engine_queue_work (IdeHighlightEngine *self)
 {
+  gint priority;
+
   g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
 
-  if ((self->highlighter == NULL) || (self->buffer == NULL) || (self->work_timeout != 0))
+  if ((self->highlighter == NULL) || (self->buffer == NULL))
     return;
 
+  /*
+   * Work on the visible region runs just before the redraw so that the
+   * next frame is drawn with it highlighted. Everything else is processed
+   * at low priority so that it does not compete with input or scrolling.
+   */
+  priority = ide_highlight_engine_get_work_priority (self);
+
+  if (priority == VISIBLE_PRIORITY && self->visible_invalid_at == 0)
+    self->visible_invalid_at = g_get_monotonic_time ();
+
+  if (self->work_timeout != 0)
+    {
+      if (self->work_priority <= priority)
+        return;
+
+      g_source_remove (self->work_timeout);
+      self->work_timeout = 0;
+    }
+
   /*
    * NOTE: It would be really nice if we could use the GdkFrameClock here to
    *       drive the next update instead of a timeout. It's possible that our
@@ -395,7 +1078,8 @@ ide_highlight_engine_queue_work (IdeHighlightEngine *self)
    *       called and we potentially cause a frame to drop.
    */
 
-  self->work_timeout = gdk_threads_add_idle_full (G_PRIORITY_LOW + 1,
+  self->work_priority = priority;
+  self->work_timeout = gdk_threads_add_idle_full (priority,
                                                   ide_highlight_engine_work_timeout_handler,
                                                   self,
                                                   NULL);
@@ -420,6 +1104,9 @@ invalidate_and_highlight (IdeHighlightEngine *self,
       GtkTextIter end_tmp;
       GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (self->buffer);
 
+      ide_highlight_engine_mark_dirty (self, gtk_text_iter_get_offset (begin));
+      ide_highlight_engine_invalidate_clean (self, begin, end);
+
       gtk_text_buffer_get_iter_at_mark (text_buffer, &begin_tmp, self->invalid_begin);
       gtk_text_buffer_get_iter_at_mark (text_buffer, &end_tmp, self->invalid_end);
 
@@ -462,6 +1149,8 @@ ide_highlight_engine_reload (IdeHighlightEngine *self)
       self->work_timeout = 0;
     }
 
+  ide_highlight_engine_cancel_async (self);
+
   if (self->buffer == NULL)
     IDE_EXIT;
 
@@ -474,6 +1163,7 @@ ide_highlight_engine_reload (IdeHighlightEngine *self)
    */
   gtk_text_buffer_move_mark (buffer, self->invalid_begin, &begin);
   gtk_text_buffer_move_mark (buffer, self->invalid_end, &end);
+  ide_highlight_engine_clear_clean (self);
 
   /*
    * Remove our highlight tags from the buffer.
@@ -661,6 +1351,8 @@ ide_highlight_engine__bind_buffer_cb (IdeHighlightEngine *self,
 
   self->invalid_begin = gtk_text_buffer_create_mark (text_buffer, NULL, &begin, TRUE);
   self->invalid_end = gtk_text_buffer_create_mark (text_buffer, NULL, &end, FALSE);
+  self->clean_begin = gtk_text_buffer_create_mark (text_buffer, NULL, &begin, TRUE);
+  self->clean_end = gtk_text_buffer_create_mark (text_buffer, NULL, &begin, FALSE);
 
   ide_highlight_engine__notify_style_scheme_cb (self, NULL, buffer);
   ide_highlight_engine__notify_language_cb (self, NULL, buffer);
@@ -693,15 +1385,22 @@ ide_highlight_engine__unbind_buffer_cb (IdeHighlightEngine  *self,
       self->work_timeout = 0;
     }
 
+  ide_highlight_engine_cancel_async (self);
+
   g_object_set_qdata (G_OBJECT (text_buffer), engineQuark, NULL);
 
   tag_table = gtk_text_buffer_get_tag_table (text_buffer);
 
   gtk_text_buffer_delete_mark (text_buffer, self->invalid_begin);
   gtk_text_buffer_delete_mark (text_buffer, self->invalid_end);
+  gtk_text_buffer_delete_mark (text_buffer, self->clean_begin);
+  gtk_text_buffer_delete_mark (text_buffer, self->clean_end);
 
   self->invalid_begin = NULL;
   self->invalid_end = NULL;
+  self->clean_begin = NULL;
+  self->clean_end = NULL;
+  self->visible_invalid_at = 0;
 
   gtk_text_buffer_get_bounds (text_buffer, &begin, &end);
 
@@ -804,14 +1503,30 @@ ide_highlight_engine_dispose (GObject *object)
 {
   IdeHighlightEngine *self = (IdeHighlightEngine *)object;
 
+  ide_highlight_engine_cancel_async (self);
+
+  while (self->views->len > 0)
+    _ide_highlight_engine_remove_view (self, g_ptr_array_index (self->views, self->views->len - 1));
+
   g_clear_object (&self->signal_group);
   g_clear_object (&self->extension);
   g_clear_object (&self->highlighter);
   g_clear_object (&self->settings);
+  g_clear_pointer (&self->run_tags, g_hash_table_unref);
 
   G_OBJECT_CLASS (ide_highlight_engine_parent_class)->dispose (object);
 }
 
+static void
+ide_highlight_engine_finalize (GObject *object)
+{
+  IdeHighlightEngine *self = (IdeHighlightEngine *)object;
+
+  g_clear_pointer (&self->views, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (ide_highlight_engine_parent_class)->finalize (object);
+}
+
 static void
 ide_highlight_engine_get_property (GObject    *object,
                                    guint       prop_id,
@@ -861,6 +1576,7 @@ ide_highlight_engine_class_init (IdeHighlightEngineClass *klass)
 
   object_class->constructed = ide_highlight_engine_constructed;
   object_class->dispose = ide_highlight_engine_dispose;
+  object_class->finalize = ide_highlight_engine_finalize;
   object_class->get_property = ide_highlight_engine_get_property;
   object_class->set_property = ide_highlight_engine_set_property;
 
@@ -889,6 +1605,9 @@ ide_highlight_engine_init (IdeHighlightEngine *self)
   self->settings = g_settings_new ("org.gnome.builder.code-insight");
   self->enabled = g_settings_get_boolean (self->settings, "semantic-highlighting");
   self->signal_group = dzl_signal_group_new (IDE_TYPE_BUFFER);
+  self->run_tags = g_hash_table_new (NULL, NULL);
+  self->views = g_ptr_array_new ();
+  self->dirty_offset = G_MAXUINT;
 
   dzl_signal_group_connect_object (self->signal_group,
                                    "insert-text",
@@ -998,6 +1717,8 @@ ide_highlight_engine_rebuild (IdeHighlightEngine *self)
       gtk_text_buffer_get_bounds (buffer, &begin, &end);
       gtk_text_buffer_move_mark (buffer, self->invalid_begin, &begin);
       gtk_text_buffer_move_mark (buffer, self->invalid_end, &end);
+      ide_highlight_engine_clear_clean (self);
+      ide_highlight_engine_mark_dirty (self, 0);
       ide_highlight_engine_queue_work (self);
     }
 
@@ -1039,6 +1760,9 @@ ide_highlight_engine_invalidate (IdeHighlightEngine *self,
 
   buffer = GTK_TEXT_BUFFER (self->buffer);
 
+  ide_highlight_engine_mark_dirty (self, gtk_text_iter_get_offset (begin));
+  ide_highlight_engine_invalidate_clean (self, begin, end);
+
   gtk_text_buffer_get_iter_at_mark (buffer, &mark_begin, self->invalid_begin);
   gtk_text_buffer_get_iter_at_mark (buffer, &mark_end, self->invalid_end);
 
@@ -1101,3 +1825,75 @@ ide_highlight_engine_unpause (IdeHighlightEngine *self)
       ide_highlight_engine_reload (self);
     }
 }
+
+static void
+ide_highlight_engine_view_finalized (gpointer  data,
+                                     GObject  *where_the_object_was)
+{
+  IdeHighlightEngine *self = data;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  g_ptr_array_remove (self->views, where_the_object_was);
+}
+
+/**
+ * _ide_highlight_engine_add_view:
+ * @self: an #IdeHighlightEngine
+ * @view: a #GtkTextView displaying the buffer
+ *
+ * Registers @view so that the range it displays is highlighted before the
+ * rest of the invalid region. @view is weakly referenced.
+ */
+void
+_ide_highlight_engine_add_view (IdeHighlightEngine *self,
+                                GtkTextView        *view)
+{
+  g_return_if_fail (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_return_if_fail (GTK_IS_TEXT_VIEW (view));
+
+  for (guint i = 0; i < self->views->len; i++)
+    {
+      if (g_ptr_array_index (self->views, i) == (gpointer)view)
+        return;
+    }
+
+  g_object_weak_ref (G_OBJECT (view), ide_highlight_engine_view_finalized, self);
+  g_ptr_array_add (self->views, view);
+}
+
+void
+_ide_highlight_engine_remove_view (IdeHighlightEngine *self,
+                                   GtkTextView        *view)
+{
+  g_return_if_fail (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_return_if_fail (GTK_IS_TEXT_VIEW (view));
+
+  if (g_ptr_array_remove (self->views, view))
+    g_object_weak_unref (G_OBJECT (view), ide_highlight_engine_view_finalized, self);
+}
+
+/**
+ * _ide_highlight_engine_queue_visible:
+ * @self: an #IdeHighlightEngine
+ *
+ * Called by views as they draw so that invalid ranges scrolled into view
+ * are given priority over the rest of the buffer.
+ */
+void
+_ide_highlight_engine_queue_visible (IdeHighlightEngine *self)
+{
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_return_if_fail (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (!self->enabled || self->buffer == NULL || self->invalid_begin == NULL)
+    return;
+
+  gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (self->buffer), &begin, self->invalid_begin);
+  gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (self->buffer), &end, self->invalid_end);
+
+  if (gtk_text_iter_compare (&begin, &end) < 0)
+    ide_highlight_engine_queue_work (self);
+}
@@ -31,6 +31,25 @@ G_DEFINE_BOXED_TYPE (IdeHighlightIndex, ide_highlight_index,
 
 DZL_DEFINE_COUNTER (instances, "IdeHighlightIndex", "Instances", "Number of indexes")
 
+/*
+ * Once frozen, the index is a minimal perfect hash built with the
+ * "hash, displace, and compress" scheme. Keys are grouped into buckets by
+ * one half of their hash, and each bucket is assigned a displacement which
+ * maps all of its keys to distinct free slots. A lookup is then a single
+ * pass over the word, one displacement fetch, and one comparison.
+ */
+#define KEYS_PER_BUCKET   4
+#define MAX_DISPLACEMENT  (1 << 20)
+#define MAX_SEEDS         8
+#define LOOKUP_BUF_SIZE   256
+
+typedef struct
+{
+  guint32  key_offset;
+  guint32  key_len;
+  gpointer tag;
+} FrozenEntry;
+
 struct _IdeHighlightIndex
 {
   volatile gint  ref_count;
@@ -39,10 +58,62 @@ struct _IdeHighlightIndex
   guint          count;
   gsize          chunk_size;
 
+  /* Mutable state, released when frozen */
   GStringChunk  *strings;
   GHashTable    *index;
+
+  /* Frozen state */
+  gchar         *arena;
+  FrozenEntry   *entries;
+  guint32       *displacements;
+  guint          n_buckets;
+  guint64        seed;
+
+  guint          frozen : 1;
 };
 
+static inline guint64
+mix64 (guint64 h)
+{
+  h ^= h >> 33;
+  h *= G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+  h ^= h >> 33;
+  h *= G_GUINT64_CONSTANT (0xc4ceb9fe1a85ec53);
+  h ^= h >> 33;
+  return h;
+}
+
+static inline guint64
+hash_word (const gchar *word,
+           gsize        len,
+           guint64      seed)
+{
+  guint64 h = G_GUINT64_CONSTANT (0xcbf29ce484222325) ^ seed;
+
+  for (gsize i = 0; i < len; i++)
+    {
+      h ^= (guchar)word[i];
+      h *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+
+  return mix64 (h);
+}
+
+static inline guint
+bucket_for_hash (guint64 h,
+                 guint   n_buckets)
+{
+  return (guint)((h >> 32) % n_buckets);
+}
+
+static inline guint
+slot_for_hash (guint64 h,
+               guint32 displacement,
+               guint   n_slots)
+{
+  return (guint)(mix64 (h ^ (displacement * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15))) % n_slots);
+}
+
 IdeHighlightIndex *
 ide_highlight_index_new (void)
 {
@@ -67,6 +138,7 @@ ide_highlight_index_insert (IdeHighlightIndex *self,
 
   g_assert (self);
   g_assert (tag != NULL);
+  g_return_if_fail (!self->frozen);
 
   if (word == NULL || word[0] == '\0')
     return;
@@ -81,6 +153,286 @@ ide_highlight_index_insert (IdeHighlightIndex *self,
   g_hash_table_insert (self->index, key, tag);
 }
 
+typedef struct
+{
+  guint64      hash;
+  const gchar *key;
+  guint32      key_len;
+  gpointer     tag;
+} BuildKey;
+
+typedef struct
+{
+  guint start;
+  guint len;
+} BuildBucket;
+
+static gint
+compare_bucket_size (gconstpointer a,
+                     gconstpointer b,
+                     gpointer      user_data)
+{
+  const BuildBucket *buckets = user_data;
+  const BuildBucket *ba = &buckets[*(const guint *)a];
+  const BuildBucket *bb = &buckets[*(const guint *)b];
+
+  return (gint)bb->len - (gint)ba->len;
+}
+
+static gboolean
+try_build (BuildKey *keys,
+           guint     n_keys,
+           guint64   seed,
+           guint32  *displacements,
+           guint    *slots,
+           guint     n_buckets)
+{
+  g_autofree BuildBucket *buckets = g_new0 (BuildBucket, n_buckets);
+  g_autofree BuildKey *sorted = g_new (BuildKey, n_keys);
+  g_autofree guint *order = g_new (guint, n_buckets);
+  g_autofree guint8 *taken = g_new0 (guint8, n_keys);
+  guint bucket_slots[64];
+
+  /* Group keys by bucket with a counting sort */
+  for (guint i = 0; i < n_keys; i++)
+    {
+      keys[i].hash = hash_word (keys[i].key, keys[i].key_len, seed);
+      buckets[bucket_for_hash (keys[i].hash, n_buckets)].len++;
+    }
+
+  for (guint i = 0, pos = 0; i < n_buckets; i++)
+    {
+      buckets[i].start = pos;
+      pos += buckets[i].len;
+      buckets[i].len = 0;
+      order[i] = i;
+    }
+
+  for (guint i = 0; i < n_keys; i++)
+    {
+      BuildBucket *bucket = &buckets[bucket_for_hash (keys[i].hash, n_buckets)];
+
+      if (bucket->len == G_N_ELEMENTS (bucket_slots))
+        return FALSE;
+
+      sorted[bucket->start + bucket->len++] = keys[i];
+    }
+
+  /* Place the largest buckets first, while the table is mostly empty */
+  g_qsort_with_data (order, n_buckets, sizeof (guint), compare_bucket_size, buckets);
+
+  for (guint i = 0; i < n_buckets; i++)
+    {
+      const BuildBucket *bucket = &buckets[order[i]];
+      guint32 d;
+
+      if (bucket->len == 0)
+        break;
+
+      for (d = 0; d < MAX_DISPLACEMENT; d++)
+        {
+          guint j;
+
+          for (j = 0; j < bucket->len; j++)
+            {
+              guint slot = slot_for_hash (sorted[bucket->start + j].hash, d, n_keys);
+
+              if (taken[slot])
+                break;
+
+              taken[slot] = 2;
+              bucket_slots[j] = slot;
+            }
+
+          if (j == bucket->len)
+            break;
+
+          /* Release the slots claimed by this attempt */
+          for (guint k = 0; k < j; k++)
+            taken[bucket_slots[k]] = 0;
+        }
+
+      if (d == MAX_DISPLACEMENT)
+        return FALSE;
+
+      displacements[order[i]] = d;
+
+      for (guint j = 0; j < bucket->len; j++)
+        {
+          taken[bucket_slots[j]] = 1;
+          slots[bucket->start + j] = bucket_slots[j];
+        }
+    }
+
+  /* Slots are indexed by bucket order, so hand back the sorted keys */
+  memcpy (keys, sorted, sizeof (BuildKey) * n_keys);
+
+  return TRUE;
+}
+
+/**
+ * ide_highlight_index_freeze:
+ * @self: An #IdeHighlightIndex.
+ *
+ * Compacts @self into an immutable form with all words stored in a single
+ * allocation and a minimal perfect hash for lookups. No more words may be
+ * inserted afterwards.
+ *
+ * Indexes are usually built once on a worker and then only queried, so
+ * this should be called before handing the index to highlighters.
+ */
+void
+ide_highlight_index_freeze (IdeHighlightIndex *self)
+{
+  g_autofree BuildKey *keys = NULL;
+  g_autofree guint32 *displacements = NULL;
+  g_autofree guint *slots = NULL;
+  g_autofree gchar *arena = NULL;
+  g_autofree FrozenEntry *entries = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  guint n_buckets;
+  guint64 seed = 0;
+  gsize pos = 0;
+  guint i = 0;
+
+  g_return_if_fail (self != NULL);
+
+  IDE_ENTRY;
+
+  if (self->frozen)
+    IDE_EXIT;
+
+  /* Offsets are stored as 32-bit integers */
+  if (self->chunk_size > G_MAXUINT32)
+    IDE_EXIT;
+
+  n_buckets = MAX (1, self->count / KEYS_PER_BUCKET);
+  keys = g_new (BuildKey, self->count);
+  arena = g_malloc (MAX (1, self->chunk_size));
+
+  g_hash_table_iter_init (&iter, self->index);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      gsize len = strlen (key);
+
+      memcpy (arena + pos, key, len + 1);
+
+      keys[i].key = arena + pos;
+      keys[i].key_len = len;
+      keys[i].tag = value;
+
+      pos += len + 1;
+      i++;
+    }
+
+  g_assert (i == self->count);
+  g_assert (pos == self->chunk_size);
+
+  displacements = g_new0 (guint32, n_buckets);
+  slots = g_new (guint, self->count);
+
+  for (guint n = 0; n < MAX_SEEDS && self->count > 0; n++)
+    {
+      seed = mix64 (n + 1);
+
+      if (try_build (keys, self->count, seed, displacements, slots, n_buckets))
+        break;
+
+      seed = 0;
+      memset (displacements, 0, sizeof (guint32) * n_buckets);
+    }
+
+  /* Extremely unlikely, but the hash table still works fine */
+  if (seed == 0 && self->count > 0)
+    {
+      g_debug ("Failed to build perfect hash for %u words", self->count);
+      IDE_EXIT;
+    }
+
+  entries = g_new0 (FrozenEntry, MAX (1, self->count));
+
+  for (i = 0; i < self->count; i++)
+    {
+      FrozenEntry *entry = &entries[slots[i]];
+
+      entry->key_offset = keys[i].key - arena;
+      entry->key_len = keys[i].key_len;
+      entry->tag = keys[i].tag;
+    }
+
+  self->arena = g_steal_pointer (&arena);
+  self->entries = g_steal_pointer (&entries);
+  self->displacements = g_steal_pointer (&displacements);
+  self->n_buckets = n_buckets;
+  self->seed = seed;
+  self->frozen = TRUE;
+
+  g_clear_pointer (&self->index, g_hash_table_unref);
+  g_clear_pointer (&self->strings, g_string_chunk_free);
+
+  IDE_EXIT;
+}
+
+/**
+ * ide_highlight_index_lookup_len:
+ * @self: An #IdeHighlightIndex.
+ * @word: the word to look up, which does not need to be %NULL-terminated
+ * @len: the length of @word in bytes, or -1 if it is %NULL-terminated
+ *
+ * Like ide_highlight_index_lookup() but takes a slice of a larger string,
+ * such as a word within a snapshot of a buffer. This does not allocate,
+ * and is safe to call from multiple threads once the index is no longer
+ * being modified.
+ *
+ * Returns: (transfer none) (nullable): Highlighter specific tag.
+ */
+gpointer
+ide_highlight_index_lookup_len (IdeHighlightIndex *self,
+                                const gchar       *word,
+                                gssize             len)
+{
+  g_assert (self);
+  g_assert (word);
+
+  if (len < 0)
+    len = strlen (word);
+
+  if (self->frozen)
+    {
+      const FrozenEntry *entry;
+      guint64 h;
+
+      if (self->count == 0)
+        return NULL;
+
+      h = hash_word (word, len, self->seed);
+      entry = &self->entries[slot_for_hash (h, self->displacements[bucket_for_hash (h, self->n_buckets)], self->count)];
+
+      if (entry->key_len == (gsize)len &&
+          memcmp (self->arena + entry->key_offset, word, len) == 0)
+        return entry->tag;
+
+      return NULL;
+    }
+  else
+    {
+      g_autofree gchar *alloc = NULL;
+      gchar buf[LOOKUP_BUF_SIZE];
+      gchar *key = buf;
+
+      if (len >= (gssize)sizeof buf)
+        key = alloc = g_malloc (len + 1);
+
+      memcpy (key, word, len);
+      key[len] = '\0';
+
+      return g_hash_table_lookup (self->index, key);
+    }
+}
+
 /**
  * ide_highlight_index_lookup:
  * @self: An #IdeHighlightIndex.
@@ -98,6 +450,9 @@ ide_highlight_index_lookup (IdeHighlightIndex *self,
   g_assert (self);
   g_assert (word);
 
+  if (self->frozen)
+    return ide_highlight_index_lookup_len (self, word, -1);
+
   return g_hash_table_lookup (self->index, word);
 }
 
@@ -117,8 +472,11 @@ ide_highlight_index_finalize (IdeHighlightIndex *self)
 {
   IDE_ENTRY;
 
-  g_string_chunk_free (self->strings);
-  g_hash_table_unref (self->index);
+  g_clear_pointer (&self->strings, g_string_chunk_free);
+  g_clear_pointer (&self->index, g_hash_table_unref);
+  g_free (self->arena);
+  g_free (self->entries);
+  g_free (self->displacements);
   g_free (self);
 
   DZL_COUNTER_DEC (instances);
@@ -143,7 +501,13 @@ ide_highlight_index_dump (IdeHighlightIndex *self)
 
   g_assert (self);
 
-  format = g_format_size (self->chunk_size);
-  g_debug ("IdeHighlightIndex (%p) contains %u items and consumes %s.",
-           self, self->count, format);
+  if (self->frozen)
+    format = g_format_size (self->chunk_size +
+                            (sizeof (FrozenEntry) * self->count) +
+                            (sizeof (guint32) * self->n_buckets));
+  else
+    format = g_format_size (self->chunk_size);
+
+  g_debug ("IdeHighlightIndex (%p) contains %u items and consumes %s%s.",
+           self, self->count, format, self->frozen ? " (frozen)" : "");
 }
@@ -27,16 +27,20 @@ G_BEGIN_DECLS
 
 typedef struct _IdeHighlightIndex IdeHighlightIndex;
 
-GType              ide_highlight_index_get_type (void);
-IdeHighlightIndex *ide_highlight_index_new      (void);
-IdeHighlightIndex *ide_highlight_index_ref      (IdeHighlightIndex *self);
-void               ide_highlight_index_unref    (IdeHighlightIndex *self);
-void               ide_highlight_index_insert   (IdeHighlightIndex *self,
-                                                 const gchar       *word,
-                                                 gpointer           tag);
-gpointer           ide_highlight_index_lookup   (IdeHighlightIndex *self,
-                                                 const gchar       *word);
-void               ide_highlight_index_dump     (IdeHighlightIndex *self);
+GType              ide_highlight_index_get_type   (void);
+IdeHighlightIndex *ide_highlight_index_new        (void);
+IdeHighlightIndex *ide_highlight_index_ref        (IdeHighlightIndex *self);
+void               ide_highlight_index_unref      (IdeHighlightIndex *self);
+void               ide_highlight_index_insert     (IdeHighlightIndex *self,
+                                                   const gchar       *word,
+                                                   gpointer           tag);
+void               ide_highlight_index_freeze     (IdeHighlightIndex *self);
+gpointer           ide_highlight_index_lookup     (IdeHighlightIndex *self,
+                                                   const gchar       *word);
+gpointer           ide_highlight_index_lookup_len (IdeHighlightIndex *self,
+                                                   const gchar       *word,
+                                                   gssize             len);
+void               ide_highlight_index_dump       (IdeHighlightIndex *self);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeHighlightIndex, ide_highlight_index_unref)
 
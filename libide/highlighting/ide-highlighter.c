@@ -17,6 +17,7 @@
  */
 
 #include <glib/gi18n.h>
+#include <string.h>
 
 #include "ide-context.h"
 #include "ide-highlighter.h"
@@ -24,6 +25,26 @@
 
 G_DEFINE_INTERFACE (IdeHighlighter, ide_highlighter, IDE_TYPE_OBJECT)
 
+typedef struct
+{
+  GBytes               *text;
+  guint                 offset;
+  IdeHighlightWordFunc  func;
+  gpointer              func_data;
+  GDestroyNotify        func_data_destroy;
+} ScanWords;
+
+static void
+scan_words_free (gpointer data)
+{
+  ScanWords *state = data;
+
+  g_clear_pointer (&state->text, g_bytes_unref);
+  if (state->func_data_destroy != NULL)
+    state->func_data_destroy (state->func_data);
+  g_slice_free (ScanWords, state);
+}
+
 static void
 ide_highlighter_real_update (IdeHighlighter       *self,
                              IdeHighlightCallback  callback,
@@ -39,11 +60,20 @@ ide_highlighter_real_set_engine (IdeHighlighter     *self,
 {
 }
 
+static GArray *
+ide_highlighter_real_update_finish (IdeHighlighter  *self,
+                                    GAsyncResult    *result,
+                                    GError         **error)
+{
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 static void
 ide_highlighter_default_init (IdeHighlighterInterface *iface)
 {
   iface->update = ide_highlighter_real_update;
   iface->set_engine = ide_highlighter_real_set_engine;
+  iface->update_finish = ide_highlighter_real_update_finish;
 
   g_object_interface_install_property (iface,
                                        g_param_spec_object ("context",
@@ -92,3 +122,240 @@ ide_highlighter_load (IdeHighlighter *self)
   if (IDE_HIGHLIGHTER_GET_IFACE (self)->load)
     IDE_HIGHLIGHTER_GET_IFACE (self)->load (self);
 }
+
+/**
+ * ide_highlighter_can_update_async:
+ * @self: A #IdeHighlighter.
+ *
+ * Checks if @self implements ide_highlighter_update_async(), so that the
+ * highlight engine may compute styles from a worker thread.
+ *
+ * Returns: %TRUE if @self supports asynchronous updates.
+ */
+gboolean
+ide_highlighter_can_update_async (IdeHighlighter *self)
+{
+  g_return_val_if_fail (IDE_IS_HIGHLIGHTER (self), FALSE);
+
+  return IDE_HIGHLIGHTER_GET_IFACE (self)->update_async != NULL;
+}
+
+/**
+ * ide_highlighter_update_async:
+ * @self: A #IdeHighlighter.
+ * @text: a snapshot of the text to highlight
+ * @offset: the character offset of @text within the buffer
+ * @cancellable: (nullable): A #GCancellable or %NULL.
+ * @callback: A callback to execute upon completion.
+ * @user_data: User data for @callback.
+ *
+ * Asynchronously computes the styles to apply to @text. Unlike
+ * ide_highlighter_update(), the work is performed without access to the
+ * buffer so that it may be done from a worker thread.
+ */
+void
+ide_highlighter_update_async (IdeHighlighter      *self,
+                              GBytes              *text,
+                              guint                offset,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data)
+{
+  g_return_if_fail (IDE_IS_HIGHLIGHTER (self));
+  g_return_if_fail (text != NULL);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+  g_return_if_fail (ide_highlighter_can_update_async (self));
+
+  IDE_HIGHLIGHTER_GET_IFACE (self)->update_async (self, text, offset, cancellable, callback, user_data);
+}
+
+/**
+ * ide_highlighter_update_finish:
+ * @self: A #IdeHighlighter.
+ * @result: A #GAsyncResult provided to the callback.
+ * @error: A location for a #GError, or %NULL.
+ *
+ * Completes an asynchronous request to ide_highlighter_update_async().
+ *
+ * Returns: (transfer full) (element-type Ide.HighlightRun): An array of
+ *   #IdeHighlightRun sorted by offset, or %NULL upon failure.
+ */
+GArray *
+ide_highlighter_update_finish (IdeHighlighter  *self,
+                               GAsyncResult    *result,
+                               GError         **error)
+{
+  g_return_val_if_fail (IDE_IS_HIGHLIGHTER (self), NULL);
+  g_return_val_if_fail (G_IS_ASYNC_RESULT (result), NULL);
+
+  return IDE_HIGHLIGHTER_GET_IFACE (self)->update_finish (self, result, error);
+}
+
+static inline gboolean
+accepts_char (gunichar ch)
+{
+  if (ch < 0x80)
+    return ch == '_' || g_ascii_isalnum (ch);
+
+  return g_unichar_isalnum (ch);
+}
+
+/**
+ * ide_highlighter_scan_words:
+ * @text: the text to scan
+ * @length: the length of @text in bytes
+ * @offset: the character offset of @text within the buffer
+ * @cancellable: (nullable): A #GCancellable or %NULL.
+ * @func: (scope call): a function to resolve the style of a word
+ * @user_data: closure data for @func
+ *
+ * Splits @text into identifier-like words and calls @func for each of them,
+ * collecting an #IdeHighlightRun for every word that resolves to a style.
+ *
+ * This is a helper for implementations of ide_highlighter_update_async() and
+ * is safe to call from a worker thread.
+ *
+ * Returns: (transfer full) (element-type Ide.HighlightRun): An array of
+ *   #IdeHighlightRun sorted by offset.
+ */
+GArray *
+ide_highlighter_scan_words (const gchar          *text,
+                            gsize                 length,
+                            guint                 offset,
+                            GCancellable         *cancellable,
+                            IdeHighlightWordFunc  func,
+                            gpointer              user_data)
+{
+  const gchar *iter = text;
+  const gchar *end = text + length;
+  gchar word_buf[256];
+  GArray *runs;
+  guint pos = offset;
+  guint n_words = 0;
+
+  g_return_val_if_fail (text != NULL || length == 0, NULL);
+  g_return_val_if_fail (func != NULL, NULL);
+
+  runs = g_array_new (FALSE, FALSE, sizeof (IdeHighlightRun));
+
+  while (iter < end)
+    {
+      g_autofree gchar *word_alloc = NULL;
+      const gchar *word_begin;
+      const gchar *style_name;
+      gchar *word = word_buf;
+      guint word_offset;
+      gsize word_len;
+
+      if (!accepts_char (g_utf8_get_char (iter)))
+        {
+          iter = g_utf8_next_char (iter);
+          pos++;
+          continue;
+        }
+
+      word_begin = iter;
+      word_offset = pos;
+
+      while (iter < end && accepts_char (g_utf8_get_char (iter)))
+        {
+          iter = g_utf8_next_char (iter);
+          pos++;
+        }
+
+      word_len = iter - word_begin;
+
+      if G_UNLIKELY (word_len >= sizeof word_buf)
+        word = word_alloc = g_malloc (word_len + 1);
+
+      memcpy (word, word_begin, word_len);
+      word[word_len] = '\0';
+
+      if ((style_name = func (word, word_len, user_data)))
+        {
+          IdeHighlightRun run = { word_offset, pos - word_offset, style_name };
+
+          g_array_append_val (runs, run);
+        }
+
+      if ((++n_words & 0x3FF) == 0 && g_cancellable_is_cancelled (cancellable))
+        break;
+    }
+
+  return runs;
+}
+
+static void
+ide_highlighter_scan_words_worker (GTask        *task,
+                                   gpointer      source_object,
+                                   gpointer      task_data,
+                                   GCancellable *cancellable)
+{
+  ScanWords *state = task_data;
+  g_autoptr(GArray) runs = NULL;
+  const gchar *text;
+  gsize length;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_HIGHLIGHTER (source_object));
+  g_assert (state != NULL);
+
+  text = g_bytes_get_data (state->text, &length);
+  runs = ide_highlighter_scan_words (text, length, state->offset, cancellable,
+                                     state->func, state->func_data);
+
+  if (!g_task_return_error_if_cancelled (task))
+    g_task_return_pointer (task, g_steal_pointer (&runs), (GDestroyNotify)g_array_unref);
+}
+
+/**
+ * ide_highlighter_scan_words_async:
+ * @self: A #IdeHighlighter.
+ * @text: the text to scan
+ * @offset: the character offset of @text within the buffer
+ * @func: (scope notified): a function to resolve the style of a word
+ * @func_data: closure data for @func
+ * @func_data_destroy: (nullable): a #GDestroyNotify for @func_data
+ * @cancellable: (nullable): A #GCancellable or %NULL.
+ * @callback: A callback to execute upon completion.
+ * @user_data: User data for @callback.
+ *
+ * Runs ide_highlighter_scan_words() on a worker thread. This is a convenient
+ * way to implement ide_highlighter_update_async() for highlighters that
+ * resolve styles word by word. @func_data must be safe to use from the worker
+ * thread until @func_data_destroy is called.
+ *
+ * The default implementation of ide_highlighter_update_finish() may be used
+ * to complete the request.
+ */
+void
+ide_highlighter_scan_words_async (IdeHighlighter       *self,
+                                  GBytes               *text,
+                                  guint                 offset,
+                                  IdeHighlightWordFunc  func,
+                                  gpointer              func_data,
+                                  GDestroyNotify        func_data_destroy,
+                                  GCancellable         *cancellable,
+                                  GAsyncReadyCallback   callback,
+                                  gpointer              user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  ScanWords *state;
+
+  g_return_if_fail (IDE_IS_HIGHLIGHTER (self));
+  g_return_if_fail (text != NULL);
+  g_return_if_fail (func != NULL);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  state = g_slice_new0 (ScanWords);
+  state->text = g_bytes_ref (text);
+  state->offset = offset;
+  state->func = func;
+  state->func_data = func_data;
+  state->func_data_destroy = func_data_destroy;
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ide_highlighter_scan_words_async);
+  g_task_set_task_data (task, state, scan_words_free);
+  g_task_run_in_thread (task, ide_highlighter_scan_words_worker);
+}
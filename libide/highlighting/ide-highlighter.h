@@ -43,6 +43,35 @@ typedef IdeHighlightResult (*IdeHighlightCallback) (const GtkTextIter *begin,
                                                     const GtkTextIter *end,
                                                     const gchar       *style_name);
 
+/**
+ * IdeHighlightRun:
+ * @offset: the character offset of the run within the buffer
+ * @length: the number of characters in the run
+ * @style_name: the style to apply, which must be a static or interned string
+ *
+ * A run of text to be styled, as produced by ide_highlighter_update_async().
+ */
+typedef struct
+{
+  guint        offset;
+  guint        length;
+  const gchar *style_name;
+} IdeHighlightRun;
+
+/**
+ * IdeHighlightWordFunc:
+ * @word: the word, which is %NULL-terminated
+ * @word_len: the length of @word in bytes
+ * @user_data: closure data
+ *
+ * Resolves the style for @word. This is called from a worker thread.
+ *
+ * Returns: (nullable): a static or interned style name, or %NULL.
+ */
+typedef const gchar *(*IdeHighlightWordFunc) (const gchar *word,
+                                              gsize        word_len,
+                                              gpointer     user_data);
+
 struct _IdeHighlighterInterface
 {
   GTypeInterface parent_interface;
@@ -70,14 +99,63 @@ struct _IdeHighlighterInterface
                       IdeHighlightEngine   *engine);
 
   void (*load)       (IdeHighlighter       *self);
+
+  /**
+   * IdeHighlighter::update_async:
+   *
+   * Optional asynchronous form of update(). @text contains a snapshot of the
+   * buffer starting at the character offset @offset. The highlighter should
+   * produce an array of #IdeHighlightRun from a worker thread, without
+   * touching the buffer.
+   *
+   * Since context classes are only available from the main thread, the engine
+   * will skip runs which begin within a string, path or comment.
+   *
+   * The default update_finish() propagates the array from a #GTask, such as
+   * one created with ide_highlighter_scan_words_async().
+   */
+  void    (*update_async)  (IdeHighlighter       *self,
+                            GBytes               *text,
+                            guint                 offset,
+                            GCancellable         *cancellable,
+                            GAsyncReadyCallback   callback,
+                            gpointer              user_data);
+  GArray *(*update_finish) (IdeHighlighter       *self,
+                            GAsyncResult         *result,
+                            GError              **error);
 };
 
-void ide_highlighter_load   (IdeHighlighter       *self);
-void ide_highlighter_update (IdeHighlighter       *self,
-                             IdeHighlightCallback  callback,
-                             const GtkTextIter    *range_begin,
-                             const GtkTextIter    *range_end,
-                             GtkTextIter          *location);
+void     ide_highlighter_load             (IdeHighlighter        *self);
+void     ide_highlighter_update           (IdeHighlighter        *self,
+                                           IdeHighlightCallback   callback,
+                                           const GtkTextIter     *range_begin,
+                                           const GtkTextIter     *range_end,
+                                           GtkTextIter           *location);
+gboolean ide_highlighter_can_update_async (IdeHighlighter        *self);
+void     ide_highlighter_update_async     (IdeHighlighter        *self,
+                                           GBytes                *text,
+                                           guint                  offset,
+                                           GCancellable          *cancellable,
+                                           GAsyncReadyCallback    callback,
+                                           gpointer               user_data);
+GArray  *ide_highlighter_update_finish    (IdeHighlighter        *self,
+                                           GAsyncResult          *result,
+                                           GError               **error);
+GArray  *ide_highlighter_scan_words       (const gchar           *text,
+                                           gsize                  length,
+                                           guint                  offset,
+                                           GCancellable          *cancellable,
+                                           IdeHighlightWordFunc   func,
+                                           gpointer               user_data);
+void     ide_highlighter_scan_words_async (IdeHighlighter        *self,
+                                           GBytes                *text,
+                                           guint                  offset,
+                                           IdeHighlightWordFunc   func,
+                                           gpointer               func_data,
+                                           GDestroyNotify         func_data_destroy,
+                                           GCancellable          *cancellable,
+                                           GAsyncReadyCallback    callback,
+                                           gpointer               user_data);
 
 G_END_DECLS
 
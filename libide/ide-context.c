@@ -47,6 +47,7 @@
 #include "projects/ide-recent-projects.h"
 #include "runner/ide-run-manager.h"
 #include "runtimes/ide-runtime-manager.h"
+#include "search/ide-content-index.h"
 #include "search/ide-search-engine.h"
 #include "search/ide-search-provider.h"
 #include "snippets/ide-source-snippets-manager.h"
@@ -69,6 +70,7 @@ struct _IdeContext
   IdeBuildSystem           *build_system;
   gchar                    *build_system_hint;
   IdeConfigurationManager  *configuration_manager;
+  IdeContentIndex          *content_index;
   IdeDiagnosticsManager    *diagnostics_manager;
   IdeDeviceManager         *device_manager;
   IdeDoap                  *doap;
@@ -460,6 +462,22 @@ ide_context_get_search_engine (IdeContext *self)
   return self->search_engine;
 }
 
+/**
+ * ide_context_get_content_index:
+ *
+ * Retrieves the #IdeContentIndex for the context. The index must be
+ * loaded with ide_content_index_load_async() before it can be queried.
+ *
+ * Returns: (transfer none): An #IdeContentIndex.
+ */
+IdeContentIndex *
+ide_context_get_content_index (IdeContext *self)
+{
+  g_return_val_if_fail (IDE_IS_CONTEXT (self), NULL);
+
+  return self->content_index;
+}
+
 /**
  * ide_context_get_service_typed:
  * @service_type: A #GType of the service desired.
@@ -570,6 +588,7 @@ ide_context_finalize (GObject *object)
 
   g_clear_object (&self->build_system);
   g_clear_object (&self->configuration_manager);
+  g_clear_object (&self->content_index);
   g_clear_object (&self->device_manager);
   g_clear_object (&self->doap);
   g_clear_object (&self->project);
@@ -882,6 +901,10 @@ ide_context_init (IdeContext *self)
 
   self->snippets_manager = g_object_new (IDE_TYPE_SOURCE_SNIPPETS_MANAGER, NULL);
 
+  self->content_index = g_object_new (IDE_TYPE_CONTENT_INDEX,
+                                      "context", self,
+                                      NULL);
+
   IDE_EXIT;
 }
 
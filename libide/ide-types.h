@@ -45,6 +45,8 @@ typedef struct _IdeBuildTarget                 IdeBuildTarget;
 typedef struct _IdeConfiguration               IdeConfiguration;
 typedef struct _IdeConfigurationManager        IdeConfigurationManager;
 
+typedef struct _IdeContentIndex                IdeContentIndex;
+
 typedef struct _IdeContext                     IdeContext;
 
 typedef struct _IdeDevice                      IdeDevice;
@@ -82,6 +82,7 @@ G_BEGIN_DECLS
 #include "editor/ide-editor-sidebar.h"
 #include "editor/ide-editor-view-addin.h"
 #include "editor/ide-editor-view.h"
+#include "files/ide-directory-crawler.h"
 #include "files/ide-file-settings.h"
 #include "files/ide-file.h"
 #include "genesis/ide-genesis-addin.h"
@@ -124,6 +125,7 @@ G_BEGIN_DECLS
 #include "runtimes/ide-runtime-manager.h"
 #include "runtimes/ide-runtime-provider.h"
 #include "runtimes/ide-runtime.h"
+#include "search/ide-content-index.h"
 #include "search/ide-search-engine.h"
 #include "search/ide-search-entry.h"
 #include "search/ide-search-provider.h"
@@ -25,6 +25,7 @@
 
 #include "ide-context.h"
 #include "ide-debug.h"
+#include "ide-macros.h"
 
 #include "buffers/ide-buffer.h"
 #include "buffers/ide-buffer-manager.h"
@@ -44,8 +45,68 @@ typedef struct
   GIOStream      *io_stream;
   GHashTable     *diagnostics_by_file;
   GPtrArray      *languages;
+  GHashTable     *journals;
+  guint           flush_source;
+  GHashTable     *pending_calls;
 } IdeLangservClientPrivate;
 
+/*
+ * Queries about a document, such as completion or hover, are only useful
+ * for the most recent state of the document. A newer call with the same
+ * method and document supersedes the previous one. Superseded and
+ * cancelled calls are completed with G_IO_ERROR_CANCELLED immediately,
+ * the peer is sent $/cancelRequest so it can stop working on them, and
+ * their replies are dropped when they arrive.
+ */
+typedef struct
+{
+  IdeLangservClient *self;
+  GCancellable      *cancellable;
+  gulong             cancelled_handler;
+  GVariant          *id;
+  gchar             *key;
+  guint              completed : 1;
+} PendingCall;
+
+static const gchar *supersedable_methods[] = {
+  "textDocument/completion",
+  "textDocument/definition",
+  "textDocument/documentHighlight",
+  "textDocument/documentSymbol",
+  "textDocument/hover",
+  "textDocument/signatureHelp",
+};
+
+/*
+ * Edits to a buffer are not sent to the peer as they happen. Instead they
+ * are recorded in a ChangeJournal, where an edit adjacent to the previous
+ * one is merged into it (such as typing, pasting or backspacing). The
+ * journal is flushed as a single textDocument/didChange once the main loop
+ * becomes idle, or before any call to the peer that depends on the
+ * contents of the document.
+ */
+typedef struct
+{
+  /* The replaced range, before this change is applied */
+  gint     begin_line;
+  gint     begin_column;
+  gint     end_line;
+  gint     end_column;
+  gint     length;
+
+  /* The position after the replacement text, once this change is applied */
+  gint     text_end_line;
+  gint     text_end_column;
+  guint    text_chars;
+  GString *text;
+} PendingChange;
+
+typedef struct
+{
+  gchar  *uri;
+  GArray *changes;
+} ChangeJournal;
+
 G_DEFINE_TYPE_WITH_PRIVATE (IdeLangservClient, ide_langserv_client, IDE_TYPE_OBJECT)
 
 enum {
@@ -134,6 +195,8 @@ ide_langserv_client_buffer_saved (IdeLangservClient *self,
   if (!ide_langserv_client_supports_buffer (self, buffer))
     IDE_EXIT;
 
+  ide_langserv_client_flush_buffer (self, buffer);
+
   uri = ide_buffer_get_uri (buffer);
 
   params = JSONRPC_MESSAGE_NEW (
@@ -149,64 +212,260 @@ ide_langserv_client_buffer_saved (IdeLangservClient *self,
   IDE_EXIT;
 }
 
-/*
- * TODO: This should all be delayed and buffered so we coalesce multiple
- *       events into a single dispatch.
- */
+static void
+pending_change_clear (gpointer data)
+{
+  PendingChange *change = data;
+
+  if (change->text != NULL)
+    g_string_free (change->text, TRUE);
+}
 
 static void
-ide_langserv_client_buffer_insert_text (IdeLangservClient *self,
-                                        GtkTextIter       *location,
-                                        const gchar       *new_text,
-                                        gint               len,
-                                        IdeBuffer         *buffer)
+change_journal_free (gpointer data)
+{
+  ChangeJournal *journal = data;
+
+  g_clear_pointer (&journal->uri, g_free);
+  g_clear_pointer (&journal->changes, g_array_unref);
+  g_slice_free (ChangeJournal, journal);
+}
+
+static inline gint
+compare_position (gint line_a,
+                  gint column_a,
+                  gint line_b,
+                  gint column_b)
+{
+  if (line_a != line_b)
+    return line_a < line_b ? -1 : 1;
+  return column_a < column_b ? -1 : column_a > column_b;
+}
+
+static void
+pending_change_update_text_end (PendingChange *change)
+{
+  gint line = change->begin_line;
+  gint column = change->begin_column;
+  guint n_chars = 0;
+
+  for (const gchar *iter = change->text->str; *iter; iter = g_utf8_next_char (iter))
+    {
+      if (*iter == '\n')
+        {
+          line++;
+          column = 0;
+        }
+      else
+        {
+          column++;
+        }
+
+      n_chars++;
+    }
+
+  change->text_end_line = line;
+  change->text_end_column = column;
+  change->text_chars = n_chars;
+}
+
+static ChangeJournal *
+ide_langserv_client_get_journal (IdeLangservClient *self,
+                                 IdeBuffer         *buffer)
 {
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+  ChangeJournal *journal;
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  if (NULL == (journal = g_hash_table_lookup (priv->journals, buffer)))
+    {
+      journal = g_slice_new0 (ChangeJournal);
+      journal->uri = ide_buffer_get_uri (buffer);
+      journal->changes = g_array_new (FALSE, FALSE, sizeof (PendingChange));
+      g_array_set_clear_func (journal->changes, pending_change_clear);
+      g_hash_table_insert (priv->journals, g_object_ref (buffer), journal);
+    }
+
+  return journal;
+}
+
+static void
+ide_langserv_client_flush_journal (IdeLangservClient *self,
+                                   IdeBuffer         *buffer,
+                                   ChangeJournal     *journal)
+{
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
   g_autoptr(GVariant) params = NULL;
-  g_autofree gchar *uri = NULL;
-  g_autofree gchar *copy = NULL;
-  gint line;
-  gint column;
+  GVariantBuilder changes;
+  GVariantBuilder builder;
+  GVariant *text_document;
   gint version;
 
   IDE_ENTRY;
 
   g_assert (IDE_IS_LANGSERV_CLIENT (self));
-  g_assert (location != NULL);
   g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (journal != NULL);
 
-  copy = g_strndup (new_text, len);
+  if (journal->changes->len == 0)
+    IDE_EXIT;
+
+  IDE_TRACE_MSG ("Flushing %u changes to %s", journal->changes->len, journal->uri);
 
-  uri = ide_buffer_get_uri (buffer);
   version = (gint)ide_buffer_get_change_count (buffer);
 
-  line = gtk_text_iter_get_line (location);
-  column = gtk_text_iter_get_line_offset (location);
+  g_variant_builder_init (&changes, G_VARIANT_TYPE ("av"));
 
-  params = JSONRPC_MESSAGE_NEW (
-    "textDocument", "{",
-      "uri", JSONRPC_MESSAGE_PUT_STRING (uri),
-      "version", JSONRPC_MESSAGE_PUT_INT64 (version),
-    "}",
-    "contentChanges", "[",
-      "{",
+  for (guint i = 0; i < journal->changes->len; i++)
+    {
+      const PendingChange *change = &g_array_index (journal->changes, PendingChange, i);
+      GVariant *item;
+
+      item = JSONRPC_MESSAGE_NEW (
         "range", "{",
           "start", "{",
-            "line", JSONRPC_MESSAGE_PUT_INT64 (line),
-            "character", JSONRPC_MESSAGE_PUT_INT64 (column),
+            "line", JSONRPC_MESSAGE_PUT_INT64 (change->begin_line),
+            "character", JSONRPC_MESSAGE_PUT_INT64 (change->begin_column),
           "}",
           "end", "{",
-            "line", JSONRPC_MESSAGE_PUT_INT64 (line),
-            "character", JSONRPC_MESSAGE_PUT_INT64 (column),
+            "line", JSONRPC_MESSAGE_PUT_INT64 (change->end_line),
+            "character", JSONRPC_MESSAGE_PUT_INT64 (change->end_column),
           "}",
         "}",
-        "rangeLength", JSONRPC_MESSAGE_PUT_INT64 (0),
-        "text", JSONRPC_MESSAGE_PUT_STRING (copy),
-      "}",
-    "]");
+        "rangeLength", JSONRPC_MESSAGE_PUT_INT64 (change->length),
+        "text", JSONRPC_MESSAGE_PUT_STRING (change->text->str)
+      );
 
-  ide_langserv_client_send_notification_async (self, "textDocument/didChange",
-                                               g_steal_pointer (&params),
-                                               NULL, NULL, NULL);
+      g_variant_builder_add (&changes, "v", item);
+    }
+
+  text_document = JSONRPC_MESSAGE_NEW (
+    "uri", JSONRPC_MESSAGE_PUT_STRING (journal->uri),
+    "version", JSONRPC_MESSAGE_PUT_INT64 (version)
+  );
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "textDocument", text_document);
+  g_variant_builder_add (&builder, "{sv}", "contentChanges", g_variant_builder_end (&changes));
+  params = g_variant_take_ref (g_variant_builder_end (&builder));
+
+  g_array_set_size (journal->changes, 0);
+
+  if (priv->rpc_client != NULL)
+    jsonrpc_client_send_notification_async (priv->rpc_client,
+                                            "textDocument/didChange",
+                                            params,
+                                            NULL, NULL, NULL);
+
+  IDE_EXIT;
+}
+
+static void
+ide_langserv_client_flush_buffer (IdeLangservClient *self,
+                                  IdeBuffer         *buffer)
+{
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+  ChangeJournal *journal;
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  if (NULL != (journal = g_hash_table_lookup (priv->journals, buffer)))
+    ide_langserv_client_flush_journal (self, buffer, journal);
+}
+
+static void
+ide_langserv_client_flush (IdeLangservClient *self)
+{
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+
+  ide_clear_source (&priv->flush_source);
+
+  g_hash_table_iter_init (&iter, priv->journals);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    ide_langserv_client_flush_journal (self, key, value);
+}
+
+static gboolean
+ide_langserv_client_flush_cb (gpointer data)
+{
+  IdeLangservClient *self = data;
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+
+  priv->flush_source = 0;
+
+  ide_langserv_client_flush (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_langserv_client_queue_flush (IdeLangservClient *self)
+{
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+
+  if (priv->flush_source == 0)
+    priv->flush_source = g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+                                          ide_langserv_client_flush_cb,
+                                          self,
+                                          NULL);
+}
+
+static void
+ide_langserv_client_buffer_insert_text (IdeLangservClient *self,
+                                        GtkTextIter       *location,
+                                        const gchar       *new_text,
+                                        gint               len,
+                                        IdeBuffer         *buffer)
+{
+  ChangeJournal *journal;
+  PendingChange *last = NULL;
+  PendingChange change = { 0 };
+  gint line;
+  gint column;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+  g_assert (location != NULL);
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  journal = ide_langserv_client_get_journal (self, buffer);
+
+  line = gtk_text_iter_get_line (location);
+  column = gtk_text_iter_get_line_offset (location);
+
+  if (journal->changes->len > 0)
+    last = &g_array_index (journal->changes, PendingChange, journal->changes->len - 1);
+
+  /* Typing or pasting at the end of the previous change extends it */
+  if (last != NULL && last->text_end_line == line && last->text_end_column == column)
+    {
+      g_string_append_len (last->text, new_text, len);
+      pending_change_update_text_end (last);
+      ide_langserv_client_queue_flush (self);
+      IDE_EXIT;
+    }
+
+  change.begin_line = change.end_line = line;
+  change.begin_column = change.end_column = column;
+  change.length = 0;
+  change.text = g_string_new_len (new_text, len);
+  pending_change_update_text_end (&change);
+
+  g_array_append_val (journal->changes, change);
+
+  ide_langserv_client_queue_flush (self);
 
   IDE_EXIT;
 }
@@ -217,14 +476,13 @@ ide_langserv_client_buffer_delete_range (IdeLangservClient *self,
                                          GtkTextIter       *end_iter,
                                          IdeBuffer         *buffer)
 {
-
-  g_autoptr(GVariant) params = NULL;
-  g_autofree gchar *uri = NULL;
+  ChangeJournal *journal;
+  PendingChange *last = NULL;
+  PendingChange change = { 0 };
   struct {
     gint line;
     gint column;
   } begin, end;
-  gint version;
   gint length;
 
   IDE_ENTRY;
@@ -234,8 +492,7 @@ ide_langserv_client_buffer_delete_range (IdeLangservClient *self,
   g_assert (end_iter != NULL);
   g_assert (IDE_IS_BUFFER (buffer));
 
-  uri = ide_buffer_get_uri (buffer);
-  version = (gint)ide_buffer_get_change_count (buffer);
+  journal = ide_langserv_client_get_journal (self, buffer);
 
   begin.line = gtk_text_iter_get_line (begin_iter);
   begin.column = gtk_text_iter_get_line_offset (begin_iter);
@@ -245,31 +502,58 @@ ide_langserv_client_buffer_delete_range (IdeLangservClient *self,
 
   length = gtk_text_iter_get_offset (end_iter) - gtk_text_iter_get_offset (begin_iter);
 
-  params = JSONRPC_MESSAGE_NEW (
-    "textDocument", "{",
-      "uri", JSONRPC_MESSAGE_PUT_STRING (uri),
-      "version", JSONRPC_MESSAGE_PUT_INT64 (version),
-    "}",
-    "contentChanges", "[",
-      "{",
-        "range", "{",
-          "start", "{",
-            "line", JSONRPC_MESSAGE_PUT_INT64 (begin.line),
-            "character", JSONRPC_MESSAGE_PUT_INT64 (begin.column),
-          "}",
-          "end", "{",
-            "line", JSONRPC_MESSAGE_PUT_INT64 (end.line),
-            "character", JSONRPC_MESSAGE_PUT_INT64 (end.column),
-          "}",
-        "}",
-        "rangeLength", JSONRPC_MESSAGE_PUT_INT64 (length),
-        "text", "",
-      "}",
-    "]");
+  if (journal->changes->len > 0)
+    last = &g_array_index (journal->changes, PendingChange, journal->changes->len - 1);
 
-  ide_langserv_client_send_notification_async (self, "textDocument/didChange",
-                                               g_steal_pointer (&params),
-                                               NULL, NULL, NULL);
+  if (last != NULL)
+    {
+      /* Deleting the tail of the previous change's text, such as a backspace */
+      if (end.line == last->text_end_line &&
+          end.column == last->text_end_column &&
+          compare_position (begin.line, begin.column, last->begin_line, last->begin_column) >= 0 &&
+          (guint)length <= last->text_chars)
+        {
+          const gchar *tail;
+
+          tail = g_utf8_offset_to_pointer (last->text->str, last->text_chars - length);
+          g_string_truncate (last->text, tail - last->text->str);
+          pending_change_update_text_end (last);
+
+          /* An insertion that was entirely undone is no change at all */
+          if (last->length == 0 && last->text->len == 0)
+            g_array_set_size (journal->changes, journal->changes->len - 1);
+
+          ide_langserv_client_queue_flush (self);
+          IDE_EXIT;
+        }
+
+      /*
+       * Deleting the range immediately before the previous change. Nothing
+       * before the previous change has moved, so the coordinates of @begin
+       * are the same before and after it.
+       */
+      if (end.line == last->begin_line && end.column == last->begin_column)
+        {
+          last->begin_line = begin.line;
+          last->begin_column = begin.column;
+          last->length += length;
+          pending_change_update_text_end (last);
+          ide_langserv_client_queue_flush (self);
+          IDE_EXIT;
+        }
+    }
+
+  change.begin_line = begin.line;
+  change.begin_column = begin.column;
+  change.end_line = end.line;
+  change.end_column = end.column;
+  change.length = length;
+  change.text = g_string_new (NULL);
+  pending_change_update_text_end (&change);
+
+  g_array_append_val (journal->changes, change);
+
+  ide_langserv_client_queue_flush (self);
 
   IDE_EXIT;
 }
@@ -340,6 +624,7 @@ ide_langserv_client_buffer_unloaded (IdeLangservClient *self,
                                      IdeBuffer         *buffer,
                                      IdeBufferManager  *buffer_manager)
 {
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
   g_autoptr(GVariant) params = NULL;
   g_autofree gchar *uri = NULL;
 
@@ -349,6 +634,22 @@ ide_langserv_client_buffer_unloaded (IdeLangservClient *self,
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (IDE_IS_BUFFER_MANAGER (buffer_manager));
 
+  /*
+   * Tear down the journaling before checking the language, which may have
+   * changed since the buffer was loaded. Otherwise the journal would keep
+   * the buffer alive and the handlers would stay connected.
+   */
+  g_signal_handlers_disconnect_by_func (buffer,
+                                        G_CALLBACK (ide_langserv_client_buffer_insert_text),
+                                        self);
+  g_signal_handlers_disconnect_by_func (buffer,
+                                        G_CALLBACK (ide_langserv_client_buffer_delete_range),
+                                        self);
+
+  /* The peer must see the final state before it forgets the document */
+  ide_langserv_client_flush_buffer (self, buffer);
+  g_hash_table_remove (priv->journals, buffer);
+
   if (!ide_langserv_client_supports_buffer (self, buffer))
     IDE_EXIT;
 
@@ -666,7 +967,11 @@ ide_langserv_client_finalize (GObject *object)
   IdeLangservClient *self = (IdeLangservClient *)object;
   IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
 
+  ide_clear_source (&priv->flush_source);
+
   g_clear_pointer (&priv->diagnostics_by_file, g_hash_table_unref);
+  g_clear_pointer (&priv->journals, g_hash_table_unref);
+  g_clear_pointer (&priv->pending_calls, g_hash_table_unref);
   g_clear_pointer (&priv->languages, g_ptr_array_unref);
   g_clear_object (&priv->rpc_client);
   g_clear_object (&priv->buffer_manager_signals);
@@ -798,6 +1103,10 @@ ide_langserv_client_init (IdeLangservClient *self)
 
   priv->languages = g_ptr_array_new_with_free_func (g_free);
 
+  priv->journals = g_hash_table_new_full (NULL, NULL, g_object_unref, change_journal_free);
+
+  priv->pending_calls = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
   priv->diagnostics_by_file = g_hash_table_new_full ((GHashFunc)g_file_hash,
                                                      (GEqualFunc)g_file_equal,
                                                      g_object_unref,
@@ -1010,6 +1319,7 @@ ide_langserv_client_stop (IdeLangservClient *self)
 
   if (priv->rpc_client != NULL)
     {
+      ide_langserv_client_flush (self);
       jsonrpc_client_call_async (priv->rpc_client,
                                  "shutdown",
                                  NULL,
@@ -1022,6 +1332,132 @@ ide_langserv_client_stop (IdeLangservClient *self)
   IDE_EXIT;
 }
 
+static void
+pending_call_free (gpointer data)
+{
+  PendingCall *call = data;
+
+  if (call->cancelled_handler != 0)
+    g_cancellable_disconnect (call->cancellable, call->cancelled_handler);
+
+  g_clear_object (&call->cancellable);
+  g_clear_pointer (&call->id, g_variant_unref);
+  g_clear_pointer (&call->key, g_free);
+  g_slice_free (PendingCall, call);
+}
+
+static gchar *
+ide_langserv_client_get_call_key (const gchar *method,
+                                  GVariant    *params)
+{
+  const gchar *uri = NULL;
+
+  g_assert (method != NULL);
+
+  if (params == NULL || !g_variant_is_of_type (params, G_VARIANT_TYPE_VARDICT))
+    return NULL;
+
+  for (guint i = 0; i < G_N_ELEMENTS (supersedable_methods); i++)
+    {
+      if (g_str_equal (method, supersedable_methods[i]))
+        {
+          if (JSONRPC_MESSAGE_PARSE (params,
+                                     "textDocument", "{",
+                                       "uri", JSONRPC_MESSAGE_GET_STRING (&uri),
+                                     "}"))
+            return g_strdup_printf ("%s %s", method, uri);
+          break;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+ide_langserv_client_complete_call (IdeLangservClient *self,
+                                   GTask             *task)
+{
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+  PendingCall *call = g_task_get_task_data (task);
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+  g_assert (call != NULL);
+  g_assert (!call->completed);
+
+  call->completed = TRUE;
+
+  if (call->key != NULL &&
+      priv->pending_calls != NULL &&
+      g_hash_table_lookup (priv->pending_calls, call->key) == (gpointer)task)
+    g_hash_table_remove (priv->pending_calls, call->key);
+}
+
+static void
+ide_langserv_client_cancel_call (IdeLangservClient *self,
+                                 GTask             *task)
+{
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+  PendingCall *call = g_task_get_task_data (task);
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+  g_assert (G_IS_TASK (task));
+
+  if (call->completed)
+    IDE_EXIT;
+
+  ide_langserv_client_complete_call (self, task);
+
+  if (call->id != NULL && priv->rpc_client != NULL)
+    {
+      g_autoptr(GVariant) params = NULL;
+
+      IDE_TRACE_MSG ("Cancelling call %s", call->key ?: "");
+
+      params = g_variant_take_ref (g_variant_new_parsed ("{'id': <%v>}", call->id));
+      jsonrpc_client_send_notification_async (priv->rpc_client,
+                                              "$/cancelRequest",
+                                              params,
+                                              NULL, NULL, NULL);
+    }
+
+  g_task_return_new_error (task,
+                           G_IO_ERROR,
+                           G_IO_ERROR_CANCELLED,
+                           "The request was cancelled");
+
+  IDE_EXIT;
+}
+
+static gboolean
+ide_langserv_client_cancel_call_cb (gpointer data)
+{
+  GTask *task = data;
+  PendingCall *call = g_task_get_task_data (task);
+
+  g_assert (G_IS_TASK (task));
+  g_assert (call != NULL);
+
+  ide_langserv_client_cancel_call (call->self, task);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_langserv_client_call_cancelled (GCancellable *cancellable,
+                                    GTask        *task)
+{
+  g_assert (G_IS_CANCELLABLE (cancellable));
+  g_assert (G_IS_TASK (task));
+
+  /* @cancellable may be cancelled from any thread */
+  g_idle_add_full (G_PRIORITY_HIGH,
+                   ide_langserv_client_cancel_call_cb,
+                   g_object_ref (task),
+                   g_object_unref);
+}
+
 static void
 ide_langserv_client_call_cb (GObject      *object,
                              GAsyncResult *result,
@@ -1031,6 +1467,7 @@ ide_langserv_client_call_cb (GObject      *object,
   g_autoptr(GVariant) return_value = NULL;
   g_autoptr(GError) error = NULL;
   g_autoptr(GTask) task = user_data;
+  PendingCall *call;
 
   IDE_ENTRY;
 
@@ -1038,12 +1475,27 @@ ide_langserv_client_call_cb (GObject      *object,
   g_assert (G_IS_ASYNC_RESULT (result));
   g_assert (G_IS_TASK (task));
 
+  call = g_task_get_task_data (task);
+
   if (!jsonrpc_client_call_finish (client, result, &return_value, &error))
     {
-      g_task_return_error (task, g_steal_pointer (&error));
-      return;
+      if (!call->completed)
+        {
+          ide_langserv_client_complete_call (call->self, task);
+          g_task_return_error (task, g_steal_pointer (&error));
+        }
+      IDE_EXIT;
     }
 
+  /* Superseded or cancelled, nobody is waiting for this anymore */
+  if (call->completed)
+    {
+      IDE_TRACE_MSG ("Dropping stale reply for %s", call->key ?: "");
+      IDE_EXIT;
+    }
+
+  ide_langserv_client_complete_call (call->self, task);
+
   g_task_return_pointer (task, g_steal_pointer (&return_value), (GDestroyNotify)g_variant_unref);
 
   IDE_EXIT;
@@ -1070,6 +1522,8 @@ ide_langserv_client_call_async (IdeLangservClient   *self,
 {
   IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
   g_autoptr(GTask) task = NULL;
+  PendingCall *call;
+  GTask *previous;
 
   IDE_ENTRY;
 
@@ -1081,6 +1535,11 @@ ide_langserv_client_call_async (IdeLangservClient   *self,
   task = g_task_new (self, cancellable, callback, user_data);
   g_task_set_source_tag (task, ide_langserv_client_call_async);
 
+  call = g_slice_new0 (PendingCall);
+  call->self = self;
+  call->key = ide_langserv_client_get_call_key (method, params);
+  g_task_set_task_data (task, call, pending_call_free);
+
   if (priv->rpc_client == NULL)
     {
       g_task_return_new_error (task,
@@ -1090,12 +1549,37 @@ ide_langserv_client_call_async (IdeLangservClient   *self,
       IDE_EXIT;
     }
 
-  jsonrpc_client_call_async (priv->rpc_client,
-                             method,
-                             params,
-                             cancellable,
-                             ide_langserv_client_call_cb,
-                             g_steal_pointer (&task));
+  /* Requests may depend on document state, so the peer must be current */
+  ide_langserv_client_flush (self);
+
+  if (call->key != NULL &&
+      NULL != (previous = g_hash_table_lookup (priv->pending_calls, call->key)))
+    ide_langserv_client_cancel_call (self, previous);
+
+  /*
+   * The jsonrpc call is not given @cancellable, it must stay alive until
+   * the peer replies so the reply can be matched up and dropped.
+   */
+  jsonrpc_client_call_with_id_async (priv->rpc_client,
+                                     method,
+                                     params,
+                                     &call->id,
+                                     NULL,
+                                     ide_langserv_client_call_cb,
+                                     g_object_ref (task));
+
+  if (call->key != NULL)
+    g_hash_table_insert (priv->pending_calls, g_strdup (call->key), task);
+
+  if (cancellable != NULL)
+    {
+      call->cancellable = g_object_ref (cancellable);
+      call->cancelled_handler =
+        g_cancellable_connect (cancellable,
+                               G_CALLBACK (ide_langserv_client_call_cancelled),
+                               task,
+                               NULL);
+    }
 
   IDE_EXIT;
 }
@@ -1178,6 +1662,9 @@ ide_langserv_client_send_notification_async (IdeLangservClient   *self,
       IDE_EXIT;
     }
 
+  /* Keep notifications ordered after any edits that preceded them */
+  ide_langserv_client_flush (self);
+
   jsonrpc_client_send_notification_async (priv->rpc_client,
                                           method,
                                           params,
@@ -177,6 +177,7 @@ ide_langserv_highlighter_document_symbol_cb (GObject      *object,
             ide_highlight_index_insert (index, name, (gpointer)tag);
         }
 
+      ide_highlight_index_freeze (index);
       ide_langserv_highlighter_set_index (self, index);
     }
 
@@ -481,6 +482,50 @@ completed:
   *location = *range_end;
 }
 
+static const gchar *
+ide_langserv_highlighter_lookup_word (const gchar *word,
+                                      gsize        word_len,
+                                      gpointer     user_data)
+{
+  return ide_highlight_index_lookup_len (user_data, word, word_len);
+}
+
+static void
+ide_langserv_highlighter_update_async (IdeHighlighter      *highlighter,
+                                       GBytes              *text,
+                                       guint                offset,
+                                       GCancellable        *cancellable,
+                                       GAsyncReadyCallback  callback,
+                                       gpointer             user_data)
+{
+  IdeLangservHighlighter *self = (IdeLangservHighlighter *)highlighter;
+  IdeLangservHighlighterPrivate *priv = ide_langserv_highlighter_get_instance_private (self);
+
+  g_assert (IDE_IS_LANGSERV_HIGHLIGHTER (self));
+  g_assert (text != NULL);
+
+  if (priv->index == NULL)
+    {
+      g_autoptr(GTask) task = g_task_new (self, cancellable, callback, user_data);
+
+      g_task_set_source_tag (task, ide_langserv_highlighter_update_async);
+      g_task_return_pointer (task,
+                             g_array_new (FALSE, FALSE, sizeof (IdeHighlightRun)),
+                             (GDestroyNotify)g_array_unref);
+      return;
+    }
+
+  ide_highlighter_scan_words_async (highlighter,
+                                    text,
+                                    offset,
+                                    ide_langserv_highlighter_lookup_word,
+                                    ide_highlight_index_ref (priv->index),
+                                    (GDestroyNotify)ide_highlight_index_unref,
+                                    cancellable,
+                                    callback,
+                                    user_data);
+}
+
 static void
 ide_langserv_highlighter_set_engine (IdeHighlighter     *highlighter,
                                      IdeHighlightEngine *engine)
@@ -513,5 +558,6 @@ static void
 highlighter_iface_init (IdeHighlighterInterface *iface)
 {
   iface->update = ide_langserv_highlighter_update;
+  iface->update_async = ide_langserv_highlighter_update_async;
   iface->set_engine = ide_langserv_highlighter_set_engine;
 }
@@ -198,6 +198,7 @@ ide_preferences_builtin_register_code_insight (DzlPreferences *preferences)
   dzl_preferences_add_switch (preferences, "code-insight", "completion", "org.gnome.builder.code-insight", "clang-autocompletion", NULL, NULL, _("Suggest completions using Clang (Experimental)"), _("Use Clang to suggest completions for C and C++ languages"), NULL, 20);
 
   dzl_preferences_add_list_group (preferences, "code-insight", "diagnostics", _("Diagnostics"), GTK_SELECTION_NONE, 200);
+  dzl_preferences_add_switch (preferences, "code-insight", "diagnostics", "org.gnome.builder.code-insight", "background-diagnostics", NULL, NULL, _("Diagnose unopened files"), _("Check every file in the project for problems while idle and not on battery"), NULL, 0);
 }
 
 static void
@@ -0,0 +1,970 @@
+/* ide-content-index.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-content-index"
+
+#include <dazzle.h>
+#include <string.h>
+
+#include "ide-context.h"
+#include "ide-debug.h"
+#include "ide-global.h"
+#include "ide-macros.h"
+
+#include "buffers/ide-buffer.h"
+#include "buffers/ide-buffer-manager.h"
+#include "files/ide-directory-crawler.h"
+#include "files/ide-file.h"
+#include "projects/ide-project.h"
+#include "search/ide-content-index.h"
+#include "search/ide-trigram-index.h"
+#include "threading/ide-thread-pool.h"
+#include "vcs/ide-vcs.h"
+
+/*
+ * IdeContentIndex keeps a trigram index of every (non-ignored, textual)
+ * file in the project working directory so that consumers such as the
+ * TODO miner or project-wide text search only need to open the handful of
+ * files that could possibly match instead of shelling out to grep.
+ *
+ * The index is persisted to the user cache directory and reconciled
+ * against file modification times when loaded, so only files that have
+ * changed since the last session get re-read.
+ *
+ * Each reconcile also remembers the listing of every directory it crawled.
+ * Later reconciles (after VCS changes, renames and the like) only enumerate
+ * directories whose modification time changed, which is where files were
+ * added, removed or replaced. Files edited in place are picked up through
+ * the buffer manager or on the next load.
+ */
+
+/* Files larger than this are almost never source code */
+#define MAX_FILE_SIZE      (1024 * 1024)
+/* Like grep -I, a NUL byte within this prefix marks a file as binary */
+#define BINARY_SNIFF_SIZE  8192
+/* Coalesce incremental updates before writing the index to disk */
+#define SAVE_DELAY_SECONDS 30
+
+struct _IdeContentIndex
+{
+  IdeObject        parent_instance;
+
+  /*
+   * The trigram index is mutated from the indexer thread pool and queried
+   * from the main thread, so all access must hold @mutex.
+   */
+  GMutex           mutex;
+  IdeTrigramIndex *index;
+
+  /* Directory listings from the last reconcile, also protected by @mutex */
+  GHashTable      *directories;
+
+  /*
+   * Held while serializing and writing the index so that an older
+   * snapshot can never replace a newer one on disk. Acquired before
+   * @mutex, which is only held for the serialization.
+   */
+  GMutex           save_mutex;
+
+  /* GTask waiting on the current load to complete */
+  GPtrArray       *waiters;
+
+  guint            save_source;
+
+  guint            connected : 1;
+  guint            loading : 1;
+  guint            loaded : 1;
+  guint            needs_reconcile : 1;
+};
+
+typedef struct
+{
+  IdeVcs *vcs;
+  GFile  *workdir;
+  GFile  *file;
+  gchar  *cache_path;
+} IndexData;
+
+typedef struct
+{
+  guint64   mtime;
+  /* Names of the subdirectories for the crawler to descend into */
+  gchar   **subdirs;
+  /* Relative paths of the files that were recorded in the index */
+  gchar   **files;
+} Directory;
+
+G_DEFINE_TYPE (IdeContentIndex, ide_content_index, IDE_TYPE_OBJECT)
+
+DZL_DEFINE_COUNTER (indexed_files, "IdeContentIndex", "Files", "Number of files in the content index")
+
+static void ide_content_index_reconcile (IdeContentIndex *self);
+
+static void
+directory_free (gpointer data)
+{
+  Directory *dir = data;
+
+  g_strfreev (dir->subdirs);
+  g_strfreev (dir->files);
+  g_slice_free (Directory, dir);
+}
+
+static guint64
+get_directory_mtime (GFileInfo *info)
+{
+  if (info == NULL)
+    return 0;
+
+  return g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+         g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
+
+static void
+index_data_free (gpointer data)
+{
+  IndexData *id = data;
+
+  g_clear_object (&id->vcs);
+  g_clear_object (&id->workdir);
+  g_clear_object (&id->file);
+  g_clear_pointer (&id->cache_path, g_free);
+  g_slice_free (IndexData, id);
+}
+
+static IndexData *
+index_data_new (IdeContentIndex *self,
+                GFile           *file)
+{
+  IdeContext *context;
+  IdeProject *project;
+  IdeVcs *vcs;
+  IndexData *id;
+
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (!file || G_IS_FILE (file));
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  project = ide_context_get_project (context);
+  vcs = ide_context_get_vcs (context);
+
+  id = g_slice_new0 (IndexData);
+  id->vcs = g_object_ref (vcs);
+  id->workdir = g_object_ref (ide_vcs_get_working_directory (vcs));
+  id->file = file ? g_object_ref (file) : NULL;
+  id->cache_path = g_build_filename (g_get_user_cache_dir (),
+                                     ide_get_program_name (),
+                                     "content-index",
+                                     ide_project_get_id (project),
+                                     "trigrams",
+                                     NULL);
+
+  return id;
+}
+
+static void
+ide_content_index_update_counter (IdeContentIndex *self)
+{
+  guint n_paths;
+
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+
+  g_mutex_lock (&self->mutex);
+  n_paths = self->index ? ide_trigram_index_get_n_paths (self->index) : 0;
+  g_mutex_unlock (&self->mutex);
+
+  DZL_COUNTER_SET (indexed_files, n_paths);
+}
+
+static gboolean
+ide_content_index_index_file (IdeContentIndex *self,
+                              GFile           *file,
+                              const gchar     *relative_path,
+                              guint64          mtime,
+                              GCancellable    *cancellable)
+{
+  g_autofree gchar *contents = NULL;
+  gsize len = 0;
+
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (G_IS_FILE (file));
+  g_assert (relative_path != NULL);
+
+  if (!g_file_load_contents (file, cancellable, &contents, &len, NULL, NULL))
+    return FALSE;
+
+  /*
+   * Binary files are recorded without contents so that they are still
+   * known at this mtime and the next reconcile does not read them again.
+   */
+  if (memchr (contents, '\0', MIN (len, BINARY_SNIFF_SIZE)) != NULL)
+    len = 0;
+
+  g_mutex_lock (&self->mutex);
+  ide_trigram_index_insert (self->index, relative_path, mtime, contents, len);
+  g_mutex_unlock (&self->mutex);
+
+  return TRUE;
+}
+
+static gboolean
+ide_content_index_write (const gchar  *cache_path,
+                         GBytes       *bytes,
+                         GError      **error)
+{
+  g_autofree gchar *dir = NULL;
+
+  g_assert (cache_path != NULL);
+  g_assert (bytes != NULL);
+
+  dir = g_path_get_dirname (cache_path);
+  g_mkdir_with_parents (dir, 0750);
+
+  return g_file_set_contents (cache_path,
+                              g_bytes_get_data (bytes, NULL),
+                              g_bytes_get_size (bytes),
+                              error);
+}
+
+static gboolean
+ide_content_index_save (IdeContentIndex  *self,
+                        const gchar      *cache_path,
+                        GError          **error)
+{
+  g_autoptr(GBytes) bytes = NULL;
+  gboolean ret;
+
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (cache_path != NULL);
+
+  g_mutex_lock (&self->save_mutex);
+
+  /* Only the serialization needs the index, not the disk I/O */
+  g_mutex_lock (&self->mutex);
+  bytes = ide_trigram_index_serialize (self->index);
+  g_mutex_unlock (&self->mutex);
+
+  ret = ide_content_index_write (cache_path, bytes, error);
+
+  g_mutex_unlock (&self->save_mutex);
+
+  return ret;
+}
+
+typedef struct
+{
+  IdeContentIndex *self;
+  GHashTable      *seen;
+  /* Listings from the previous reconcile, read-only while crawling */
+  GHashTable      *cached;
+  /* Listings gathered by this reconcile */
+  GHashTable      *directories;
+  GCancellable    *cancellable;
+} Crawl;
+
+/* Called from the crawler workers to skip directories that did not change */
+static gchar **
+ide_content_index_reuse_cb (GFile       *directory,
+                            const gchar *relative_dir,
+                            GFileInfo   *directory_info,
+                            gpointer     user_data)
+{
+  Crawl *crawl = user_data;
+  Directory *dir;
+
+  g_assert (relative_dir != NULL);
+  g_assert (crawl != NULL);
+
+  if (crawl->cached == NULL ||
+      !(dir = g_hash_table_lookup (crawl->cached, relative_dir)) ||
+      dir->mtime != get_directory_mtime (directory_info))
+    return NULL;
+
+  return g_strdupv (dir->subdirs);
+}
+
+static void
+ide_content_index_crawl_cb (GFile       *directory,
+                            const gchar *relative_dir,
+                            GFileInfo   *directory_info,
+                            GPtrArray   *children,
+                            gpointer     user_data)
+{
+  Crawl *crawl = user_data;
+  g_autoptr(GPtrArray) subdirs = NULL;
+  g_autoptr(GPtrArray) files = NULL;
+  Directory *dir;
+
+  g_assert (G_IS_FILE (directory));
+  g_assert (relative_dir != NULL);
+  g_assert (crawl != NULL);
+
+  if (children == NULL)
+    {
+      Directory *cached = g_hash_table_lookup (crawl->cached, relative_dir);
+
+      g_assert (cached != NULL);
+
+      for (guint i = 0; cached->files[i] != NULL; i++)
+        g_hash_table_add (crawl->seen, g_strdup (cached->files[i]));
+
+      dir = g_slice_new0 (Directory);
+      dir->mtime = cached->mtime;
+      dir->subdirs = g_strdupv (cached->subdirs);
+      dir->files = g_strdupv (cached->files);
+      g_hash_table_insert (crawl->directories, g_strdup (relative_dir), dir);
+
+      return;
+    }
+
+  subdirs = g_ptr_array_new_with_free_func (g_free);
+  files = g_ptr_array_new_with_free_func (g_free);
+
+  for (guint i = 0; i < children->len; i++)
+    {
+      GFileInfo *info = g_ptr_array_index (children, i);
+      const gchar *name = g_file_info_get_name (info);
+      g_autoptr(GFile) file = NULL;
+      g_autofree gchar *relative_path = NULL;
+      guint64 prev_mtime = 0;
+      guint64 mtime;
+      gboolean known;
+
+      if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+        {
+          g_ptr_array_add (subdirs, g_strdup (name));
+          continue;
+        }
+
+      if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR ||
+          g_file_info_get_size (info) > MAX_FILE_SIZE)
+        continue;
+
+      if (*relative_dir != '\0')
+        relative_path = g_build_filename (relative_dir, name, NULL);
+      else
+        relative_path = g_strdup (name);
+
+      mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+      g_mutex_lock (&crawl->self->mutex);
+      known = ide_trigram_index_get_mtime (crawl->self->index, relative_path, &prev_mtime);
+      g_mutex_unlock (&crawl->self->mutex);
+
+      if (!known || prev_mtime != mtime)
+        {
+          file = g_file_get_child (directory, name);
+
+          if (!ide_content_index_index_file (crawl->self, file, relative_path, mtime, crawl->cancellable))
+            continue;
+        }
+
+      g_ptr_array_add (files, g_strdup (relative_path));
+      g_hash_table_add (crawl->seen, g_steal_pointer (&relative_path));
+    }
+
+  g_ptr_array_add (subdirs, NULL);
+  g_ptr_array_add (files, NULL);
+
+  dir = g_slice_new0 (Directory);
+  dir->mtime = get_directory_mtime (directory_info);
+  dir->subdirs = (gchar **)g_ptr_array_free (g_steal_pointer (&subdirs), FALSE);
+  dir->files = (gchar **)g_ptr_array_free (g_steal_pointer (&files), FALSE);
+  g_hash_table_insert (crawl->directories, g_strdup (relative_dir), dir);
+}
+
+static void
+ide_content_index_reconcile_worker (GTask        *task,
+                                    gpointer      source_object,
+                                    gpointer      task_data,
+                                    GCancellable *cancellable)
+{
+  IdeContentIndex *self = source_object;
+  IndexData *id = task_data;
+  g_autoptr(IdeDirectoryCrawler) crawler = NULL;
+  g_autoptr(GHashTable) seen = NULL;
+  g_autoptr(GHashTable) cached = NULL;
+  g_autoptr(GHashTable) directories = NULL;
+  g_autoptr(GPtrArray) paths = NULL;
+  g_autoptr(GTimer) timer = NULL;
+  g_autoptr(GError) error = NULL;
+  Crawl crawl = { 0 };
+  guint n_paths;
+
+  IDE_ENTRY;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (id != NULL);
+
+  timer = g_timer_new ();
+
+  g_mutex_lock (&self->mutex);
+  if (self->index == NULL)
+    {
+      g_autoptr(GError) load_error = NULL;
+
+      self->index = ide_trigram_index_new_from_file (id->cache_path, &load_error);
+
+      if (self->index == NULL)
+        {
+          g_debug ("Creating new content index: %s", load_error->message);
+          self->index = ide_trigram_index_new ();
+        }
+    }
+  if (self->directories != NULL)
+    cached = g_hash_table_ref (self->directories);
+  g_mutex_unlock (&self->mutex);
+
+  seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  directories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, directory_free);
+
+  crawl.self = self;
+  crawl.seen = seen;
+  crawl.cached = cached;
+  crawl.directories = directories;
+  crawl.cancellable = cancellable;
+
+  crawler = ide_directory_crawler_new (id->workdir);
+  ide_directory_crawler_set_vcs (crawler, id->vcs);
+  ide_directory_crawler_set_attributes (crawler,
+                                        G_FILE_ATTRIBUTE_STANDARD_SIZE","
+                                        G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                                        G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+  ide_directory_crawler_set_reuse_func (crawler, ide_content_index_reuse_cb, &crawl, NULL);
+
+  if (!ide_directory_crawler_run (crawler, cancellable, ide_content_index_crawl_cb, &crawl, &error))
+    {
+      g_task_return_error (task, g_steal_pointer (&error));
+      IDE_EXIT;
+    }
+
+  g_mutex_lock (&self->mutex);
+
+  paths = ide_trigram_index_get_paths (self->index);
+
+  for (guint i = 0; i < paths->len; i++)
+    {
+      const gchar *path = g_ptr_array_index (paths, i);
+
+      if (!g_hash_table_contains (seen, path))
+        ide_trigram_index_remove (self->index, path);
+    }
+
+  n_paths = ide_trigram_index_get_n_paths (self->index);
+
+  g_clear_pointer (&self->directories, g_hash_table_unref);
+  self->directories = g_steal_pointer (&directories);
+
+  g_mutex_unlock (&self->mutex);
+
+  if (!ide_content_index_save (self, id->cache_path, &error))
+    g_warning ("Failed to save content index: %s", error->message);
+
+  IDE_TRACE_MSG ("Reconciled %u files in content index in %lf seconds",
+                 n_paths, g_timer_elapsed (timer, NULL));
+
+  g_task_return_boolean (task, TRUE);
+
+  IDE_EXIT;
+}
+
+static void
+ide_content_index_reconcile_cb (GObject      *object,
+                                GAsyncResult *result,
+                                gpointer      user_data)
+{
+  IdeContentIndex *self = (IdeContentIndex *)object;
+  g_autoptr(GPtrArray) waiters = NULL;
+  g_autoptr(GError) error = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (G_IS_TASK (result));
+
+  self->loading = FALSE;
+
+  if (g_task_propagate_boolean (G_TASK (result), &error))
+    self->loaded = TRUE;
+
+  ide_content_index_update_counter (self);
+
+  waiters = g_steal_pointer (&self->waiters);
+  self->waiters = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint i = 0; i < waiters->len; i++)
+    {
+      GTask *task = g_ptr_array_index (waiters, i);
+
+      if (error != NULL)
+        g_task_return_error (task, g_error_copy (error));
+      else
+        g_task_return_boolean (task, TRUE);
+    }
+
+  if (self->needs_reconcile)
+    {
+      self->needs_reconcile = FALSE;
+      ide_content_index_reconcile (self);
+    }
+
+  IDE_EXIT;
+}
+
+static void
+ide_content_index_reconcile (IdeContentIndex *self)
+{
+  g_autoptr(GTask) task = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+
+  if (self->loading)
+    {
+      self->needs_reconcile = TRUE;
+      IDE_EXIT;
+    }
+
+  self->loading = TRUE;
+
+  task = g_task_new (self, NULL, ide_content_index_reconcile_cb, NULL);
+  g_task_set_source_tag (task, ide_content_index_reconcile);
+  g_task_set_priority (task, G_PRIORITY_LOW);
+  g_task_set_task_data (task, index_data_new (self, NULL), index_data_free);
+  ide_thread_pool_push_task (IDE_THREAD_POOL_INDEXER,
+                             task,
+                             ide_content_index_reconcile_worker);
+
+  IDE_EXIT;
+}
+
+static void
+ide_content_index_save_worker (GTask        *task,
+                               gpointer      source_object,
+                               gpointer      task_data,
+                               GCancellable *cancellable)
+{
+  IdeContentIndex *self = source_object;
+  IndexData *id = task_data;
+  g_autoptr(GError) error = NULL;
+  gboolean ret;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (id != NULL);
+
+  if (!(ret = ide_content_index_save (self, id->cache_path, &error)))
+    g_warning ("Failed to save content index: %s", error->message);
+
+  g_task_return_boolean (task, ret);
+}
+
+static gboolean
+ide_content_index_save_timeout (gpointer user_data)
+{
+  IdeContentIndex *self = user_data;
+  g_autoptr(GTask) task = NULL;
+
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+
+  self->save_source = 0;
+
+  /* A full reconcile will save the index when it completes */
+  if (self->loading)
+    return G_SOURCE_REMOVE;
+
+  task = g_task_new (self, NULL, NULL, NULL);
+  g_task_set_source_tag (task, ide_content_index_save_timeout);
+  g_task_set_task_data (task, index_data_new (self, NULL), index_data_free);
+  ide_thread_pool_push_task (IDE_THREAD_POOL_INDEXER,
+                             task,
+                             ide_content_index_save_worker);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_content_index_update_worker (GTask        *task,
+                                 gpointer      source_object,
+                                 gpointer      task_data,
+                                 GCancellable *cancellable)
+{
+  IdeContentIndex *self = source_object;
+  IndexData *id = task_data;
+  g_autoptr(GFileInfo) info = NULL;
+  g_autofree gchar *relative_path = NULL;
+  gboolean indexed = FALSE;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (id != NULL);
+  g_assert (G_IS_FILE (id->file));
+
+  relative_path = g_file_get_relative_path (id->workdir, id->file);
+
+  if (relative_path == NULL)
+    {
+      g_task_return_boolean (task, FALSE);
+      return;
+    }
+
+  info = g_file_query_info (id->file,
+                            G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                            cancellable,
+                            NULL);
+
+  if (info != NULL &&
+      g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+      g_file_info_get_size (info) <= MAX_FILE_SIZE &&
+      !ide_vcs_is_ignored (id->vcs, id->file, NULL))
+    {
+      guint64 mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+      indexed = ide_content_index_index_file (self, id->file, relative_path, mtime, cancellable);
+    }
+
+  if (!indexed)
+    {
+      g_mutex_lock (&self->mutex);
+      ide_trigram_index_remove (self->index, relative_path);
+      g_mutex_unlock (&self->mutex);
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+ide_content_index_update_cb (GObject      *object,
+                             GAsyncResult *result,
+                             gpointer      user_data)
+{
+  IdeContentIndex *self = (IdeContentIndex *)object;
+
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (G_IS_TASK (result));
+
+  if (g_task_propagate_boolean (G_TASK (result), NULL))
+    {
+      ide_content_index_update_counter (self);
+
+      if (self->save_source == 0)
+        self->save_source = g_timeout_add_seconds (SAVE_DELAY_SECONDS,
+                                                   ide_content_index_save_timeout,
+                                                   self);
+    }
+}
+
+static void
+ide_content_index_buffer_saved (IdeContentIndex  *self,
+                                IdeBuffer        *buffer,
+                                IdeBufferManager *buffer_manager)
+{
+  IdeFile *file;
+
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (IDE_IS_BUFFER_MANAGER (buffer_manager));
+
+  file = ide_buffer_get_file (buffer);
+  ide_content_index_update_file (self, ide_file_get_file (file));
+}
+
+static void
+ide_content_index_file_renamed (IdeContentIndex *self,
+                                GFile           *src_file,
+                                GFile           *dst_file,
+                                IdeProject      *project)
+{
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (G_IS_FILE (src_file));
+  g_assert (G_IS_FILE (dst_file));
+  g_assert (IDE_IS_PROJECT (project));
+
+  /*
+   * Renaming a directory affects too many paths to update one by one. The
+   * reconcile only enumerates the directories whose listing changed.
+   */
+  if (g_file_query_file_type (dst_file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL) == G_FILE_TYPE_DIRECTORY)
+    {
+      if (self->loaded)
+        ide_content_index_reconcile (self);
+      return;
+    }
+
+  ide_content_index_update_file (self, src_file);
+  ide_content_index_update_file (self, dst_file);
+}
+
+static void
+ide_content_index_file_trashed (IdeContentIndex *self,
+                                GFile           *file,
+                                IdeProject      *project)
+{
+  g_autofree gchar *relative_path = NULL;
+  IdeContext *context;
+  GFile *workdir;
+  gboolean is_directory;
+
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (G_IS_FILE (file));
+  g_assert (IDE_IS_PROJECT (project));
+
+  if (!self->loaded)
+    return;
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  workdir = ide_vcs_get_working_directory (ide_context_get_vcs (context));
+
+  if (!(relative_path = g_file_get_relative_path (workdir, file)))
+    return;
+
+  g_mutex_lock (&self->mutex);
+  is_directory = self->directories != NULL &&
+                 g_hash_table_contains (self->directories, relative_path);
+  g_mutex_unlock (&self->mutex);
+
+  /* A single file can just be dropped from the index */
+  if (is_directory)
+    ide_content_index_reconcile (self);
+  else
+    ide_content_index_update_file (self, file);
+}
+
+static void
+ide_content_index_vcs_changed (IdeContentIndex *self,
+                               IdeVcs          *vcs)
+{
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+  g_assert (IDE_IS_VCS (vcs));
+
+  /*
+   * Branch switches and the like can touch any number of files. Checking
+   * out a file replaces it, which changes the mtime of its directory, so
+   * the reconcile only enumerates those directories.
+   */
+  if (self->loaded)
+    ide_content_index_reconcile (self);
+}
+
+static void
+ide_content_index_connect (IdeContentIndex *self)
+{
+  IdeContext *context;
+
+  g_assert (IDE_IS_CONTENT_INDEX (self));
+
+  if (self->connected)
+    return;
+
+  self->connected = TRUE;
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+
+  g_signal_connect_object (ide_context_get_buffer_manager (context),
+                           "buffer-saved",
+                           G_CALLBACK (ide_content_index_buffer_saved),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  g_signal_connect_object (ide_context_get_project (context),
+                           "file-renamed",
+                           G_CALLBACK (ide_content_index_file_renamed),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  g_signal_connect_object (ide_context_get_project (context),
+                           "file-trashed",
+                           G_CALLBACK (ide_content_index_file_trashed),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  g_signal_connect_object (ide_context_get_vcs (context),
+                           "changed",
+                           G_CALLBACK (ide_content_index_vcs_changed),
+                           self,
+                           G_CONNECT_SWAPPED);
+}
+
+static void
+ide_content_index_finalize (GObject *object)
+{
+  IdeContentIndex *self = (IdeContentIndex *)object;
+
+  ide_clear_source (&self->save_source);
+
+  g_clear_pointer (&self->index, ide_trigram_index_unref);
+  g_clear_pointer (&self->directories, g_hash_table_unref);
+  g_clear_pointer (&self->waiters, g_ptr_array_unref);
+  g_mutex_clear (&self->mutex);
+  g_mutex_clear (&self->save_mutex);
+
+  G_OBJECT_CLASS (ide_content_index_parent_class)->finalize (object);
+}
+
+static void
+ide_content_index_class_init (IdeContentIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ide_content_index_finalize;
+}
+
+static void
+ide_content_index_init (IdeContentIndex *self)
+{
+  g_mutex_init (&self->mutex);
+  g_mutex_init (&self->save_mutex);
+  self->waiters = g_ptr_array_new_with_free_func (g_object_unref);
+}
+
+/**
+ * ide_content_index_load_async:
+ * @self: An #IdeContentIndex
+ * @cancellable: (nullable): A #GCancellable or %NULL
+ * @callback: A callback to execute upon completion
+ * @user_data: user data for @callback
+ *
+ * Loads the content index from the cache and reconciles it with the
+ * working directory. Subsequent calls complete immediately once the
+ * index has been loaded.
+ */
+void
+ide_content_index_load_async (IdeContentIndex     *self,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+
+  IDE_ENTRY;
+
+  g_return_if_fail (IDE_IS_CONTENT_INDEX (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ide_content_index_load_async);
+
+  if (self->loaded)
+    {
+      g_task_return_boolean (task, TRUE);
+      IDE_EXIT;
+    }
+
+  g_ptr_array_add (self->waiters, g_steal_pointer (&task));
+
+  ide_content_index_connect (self);
+
+  if (!self->loading)
+    ide_content_index_reconcile (self);
+
+  IDE_EXIT;
+}
+
+gboolean
+ide_content_index_load_finish (IdeContentIndex  *self,
+                               GAsyncResult     *result,
+                               GError          **error)
+{
+  g_return_val_if_fail (IDE_IS_CONTENT_INDEX (self), FALSE);
+  g_return_val_if_fail (G_IS_TASK (result), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+gboolean
+ide_content_index_get_loaded (IdeContentIndex *self)
+{
+  g_return_val_if_fail (IDE_IS_CONTENT_INDEX (self), FALSE);
+
+  return self->loaded;
+}
+
+/**
+ * ide_content_index_update_file:
+ * @self: An #IdeContentIndex
+ * @file: A #GFile within the project
+ *
+ * Re-indexes @file in the background, or removes it from the index
+ * if it no longer exists. This is a no-op until the index is loaded.
+ */
+void
+ide_content_index_update_file (IdeContentIndex *self,
+                               GFile           *file)
+{
+  g_autoptr(GTask) task = NULL;
+
+  g_return_if_fail (IDE_IS_CONTENT_INDEX (self));
+  g_return_if_fail (G_IS_FILE (file));
+
+  if (!self->loaded)
+    return;
+
+  task = g_task_new (self, NULL, ide_content_index_update_cb, NULL);
+  g_task_set_source_tag (task, ide_content_index_update_file);
+  g_task_set_task_data (task, index_data_new (self, file), index_data_free);
+  ide_thread_pool_push_task (IDE_THREAD_POOL_INDEXER,
+                             task,
+                             ide_content_index_update_worker);
+}
+
+/**
+ * ide_content_index_find_candidates:
+ * @self: An #IdeContentIndex
+ * @literals: (array zero-terminated=1): literal strings to look for
+ *
+ * Locates the files which may contain any of the strings in @literals.
+ * Matching is case-insensitive for ASCII and may return false positives,
+ * so callers must verify the contents of each file. Literals shorter than
+ * three bytes cannot narrow the result and match every file.
+ *
+ * Returns: (transfer full) (element-type GFile) (nullable): A #GPtrArray
+ *   of #GFile, or %NULL if the index has not been loaded.
+ */
+GPtrArray *
+ide_content_index_find_candidates (IdeContentIndex     *self,
+                                   const gchar * const *literals)
+{
+  g_autoptr(GPtrArray) paths = NULL;
+  IdeContext *context;
+  GPtrArray *ret;
+  GFile *workdir;
+
+  g_return_val_if_fail (IDE_IS_CONTENT_INDEX (self), NULL);
+
+  if (!self->loaded)
+    return NULL;
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  workdir = ide_vcs_get_working_directory (ide_context_get_vcs (context));
+
+  g_mutex_lock (&self->mutex);
+  paths = ide_trigram_index_query (self->index, literals);
+  g_mutex_unlock (&self->mutex);
+
+  ret = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint i = 0; i < paths->len; i++)
+    g_ptr_array_add (ret, g_file_get_child (workdir, g_ptr_array_index (paths, i)));
+
+  return ret;
+}
@@ -0,0 +1,45 @@
+/* ide-content-index.h
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_CONTENT_INDEX_H
+#define IDE_CONTENT_INDEX_H
+
+#include "ide-object.h"
+
+G_BEGIN_DECLS
+
+#define IDE_TYPE_CONTENT_INDEX (ide_content_index_get_type())
+
+G_DECLARE_FINAL_TYPE (IdeContentIndex, ide_content_index, IDE, CONTENT_INDEX, IdeObject)
+
+void       ide_content_index_load_async      (IdeContentIndex      *self,
+                                              GCancellable         *cancellable,
+                                              GAsyncReadyCallback   callback,
+                                              gpointer              user_data);
+gboolean   ide_content_index_load_finish     (IdeContentIndex      *self,
+                                              GAsyncResult         *result,
+                                              GError              **error);
+gboolean   ide_content_index_get_loaded      (IdeContentIndex      *self);
+void       ide_content_index_update_file     (IdeContentIndex      *self,
+                                              GFile                *file);
+GPtrArray *ide_content_index_find_candidates (IdeContentIndex      *self,
+                                              const gchar * const  *literals);
+
+G_END_DECLS
+
+#endif /* IDE_CONTENT_INDEX_H */
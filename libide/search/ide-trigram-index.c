@@ -0,0 +1,698 @@
+/* ide-trigram-index.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-trigram-index"
+
+#include <dazzle.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ide-debug.h"
+
+#include "search/ide-trigram-index.h"
+
+/*
+ * IdeTrigramIndex maps every (ASCII case-folded) trigram found in a document
+ * to the sorted list of documents containing it. To find documents that
+ * might contain a literal, we intersect the posting lists of the literal's
+ * trigrams. The result is a superset of the real matches, so callers are
+ * expected to verify the candidates by looking at the document contents.
+ *
+ * Documents are identified by an increasing id so that posting lists stay
+ * sorted when appending. Removing a document only tombstones its id, and we
+ * compact the posting lists once too many tombstones have accumulated.
+ *
+ * This structure is not thread-safe, callers must provide locking.
+ */
+
+G_DEFINE_BOXED_TYPE (IdeTrigramIndex, ide_trigram_index,
+                     ide_trigram_index_ref, ide_trigram_index_unref)
+
+DZL_DEFINE_COUNTER (instances, "IdeTrigramIndex", "Instances", "Number of trigram indexes")
+
+#define TRIGRAM_INDEX_VERSION      1
+#define TRIGRAM_INDEX_VARIANT_TYPE "(ua(st)a(uau))"
+
+typedef struct
+{
+  gchar   *path;
+  guint64  mtime;
+  guint    removed : 1;
+} Document;
+
+struct _IdeTrigramIndex
+{
+  volatile gint  ref_count;
+
+  /* Array of Document, indexed by document id */
+  GArray        *documents;
+
+  /* Path -> document id */
+  GHashTable    *by_path;
+
+  /* Trigram -> GArray of sorted guint32 document ids */
+  GHashTable    *postings;
+
+  guint          n_removed;
+};
+
+static inline guint32
+make_trigram (const guchar *str)
+{
+  return ((guint32)g_ascii_tolower (str[0]) << 16) |
+         ((guint32)g_ascii_tolower (str[1]) << 8) |
+         (guint32)g_ascii_tolower (str[2]);
+}
+
+static void
+clear_document (gpointer data)
+{
+  Document *doc = data;
+
+  g_clear_pointer (&doc->path, g_free);
+}
+
+static IdeTrigramIndex *
+ide_trigram_index_alloc (void)
+{
+  IdeTrigramIndex *self;
+
+  self = g_slice_new0 (IdeTrigramIndex);
+  self->ref_count = 1;
+  self->documents = g_array_new (FALSE, FALSE, sizeof (Document));
+  g_array_set_clear_func (self->documents, clear_document);
+  self->by_path = g_hash_table_new (g_str_hash, g_str_equal);
+  self->postings = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify)g_array_unref);
+
+  DZL_COUNTER_INC (instances);
+
+  return self;
+}
+
+/**
+ * ide_trigram_index_new:
+ *
+ * Creates a new, empty #IdeTrigramIndex.
+ *
+ * Returns: (transfer full): An #IdeTrigramIndex.
+ */
+IdeTrigramIndex *
+ide_trigram_index_new (void)
+{
+  return ide_trigram_index_alloc ();
+}
+
+IdeTrigramIndex *
+ide_trigram_index_ref (IdeTrigramIndex *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+ide_trigram_index_unref (IdeTrigramIndex *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_clear_pointer (&self->by_path, g_hash_table_unref);
+      g_clear_pointer (&self->postings, g_hash_table_unref);
+      g_clear_pointer (&self->documents, g_array_unref);
+      g_slice_free (IdeTrigramIndex, self);
+
+      DZL_COUNTER_DEC (instances);
+    }
+}
+
+static void
+ide_trigram_index_compact (IdeTrigramIndex *self)
+{
+  g_autoptr(GArray) documents = NULL;
+  g_autofree guint32 *remap = NULL;
+  GHashTableIter iter;
+  gpointer value;
+
+  IDE_ENTRY;
+
+  g_assert (self != NULL);
+
+  remap = g_new (guint32, self->documents->len);
+  documents = g_array_sized_new (FALSE, FALSE, sizeof (Document),
+                                 self->documents->len - self->n_removed);
+  g_array_set_clear_func (documents, clear_document);
+
+  g_hash_table_remove_all (self->by_path);
+
+  for (guint i = 0; i < self->documents->len; i++)
+    {
+      Document *doc = &g_array_index (self->documents, Document, i);
+
+      if (doc->removed)
+        {
+          remap[i] = G_MAXUINT32;
+          continue;
+        }
+
+      remap[i] = documents->len;
+      g_array_append_val (documents, *doc);
+      g_hash_table_insert (self->by_path, doc->path, GUINT_TO_POINTER (remap[i]));
+
+      /* Ownership of the path was transferred to @documents */
+      doc->path = NULL;
+    }
+
+  g_hash_table_iter_init (&iter, self->postings);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GArray *ids = value;
+      guint pos = 0;
+
+      /* Renumbering preserves ordering, so the list stays sorted */
+      for (guint i = 0; i < ids->len; i++)
+        {
+          guint32 id = remap[g_array_index (ids, guint32, i)];
+
+          if (id != G_MAXUINT32)
+            g_array_index (ids, guint32, pos++) = id;
+        }
+
+      if (pos == 0)
+        g_hash_table_iter_remove (&iter);
+      else
+        g_array_set_size (ids, pos);
+    }
+
+  g_array_unref (self->documents);
+  self->documents = g_steal_pointer (&documents);
+  self->n_removed = 0;
+
+  IDE_EXIT;
+}
+
+void
+ide_trigram_index_remove (IdeTrigramIndex *self,
+                          const gchar     *path)
+{
+  gpointer value;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (path != NULL);
+
+  if (g_hash_table_lookup_extended (self->by_path, path, NULL, &value))
+    {
+      Document *doc = &g_array_index (self->documents, Document, GPOINTER_TO_UINT (value));
+
+      g_hash_table_remove (self->by_path, path);
+      doc->removed = TRUE;
+      self->n_removed++;
+
+      if (self->n_removed > 1024 && self->n_removed > self->documents->len / 2)
+        ide_trigram_index_compact (self);
+    }
+}
+
+/**
+ * ide_trigram_index_insert:
+ * @self: An #IdeTrigramIndex
+ * @path: the path of the document
+ * @mtime: the modification time of the document
+ * @contents: the document contents
+ * @length: the length of @contents in bytes
+ *
+ * Adds the trigrams of @contents to the index for @path, replacing any
+ * previously indexed contents for @path.
+ */
+void
+ide_trigram_index_insert (IdeTrigramIndex *self,
+                          const gchar     *path,
+                          guint64          mtime,
+                          const gchar     *contents,
+                          gsize            length)
+{
+  g_autoptr(GHashTable) seen = NULL;
+  const guchar *data = (const guchar *)contents;
+  Document doc = { 0 };
+  guint32 id;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (path != NULL);
+  g_return_if_fail (contents != NULL || length == 0);
+
+  ide_trigram_index_remove (self, path);
+
+  id = self->documents->len;
+
+  doc.path = g_strdup (path);
+  doc.mtime = mtime;
+  g_array_append_val (self->documents, doc);
+  g_hash_table_insert (self->by_path, doc.path, GUINT_TO_POINTER (id));
+
+  if (length < 3)
+    return;
+
+  seen = g_hash_table_new (NULL, NULL);
+
+  for (gsize i = 0; i + 2 < length; i++)
+    {
+      guint32 trigram;
+      GArray *ids;
+
+      if (data[i] == 0 || data[i + 1] == 0 || data[i + 2] == 0)
+        continue;
+
+      trigram = make_trigram (&data[i]);
+
+      if (!g_hash_table_add (seen, GUINT_TO_POINTER (trigram)))
+        continue;
+
+      if (!(ids = g_hash_table_lookup (self->postings, GUINT_TO_POINTER (trigram))))
+        {
+          ids = g_array_new (FALSE, FALSE, sizeof (guint32));
+          g_hash_table_insert (self->postings, GUINT_TO_POINTER (trigram), ids);
+        }
+
+      /* @id is always the largest id so far, keeping the list sorted */
+      g_array_append_val (ids, id);
+    }
+}
+
+gboolean
+ide_trigram_index_get_mtime (IdeTrigramIndex *self,
+                             const gchar     *path,
+                             guint64         *mtime)
+{
+  gpointer value;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (path != NULL, FALSE);
+
+  if (!g_hash_table_lookup_extended (self->by_path, path, NULL, &value))
+    return FALSE;
+
+  if (mtime != NULL)
+    *mtime = g_array_index (self->documents, Document, GPOINTER_TO_UINT (value)).mtime;
+
+  return TRUE;
+}
+
+guint
+ide_trigram_index_get_n_paths (IdeTrigramIndex *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return g_hash_table_size (self->by_path);
+}
+
+static GPtrArray *
+ide_trigram_index_collect_paths (IdeTrigramIndex *self)
+{
+  GPtrArray *ret;
+
+  g_assert (self != NULL);
+
+  ret = g_ptr_array_new_with_free_func (g_free);
+
+  for (guint i = 0; i < self->documents->len; i++)
+    {
+      const Document *doc = &g_array_index (self->documents, Document, i);
+
+      if (!doc->removed)
+        g_ptr_array_add (ret, g_strdup (doc->path));
+    }
+
+  return ret;
+}
+
+/**
+ * ide_trigram_index_get_paths:
+ * @self: An #IdeTrigramIndex
+ *
+ * Gets all of the paths contained in the index.
+ *
+ * Returns: (transfer full) (element-type utf8): A #GPtrArray of paths.
+ */
+GPtrArray *
+ide_trigram_index_get_paths (IdeTrigramIndex *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return ide_trigram_index_collect_paths (self);
+}
+
+static gint
+compare_by_length (gconstpointer a,
+                   gconstpointer b)
+{
+  const GArray *ida = *(const GArray **)a;
+  const GArray *idb = *(const GArray **)b;
+
+  return (gint)ida->len - (gint)idb->len;
+}
+
+static void
+intersect (GArray       *dest,
+           const GArray *other)
+{
+  guint pos = 0;
+  guint i = 0;
+  guint j = 0;
+
+  g_assert (dest != NULL);
+  g_assert (other != NULL);
+
+  while (i < dest->len && j < other->len)
+    {
+      guint32 a = g_array_index (dest, guint32, i);
+      guint32 b = g_array_index (other, guint32, j);
+
+      if (a < b)
+        i++;
+      else if (a > b)
+        j++;
+      else
+        {
+          g_array_index (dest, guint32, pos++) = a;
+          i++;
+          j++;
+        }
+    }
+
+  g_array_set_size (dest, pos);
+}
+
+/*
+ * Returns the ids of documents which may contain @literal, or %NULL if
+ * @literal is too short to be filtered by trigrams.
+ */
+static GArray *
+ide_trigram_index_query_literal (IdeTrigramIndex *self,
+                                 const gchar     *literal)
+{
+  g_autoptr(GPtrArray) lists = NULL;
+  const guchar *data = (const guchar *)literal;
+  GArray *ret;
+  gsize len;
+
+  g_assert (self != NULL);
+  g_assert (literal != NULL);
+
+  len = strlen (literal);
+
+  if (len < 3)
+    return NULL;
+
+  lists = g_ptr_array_new ();
+
+  for (gsize i = 0; i + 2 < len; i++)
+    {
+      guint32 trigram = make_trigram (&data[i]);
+      GArray *ids;
+
+      /* A missing trigram means nothing can match */
+      if (!(ids = g_hash_table_lookup (self->postings, GUINT_TO_POINTER (trigram))))
+        return g_array_new (FALSE, FALSE, sizeof (guint32));
+
+      g_ptr_array_add (lists, ids);
+    }
+
+  /* Start with the shortest list to keep the intersection cheap */
+  g_ptr_array_sort (lists, compare_by_length);
+
+  ret = g_array_sized_new (FALSE, FALSE, sizeof (guint32),
+                           ((GArray *)g_ptr_array_index (lists, 0))->len);
+  g_array_append_vals (ret,
+                       ((GArray *)g_ptr_array_index (lists, 0))->data,
+                       ((GArray *)g_ptr_array_index (lists, 0))->len);
+
+  for (guint i = 1; i < lists->len && ret->len > 0; i++)
+    intersect (ret, g_ptr_array_index (lists, i));
+
+  return ret;
+}
+
+/**
+ * ide_trigram_index_query:
+ * @self: An #IdeTrigramIndex
+ * @literals: (array zero-terminated=1): the literals to look for
+ *
+ * Locates the paths of documents that may contain any of @literals. The
+ * comparison is ASCII case-insensitive and may contain false positives, so
+ * the caller should verify the contents of each document.
+ *
+ * Literals shorter than 3 bytes cannot be filtered and will cause every
+ * path in the index to be returned.
+ *
+ * Returns: (transfer full) (element-type utf8): A #GPtrArray of paths.
+ */
+GPtrArray *
+ide_trigram_index_query (IdeTrigramIndex     *self,
+                         const gchar * const *literals)
+{
+  g_autoptr(GHashTable) matched = NULL;
+  GPtrArray *ret;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (literals != NULL, NULL);
+
+  matched = g_hash_table_new (NULL, NULL);
+
+  for (guint i = 0; literals[i] != NULL; i++)
+    {
+      g_autoptr(GArray) ids = ide_trigram_index_query_literal (self, literals[i]);
+
+      if (ids == NULL)
+        return ide_trigram_index_collect_paths (self);
+
+      for (guint j = 0; j < ids->len; j++)
+        g_hash_table_add (matched, GUINT_TO_POINTER (g_array_index (ids, guint32, j)));
+    }
+
+  ret = g_ptr_array_new_with_free_func (g_free);
+
+  /* Walk the documents rather than the set to return them in id order */
+  for (guint i = 0; i < self->documents->len; i++)
+    {
+      const Document *doc = &g_array_index (self->documents, Document, i);
+
+      if (!doc->removed && g_hash_table_contains (matched, GUINT_TO_POINTER (i)))
+        g_ptr_array_add (ret, g_strdup (doc->path));
+    }
+
+  return ret;
+}
+
+/**
+ * ide_trigram_index_serialize:
+ * @self: An #IdeTrigramIndex
+ *
+ * Serializes the index into the format read by
+ * ide_trigram_index_new_from_file(). This does not touch the disk, so
+ * callers sharing the index between threads may serialize while holding
+ * their lock and write the result after releasing it.
+ *
+ * Returns: (transfer full): A #GBytes containing the serialized index.
+ */
+GBytes *
+ide_trigram_index_serialize (IdeTrigramIndex *self)
+{
+  g_autoptr(GVariant) variant = NULL;
+  GVariantBuilder documents;
+  GVariantBuilder postings;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  /* Tombstones are not persisted, so the ids must be dense */
+  if (self->n_removed > 0)
+    ide_trigram_index_compact (self);
+
+  g_variant_builder_init (&documents, G_VARIANT_TYPE ("a(st)"));
+
+  for (guint i = 0; i < self->documents->len; i++)
+    {
+      const Document *doc = &g_array_index (self->documents, Document, i);
+
+      g_variant_builder_add (&documents, "(st)", doc->path, doc->mtime);
+    }
+
+  g_variant_builder_init (&postings, G_VARIANT_TYPE ("a(uau)"));
+
+  g_hash_table_iter_init (&iter, self->postings);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      GArray *ids = value;
+
+      g_variant_builder_add (&postings, "(u@au)",
+                             GPOINTER_TO_UINT (key),
+                             g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                                        ids->data,
+                                                        ids->len,
+                                                        sizeof (guint32)));
+    }
+
+  variant = g_variant_ref_sink (g_variant_new ("(ua(st)a(uau))",
+                                               TRIGRAM_INDEX_VERSION,
+                                               &documents,
+                                               &postings));
+
+  return g_variant_get_data_as_bytes (variant);
+}
+
+/**
+ * ide_trigram_index_save:
+ * @self: An #IdeTrigramIndex
+ * @path: the path to write the index to
+ * @error: A location for a #GError, or %NULL
+ *
+ * Serializes the index to @path so that it may be restored with
+ * ide_trigram_index_new_from_file().
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+ide_trigram_index_save (IdeTrigramIndex  *self,
+                        const gchar      *path,
+                        GError          **error)
+{
+  g_autoptr(GBytes) bytes = NULL;
+  g_autofree gchar *dir = NULL;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (path != NULL, FALSE);
+
+  bytes = ide_trigram_index_serialize (self);
+
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0750);
+
+  IDE_RETURN (g_file_set_contents (path,
+                                   g_bytes_get_data (bytes, NULL),
+                                   g_bytes_get_size (bytes),
+                                   error));
+}
+
+/**
+ * ide_trigram_index_new_from_file:
+ * @path: the path to a file created with ide_trigram_index_save()
+ * @error: A location for a #GError, or %NULL
+ *
+ * Restores an index previously saved with ide_trigram_index_save().
+ *
+ * Returns: (transfer full): An #IdeTrigramIndex or %NULL and @error is set.
+ */
+IdeTrigramIndex *
+ide_trigram_index_new_from_file (const gchar  *path,
+                                 GError      **error)
+{
+  g_autoptr(IdeTrigramIndex) self = NULL;
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GVariant) documents = NULL;
+  g_autoptr(GVariant) postings = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  GVariantIter iter;
+  const gchar *doc_path;
+  guint64 mtime;
+  guint32 trigram;
+  GVariant *ids_variant;
+  guint version = 0;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (path != NULL, NULL);
+
+  if (!(mapped = g_mapped_file_new (path, FALSE, error)))
+    IDE_RETURN (NULL);
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  variant = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (TRIGRAM_INDEX_VARIANT_TYPE),
+                                                          bytes, FALSE));
+
+  /* Untrusted data, make sure offsets are sane before we walk it */
+  if (!g_variant_is_normal_form (variant))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Trigram index is corrupted");
+      IDE_RETURN (NULL);
+    }
+
+  g_variant_get (variant, "(u@a(st)@a(uau))", &version, &documents, &postings);
+
+  if (version != TRIGRAM_INDEX_VERSION)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Trigram index version %u is not supported",
+                   version);
+      IDE_RETURN (NULL);
+    }
+
+  self = ide_trigram_index_alloc ();
+
+  g_variant_iter_init (&iter, documents);
+
+  while (g_variant_iter_next (&iter, "(&st)", &doc_path, &mtime))
+    {
+      Document doc = { 0 };
+
+      doc.path = g_strdup (doc_path);
+      doc.mtime = mtime;
+      g_array_append_val (self->documents, doc);
+      g_hash_table_insert (self->by_path, doc.path, GUINT_TO_POINTER (self->documents->len - 1));
+    }
+
+  g_variant_iter_init (&iter, postings);
+
+  while (g_variant_iter_next (&iter, "(u@au)", &trigram, &ids_variant))
+    {
+      const guint32 *ids;
+      gsize n_ids = 0;
+      GArray *ar;
+
+      ids = g_variant_get_fixed_array (ids_variant, &n_ids, sizeof (guint32));
+      ar = g_array_sized_new (FALSE, FALSE, sizeof (guint32), n_ids);
+
+      for (gsize i = 0; i < n_ids; i++)
+        {
+          /* Drop anything that doesn't reference a document */
+          if (ids[i] < self->documents->len)
+            g_array_append_val (ar, ids[i]);
+        }
+
+      g_hash_table_insert (self->postings, GUINT_TO_POINTER (trigram), ar);
+
+      g_variant_unref (ids_variant);
+    }
+
+  IDE_RETURN (g_steal_pointer (&self));
+}
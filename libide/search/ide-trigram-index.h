@@ -0,0 +1,59 @@
+/* ide-trigram-index.h
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_TRIGRAM_INDEX_H
+#define IDE_TRIGRAM_INDEX_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define IDE_TYPE_TRIGRAM_INDEX (ide_trigram_index_get_type())
+
+typedef struct _IdeTrigramIndex IdeTrigramIndex;
+
+GType            ide_trigram_index_get_type      (void);
+IdeTrigramIndex *ide_trigram_index_new           (void);
+IdeTrigramIndex *ide_trigram_index_new_from_file (const gchar          *path,
+                                                  GError              **error);
+IdeTrigramIndex *ide_trigram_index_ref           (IdeTrigramIndex      *self);
+void             ide_trigram_index_unref         (IdeTrigramIndex      *self);
+void             ide_trigram_index_insert        (IdeTrigramIndex      *self,
+                                                  const gchar          *path,
+                                                  guint64               mtime,
+                                                  const gchar          *contents,
+                                                  gsize                 length);
+void             ide_trigram_index_remove        (IdeTrigramIndex      *self,
+                                                  const gchar          *path);
+gboolean         ide_trigram_index_get_mtime     (IdeTrigramIndex      *self,
+                                                  const gchar          *path,
+                                                  guint64              *mtime);
+guint            ide_trigram_index_get_n_paths   (IdeTrigramIndex      *self);
+GPtrArray       *ide_trigram_index_get_paths     (IdeTrigramIndex      *self);
+GPtrArray       *ide_trigram_index_query         (IdeTrigramIndex      *self,
+                                                  const gchar * const  *literals);
+GBytes          *ide_trigram_index_serialize     (IdeTrigramIndex      *self);
+gboolean         ide_trigram_index_save          (IdeTrigramIndex      *self,
+                                                  const gchar          *path,
+                                                  GError              **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeTrigramIndex, ide_trigram_index_unref)
+
+G_END_DECLS
+
+#endif /* IDE_TRIGRAM_INDEX_H */
@@ -0,0 +1,47 @@
+/* ide-completion-fuzzy-private.h
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _IdeCompletionFuzzyBatch IdeCompletionFuzzyBatch;
+
+gboolean                 _ide_completion_fuzzy_match            (const gchar             *haystack,
+                                                                 gsize                    haystack_len,
+                                                                 const gchar             *casefold_needle,
+                                                                 guint                   *priority);
+const gchar             *_ide_completion_fuzzy_get_impl         (void);
+IdeCompletionFuzzyBatch *_ide_completion_fuzzy_batch_new        (void);
+void                     _ide_completion_fuzzy_batch_free       (IdeCompletionFuzzyBatch *self);
+guint                    _ide_completion_fuzzy_batch_add        (IdeCompletionFuzzyBatch *self,
+                                                                 const gchar             *text);
+guint                    _ide_completion_fuzzy_batch_get_length (IdeCompletionFuzzyBatch *self);
+const gchar             *_ide_completion_fuzzy_batch_get_text   (IdeCompletionFuzzyBatch *self,
+                                                                 guint                    index);
+guint                    _ide_completion_fuzzy_batch_filter     (IdeCompletionFuzzyBatch *self,
+                                                                 const gchar             *casefold_needle,
+                                                                 guint                   *indexes,
+                                                                 guint                    n_indexes,
+                                                                 guint                   *priorities);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeCompletionFuzzyBatch, _ide_completion_fuzzy_batch_free)
+
+G_END_DECLS
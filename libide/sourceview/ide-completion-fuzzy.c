@@ -0,0 +1,457 @@
+/* ide-completion-fuzzy.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-completion-fuzzy"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+# define HAVE_X86_SIMD 1
+# include <immintrin.h>
+#endif
+
+#include "sourceview/ide-completion-fuzzy-private.h"
+
+/*
+ * This is the matching kernel behind ide_completion_item_fuzzy_match().
+ *
+ * For every character of the casefolded needle, the haystack is searched
+ * for the character, and only then for its uppercase form. Skipped bytes
+ * cost 2 each, and the bytes left after the last match cost 1 each. The
+ * scores are identical to the strchr() based implementation this replaces,
+ * but both searches happen in a single pass over the haystack, 16 or 32
+ * bytes at a time when SSE2 or AVX2 is available.
+ *
+ * IdeCompletionFuzzyBatch stores many candidates back to back so that a
+ * whole result set can be filtered without touching the proposal objects.
+ * Each candidate also has a bitmap of the (case-insensitive) characters it
+ * contains, which rejects most candidates without looking at their text.
+ *
+ * Only ASCII needles are supported. The haystack may contain UTF-8, which
+ * is treated as opaque bytes.
+ */
+
+typedef gboolean (*MatchFunc) (const guint8 *haystack,
+                               gsize         haystack_len,
+                               const guint8 *needle,
+                               gsize         needle_len,
+                               guint        *priority);
+
+struct _IdeCompletionFuzzyBatch
+{
+  /* Candidates, each followed by a NUL byte */
+  GByteArray *text;
+  /* guint32 offset of each candidate within @text */
+  GArray     *offsets;
+  /* guint32 length of each candidate, not including the NUL */
+  GArray     *lengths;
+  /* guint64 bitmap of the characters within each candidate */
+  GArray     *masks;
+};
+
+static inline guint64
+char_bit (guint8 ch)
+{
+  ch = g_ascii_tolower (ch);
+
+  if (ch >= 'a' && ch <= 'z')
+    return G_GUINT64_CONSTANT (1) << (ch - 'a');
+
+  if (ch >= '0' && ch <= '9')
+    return G_GUINT64_CONSTANT (1) << (26 + ch - '0');
+
+  if (ch == '_')
+    return G_GUINT64_CONSTANT (1) << 36;
+
+  return G_GUINT64_CONSTANT (1) << 63;
+}
+
+static guint64
+get_mask (const guint8 *str,
+          gsize         len)
+{
+  guint64 mask = 0;
+
+  for (gsize i = 0; i < len; i++)
+    mask |= char_bit (str[i]);
+
+  return mask;
+}
+
+/*
+ * Returns the offset of the first @lower within @str, or if there is
+ * none, the offset of the first @upper. Returns -1 if neither is found.
+ */
+static inline gssize
+find_scalar (const guint8 *str,
+             gsize         len,
+             guint8        lower,
+             guint8        upper)
+{
+  const guint8 *found;
+
+  if ((found = memchr (str, lower, len)))
+    return found - str;
+
+  if (upper != lower && (found = memchr (str, upper, len)))
+    return found - str;
+
+  return -1;
+}
+
+#ifdef HAVE_X86_SIMD
+static inline gssize
+find_sse2 (const guint8 *str,
+           gsize         len,
+           guint8        lower,
+           guint8        upper)
+{
+  const __m128i vlower = _mm_set1_epi8 ((gchar)lower);
+  const __m128i vupper = _mm_set1_epi8 ((gchar)upper);
+  gssize first_upper = -1;
+  gsize i = 0;
+
+  for (; i + 16 <= len; i += 16)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *)(gconstpointer)(str + i));
+      guint m = _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, vlower));
+
+      if (m != 0)
+        return i + __builtin_ctz (m);
+
+      if (first_upper < 0 && (m = _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, vupper))))
+        first_upper = i + __builtin_ctz (m);
+    }
+
+  for (; i < len; i++)
+    {
+      if (str[i] == lower)
+        return i;
+
+      if (first_upper < 0 && str[i] == upper)
+        first_upper = i;
+    }
+
+  return first_upper;
+}
+
+__attribute__((target("avx2")))
+static inline gssize
+find_avx2 (const guint8 *str,
+           gsize         len,
+           guint8        lower,
+           guint8        upper)
+{
+  const __m256i vlower = _mm256_set1_epi8 ((gchar)lower);
+  const __m256i vupper = _mm256_set1_epi8 ((gchar)upper);
+  gssize first_upper = -1;
+  gsize i = 0;
+
+  for (; i + 32 <= len; i += 32)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *)(gconstpointer)(str + i));
+      guint m = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, vlower));
+
+      if (m != 0)
+        return i + __builtin_ctz (m);
+
+      if (first_upper < 0 && (m = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, vupper))))
+        first_upper = i + __builtin_ctz (m);
+    }
+
+  for (; i < len; i++)
+    {
+      if (str[i] == lower)
+        return i;
+
+      if (first_upper < 0 && str[i] == upper)
+        first_upper = i;
+    }
+
+  return first_upper;
+}
+#endif
+
+#define TO_UPPER(ch) (((ch) >= 'a' && (ch) <= 'z') ? (ch) - 'a' + 'A' : (ch))
+
+#define DEFINE_MATCH_FUNC(name, find, attributes)                             \
+  attributes                                                                  \
+  static gboolean                                                             \
+  name (const guint8 *haystack,                                               \
+        gsize         haystack_len,                                           \
+        const guint8 *needle,                                                 \
+        gsize         needle_len,                                             \
+        guint        *priority)                                               \
+  {                                                                           \
+    guint score = 0;                                                          \
+                                                                              \
+    for (gsize i = 0; i < needle_len; i++)                                    \
+      {                                                                       \
+        guint8 upper = TO_UPPER (needle[i]);                                  \
+        gssize pos = find (haystack, haystack_len, needle[i], upper);         \
+                                                                              \
+        if (pos < 0)                                                          \
+          return FALSE;                                                       \
+                                                                              \
+        score += pos * 2;                                                     \
+        haystack += pos + 1;                                                  \
+        haystack_len -= pos + 1;                                              \
+      }                                                                       \
+                                                                              \
+    *priority = score + haystack_len;                                         \
+                                                                              \
+    return TRUE;                                                              \
+  }
+
+DEFINE_MATCH_FUNC (match_scalar, find_scalar, )
+#ifdef HAVE_X86_SIMD
+DEFINE_MATCH_FUNC (match_sse2, find_sse2, )
+DEFINE_MATCH_FUNC (match_avx2, find_avx2, __attribute__((target("avx2"))))
+#endif
+
+static const struct {
+  const gchar *name;
+  MatchFunc    func;
+} impls[] = {
+  { "scalar", match_scalar },
+#ifdef HAVE_X86_SIMD
+  { "sse2", match_sse2 },
+  { "avx2", match_avx2 },
+#endif
+};
+
+static guint
+get_impl (void)
+{
+  static gsize impl_init;
+
+  if (g_once_init_enter (&impl_init))
+    {
+      gsize impl = 0;
+      const gchar *force = g_getenv ("IDE_COMPLETION_FUZZY_IMPL");
+
+#ifdef HAVE_X86_SIMD
+      __builtin_cpu_init ();
+      impl = __builtin_cpu_supports ("avx2") ? 2 : 1;
+#endif
+
+      /* Allow comparing implementations on the same machine */
+      if (force != NULL)
+        {
+          for (guint i = 0; i <= impl; i++)
+            {
+              if (g_strcmp0 (force, impls[i].name) == 0)
+                {
+                  impl = i;
+                  break;
+                }
+            }
+        }
+
+      g_once_init_leave (&impl_init, impl + 1);
+    }
+
+  return impl_init - 1;
+}
+
+/**
+ * _ide_completion_fuzzy_get_impl:
+ *
+ * Gets the name of the implementation used for matching on this machine,
+ * which is one of "scalar", "sse2" or "avx2". The implementation can be
+ * downgraded with the IDE_COMPLETION_FUZZY_IMPL environment variable.
+ */
+const gchar *
+_ide_completion_fuzzy_get_impl (void)
+{
+  return impls[get_impl ()].name;
+}
+
+/**
+ * _ide_completion_fuzzy_match:
+ * @haystack: the string to search
+ * @haystack_len: the length of @haystack in bytes
+ * @casefold_needle: a casefolded ASCII needle
+ * @priority: (out): a location for the score
+ *
+ * Like ide_completion_item_fuzzy_match() but requires an ASCII needle.
+ *
+ * Returns: %TRUE if @haystack matched.
+ */
+gboolean
+_ide_completion_fuzzy_match (const gchar *haystack,
+                             gsize        haystack_len,
+                             const gchar *casefold_needle,
+                             guint       *priority)
+{
+  guint dummy;
+
+  g_return_val_if_fail (haystack != NULL, FALSE);
+  g_return_val_if_fail (casefold_needle != NULL, FALSE);
+
+  return impls[get_impl ()].func ((const guint8 *)haystack,
+                                  haystack_len,
+                                  (const guint8 *)casefold_needle,
+                                  strlen (casefold_needle),
+                                  priority ? priority : &dummy);
+}
+
+IdeCompletionFuzzyBatch *
+_ide_completion_fuzzy_batch_new (void)
+{
+  IdeCompletionFuzzyBatch *self;
+
+  self = g_slice_new0 (IdeCompletionFuzzyBatch);
+  self->text = g_byte_array_new ();
+  self->offsets = g_array_new (FALSE, FALSE, sizeof (guint32));
+  self->lengths = g_array_new (FALSE, FALSE, sizeof (guint32));
+  self->masks = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+  return self;
+}
+
+void
+_ide_completion_fuzzy_batch_free (IdeCompletionFuzzyBatch *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->text, g_byte_array_unref);
+      g_clear_pointer (&self->offsets, g_array_unref);
+      g_clear_pointer (&self->lengths, g_array_unref);
+      g_clear_pointer (&self->masks, g_array_unref);
+      g_slice_free (IdeCompletionFuzzyBatch, self);
+    }
+}
+
+/**
+ * _ide_completion_fuzzy_batch_add:
+ * @self: an #IdeCompletionFuzzyBatch
+ * @text: (nullable): the text to match against, such as the typed text
+ *   of a proposal. %NULL is treated as an empty string.
+ *
+ * Returns: the index of the new candidate
+ */
+guint
+_ide_completion_fuzzy_batch_add (IdeCompletionFuzzyBatch *self,
+                                 const gchar             *text)
+{
+  guint32 offset;
+  guint32 len;
+  guint64 mask;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  if (text == NULL)
+    text = "";
+
+  offset = self->text->len;
+  len = strlen (text);
+  mask = get_mask ((const guint8 *)text, len);
+
+  g_byte_array_append (self->text, (const guint8 *)text, len + 1);
+  g_array_append_val (self->offsets, offset);
+  g_array_append_val (self->lengths, len);
+  g_array_append_val (self->masks, mask);
+
+  return self->offsets->len - 1;
+}
+
+guint
+_ide_completion_fuzzy_batch_get_length (IdeCompletionFuzzyBatch *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->offsets->len;
+}
+
+const gchar *
+_ide_completion_fuzzy_batch_get_text (IdeCompletionFuzzyBatch *self,
+                                      guint                    index)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (index < self->offsets->len, NULL);
+
+  return (const gchar *)self->text->data + g_array_index (self->offsets, guint32, index);
+}
+
+/**
+ * _ide_completion_fuzzy_batch_filter:
+ * @self: an #IdeCompletionFuzzyBatch
+ * @casefold_needle: a casefolded ASCII needle
+ * @indexes: (array length=n_indexes) (inout): the candidates to check
+ * @n_indexes: the number of elements in @indexes
+ * @priorities: (out caller-allocates): an array with an element for each
+ *   candidate in @self
+ *
+ * Removes the candidates that do not match @casefold_needle from @indexes,
+ * keeping the order of the others, and stores their score in @priorities
+ * at their index. Elements of @priorities for other candidates are left
+ * untouched.
+ *
+ * Returns: the number of candidates left in @indexes
+ */
+guint
+_ide_completion_fuzzy_batch_filter (IdeCompletionFuzzyBatch *self,
+                                    const gchar             *casefold_needle,
+                                    guint                   *indexes,
+                                    guint                    n_indexes,
+                                    guint                   *priorities)
+{
+  const guint8 *text;
+  const guint32 *offsets;
+  const guint32 *lengths;
+  const guint64 *masks;
+  const guint8 *needle;
+  MatchFunc match;
+  guint64 needle_mask;
+  gsize needle_len;
+  guint n_matched = 0;
+
+  g_return_val_if_fail (self != NULL, 0);
+  g_return_val_if_fail (casefold_needle != NULL, 0);
+  g_return_val_if_fail (indexes != NULL || n_indexes == 0, 0);
+  g_return_val_if_fail (priorities != NULL || n_indexes == 0, 0);
+
+  text = self->text->data;
+  offsets = (const guint32 *)(gpointer)self->offsets->data;
+  lengths = (const guint32 *)(gpointer)self->lengths->data;
+  masks = (const guint64 *)(gpointer)self->masks->data;
+
+  needle = (const guint8 *)casefold_needle;
+  needle_len = strlen (casefold_needle);
+  needle_mask = get_mask (needle, needle_len);
+  match = impls[get_impl ()].func;
+
+  for (guint i = 0; i < n_indexes; i++)
+    {
+      guint index = indexes[i];
+
+      g_assert (index < self->offsets->len);
+
+      /* Skip candidates missing one of the characters altogether */
+      if ((masks[index] & needle_mask) != needle_mask)
+        continue;
+
+      if (!match (text + offsets[index], lengths[index], needle, needle_len, &priorities[index]))
+        continue;
+
+      indexes[n_matched++] = index;
+    }
+
+  return n_matched;
+}
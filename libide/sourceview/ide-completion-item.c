@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include "ide-completion-item.h"
+#include "sourceview/ide-completion-fuzzy-private.h"
 
 G_DEFINE_ABSTRACT_TYPE (IdeCompletionItem, ide_completion_item, G_TYPE_OBJECT)
 
@@ -100,6 +101,10 @@ ide_completion_item_fuzzy_match (const gchar *haystack,
 {
   gint real_score = 0;
 
+  /* The common case of an ASCII needle has a faster implementation */
+  if (g_str_is_ascii (casefold_needle))
+    return _ide_completion_fuzzy_match (haystack, strlen (haystack), casefold_needle, priority);
+
   for (; *casefold_needle; casefold_needle = g_utf8_next_char (casefold_needle))
     {
       gunichar ch = g_utf8_get_char (casefold_needle);
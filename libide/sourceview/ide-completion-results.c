@@ -22,36 +22,62 @@
 #include <string.h>
 
 #include "ide-debug.h"
+#include "ide-macros.h"
 
-#include "sourceview/ide-completion-results.h"
-#include "util/ide-list-inline.h"
+#include "sourceview/ide-completion-fuzzy-private.h"
+#include "sourceview/ide-completion-results-private.h"
+
+/*
+ * The number of proposals handed to GtkSourceCompletion synchronously
+ * from ide_completion_results_present(). It only displays a few dozen
+ * rows, so this is what needs to be ready in the same frame. The rest
+ * are selected and added PAGE_SIZE at a time from an idle callback.
+ */
+#define INITIAL_PAGE_SIZE 100
+#define PAGE_SIZE         1000
 
 typedef struct
 {
   /*
-   * needs_refilter indicates that the result set must have
-   * the linked list rebuilt from the array. Doing so must
-   * have match() called on each item to determine its
-   * visibility.
+   * needs_refilter indicates that visible must be filtered
+   * again for the current replay query.
    */
   guint needs_refilter : 1;
   /*
-   * If a g_list_sort() needs to be called on our synthesized
-   * linked list of visible items.
+   * If can_reuse_list is set, refilter requests may filter the
+   * visible items instead of starting over from all results.
    */
-  guint needs_sort : 1;
+  guint can_reuse_list : 1;
   /*
-   * If can_reuse_list is set, refilter requests may traverse
-   * the linked list instead of a full array scan.
+   * has_unkeyed is set once a proposal was added without a key,
+   * after which keys can no longer be used for filtering.
    */
-  guint can_reuse_list : 1;
+  guint has_unkeyed : 1;
   /*
-   * results contains all of our IdeCompletionItem results.
-   * We use this array of items with embedded GList links to
-   * create a zero-allocation linked list (well technically
-   * the item is an allocation, but we can't get around that).
+   * results contains all of our IdeCompletionItem results, in the
+   * order they were added. Everything below refers to items by
+   * their index within this array.
    */
   GPtrArray *results;
+  /*
+   * keys contains the text to match for each item, when all of
+   * them were added with ide_completion_results_take_proposal_with_key().
+   * They are stored contiguously so that filtering does not need
+   * to touch the items themselves.
+   */
+  IdeCompletionFuzzyBatch *keys;
+  /*
+   * priorities contains the score of each item from the last
+   * refilter, indexed like results.
+   */
+  GArray *priorities;
+  /*
+   * visible contains the indexes of the items matching the query.
+   * It is filtered in place. Only the first n_sorted indexes are
+   * in presentation order, we select more as they are presented.
+   */
+  GArray *visible;
+  guint n_sorted;
   /*
    * query is the filtering string that was used to create the
    * initial set of results. All future queries must have this
@@ -65,14 +91,13 @@ typedef struct
    */
   gchar *replay;
   /*
-   * As an optimization, the linked list for result nodes are
-   * embedded in the IdeCompletionItem structures and we do not
-   * allocate them. This is the pointer to the first item in the
-   * result set that matches our query. It is not allocated
-   * and do not try to free it or perform g_list_*() operations
-   * upon it except for g_list_sort().
+   * The context we are adding the remaining visible items to,
+   * from present_source, until it is cancelled.
    */
-  GList *head;
+  GtkSourceCompletionContext *context;
+  GtkSourceCompletionProvider *provider;
+  guint n_presented;
+  guint present_source;
 } IdeCompletionResultsPrivate;
 
 typedef struct
@@ -81,15 +106,15 @@ typedef struct
   gint (*compare) (IdeCompletionResults *,
                    IdeCompletionItem *,
                    IdeCompletionItem *);
+  GPtrArray *results;
+  IdeCompletionFuzzyBatch *keys;
+  const guint *priorities;
 } SortState;
 
 G_DEFINE_TYPE_WITH_PRIVATE (IdeCompletionResults, ide_completion_results, G_TYPE_OBJECT)
 
 DZL_DEFINE_COUNTER (instances, "IdeCompletionResults", "Instances", "Number of IdeCompletionResults")
 
-#define GET_ITEM(i) ((IdeCompletionItem *)(g_ptr_array_index((priv)->results, (i))))
-#define GET_ITEM_LINK(item) (&((IdeCompletionItem *)(item))->link)
-
 enum {
   PROP_0,
   PROP_QUERY,
@@ -106,6 +131,44 @@ ide_completion_results_new (const gchar *query)
                        NULL);
 }
 
+static void
+ide_completion_results_stop_presenting (IdeCompletionResults *self)
+{
+  IdeCompletionResultsPrivate *priv = ide_completion_results_get_instance_private (self);
+
+  g_assert (IDE_IS_COMPLETION_RESULTS (self));
+
+  ide_clear_source (&priv->present_source);
+
+  if (priv->context != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (priv->context,
+                                            G_CALLBACK (ide_completion_results_stop_presenting),
+                                            self);
+      g_clear_object (&priv->context);
+    }
+
+  g_clear_object (&priv->provider);
+}
+
+static void
+ide_completion_results_add (IdeCompletionResults *self,
+                            IdeCompletionItem    *item)
+{
+  IdeCompletionResultsPrivate *priv = ide_completion_results_get_instance_private (self);
+
+  g_assert (IDE_IS_COMPLETION_RESULTS (self));
+  g_assert (IDE_IS_COMPLETION_ITEM (item));
+
+  ide_completion_results_stop_presenting (self);
+
+  g_ptr_array_add (priv->results, item);
+
+  priv->needs_refilter = TRUE;
+  priv->can_reuse_list = FALSE;
+  priv->n_sorted = 0;
+}
+
 /**
  * ide_completion_results_take_proposal:
  * @proposal: (transfer full): The completion item
@@ -119,11 +182,49 @@ ide_completion_results_take_proposal (IdeCompletionResults *self,
   g_return_if_fail (IDE_IS_COMPLETION_RESULTS (self));
   g_return_if_fail (IDE_IS_COMPLETION_ITEM (item));
 
-  g_ptr_array_add (priv->results, item);
+  priv->has_unkeyed = TRUE;
+  g_clear_pointer (&priv->keys, _ide_completion_fuzzy_batch_free);
 
-  priv->needs_refilter = TRUE;
-  priv->needs_sort = TRUE;
-  priv->can_reuse_list = FALSE;
+  ide_completion_results_add (self, item);
+}
+
+/**
+ * ide_completion_results_take_proposal_with_key:
+ * @proposal: (transfer full): The completion item
+ * @key: (nullable): the text to match against the query, such as the
+ *   text inserted by @proposal
+ *
+ * Like ide_completion_results_take_proposal(), but @proposal will be
+ * matched by fuzzy matching @key against the query, as done by
+ * ide_completion_item_fuzzy_match(), instead of calling
+ * #IdeCompletionItem::match. Keys are kept together in a compact form,
+ * so this is much faster for large result sets. Proposals with the same
+ * score are sorted by @key.
+ *
+ * If the result set also contains proposals added without a key, all of
+ * them are matched with #IdeCompletionItem::match.
+ */
+void
+ide_completion_results_take_proposal_with_key (IdeCompletionResults *self,
+                                               IdeCompletionItem    *proposal,
+                                               const gchar          *key)
+{
+  IdeCompletionResultsPrivate *priv = ide_completion_results_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_COMPLETION_RESULTS (self));
+  g_return_if_fail (IDE_IS_COMPLETION_ITEM (proposal));
+
+  if (!priv->has_unkeyed)
+    {
+      if (priv->keys == NULL)
+        priv->keys = _ide_completion_fuzzy_batch_new ();
+
+      _ide_completion_fuzzy_batch_add (priv->keys, key);
+
+      g_assert (_ide_completion_fuzzy_batch_get_length (priv->keys) == priv->results->len + 1);
+    }
+
+  ide_completion_results_add (self, proposal);
 }
 
 static void
@@ -132,10 +233,14 @@ ide_completion_results_finalize (GObject *object)
   IdeCompletionResults *self = (IdeCompletionResults *)object;
   IdeCompletionResultsPrivate *priv = ide_completion_results_get_instance_private (self);
 
+  ide_completion_results_stop_presenting (self);
+
   g_clear_pointer (&priv->query, g_free);
   g_clear_pointer (&priv->replay, g_free);
   g_clear_pointer (&priv->results, g_ptr_array_unref);
-  priv->head = NULL;
+  g_clear_pointer (&priv->keys, _ide_completion_fuzzy_batch_free);
+  g_clear_pointer (&priv->priorities, g_array_unref);
+  g_clear_pointer (&priv->visible, g_array_unref);
 
   G_OBJECT_CLASS (ide_completion_results_parent_class)->finalize (object);
 
@@ -168,7 +273,26 @@ ide_completion_results_set_query (IdeCompletionResults *self,
   priv->replay = g_strdup (query);
   priv->can_reuse_list = FALSE;
   priv->needs_refilter = TRUE;
-  priv->needs_sort = TRUE;
+  priv->n_sorted = 0;
+}
+
+/**
+ * ide_completion_results_invalidate_sort:
+ *
+ * Notes that the result of #IdeCompletionResultsClass.compare changed,
+ * so that the proposals are sorted again on the next call to
+ * ide_completion_results_present().
+ */
+void
+ide_completion_results_invalidate_sort (IdeCompletionResults *self)
+{
+  IdeCompletionResultsPrivate *priv = ide_completion_results_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_COMPLETION_RESULTS (self));
+
+  ide_completion_results_stop_presenting (self);
+
+  priv->n_sorted = 0;
 }
 
 gboolean
@@ -203,9 +327,11 @@ ide_completion_results_replay (IdeCompletionResults *self,
           IDE_RETURN (FALSE);
         }
 
+      ide_completion_results_stop_presenting (self);
+
       priv->can_reuse_list = (priv->replay != NULL && g_str_has_prefix (query, priv->replay));
       priv->needs_refilter = TRUE;
-      priv->needs_sort = TRUE;
+      priv->n_sorted = 0;
 
       g_free (priv->replay);
       priv->replay = g_strdup (query);
@@ -216,60 +342,15 @@ ide_completion_results_replay (IdeCompletionResults *self,
   IDE_RETURN (FALSE);
 }
 
-static void
-ide_completion_results_update_links (IdeCompletionResults *self)
-{
-  IdeCompletionResultsPrivate *priv = ide_completion_results_get_instance_private (self);
-  IdeCompletionItem *item;
-  IdeCompletionItem *next;
-  IdeCompletionItem *prev;
-  guint i;
-
-  g_assert (IDE_IS_COMPLETION_RESULTS (self));
-  g_assert (priv->results != NULL);
-
-  if (G_UNLIKELY (priv->results->len == 0))
-    {
-      priv->head = NULL;
-      return;
-    }
-
-  /* Unrolling loops for the gentoo crowd */
-
-  item = GET_ITEM (0);
-  GET_ITEM_LINK (item)->prev = NULL;
-  GET_ITEM_LINK (item)->next = (priv->results->len == 1)
-                             ? NULL
-                             : GET_ITEM_LINK (GET_ITEM (1));
-
-  priv->head = GET_ITEM_LINK (item);
-
-  prev = item;
-
-  for (i = 1; i < (priv->results->len - 1); i++)
-    {
-      item = GET_ITEM (i);
-      next = GET_ITEM (i + 1);
-
-      GET_ITEM_LINK (item)->prev = GET_ITEM_LINK (prev);
-      GET_ITEM_LINK (item)->next = GET_ITEM_LINK (next);
-
-      prev = item;
-    }
-
-  if (priv->results->len > 1)
-    {
-      item = GET_ITEM (priv->results->len - 1);
-      GET_ITEM_LINK (item)->prev = GET_ITEM_LINK (GET_ITEM (priv->results->len - 2));
-      GET_ITEM_LINK (item)->next = NULL;
-    }
-}
-
 static void
 ide_completion_results_refilter (IdeCompletionResults *self)
 {
   IdeCompletionResultsPrivate *priv = ide_completion_results_get_instance_private (self);
+  IdeCompletionResultsClass *klass = IDE_COMPLETION_RESULTS_GET_CLASS (self);
   g_autofree gchar *casefold = NULL;
+  guint *priorities;
+  guint *visible;
+  guint n_visible;
 
   g_assert (IDE_IS_COMPLETION_RESULTS (self));
   g_assert (priv->results != NULL);
@@ -277,14 +358,23 @@ ide_completion_results_refilter (IdeCompletionResults *self)
   if (priv->query == NULL || priv->replay == NULL || priv->results->len == 0)
     return;
 
+  g_array_set_size (priv->priorities, priv->results->len);
+
   /*
-   * By traversing the linked list nodes instead of the array, we allow
+   * By filtering the visible indexes instead of all results, we allow
    * ourselves to avoid rechecking items we already know filtered.
    * We do need to be mindful of this in case the user backspaced
    * and our list is no longer a continual "deep dive" of matched items.
    */
   if (G_UNLIKELY (!priv->can_reuse_list))
-    ide_completion_results_update_links (self);
+    {
+      g_array_set_size (priv->visible, priv->results->len);
+      visible = (guint *)(gpointer)priv->visible->data;
+      for (guint i = 0; i < priv->results->len; i++)
+        visible[i] = i;
+    }
+
+  priv->n_sorted = 0;
 
   casefold = g_utf8_casefold (priv->replay, -1);
 
@@ -294,68 +384,270 @@ ide_completion_results_refilter (IdeCompletionResults *self)
       return;
     }
 
-  for (GList *iter = priv->head; iter; iter = iter->next)
+  visible = (guint *)(gpointer)priv->visible->data;
+  n_visible = priv->visible->len;
+  priorities = (guint *)(gpointer)priv->priorities->data;
+
+  if (priv->keys != NULL)
+    {
+      /* Everything matches an empty query equally */
+      if (*casefold == '\0')
+        {
+          for (guint i = 0; i < n_visible; i++)
+            priorities[visible[i]] = 0;
+        }
+      else
+        {
+          n_visible = _ide_completion_fuzzy_batch_filter (priv->keys, casefold,
+                                                          visible, n_visible,
+                                                          priorities);
+        }
+
+      /* Let compare() implementations use the score like with match() */
+      if (klass->compare != NULL)
+        {
+          for (guint i = 0; i < n_visible; i++)
+            {
+              IdeCompletionItem *item = g_ptr_array_index (priv->results, visible[i]);
+              item->priority = priorities[visible[i]];
+            }
+        }
+    }
+  else
     {
-      IdeCompletionItem *item = iter->data;
+      guint n_matched = 0;
 
-      if (!IDE_COMPLETION_ITEM_GET_CLASS (item)->match (item, priv->replay, casefold))
+      for (guint i = 0; i < n_visible; i++)
         {
-          if (iter->prev != NULL)
-            iter->prev->next = iter->next;
-          else
-            priv->head = iter->next;
+          IdeCompletionItem *item = g_ptr_array_index (priv->results, visible[i]);
 
-          if (iter->next != NULL)
-            iter->next->prev = iter->prev;
+          if (IDE_COMPLETION_ITEM_GET_CLASS (item)->match (item, priv->replay, casefold))
+            {
+              priorities[visible[i]] = item->priority;
+              visible[n_matched++] = visible[i];
+            }
         }
+
+      n_visible = n_matched;
     }
+
+  g_array_set_size (priv->visible, n_visible);
 }
 
-static gint
-compare_fast (const IdeCompletionItem *left,
-              const IdeCompletionItem *right)
+static inline gint
+sort_state_compare (const SortState *state,
+                    guint            a,
+                    guint            b)
 {
-  if (left->priority < right->priority)
-    return -1;
-  else if (left->priority > right->priority)
-    return 1;
+  gint ret;
+
+  if (state->compare != NULL)
+    {
+      ret = state->compare (state->self,
+                            g_ptr_array_index (state->results, a),
+                            g_ptr_array_index (state->results, b));
+      if (ret != 0)
+        return ret;
+    }
   else
-    return 0;
-}
+    {
+      if (state->priorities[a] < state->priorities[b])
+        return -1;
+      else if (state->priorities[a] > state->priorities[b])
+        return 1;
 
+      if (state->keys != NULL)
+        {
+          ret = strcmp (_ide_completion_fuzzy_batch_get_text (state->keys, a),
+                        _ide_completion_fuzzy_batch_get_text (state->keys, b));
+          if (ret != 0)
+            return ret;
+        }
+    }
+
+  /* Keep the order the items were added in otherwise */
+  return (a > b) - (a < b);
+}
 
 static gint
-sort_state_compare (gconstpointer a,
-                    gconstpointer b,
-                    gpointer      user_data)
+sort_state_qsort_compare (gconstpointer a,
+                          gconstpointer b,
+                          gpointer      user_data)
+{
+  return sort_state_compare (user_data, *(const guint *)a, *(const guint *)b);
+}
+
+static inline void
+swap_indexes (guint *indexes,
+              guint  a,
+              guint  b)
+{
+  guint tmp = indexes[a];
+
+  indexes[a] = indexes[b];
+  indexes[b] = tmp;
+}
+
+/*
+ * Moves the @k first items of @indexes, in sorted order, to the front of
+ * @indexes. This is a quickselect followed by sorting only those items,
+ * so we only pay for sorting what is being presented.
+ */
+static void
+select_top (const SortState *state,
+            guint           *indexes,
+            guint            n_indexes,
+            guint            k)
 {
-  SortState *state = user_data;
+  guint lo = 0;
+  guint hi = n_indexes;
+
+  g_assert (state != NULL);
+  g_assert (indexes != NULL || n_indexes == 0);
+
+  if (k >= n_indexes)
+    k = n_indexes;
+
+  while (k < hi && hi - lo > 1)
+    {
+      guint pivot;
+      guint store = lo;
+
+      /* Items are never equal thanks to the index tie-breaker */
+      swap_indexes (indexes, lo + (hi - lo) / 2, hi - 1);
+      pivot = indexes[hi - 1];
+
+      for (guint i = lo; i < hi - 1; i++)
+        {
+          if (sort_state_compare (state, indexes[i], pivot) < 0)
+            swap_indexes (indexes, i, store++);
+        }
 
-  return state->compare (state->self, (IdeCompletionItem *)a, (IdeCompletionItem *)b);
+      swap_indexes (indexes, store, hi - 1);
+
+      if (store == k)
+        break;
+      else if (store < k)
+        lo = store + 1;
+      else
+        hi = store;
+    }
+
+  g_qsort_with_data (indexes, k, sizeof (guint), sort_state_qsort_compare, (gpointer)state);
 }
 
+/*
+ * Makes sure the first @end visible items are in presentation order,
+ * selecting those after the ones already sorted.
+ */
 static void
-ide_completion_results_resort (IdeCompletionResults *self)
+ide_completion_results_select (IdeCompletionResults *self,
+                               guint                 end)
 {
   IdeCompletionResultsPrivate *priv = ide_completion_results_get_instance_private (self);
-  IdeCompletionResultsClass *klass = IDE_COMPLETION_RESULTS_GET_CLASS (self);
+  guint *visible = (guint *)(gpointer)priv->visible->data;
+  guint n_visible = priv->visible->len;
   SortState state;
 
+  g_assert (IDE_IS_COMPLETION_RESULTS (self));
+  g_assert (end <= n_visible);
+
+  if (priv->n_sorted >= end)
+    return;
+
+  state.self = self;
+  state.compare = IDE_COMPLETION_RESULTS_GET_CLASS (self)->compare;
+  state.results = priv->results;
+  state.keys = priv->keys;
+  state.priorities = (const guint *)(gpointer)priv->priorities->data;
+
+  select_top (&state,
+              visible + priv->n_sorted,
+              n_visible - priv->n_sorted,
+              end - priv->n_sorted);
+
+  priv->n_sorted = end;
+}
+
+/*
+ * Adds up to @max_items more of the visible items to @context, selecting
+ * them first if necessary. Returns %TRUE if there are no more to add.
+ */
+static gboolean
+ide_completion_results_present_page (IdeCompletionResults        *self,
+                                     GtkSourceCompletionProvider *provider,
+                                     GtkSourceCompletionContext  *context,
+                                     guint                        max_items)
+{
+  IdeCompletionResultsPrivate *priv = ide_completion_results_get_instance_private (self);
+  guint *visible = (guint *)(gpointer)priv->visible->data;
+  guint n_visible = priv->visible->len;
+  GList *head = NULL;
+  gboolean finished;
+  guint end;
+
+  g_assert (IDE_IS_COMPLETION_RESULTS (self));
+  g_assert (priv->n_presented <= priv->n_sorted);
+
+  end = priv->n_presented + MIN (max_items, n_visible - priv->n_presented);
+
+  ide_completion_results_select (self, end);
+
   /*
-   * Instead of invoking the vfunc for every item, save ourself an extra
-   * dereference and call g_list_sort() directly with our compare funcs.
+   * As an optimization, the linked list nodes are embedded in the
+   * IdeCompletionItem structures so we do not need to allocate them.
+   * GtkSourceCompletion does not keep the list around.
    */
-  if (G_LIKELY (klass->compare == NULL))
+  for (guint i = end; i > priv->n_presented; i--)
     {
-      priv->head = ide_list_sort (priv->head, (GCompareFunc)compare_fast);
-      return;
+      IdeCompletionItem *item = g_ptr_array_index (priv->results, visible[i - 1]);
+
+      item->link.prev = NULL;
+      item->link.next = head;
+
+      if (head != NULL)
+        head->prev = &item->link;
+
+      head = &item->link;
     }
 
-  state.self = self;
-  state.compare = klass->compare;
-  priv->head = ide_list_sort_with_data (priv->head, sort_state_compare, &state);
+  priv->n_presented = end;
+  finished = (end == n_visible);
+
+  gtk_source_completion_context_add_proposals (context, provider, head, finished);
+
+  return finished;
+}
+
+static gboolean
+ide_completion_results_present_cb (gpointer user_data)
+{
+  IdeCompletionResults *self = user_data;
+  IdeCompletionResultsPrivate *priv = ide_completion_results_get_instance_private (self);
+
+  g_assert (IDE_IS_COMPLETION_RESULTS (self));
+  g_assert (GTK_SOURCE_IS_COMPLETION_CONTEXT (priv->context));
+
+  if (ide_completion_results_present_page (self, priv->provider, priv->context, PAGE_SIZE))
+    {
+      priv->present_source = 0;
+      ide_completion_results_stop_presenting (self);
+      return G_SOURCE_REMOVE;
+    }
+
+  return G_SOURCE_CONTINUE;
 }
 
+/**
+ * ide_completion_results_present:
+ *
+ * Adds the proposals matching the query to @context, best first.
+ *
+ * Only the first proposals are selected and added right away, which is
+ * enough to fill the completion window. The others are added in pages
+ * from an idle callback, until they are all added or @context is
+ * cancelled.
+ */
 void
 ide_completion_results_present (IdeCompletionResults        *self,
                                 GtkSourceCompletionProvider *provider,
@@ -369,19 +661,70 @@ ide_completion_results_present (IdeCompletionResults        *self,
   g_return_if_fail (priv->query != NULL);
   g_return_if_fail (priv->replay != NULL);
 
+  ide_completion_results_stop_presenting (self);
+
   if (priv->needs_refilter)
     {
       ide_completion_results_refilter (self);
       priv->needs_refilter = FALSE;
     }
 
-  if (priv->needs_sort)
+  priv->n_presented = 0;
+
+  if (ide_completion_results_present_page (self, provider, context, INITIAL_PAGE_SIZE))
+    return;
+
+  priv->context = g_object_ref (context);
+  priv->provider = g_object_ref (provider);
+
+  g_signal_connect_object (context,
+                           "cancelled",
+                           G_CALLBACK (ide_completion_results_stop_presenting),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  priv->present_source = g_idle_add_full (G_PRIORITY_LOW,
+                                          ide_completion_results_present_cb,
+                                          self,
+                                          NULL);
+}
+
+/*
+ * Returns the first @n_items proposals matching the query, in the order
+ * ide_completion_results_present() would add them. Proposals that were
+ * already selected stay in place, so growing @n_items over several calls
+ * selects them a page at a time like presenting does.
+ */
+GPtrArray *
+_ide_completion_results_get_top (IdeCompletionResults *self,
+                                 guint                 n_items)
+{
+  IdeCompletionResultsPrivate *priv = ide_completion_results_get_instance_private (self);
+  GPtrArray *ret;
+  guint *visible;
+
+  g_return_val_if_fail (IDE_IS_COMPLETION_RESULTS (self), NULL);
+  g_return_val_if_fail (priv->query != NULL, NULL);
+  g_return_val_if_fail (priv->replay != NULL, NULL);
+
+  ide_completion_results_stop_presenting (self);
+
+  if (priv->needs_refilter)
     {
-      ide_completion_results_resort (self);
-      priv->needs_sort = FALSE;
+      ide_completion_results_refilter (self);
+      priv->needs_refilter = FALSE;
     }
 
-  gtk_source_completion_context_add_proposals (context, provider, priv->head, TRUE);
+  n_items = MIN (n_items, priv->visible->len);
+  ide_completion_results_select (self, n_items);
+
+  ret = g_ptr_array_new_full (n_items, g_object_unref);
+  visible = (guint *)(gpointer)priv->visible->data;
+
+  for (guint i = 0; i < n_items; i++)
+    g_ptr_array_add (ret, g_object_ref (g_ptr_array_index (priv->results, visible[i])));
+
+  return ret;
 }
 
 static void
@@ -449,7 +792,8 @@ ide_completion_results_init (IdeCompletionResults *self)
   DZL_COUNTER_INC (instances);
 
   priv->results = g_ptr_array_new_with_free_func (g_object_unref);
-  priv->head = NULL;
+  priv->priorities = g_array_new (FALSE, TRUE, sizeof (guint));
+  priv->visible = g_array_new (FALSE, FALSE, sizeof (guint));
   priv->query = NULL;
 }
 
@@ -19,23 +19,68 @@
 #define G_LOG_DOMAIN "ide-line-diagnostics-gutter-renderer"
 
 #include "buffers/ide-buffer.h"
+#include "buffers/ide-buffer-private.h"
 #include "sourceview/ide-line-diagnostics-gutter-renderer.h"
 
 struct _IdeLineDiagnosticsGutterRenderer
 {
-  GtkSourceGutterRendererPixbuf parent_instance;
+  GtkSourceGutterRendererPixbuf  parent_instance;
+
+  /*
+   * The severities of the lines being drawn, resolved in a single query
+   * from ::begin() so that ::query_data() does not search per line.
+   */
+  GArray                        *severities;
+  guint                          begin_line;
 };
 
 G_DEFINE_TYPE (IdeLineDiagnosticsGutterRenderer,
                ide_line_diagnostics_gutter_renderer,
                GTK_SOURCE_TYPE_GUTTER_RENDERER_PIXBUF)
 
+static void
+ide_line_diagnostics_gutter_renderer_begin (GtkSourceGutterRenderer *renderer,
+                                            cairo_t                 *cr,
+                                            GdkRectangle            *bg_area,
+                                            GdkRectangle            *cell_area,
+                                            GtkTextIter             *begin,
+                                            GtkTextIter             *end)
+{
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)renderer;
+  GtkTextBuffer *buffer;
+  guint end_line;
+
+  g_assert (IDE_IS_LINE_DIAGNOSTICS_GUTTER_RENDERER (self));
+  g_assert (begin);
+  g_assert (end);
+
+  if (GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->begin)
+    GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->begin (renderer, cr, bg_area, cell_area, begin, end);
+
+  g_array_set_size (self->severities, 0);
+
+  buffer = gtk_text_iter_get_buffer (begin);
+
+  if (!IDE_IS_BUFFER (buffer))
+    return;
+
+  self->begin_line = gtk_text_iter_get_line (begin);
+  end_line = MAX (self->begin_line, (guint)gtk_text_iter_get_line (end));
+
+  g_array_set_size (self->severities, end_line - self->begin_line + 1);
+  _ide_buffer_get_diagnostics_range (IDE_BUFFER (buffer),
+                                     self->begin_line,
+                                     end_line,
+                                     &g_array_index (self->severities, IdeDiagnosticSeverity, 0));
+}
+
 static void
 ide_line_diagnostics_gutter_renderer_query_data (GtkSourceGutterRenderer      *renderer,
                                                  GtkTextIter                  *begin,
                                                  GtkTextIter                  *end,
                                                  GtkSourceGutterRendererState  state)
 {
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)renderer;
   GtkTextBuffer *buffer;
   IdeBufferLineFlags flags;
   const gchar *icon_name = NULL;
@@ -51,8 +96,19 @@ ide_line_diagnostics_gutter_renderer_query_data (GtkSourceGutterRenderer      *r
     return;
 
   line = gtk_text_iter_get_line (begin);
-  flags = ide_buffer_get_line_flags (IDE_BUFFER (buffer), line);
-  flags &= IDE_BUFFER_LINE_FLAGS_DIAGNOSTICS_MASK;
+
+  if (line >= self->begin_line && line - self->begin_line < self->severities->len)
+    {
+      IdeDiagnosticSeverity severity;
+
+      severity = g_array_index (self->severities, IdeDiagnosticSeverity, line - self->begin_line);
+      flags = _ide_buffer_severity_to_line_flags (severity);
+    }
+  else
+    {
+      flags = ide_buffer_get_line_flags (IDE_BUFFER (buffer), line);
+      flags &= IDE_BUFFER_LINE_FLAGS_DIAGNOSTICS_MASK;
+    }
 
   if (flags == 0)
     icon_name = NULL;
@@ -71,15 +127,44 @@ ide_line_diagnostics_gutter_renderer_query_data (GtkSourceGutterRenderer      *r
     g_object_set (renderer, "pixbuf", NULL, NULL);
 }
 
+static void
+ide_line_diagnostics_gutter_renderer_end (GtkSourceGutterRenderer *renderer)
+{
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)renderer;
+
+  g_assert (IDE_IS_LINE_DIAGNOSTICS_GUTTER_RENDERER (self));
+
+  g_array_set_size (self->severities, 0);
+
+  if (GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->end)
+    GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->end (renderer);
+}
+
+static void
+ide_line_diagnostics_gutter_renderer_finalize (GObject *object)
+{
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)object;
+
+  g_clear_pointer (&self->severities, g_array_unref);
+
+  G_OBJECT_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->finalize (object);
+}
+
 static void
 ide_line_diagnostics_gutter_renderer_class_init (IdeLineDiagnosticsGutterRendererClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkSourceGutterRendererClass *renderer_class = GTK_SOURCE_GUTTER_RENDERER_CLASS (klass);
 
+  object_class->finalize = ide_line_diagnostics_gutter_renderer_finalize;
+
+  renderer_class->begin = ide_line_diagnostics_gutter_renderer_begin;
   renderer_class->query_data = ide_line_diagnostics_gutter_renderer_query_data;
+  renderer_class->end = ide_line_diagnostics_gutter_renderer_end;
 }
 
 static void
 ide_line_diagnostics_gutter_renderer_init (IdeLineDiagnosticsGutterRenderer *self)
 {
+  self->severities = g_array_new (FALSE, FALSE, sizeof (IdeDiagnosticSeverity));
 }
@@ -36,6 +36,7 @@
 #include "diagnostics/ide-source-range.h"
 #include "files/ide-file-settings.h"
 #include "files/ide-file.h"
+#include "highlighting/ide-highlight-engine-private.h"
 #include "history/ide-back-forward-item.h"
 #include "history/ide-back-forward-list.h"
 #include "plugins/ide-extension-adapter.h"
@@ -1603,6 +1604,9 @@ ide_source_view_bind_buffer (IdeSourceView  *self,
 
   ide_source_view_reset_definition_highlight (self);
 
+  if (_ide_buffer_get_highlight_engine (buffer) != NULL)
+    _ide_highlight_engine_add_view (_ide_buffer_get_highlight_engine (buffer), GTK_TEXT_VIEW (self));
+
   ide_buffer_hold (buffer);
 
   if (_ide_buffer_get_loading (buffer))
@@ -1706,6 +1710,9 @@ ide_source_view_unbind_buffer (IdeSourceView  *self,
   if (priv->buffer == NULL)
     IDE_EXIT;
 
+  if (_ide_buffer_get_highlight_engine (priv->buffer) != NULL)
+    _ide_highlight_engine_remove_view (_ide_buffer_get_highlight_engine (priv->buffer), GTK_TEXT_VIEW (self));
+
   priv->scroll_mark = NULL;
 
   if (priv->completion_blocked)
@@ -4889,6 +4896,10 @@ ide_source_view_real_draw_layer (GtkTextView      *text_view,
 
   if (layer == GTK_TEXT_VIEW_LAYER_BELOW_TEXT)
     {
+      /* Give priority to any invalid ranges we just scrolled into view */
+      if (priv->buffer != NULL && _ide_buffer_get_highlight_engine (priv->buffer) != NULL)
+        _ide_highlight_engine_queue_visible (_ide_buffer_get_highlight_engine (priv->buffer));
+
       if (priv->snippets->length)
         ide_source_view_draw_snippets_background (self, cr);
     }
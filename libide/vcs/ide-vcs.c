@@ -18,6 +18,8 @@
 
 #define G_LOG_DOMAIN "ide-vcs"
 
+#include <string.h>
+
 #include "ide-context.h"
 
 #include "buffers/ide-buffer.h"
@@ -32,15 +34,383 @@ enum {
 };
 
 static guint signals [N_SIGNALS];
-static GPtrArray *ignored;
+
+/*
+ * Patterns registered with ide_vcs_register_ignored() are compiled into a
+ * matcher so that checking a file name does not require walking every
+ * GPatternSpec. Literal names, "*suffix" and "prefix*" patterns (which is
+ * nearly everything registered in practice) are placed into small
+ * open-addressed hash sets that can be probed with a slice of the path.
+ * Anything else falls back to a GPatternSpec.
+ */
+
+#define IGNORE_NAME_MAX 256
+
+typedef struct
+{
+  const gchar *str;
+  guint        len;
+  guint        hash;
+} IgnoreLiteral;
+
+typedef struct
+{
+  IgnoreLiteral *slots;
+  guint          mask;
+  /* Distinct literal lengths, so suffixes and prefixes can be probed */
+  guint          lengths[8];
+  guint          n_lengths;
+  guint          overflow : 1;
+} IgnoreLiteralSet;
+
+typedef struct
+{
+  GPtrArray        *patterns;
+  IgnoreLiteralSet  exact;
+  IgnoreLiteralSet  suffixes;
+  IgnoreLiteralSet  prefixes;
+  GPtrArray        *residual;
+} IgnoreMatcher;
+
+static GRWLock ignored_lock;
+static IgnoreMatcher ignored;
+
+/*
+ * Backends may check ignored files with objects which are not thread-safe,
+ * such as the GgitRepository of IdeGitVcs, while the directory crawler calls
+ * ide_vcs_classify_ignored() from several worker threads. All calls to
+ * IdeVcsInterface.is_ignored are serialized with this lock.
+ */
+static GMutex backend_lock;
+
+static inline guint
+ignore_hash (const gchar *str,
+             gsize        len)
+{
+  guint hash = 5381;
+
+  for (gsize i = 0; i < len; i++)
+    hash = ((hash << 5) + hash) + (guchar)str[i];
+
+  return hash;
+}
+
+static void
+ignore_literal_set_clear (IgnoreLiteralSet *set)
+{
+  g_clear_pointer (&set->slots, g_free);
+  set->mask = 0;
+  set->n_lengths = 0;
+  set->overflow = FALSE;
+}
+
+static void
+ignore_literal_set_init (IgnoreLiteralSet *set,
+                         guint             n_items)
+{
+  guint size = 8;
+
+  while (size < n_items * 2)
+    size <<= 1;
+
+  set->slots = g_new0 (IgnoreLiteral, size);
+  set->mask = size - 1;
+  set->n_lengths = 0;
+  set->overflow = FALSE;
+}
+
+static void
+ignore_literal_set_add (IgnoreLiteralSet *set,
+                        const gchar      *str,
+                        guint             len)
+{
+  guint hash = ignore_hash (str, len);
+  guint i;
+
+  for (i = hash & set->mask; set->slots[i].str != NULL; i = (i + 1) & set->mask)
+    {
+      if (set->slots[i].hash == hash &&
+          set->slots[i].len == len &&
+          memcmp (set->slots[i].str, str, len) == 0)
+        return;
+    }
+
+  set->slots[i].str = str;
+  set->slots[i].len = len;
+  set->slots[i].hash = hash;
+
+  for (guint j = 0; j < set->n_lengths; j++)
+    {
+      if (set->lengths[j] == len)
+        return;
+    }
+
+  if (set->n_lengths < G_N_ELEMENTS (set->lengths))
+    set->lengths[set->n_lengths++] = len;
+  else
+    set->overflow = TRUE;
+}
+
+static gboolean
+ignore_literal_set_contains (const IgnoreLiteralSet *set,
+                             const gchar            *str,
+                             guint                   len)
+{
+  guint hash;
+
+  if (set->slots == NULL)
+    return FALSE;
+
+  hash = ignore_hash (str, len);
+
+  for (guint i = hash & set->mask; set->slots[i].str != NULL; i = (i + 1) & set->mask)
+    {
+      if (set->slots[i].hash == hash &&
+          set->slots[i].len == len &&
+          memcmp (set->slots[i].str, str, len) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+ignore_literal_set_matches_suffix (const IgnoreLiteralSet *set,
+                                   const gchar            *name,
+                                   guint                   len)
+{
+  if (set->slots == NULL)
+    return FALSE;
+
+  if G_UNLIKELY (set->overflow)
+    {
+      for (guint i = 1; i <= len; i++)
+        {
+          if (ignore_literal_set_contains (set, name + len - i, i))
+            return TRUE;
+        }
+
+      return FALSE;
+    }
+
+  for (guint i = 0; i < set->n_lengths; i++)
+    {
+      guint suffix_len = set->lengths[i];
+
+      if (suffix_len <= len &&
+          ignore_literal_set_contains (set, name + len - suffix_len, suffix_len))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+ignore_literal_set_matches_prefix (const IgnoreLiteralSet *set,
+                                   const gchar            *name,
+                                   guint                   len)
+{
+  if (set->slots == NULL)
+    return FALSE;
+
+  if G_UNLIKELY (set->overflow)
+    {
+      for (guint i = 1; i <= len; i++)
+        {
+          if (ignore_literal_set_contains (set, name, i))
+            return TRUE;
+        }
+
+      return FALSE;
+    }
+
+  for (guint i = 0; i < set->n_lengths; i++)
+    {
+      guint prefix_len = set->lengths[i];
+
+      if (prefix_len <= len &&
+          ignore_literal_set_contains (set, name, prefix_len))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+ignore_matcher_compile (IgnoreMatcher *self)
+{
+  guint n_patterns = self->patterns->len;
+
+  ignore_literal_set_clear (&self->exact);
+  ignore_literal_set_clear (&self->suffixes);
+  ignore_literal_set_clear (&self->prefixes);
+  g_clear_pointer (&self->residual, g_ptr_array_unref);
+
+  ignore_literal_set_init (&self->exact, n_patterns);
+  ignore_literal_set_init (&self->suffixes, n_patterns);
+  ignore_literal_set_init (&self->prefixes, n_patterns);
+  self->residual = g_ptr_array_new_with_free_func ((GDestroyNotify)g_pattern_spec_free);
+
+  for (guint i = 0; i < n_patterns; i++)
+    {
+      const gchar *pattern = g_ptr_array_index (self->patterns, i);
+      guint len = strlen (pattern);
+      const gchar *star = strchr (pattern, '*');
+
+      if (len == 0 || strchr (pattern, '?') != NULL)
+        goto residual;
+
+      if (star == NULL)
+        {
+          ignore_literal_set_add (&self->exact, pattern, len);
+          continue;
+        }
+
+      if (len < 2 || strchr (star + 1, '*') != NULL)
+        goto residual;
+
+      if (star == pattern)
+        {
+          ignore_literal_set_add (&self->suffixes, pattern + 1, len - 1);
+          continue;
+        }
+
+      if (star == pattern + len - 1)
+        {
+          ignore_literal_set_add (&self->prefixes, pattern, len - 1);
+          continue;
+        }
+
+    residual:
+      g_ptr_array_add (self->residual, g_pattern_spec_new (pattern));
+    }
+}
+
+static void
+reverse_utf8 (const gchar *str,
+              gsize        len,
+              gchar       *reversed)
+{
+  const gchar *end = str + len;
+  gchar *out = reversed + len;
+
+  *out = '\0';
+
+  while (str < end)
+    {
+      const gchar *next = MIN (g_utf8_next_char (str), end);
+      gsize n = next - str;
+
+      out -= n;
+      memcpy (out, str, n);
+      str = next;
+    }
+}
+
+static gboolean
+ignore_matcher_match_residual (IgnoreMatcher *self,
+                               const gchar   *name,
+                               guint          len)
+{
+  gchar name_buf[IGNORE_NAME_MAX];
+  gchar reversed_buf[IGNORE_NAME_MAX];
+  g_autofree gchar *name_alloc = NULL;
+  g_autofree gchar *reversed_alloc = NULL;
+  gchar *copy = name_buf;
+  gchar *reversed = reversed_buf;
+
+  /* GPatternSpec requires a terminated string, so copy the slice */
+  if G_UNLIKELY (len >= IGNORE_NAME_MAX)
+    {
+      copy = name_alloc = g_malloc (len + 1);
+      reversed = reversed_alloc = g_malloc (len + 1);
+    }
+
+  memcpy (copy, name, len);
+  copy[len] = '\0';
+  reverse_utf8 (copy, len, reversed);
+
+  for (guint i = 0; i < self->residual->len; i++)
+    {
+      GPatternSpec *pattern_spec = g_ptr_array_index (self->residual, i);
+
+      if (g_pattern_match (pattern_spec, len, copy, reversed))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+ignore_matcher_match (IgnoreMatcher *self,
+                      const gchar   *name,
+                      guint          len)
+{
+  return ignore_literal_set_contains (&self->exact, name, len) ||
+         ignore_literal_set_matches_suffix (&self->suffixes, name, len) ||
+         ignore_literal_set_matches_prefix (&self->prefixes, name, len) ||
+         (self->residual->len > 0 && ignore_matcher_match_residual (self, name, len));
+}
 
 void
 ide_vcs_register_ignored (const gchar *pattern)
 {
-  if (ignored == NULL)
-    ignored = g_ptr_array_new ();
+  g_return_if_fail (pattern != NULL);
+
+  g_rw_lock_writer_lock (&ignored_lock);
+
+  if (ignored.patterns == NULL)
+    ignored.patterns = g_ptr_array_new_with_free_func (g_free);
+
+  g_ptr_array_add (ignored.patterns, g_strdup (pattern));
+  ignore_matcher_compile (&ignored);
+
+  g_rw_lock_writer_unlock (&ignored_lock);
+}
+
+/**
+ * ide_vcs_path_matches_ignored:
+ * @path: a file name or path
+ * @len: the length of @path in bytes, or -1 if it is %NULL-terminated
+ *
+ * Checks the basename of @path against the patterns registered with
+ * ide_vcs_register_ignored(). @path does not need to be %NULL-terminated
+ * when @len is provided, so callers may pass a slice of a larger buffer.
+ *
+ * This does not consult the version control backend, and does not allocate
+ * memory unless a complex glob is registered and the name is very long.
+ *
+ * Returns: %TRUE if @path matches a registered pattern.
+ */
+gboolean
+ide_vcs_path_matches_ignored (const gchar *path,
+                              gssize       len)
+{
+  const gchar *name;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+
+  if (len < 0)
+    len = strlen (path);
+
+  while (len > 1 && path[len - 1] == G_DIR_SEPARATOR)
+    len--;
+
+  for (name = path + len; name > path && name[-1] != G_DIR_SEPARATOR; name--)
+    { /* Do Nothing */ }
 
-  g_ptr_array_add (ignored, g_pattern_spec_new (pattern));
+  len -= name - path;
+
+  if (len == 0)
+    return FALSE;
+
+  g_rw_lock_reader_lock (&ignored_lock);
+  if (ignored.patterns != NULL)
+    ret = ignore_matcher_match (&ignored, name, len);
+  g_rw_lock_reader_unlock (&ignored_lock);
+
+  return ret;
 }
 
 static void
@@ -89,27 +459,86 @@ ide_vcs_is_ignored (IdeVcs  *self,
 {
   g_return_val_if_fail (IDE_IS_VCS (self), FALSE);
 
-  if G_LIKELY (ignored != NULL)
+  if G_LIKELY (ignored.patterns != NULL)
     {
       g_autofree gchar *name = g_file_get_basename (file);
-      guint len = strlen (name);
-      g_autofree gchar *reversed = g_utf8_strreverse (name, len);
-
-      for (guint i = 0; i < ignored->len; i++)
-        {
-          GPatternSpec *pattern_spec = g_ptr_array_index (ignored, i);
 
-          if (g_pattern_match (pattern_spec, len, name, reversed))
-            return TRUE;
-        }
+      if (name != NULL && ide_vcs_path_matches_ignored (name, -1))
+        return TRUE;
     }
 
   if (IDE_VCS_GET_IFACE (self)->is_ignored)
-    return IDE_VCS_GET_IFACE (self)->is_ignored (self, file, error);
+    {
+      gboolean ret;
+
+      g_mutex_lock (&backend_lock);
+      ret = IDE_VCS_GET_IFACE (self)->is_ignored (self, file, error);
+      g_mutex_unlock (&backend_lock);
+
+      return ret;
+    }
 
   return FALSE;
 }
 
+/**
+ * ide_vcs_classify_ignored:
+ * @self: An #IdeVcs
+ * @directory: the directory containing @names
+ * @names: (array length=n_names): the names of children of @directory
+ * @n_names: the number of elements in @names
+ * @results: (array length=n_names) (out caller-allocates): a location
+ *   to store whether each of @names is ignored
+ *
+ * This is a batched form of ide_vcs_is_ignored() for the children of a
+ * single directory, such as those returned from a #GFileEnumerator.
+ *
+ * The registered patterns are checked for all of @names while holding the
+ * lock once, and only names which do not match are passed on to the version
+ * control backend. This is safe to call from several threads at once, the
+ * calls to the backend are serialized.
+ */
+void
+ide_vcs_classify_ignored (IdeVcs              *self,
+                          GFile               *directory,
+                          const gchar * const *names,
+                          guint                n_names,
+                          gboolean            *results)
+{
+  IdeVcsInterface *iface;
+
+  g_return_if_fail (IDE_IS_VCS (self));
+  g_return_if_fail (G_IS_FILE (directory));
+  g_return_if_fail (names != NULL || n_names == 0);
+  g_return_if_fail (results != NULL || n_names == 0);
+
+  g_rw_lock_reader_lock (&ignored_lock);
+  for (guint i = 0; i < n_names; i++)
+    results[i] = ignored.patterns != NULL &&
+                 ignore_matcher_match (&ignored, names[i], strlen (names[i]));
+  g_rw_lock_reader_unlock (&ignored_lock);
+
+  iface = IDE_VCS_GET_IFACE (self);
+
+  if (iface->is_ignored == NULL)
+    return;
+
+  g_mutex_lock (&backend_lock);
+
+  for (guint i = 0; i < n_names; i++)
+    {
+      g_autoptr(GFile) child = NULL;
+
+      if (results[i])
+        continue;
+
+      child = g_file_get_child (directory, names[i]);
+      results[i] = iface->is_ignored (self, child, NULL);
+    }
+
+  g_mutex_unlock (&backend_lock);
+}
+
 gint
 ide_vcs_get_priority (IdeVcs *self)
 {
@@ -47,6 +47,8 @@ struct _IdeVcsInterface
 };
 
 void                    ide_vcs_register_ignored          (const gchar          *pattern);
+gboolean                ide_vcs_path_matches_ignored      (const gchar          *path,
+                                                           gssize                len);
 IdeBufferChangeMonitor *ide_vcs_get_buffer_change_monitor (IdeVcs               *self,
                                                            IdeBuffer            *buffer);
 GFile                  *ide_vcs_get_working_directory     (IdeVcs               *self);
@@ -60,6 +62,11 @@ IdeVcs                 *ide_vcs_new_finish                (GAsyncResult
 gboolean                ide_vcs_is_ignored                (IdeVcs               *self,
                                                            GFile                *file,
                                                            GError              **error);
+void                    ide_vcs_classify_ignored          (IdeVcs               *self,
+                                                           GFile                *directory,
+                                                           const gchar * const  *names,
+                                                           guint                 n_names,
+                                                           gboolean             *results);
 gint                    ide_vcs_get_priority              (IdeVcs               *self);
 void                    ide_vcs_emit_changed              (IdeVcs               *self);
 IdeVcsConfig           *ide_vcs_get_config                (IdeVcs               *self);
@@ -26,7 +26,7 @@
 
 static void completion_proposal_iface_init (GtkSourceCompletionProposalIface *);
 
-G_DEFINE_TYPE_WITH_CODE (IdeClangCompletionItem, ide_clang_completion_item, G_TYPE_OBJECT,
+G_DEFINE_TYPE_WITH_CODE (IdeClangCompletionItem, ide_clang_completion_item, IDE_TYPE_COMPLETION_ITEM,
                          G_IMPLEMENT_INTERFACE (GTK_SOURCE_TYPE_COMPLETION_PROPOSAL,
                                                 completion_proposal_iface_init))
 
@@ -427,7 +427,6 @@ ide_clang_completion_item_class_init (IdeClangCompletionItemClass *klass)
 static void
 ide_clang_completion_item_init (IdeClangCompletionItem *self)
 {
-  self->link.data = self;
   self->typed_text_index = -1;
 }
 
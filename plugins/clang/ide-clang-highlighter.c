@@ -176,6 +176,81 @@ completed:
   *location = *range_end;
 }
 
+static const gchar *
+ide_clang_highlighter_lookup_word (const gchar *word,
+                                   gsize        word_len,
+                                   gpointer     user_data)
+{
+  return ide_highlight_index_lookup_len (user_data, word, word_len);
+}
+
+static void
+ide_clang_highlighter_real_update_async (IdeHighlighter      *highlighter,
+                                         GBytes              *text,
+                                         guint                offset,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data)
+{
+  g_autoptr(IdeClangTranslationUnit) unit = NULL;
+  IdeClangHighlighter *self = (IdeClangHighlighter *)highlighter;
+  IdeHighlightIndex *index = NULL;
+  IdeClangService *service = NULL;
+  IdeContext *context;
+  IdeBuffer *buffer;
+  IdeFile *file;
+
+  g_assert (IDE_IS_CLANG_HIGHLIGHTER (self));
+  g_assert (text != NULL);
+
+  if (self->engine != NULL &&
+      (buffer = ide_highlight_engine_get_buffer (self->engine)) &&
+      (file = ide_buffer_get_file (buffer)) &&
+      (context = ide_object_get_context (IDE_OBJECT (self))) &&
+      (service = ide_context_get_service_typed (context, IDE_TYPE_CLANG_SERVICE)))
+    {
+      if (!(unit = ide_clang_service_get_cached_translation_unit (service, file)))
+        {
+          if (!self->waiting_for_unit)
+            {
+              self->waiting_for_unit = TRUE;
+              ide_clang_service_get_translation_unit_async (service,
+                                                            file,
+                                                            0,
+                                                            NULL,
+                                                            get_unit_cb,
+                                                            g_object_ref (self));
+            }
+        }
+      else
+        {
+          index = ide_clang_translation_unit_get_index (unit);
+        }
+    }
+
+  if (index == NULL)
+    {
+      g_autoptr(GTask) task = g_task_new (self, cancellable, callback, user_data);
+
+      /* Nothing to highlight until the translation unit is available */
+      g_task_set_source_tag (task, ide_clang_highlighter_real_update_async);
+      g_task_return_pointer (task,
+                             g_array_new (FALSE, FALSE, sizeof (IdeHighlightRun)),
+                             (GDestroyNotify)g_array_unref);
+      return;
+    }
+
+  ide_highlighter_scan_words_async (highlighter,
+                                    text,
+                                    offset,
+                                    ide_clang_highlighter_lookup_word,
+                                    ide_highlight_index_ref (index),
+                                    (GDestroyNotify)ide_highlight_index_unref,
+                                    cancellable,
+                                    callback,
+                                    user_data);
+}
+
 static void
 ide_clang_highlighter_real_set_engine (IdeHighlighter     *highlighter,
                                        IdeHighlightEngine *engine)
@@ -212,5 +287,6 @@ static void
 highlighter_iface_init (IdeHighlighterInterface *iface)
 {
   iface->update = ide_clang_highlighter_real_update;
+  iface->update_async = ide_clang_highlighter_real_update_async;
   iface->set_engine = ide_clang_highlighter_real_set_engine;
 }
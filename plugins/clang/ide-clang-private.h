@@ -34,6 +34,7 @@ IdeClangTranslationUnit *_ide_clang_translation_unit_new     (IdeContext
                                                               IdeHighlightIndex  *index,
                                                               gint64              serial);
 void                     _ide_clang_dispose_string           (CXString           *str);
+void                     _ide_clang_release_native           (CXTranslationUnit   tu);
 IdeSymbolNode           *_ide_clang_symbol_node_new          (IdeContext         *context,
                                                               CXCursor            cursor);
 CXCursor                 _ide_clang_symbol_node_get_cursor   (IdeClangSymbolNode *self);
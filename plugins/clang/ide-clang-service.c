@@ -27,7 +27,8 @@
 #include "ide-clang-private.h"
 #include "ide-clang-service.h"
 
-#define DEFAULT_EVICTION_MSEC (60 * 1000)
+#define MAX_SPARE_UNITS       8
+#define MEGABYTE              (1024 * 1024)
 
 struct _IdeClangService
 {
@@ -36,17 +37,87 @@ struct _IdeClangService
   CXIndex       index;
   GCancellable *cancellable;
   DzlTaskCache *units_cache;
+
+  /*
+   * Native translation units which are no longer referenced, most recently
+   * released first. They are reparsed in place when the same file is
+   * requested again, which reuses the precompiled preamble rather than
+   * parsing every included header from scratch.
+   */
+  GMutex        mutex;
+  GQueue        spares;
+  guint         spares_enabled : 1;
+
+  /* Path to ContentStamp of the unit in units_cache */
+  GHashTable   *stamps;
+
+  /*
+   * Units in units_cache, most recently used first, and an IdeFile to GList
+   * index into it. Only used from the main thread. Units are evicted from
+   * the tail when the approximate memory used by units and spares goes
+   * over budget. The costs are guarded by mutex, since spares may be
+   * released from any thread.
+   */
+  GQueue        lru;
+  GHashTable   *lru_index;
+  GSettings    *settings;
+  gsize         budget;
+  gsize         units_cost;
+  gsize         spares_cost;
 };
 
 typedef struct
 {
-  IdeFile    *file;
-  CXIndex     index;
-  gchar      *source_filename;
-  gchar     **command_line_args;
-  GPtrArray  *unsaved_files;
-  gint64      sequence;
-  guint       options;
+  IdeFile *file;
+  gsize    cost;
+} CachedUnit;
+
+typedef struct
+{
+  gint64 sequence;
+  guint  included : 1;
+} FileStamp;
+
+typedef struct
+{
+  gint64      serial;
+  /*
+   * FileStamp for each unsaved file the unit was parsed with, by path.
+   * Only the files that are part of the unit affect what clang sees.
+   */
+  GHashTable *files;
+  guint       n_included;
+} ContentStamp;
+
+typedef struct
+{
+  CXTranslationUnit   tu;
+  gchar              *path;
+  gchar             **argv;
+  guint               options;
+  gsize               cost;
+} SpareUnit;
+
+typedef struct
+{
+  GWeakRef   service;
+  gchar     *path;
+  gchar    **argv;
+  guint      options;
+  gsize      cost;
+} NativeInfo;
+
+typedef struct
+{
+  IdeFile       *file;
+  CXIndex        index;
+  gchar         *source_filename;
+  gchar        **command_line_args;
+  GPtrArray     *unsaved_files;
+  ContentStamp  *stamp;
+  gint64         sequence;
+  guint          options;
+  gsize          cost;
 } ParseRequest;
 
 typedef struct
@@ -65,6 +136,294 @@ DZL_DEFINE_COUNTER (ParseAttempts,
                     "Clang",
                     "Total Parse Attempts",
                     "Total number of attempts to create a translation unit.")
+DZL_DEFINE_COUNTER (Reparses,
+                    "Clang",
+                    "Total Reparses",
+                    "Total number of translation units refreshed with clang_reparseTranslationUnit().")
+DZL_DEFINE_COUNTER (Reuses,
+                    "Clang",
+                    "Total Reuses",
+                    "Total number of requests satisfied by an unchanged translation unit.")
+DZL_DEFINE_COUNTER (Evictions,
+                    "Clang",
+                    "Total Evictions",
+                    "Total number of translation units evicted to stay within the memory budget.")
+DZL_DEFINE_COUNTER (MemoryBudget,
+                    "Clang",
+                    "Memory Budget",
+                    "Memory budget for translation units, in bytes.")
+DZL_DEFINE_COUNTER (MemoryUsage,
+                    "Clang",
+                    "Memory Usage",
+                    "Approximate memory used by cached and spare translation units, in bytes.")
+
+/* Native translation unit to NativeInfo, for units created by a service */
+static GMutex      natives_mutex;
+static GHashTable *natives;
+
+static void
+cached_unit_free (gpointer data)
+{
+  CachedUnit *cu = data;
+
+  g_clear_object (&cu->file);
+  g_slice_free (CachedUnit, cu);
+}
+
+static gsize
+get_unit_cost (CXTranslationUnit tu)
+{
+  CXTUResourceUsage usage;
+  gsize ret = 0;
+
+  g_assert (tu != NULL);
+
+  usage = clang_getCXTUResourceUsage (tu);
+  for (guint i = 0; i < usage.numEntries; i++)
+    ret += usage.entries[i].amount;
+  clang_disposeCXTUResourceUsage (usage);
+
+  return ret;
+}
+
+static void
+native_info_free (gpointer data)
+{
+  NativeInfo *info = data;
+
+  g_weak_ref_clear (&info->service);
+  g_free (info->path);
+  g_strfreev (info->argv);
+  g_slice_free (NativeInfo, info);
+}
+
+static void
+spare_unit_free (gpointer data)
+{
+  SpareUnit *spare = data;
+
+  g_clear_pointer (&spare->tu, clang_disposeTranslationUnit);
+  g_free (spare->path);
+  g_strfreev (spare->argv);
+  g_slice_free (SpareUnit, spare);
+}
+
+static void
+file_stamp_free (gpointer data)
+{
+  g_slice_free (FileStamp, data);
+}
+
+static void
+content_stamp_free (gpointer data)
+{
+  ContentStamp *stamp = data;
+
+  g_clear_pointer (&stamp->files, g_hash_table_unref);
+  g_slice_free (ContentStamp, stamp);
+}
+
+static gboolean
+argv_equal (const gchar * const *a,
+            const gchar * const *b)
+{
+  for (; *a != NULL && *b != NULL; a++, b++)
+    {
+      if (!g_str_equal (*a, *b))
+        return FALSE;
+    }
+
+  return *a == NULL && *b == NULL;
+}
+
+/*
+ * Records the sequence of each unsaved file @tu was parsed with, and
+ * whether clang loaded it. Clang resolves the path itself, so this is
+ * not confused by differently spelled include paths.
+ */
+static ContentStamp *
+create_content_stamp (CXTranslationUnit  tu,
+                      GPtrArray         *unsaved_files,
+                      gint64             serial)
+{
+  ContentStamp *stamp;
+
+  g_assert (tu != NULL);
+  g_assert (unsaved_files != NULL);
+
+  stamp = g_slice_new0 (ContentStamp);
+  stamp->serial = serial;
+  stamp->files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, file_stamp_free);
+
+  for (guint i = 0; i < unsaved_files->len; i++)
+    {
+      IdeUnsavedFile *uf = g_ptr_array_index (unsaved_files, i);
+      g_autofree gchar *path = g_file_get_path (ide_unsaved_file_get_file (uf));
+      FileStamp *file_stamp;
+
+      if (path == NULL)
+        continue;
+
+      file_stamp = g_slice_new0 (FileStamp);
+      file_stamp->sequence = ide_unsaved_file_get_sequence (uf);
+      file_stamp->included = clang_getFile (tu, path) != NULL;
+
+      if (file_stamp->included)
+        stamp->n_included++;
+
+      g_hash_table_insert (stamp->files, g_steal_pointer (&path), file_stamp);
+    }
+
+  return stamp;
+}
+
+static void
+ide_clang_service_register_native (IdeClangService     *self,
+                                   CXTranslationUnit    tu,
+                                   const gchar         *path,
+                                   const gchar * const *argv,
+                                   guint                options,
+                                   gsize                cost)
+{
+  NativeInfo *info;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (tu != NULL);
+
+  info = g_slice_new0 (NativeInfo);
+  g_weak_ref_init (&info->service, self);
+  info->path = g_strdup (path);
+  info->argv = g_strdupv ((gchar **)argv);
+  info->options = options;
+  info->cost = cost;
+
+  g_mutex_lock (&natives_mutex);
+  if (natives == NULL)
+    natives = g_hash_table_new_full (NULL, NULL, NULL, native_info_free);
+  g_hash_table_insert (natives, tu, info);
+  g_mutex_unlock (&natives_mutex);
+}
+
+static SpareUnit *
+ide_clang_service_take_spare (IdeClangService *self,
+                              const gchar     *path)
+{
+  SpareUnit *ret = NULL;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (path != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  for (GList *iter = self->spares.head; iter; iter = iter->next)
+    {
+      SpareUnit *spare = iter->data;
+
+      if (g_str_equal (spare->path, path))
+        {
+          g_queue_delete_link (&self->spares, iter);
+          self->spares_cost -= spare->cost;
+          DZL_COUNTER_ADD (MemoryUsage, -(gint64)spare->cost);
+          ret = spare;
+          break;
+        }
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/* Spares are the cheapest to lose, so they go first when over budget */
+static void
+ide_clang_service_trim_spares_locked (IdeClangService *self)
+{
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+
+  while (self->spares.length > 0 &&
+         (self->spares.length > MAX_SPARE_UNITS ||
+          self->units_cost + self->spares_cost > self->budget))
+    {
+      SpareUnit *spare = g_queue_pop_tail (&self->spares);
+
+      self->spares_cost -= spare->cost;
+      DZL_COUNTER_ADD (MemoryUsage, -(gint64)spare->cost);
+      spare_unit_free (spare);
+    }
+}
+
+static void
+ide_clang_service_clear_spares (IdeClangService *self)
+{
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+
+  g_mutex_lock (&self->mutex);
+  self->spares_enabled = FALSE;
+  g_queue_foreach (&self->spares, (GFunc)spare_unit_free, NULL);
+  g_queue_clear (&self->spares);
+  DZL_COUNTER_ADD (MemoryUsage, -(gint64)self->spares_cost);
+  self->spares_cost = 0;
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * _ide_clang_release_native:
+ * @tu: a native translation unit
+ *
+ * Called when the last reference to @tu is dropped. If @tu was created by
+ * an #IdeClangService that is still running, it is kept as a spare for the
+ * next parse of the same file. Otherwise it is disposed.
+ *
+ * This may be called from any thread.
+ */
+void
+_ide_clang_release_native (CXTranslationUnit tu)
+{
+  g_autoptr(IdeClangService) self = NULL;
+  NativeInfo *info = NULL;
+
+  if (tu == NULL)
+    return;
+
+  g_mutex_lock (&natives_mutex);
+  if (natives != NULL && (info = g_hash_table_lookup (natives, tu)))
+    g_hash_table_steal (natives, tu);
+  g_mutex_unlock (&natives_mutex);
+
+  if (info != NULL && (self = g_weak_ref_get (&info->service)))
+    {
+      SpareUnit *old_spare;
+
+      /* Only one spare per file, keep the most recent */
+      old_spare = ide_clang_service_take_spare (self, info->path);
+
+      g_mutex_lock (&self->mutex);
+
+      if (self->spares_enabled)
+        {
+          SpareUnit *spare = g_slice_new0 (SpareUnit);
+
+          spare->tu = g_steal_pointer (&tu);
+          spare->path = g_steal_pointer (&info->path);
+          spare->argv = g_steal_pointer (&info->argv);
+          spare->options = info->options;
+          spare->cost = info->cost;
+
+          g_queue_push_head (&self->spares, spare);
+          self->spares_cost += spare->cost;
+          DZL_COUNTER_ADD (MemoryUsage, spare->cost);
+
+          ide_clang_service_trim_spares_locked (self);
+        }
+
+      g_mutex_unlock (&self->mutex);
+
+      g_clear_pointer (&old_spare, spare_unit_free);
+    }
+
+  g_clear_pointer (&info, native_info_free);
+  g_clear_pointer (&tu, clang_disposeTranslationUnit);
+}
 
 static void
 parse_request_free (gpointer data)
@@ -74,6 +433,7 @@ parse_request_free (gpointer data)
   g_free (request->source_filename);
   g_strfreev (request->command_line_args);
   g_ptr_array_unref (request->unsaved_files);
+  g_clear_pointer (&request->stamp, content_stamp_free);
   g_clear_object (&request->file);
   g_slice_free (ParseRequest, request);
 }
@@ -179,6 +539,8 @@ ide_clang_service_build_index (IdeClangService   *self,
   cursor = clang_getTranslationUnitCursor (tu);
   clang_visitChildren (cursor, ide_clang_service_build_index_visitor, &client_data);
 
+  ide_highlight_index_freeze (index);
+
   return index;
 }
 
@@ -260,7 +622,8 @@ ide_clang_service_parse_worker (GTask        *task,
   GFile *gfile;
   const gchar *detail_error = NULL;
   const gchar *llvm_flags;
-  enum CXErrorCode code;
+  enum CXErrorCode code = CXError_Failure;
+  SpareUnit *spare;
   GArray *ar = NULL;
   gsize i;
 
@@ -302,15 +665,49 @@ ide_clang_service_parse_worker (GTask        *task,
     g_ptr_array_add (built_argv, request->command_line_args[i]);
   g_ptr_array_add (built_argv, NULL);
 
-  DZL_COUNTER_INC (ParseAttempts);
-  code = clang_parseTranslationUnit2 (request->index,
-                                      request->source_filename,
-                                      (const gchar * const *)built_argv->pdata,
-                                      built_argv->len - 1,
-                                      (struct CXUnsavedFile *)(gpointer)ar->data,
-                                      ar->len,
-                                      request->options,
-                                      &tu);
+  /*
+   * If a previous unit for this file was released and was built with the
+   * same flags, refresh it in place. Clang keeps the preamble (the headers
+   * at the top of the file) precompiled across reparses, so only the body
+   * of the file needs to be parsed again.
+   */
+  if (NULL != (spare = ide_clang_service_take_spare (self, request->source_filename)))
+    {
+      if (spare->options == request->options &&
+          argv_equal ((const gchar * const *)spare->argv,
+                      (const gchar * const *)built_argv->pdata))
+        {
+          CXTranslationUnit spare_tu = g_steal_pointer (&spare->tu);
+
+          DZL_COUNTER_INC (Reparses);
+
+          code = clang_reparseTranslationUnit (spare_tu,
+                                               ar->len,
+                                               (struct CXUnsavedFile *)(gpointer)ar->data,
+                                               clang_defaultReparseOptions (spare_tu));
+
+          /* The unit may not be used again after a failed reparse */
+          if (code == CXError_Success)
+            tu = spare_tu;
+          else
+            clang_disposeTranslationUnit (spare_tu);
+        }
+
+      g_clear_pointer (&spare, spare_unit_free);
+    }
+
+  if (tu == NULL)
+    {
+      DZL_COUNTER_INC (ParseAttempts);
+      code = clang_parseTranslationUnit2 (request->index,
+                                          request->source_filename,
+                                          (const gchar * const *)built_argv->pdata,
+                                          built_argv->len - 1,
+                                          (struct CXUnsavedFile *)(gpointer)ar->data,
+                                          ar->len,
+                                          request->options,
+                                          &tu);
+    }
 
   switch (code)
     {
@@ -351,6 +748,16 @@ ide_clang_service_parse_worker (GTask        *task,
       goto cleanup;
     }
 
+  request->cost = get_unit_cost (tu);
+  request->stamp = create_content_stamp (tu, request->unsaved_files, request->sequence);
+
+  ide_clang_service_register_native (self,
+                                     tu,
+                                     request->source_filename,
+                                     (const gchar * const *)built_argv->pdata,
+                                     request->options,
+                                     request->cost);
+
   context = ide_object_get_context (source_object);
   gfile = ide_file_get_file (request->file);
   ret = _ide_clang_translation_unit_new (context, tu, gfile, index, request->sequence);
@@ -427,23 +834,190 @@ ide_clang_service__get_build_flags_cb (GObject      *object,
                              ide_clang_service_parse_worker);
 }
 
+static void
+ide_clang_service_touch (IdeClangService *self,
+                         IdeFile         *file)
+{
+  GList *link;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (IDE_IS_FILE (file));
+
+  if (self->lru_index != NULL &&
+      (link = g_hash_table_lookup (self->lru_index, file)) &&
+      link != self->lru.head)
+    {
+      g_queue_unlink (&self->lru, link);
+      g_queue_push_head_link (&self->lru, link);
+    }
+}
+
+/*
+ * Evicts the least recently used units until the approximate memory used
+ * fits within the budget. The most recently used unit is always kept, even
+ * if it alone is over budget.
+ */
+static void
+ide_clang_service_trim (IdeClangService *self)
+{
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+
+  g_mutex_lock (&self->mutex);
+  ide_clang_service_trim_spares_locked (self);
+  g_mutex_unlock (&self->mutex);
+
+  while (self->lru.length > 1)
+    {
+      g_autofree gchar *path = NULL;
+      CachedUnit *cu = g_queue_peek_tail (&self->lru);
+      SpareUnit *spare = NULL;
+      gboolean over_budget;
+
+      g_mutex_lock (&self->mutex);
+      over_budget = self->units_cost + self->spares_cost > self->budget;
+      g_mutex_unlock (&self->mutex);
+
+      if (!over_budget)
+        break;
+
+      IDE_TRACE_MSG ("Evicting translation unit using %"G_GSIZE_FORMAT" bytes", cu->cost);
+
+      DZL_COUNTER_INC (Evictions);
+
+      g_queue_pop_tail (&self->lru);
+      g_hash_table_remove (self->lru_index, cu->file);
+
+      g_mutex_lock (&self->mutex);
+      self->units_cost -= cu->cost;
+      DZL_COUNTER_ADD (MemoryUsage, -(gint64)cu->cost);
+      g_mutex_unlock (&self->mutex);
+
+      dzl_task_cache_evict (self->units_cache, cu->file);
+
+      /* Don't keep the native unit around as a spare either */
+      if (NULL != (path = g_file_get_path (ide_file_get_file (cu->file))))
+        {
+          g_hash_table_remove (self->stamps, path);
+          spare = ide_clang_service_take_spare (self, path);
+        }
+
+      g_clear_pointer (&spare, spare_unit_free);
+      cached_unit_free (cu);
+    }
+}
+
+static void
+ide_clang_service_account (IdeClangService *self,
+                           IdeFile         *file,
+                           gsize            cost)
+{
+  CachedUnit *cu;
+  GList *link;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (IDE_IS_FILE (file));
+
+  if (self->lru_index == NULL)
+    return;
+
+  if (NULL != (link = g_hash_table_lookup (self->lru_index, file)))
+    {
+      cu = link->data;
+      g_queue_unlink (&self->lru, link);
+      g_queue_push_head_link (&self->lru, link);
+    }
+  else
+    {
+      cu = g_slice_new0 (CachedUnit);
+      cu->file = g_object_ref (file);
+      g_queue_push_head (&self->lru, cu);
+      g_hash_table_insert (self->lru_index, cu->file, self->lru.head);
+    }
+
+  g_mutex_lock (&self->mutex);
+  self->units_cost -= cu->cost;
+  self->units_cost += cost;
+  DZL_COUNTER_ADD (MemoryUsage, (gint64)cost - (gint64)cu->cost);
+  g_mutex_unlock (&self->mutex);
+
+  cu->cost = cost;
+
+  ide_clang_service_trim (self);
+}
+
+static void
+ide_clang_service_set_budget (IdeClangService *self,
+                              gsize            budget)
+{
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+
+  g_mutex_lock (&self->mutex);
+  DZL_COUNTER_ADD (MemoryBudget, (gint64)budget - (gint64)self->budget);
+  self->budget = budget;
+  g_mutex_unlock (&self->mutex);
+
+  ide_clang_service_trim (self);
+}
+
+static void
+ide_clang_service_budget_changed (IdeClangService *self,
+                                  const gchar     *key,
+                                  GSettings       *settings)
+{
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (G_IS_SETTINGS (settings));
+
+  ide_clang_service_set_budget (self, (gsize)g_settings_get_uint (settings, key) * MEGABYTE);
+}
+
+static void
+ide_clang_service_clear_lru (IdeClangService *self)
+{
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+
+  g_clear_pointer (&self->lru_index, g_hash_table_unref);
+  g_queue_foreach (&self->lru, (GFunc)cached_unit_free, NULL);
+  g_queue_clear (&self->lru);
+
+  g_mutex_lock (&self->mutex);
+  DZL_COUNTER_ADD (MemoryUsage, -(gint64)self->units_cost);
+  self->units_cost = 0;
+  g_mutex_unlock (&self->mutex);
+}
+
 static void
 ide_clang_service_unit_completed_cb (GObject      *object,
                                      GAsyncResult *result,
                                      gpointer      user_data)
 {
+  IdeClangService *self = (IdeClangService *)object;
   g_autoptr(GTask) task = user_data;
+  ParseRequest *request;
   gpointer ret;
   GError *error = NULL;
 
-  g_assert (IDE_IS_CLANG_SERVICE (object));
+  g_assert (IDE_IS_CLANG_SERVICE (self));
   g_assert (G_IS_TASK (result));
   g_assert (G_IS_TASK (task));
 
   if (!(ret = g_task_propagate_pointer (G_TASK (result), &error)))
-    g_task_return_error (task, error);
-  else
-    g_task_return_pointer (task, ret, g_object_unref);
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  /* Remember what the unit was parsed from, so it may be reused */
+  if (self->stamps != NULL)
+    {
+      request = g_task_get_task_data (G_TASK (result));
+      g_hash_table_insert (self->stamps,
+                           g_strdup (request->source_filename),
+                           g_steal_pointer (&request->stamp));
+
+      ide_clang_service_account (self, request->file, request->cost);
+    }
+
+  g_task_return_pointer (task, ret, g_object_unref);
 }
 
 static void
@@ -537,6 +1111,55 @@ ide_clang_service_get_translation_unit_cb (GObject      *object,
     g_task_return_pointer (task, g_steal_pointer (&ret), g_object_unref);
 }
 
+static gboolean
+ide_clang_service_is_unchanged (IdeClangService         *self,
+                                IdeClangTranslationUnit *unit)
+{
+  g_autoptr(GPtrArray) unsaved_files = NULL;
+  g_autofree gchar *path = NULL;
+  const ContentStamp *stamp;
+  IdeContext *context;
+  guint n_included = 0;
+  GFile *file;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (IDE_IS_CLANG_TRANSLATION_UNIT (unit));
+
+  if (self->stamps == NULL ||
+      !(file = ide_clang_translation_unit_get_file (unit)) ||
+      !(path = g_file_get_path (file)) ||
+      !(stamp = g_hash_table_lookup (self->stamps, path)) ||
+      stamp->serial != ide_clang_translation_unit_get_serial (unit))
+    return FALSE;
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  unsaved_files = ide_unsaved_files_to_array (ide_context_get_unsaved_files (context));
+
+  for (guint i = 0; i < unsaved_files->len; i++)
+    {
+      IdeUnsavedFile *uf = g_ptr_array_index (unsaved_files, i);
+      g_autofree gchar *uf_path = g_file_get_path (ide_unsaved_file_get_file (uf));
+      const FileStamp *file_stamp;
+
+      if (uf_path == NULL)
+        continue;
+
+      /* We cannot tell whether a newly modified file is part of the unit */
+      if (!(file_stamp = g_hash_table_lookup (stamp->files, uf_path)))
+        return FALSE;
+
+      if (file_stamp->included)
+        {
+          if (file_stamp->sequence != ide_unsaved_file_get_sequence (uf))
+            return FALSE;
+          n_included++;
+        }
+    }
+
+  /* An unsaved file of the unit went away, so clang would read the disk */
+  return n_included == stamp->n_included;
+}
+
 /**
  * ide_clang_service_get_translation_unit_async:
  *
@@ -547,7 +1170,9 @@ ide_clang_service_get_translation_unit_cb (GObject      *object,
  * existing translation unit will be used.
  *
  * If the translation unit is out of date, then the source file(s) will be
- * parsed via clang_parseTranslationUnit() asynchronously.
+ * parsed asynchronously. When a released translation unit for the file is
+ * available it is refreshed with clang_reparseTranslationUnit(), otherwise
+ * clang_parseTranslationUnit() is used.
  */
 void
 ide_clang_service_get_translation_unit_async (IdeClangService     *self,
@@ -591,6 +1216,8 @@ ide_clang_service_get_translation_unit_async (IdeClangService     *self,
   /*
    * If we have a cached unit, and it is new enough, then re-use it.
    */
+  ide_clang_service_touch (self, file);
+
   if ((cached = dzl_task_cache_peek (self->units_cache, file)) &&
       (ide_clang_translation_unit_get_serial (cached) >= min_serial))
     {
@@ -598,6 +1225,19 @@ ide_clang_service_get_translation_unit_async (IdeClangService     *self,
       return;
     }
 
+  /*
+   * The sequence changes with every edit to any buffer. If none of the
+   * unsaved files that are part of the unit changed since it was parsed,
+   * the content clang would see is the same and there is nothing to
+   * reparse, even though other buffers were edited in the meantime.
+   */
+  if (cached != NULL && ide_clang_service_is_unchanged (self, cached))
+    {
+      DZL_COUNTER_INC (Reuses);
+      g_task_return_pointer (task, g_object_ref (cached), g_object_unref);
+      return;
+    }
+
   dzl_task_cache_get_async (self->units_cache,
                             file,
                             TRUE,
@@ -642,13 +1282,29 @@ ide_clang_service_start (IdeService *service)
                                           g_object_unref,
                                           g_object_ref,
                                           g_object_unref,
-                                          DEFAULT_EVICTION_MSEC,
+                                          0, /* Evicted by memory budget, not age */
                                           ide_clang_service_get_translation_unit_worker,
                                           g_object_ref (self),
                                           g_object_unref);
 
   dzl_task_cache_set_name (self->units_cache, "clang translation-unit cache");
 
+  self->stamps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, content_stamp_free);
+
+  g_mutex_lock (&self->mutex);
+  self->spares_enabled = TRUE;
+  g_mutex_unlock (&self->mutex);
+
+  self->lru_index = g_hash_table_new ((GHashFunc)ide_file_hash, (GEqualFunc)ide_file_equal);
+
+  self->settings = g_settings_new ("org.gnome.builder.code-insight");
+  g_signal_connect_object (self->settings,
+                           "changed::clang-memory-budget",
+                           G_CALLBACK (ide_clang_service_budget_changed),
+                           self,
+                           G_CONNECT_SWAPPED);
+  ide_clang_service_budget_changed (self, "clang-memory-budget", self->settings);
+
   self->index = clang_createIndex (0, 0);
   clang_CXIndex_setGlobalOptions (self->index,
                                   CXGlobalOpt_ThreadBackgroundPriorityForAll);
@@ -664,6 +1320,11 @@ ide_clang_service_stop (IdeService *service)
 
   g_cancellable_cancel (self->cancellable);
   g_clear_object (&self->units_cache);
+  g_clear_object (&self->settings);
+  g_clear_pointer (&self->stamps, g_hash_table_unref);
+  ide_clang_service_clear_lru (self);
+  ide_clang_service_clear_spares (self);
+  ide_clang_service_set_budget (self, 0);
 }
 
 static void
@@ -675,6 +1336,10 @@ ide_clang_service_dispose (GObject *object)
 
   g_clear_object (&self->units_cache);
   g_clear_object (&self->cancellable);
+  g_clear_object (&self->settings);
+  g_clear_pointer (&self->stamps, g_hash_table_unref);
+  ide_clang_service_clear_lru (self);
+  ide_clang_service_clear_spares (self);
   g_clear_pointer (&self->index, clang_disposeIndex);
 
   G_OBJECT_CLASS (ide_clang_service_parent_class)->dispose (object);
@@ -685,8 +1350,12 @@ ide_clang_service_dispose (GObject *object)
 static void
 ide_clang_service_finalize (GObject *object)
 {
+  IdeClangService *self = (IdeClangService *)object;
+
   IDE_ENTRY;
 
+  g_mutex_clear (&self->mutex);
+
   G_OBJECT_CLASS (ide_clang_service_parent_class)->finalize (object);
 
   IDE_EXIT;
@@ -711,6 +1380,8 @@ service_iface_init (IdeServiceInterface *iface)
 static void
 ide_clang_service_init (IdeClangService *self)
 {
+  g_mutex_init (&self->mutex);
+  g_queue_init (&self->spares);
 }
 
 /**
@@ -730,7 +1401,8 @@ ide_clang_service_get_cached_translation_unit (IdeClangService *self,
   g_return_val_if_fail (IDE_IS_CLANG_SERVICE (self), NULL);
   g_return_val_if_fail (IDE_IS_FILE (file), NULL);
 
-  cached = dzl_task_cache_peek (self->units_cache, file);
+  if (NULL != (cached = dzl_task_cache_peek (self->units_cache, file)))
+    ide_clang_service_touch (self, file);
 
   return cached ? g_object_ref (cached) : NULL;
 }
@@ -493,7 +493,7 @@ ide_clang_translation_unit_set_native (IdeClangTranslationUnit *self,
   g_assert (IDE_IS_CLANG_TRANSLATION_UNIT (self));
 
   if (native != NULL)
-    self->native = ide_ref_ptr_new (native, (GDestroyNotify)clang_disposeTranslationUnit);
+    self->native = ide_ref_ptr_new (native, (GDestroyNotify)_ide_clang_release_native);
 }
 
 static void
@@ -19,6 +19,7 @@
 #define G_LOG_DOMAIN "ide-ctags-builder"
 
 #include "ide-ctags-builder.h"
+#include "ide-ctags-index.h"
 
 struct _IdeCtagsBuilder
 {
@@ -86,6 +87,56 @@ ide_ctags_builder_new (IdeContext *context)
                        NULL);
 }
 
+static void
+push_ctags_arguments (IdeSubprocessLauncher *launcher,
+                      const gchar           *ctags)
+{
+  g_autofree gchar *options_path = NULL;
+
+  g_assert (IDE_IS_SUBPROCESS_LAUNCHER (launcher));
+  g_assert (ctags != NULL);
+
+  options_path = g_build_filename (g_get_user_config_dir (),
+                                   ide_get_program_name (),
+                                   "ctags.conf",
+                                   NULL);
+
+  ide_subprocess_launcher_push_argv (launcher, ctags);
+  ide_subprocess_launcher_push_argv (launcher, "-f");
+  ide_subprocess_launcher_push_argv (launcher, "-");
+  ide_subprocess_launcher_push_argv (launcher, "--tag-relative=no");
+  ide_subprocess_launcher_push_argv (launcher, "--exclude=.git");
+  ide_subprocess_launcher_push_argv (launcher, "--exclude=.bzr");
+  ide_subprocess_launcher_push_argv (launcher, "--exclude=.svn");
+  ide_subprocess_launcher_push_argv (launcher, "--exclude=.flatpak-builder");
+  ide_subprocess_launcher_push_argv (launcher, "--sort=yes");
+  ide_subprocess_launcher_push_argv (launcher, "--languages=all");
+  ide_subprocess_launcher_push_argv (launcher, "--file-scope=yes");
+  ide_subprocess_launcher_push_argv (launcher, "--c-kinds=+defgpstx");
+
+  if (g_file_test (options_path, G_FILE_TEST_IS_REGULAR))
+    {
+      ide_subprocess_launcher_push_argv (launcher, "--options");
+      ide_subprocess_launcher_push_argv (launcher, options_path);
+    }
+}
+
+static gchar *
+get_ctags_program (void)
+{
+  g_autoptr(GSettings) settings = NULL;
+  g_autofree gchar *ctags = NULL;
+  g_autofree gchar *program = NULL;
+
+  settings = g_settings_new ("org.gnome.builder.code-insight");
+  ctags = g_settings_get_string (settings, "ctags-path");
+
+  if (!(program = g_find_program_in_path (ctags)))
+    return g_strdup ("ctags");
+
+  return g_steal_pointer (&ctags);
+}
+
 static gboolean
 ide_ctags_builder_build (IdeCtagsBuilder *self,
                          const gchar     *ctags,
@@ -101,9 +152,9 @@ ide_ctags_builder_build (IdeCtagsBuilder *self,
   g_autoptr(GFile) tags_file = NULL;
   g_autoptr(GFileEnumerator) enumerator = NULL;
   g_autoptr(GError) error = NULL;
+  g_autoptr(GError) sidecar_error = NULL;
   g_autofree gchar *cwd = NULL;
   g_autofree gchar *dest_dir = NULL;
-  g_autofree gchar *options_path = NULL;
   g_autofree gchar *tags_path = NULL;
   g_autoptr(GString) filenames = NULL;
   GOutputStream *stdin_stream;
@@ -120,10 +171,6 @@ ide_ctags_builder_build (IdeCtagsBuilder *self,
   tags_file = g_file_get_child (destination, "tags");
   tags_path = g_file_get_path (tags_file);
   cwd = g_file_get_path (directory);
-  options_path = g_build_filename (g_get_user_config_dir (),
-                                   ide_get_program_name (),
-                                   "ctags.conf",
-                                   NULL);
   directories = g_ptr_array_new_with_free_func (g_object_unref);
   dest_directories = g_ptr_array_new_with_free_func (g_object_unref);
   filenames = g_string_new (NULL);
@@ -135,24 +182,7 @@ ide_ctags_builder_build (IdeCtagsBuilder *self,
   ide_subprocess_launcher_setenv (launcher, "TMPDIR", cwd, TRUE);
   ide_subprocess_launcher_set_stdout_file_path (launcher, tags_path);
 
-  ide_subprocess_launcher_push_argv (launcher, ctags);
-  ide_subprocess_launcher_push_argv (launcher, "-f");
-  ide_subprocess_launcher_push_argv (launcher, "-");
-  ide_subprocess_launcher_push_argv (launcher, "--tag-relative=no");
-  ide_subprocess_launcher_push_argv (launcher, "--exclude=.git");
-  ide_subprocess_launcher_push_argv (launcher, "--exclude=.bzr");
-  ide_subprocess_launcher_push_argv (launcher, "--exclude=.svn");
-  ide_subprocess_launcher_push_argv (launcher, "--exclude=.flatpak-builder");
-  ide_subprocess_launcher_push_argv (launcher, "--sort=yes");
-  ide_subprocess_launcher_push_argv (launcher, "--languages=all");
-  ide_subprocess_launcher_push_argv (launcher, "--file-scope=yes");
-  ide_subprocess_launcher_push_argv (launcher, "--c-kinds=+defgpstx");
-
-  if (g_file_test (options_path, G_FILE_TEST_IS_REGULAR))
-    {
-      ide_subprocess_launcher_push_argv (launcher, "--options");
-      ide_subprocess_launcher_push_argv (launcher, options_path);
-    }
+  push_ctags_arguments (launcher, ctags);
 
   /* Read filenames from stdin, which we will provided below */
   ide_subprocess_launcher_push_argv (launcher, "-L");
@@ -225,6 +255,13 @@ finish_subprocess:
       return FALSE;
     }
 
+  /*
+   * Compile the tags into the pre-sorted sidecar now while we are on a
+   * worker thread so that IdeCtagsIndex can simply mmap() it later.
+   */
+  if (!ide_ctags_index_write_sidecar (tags_file, cancellable, &sidecar_error))
+    g_debug ("Failed to write ctags sidecar: %s", sidecar_error->message);
+
   for (guint i = 0; i < directories->len; i++)
     {
       GFile *child = g_ptr_array_index (directories, i);
@@ -248,8 +285,6 @@ ide_ctags_builder_build_worker (GTask        *task,
 {
   BuildTaskData *task_data = task_data_ptr;
   IdeCtagsBuilder *self = source_object;
-  const gchar *ctags;
-  g_autofree gchar *program = NULL;
 
   IDE_ENTRY;
 
@@ -257,13 +292,8 @@ ide_ctags_builder_build_worker (GTask        *task,
   g_assert (IDE_IS_CTAGS_BUILDER (source_object));
   g_assert (G_IS_FILE (task_data->directory));
 
-  ctags = task_data->ctags;
-  program = g_find_program_in_path (ctags);
-  if (!program)
-    ctags = "ctags";
-
   ide_ctags_builder_build (self,
-                           ctags,
+                           task_data->ctags,
                            task_data->directory,
                            task_data->destination,
                            task_data->recursive,
@@ -284,7 +314,6 @@ ide_ctags_builder_build_async (IdeTagsBuilder      *builder,
 {
   IdeCtagsBuilder *self = (IdeCtagsBuilder *)builder;
   g_autoptr(GTask) task = NULL;
-  g_autoptr(GSettings) settings = NULL;
   g_autofree gchar *destination_path = NULL;
   g_autofree gchar *relative_path = NULL;
   BuildTaskData *task_data;
@@ -297,10 +326,8 @@ ide_ctags_builder_build_async (IdeTagsBuilder      *builder,
   g_assert (IDE_IS_CTAGS_BUILDER (self));
   g_assert (G_IS_FILE (directory_or_file));
 
-  settings = g_settings_new ("org.gnome.builder.code-insight");
-
   task_data = g_slice_new0 (BuildTaskData);
-  task_data->ctags = g_settings_get_string (settings, "ctags-path");
+  task_data->ctags = get_ctags_program ();
   task_data->directory = g_object_ref (directory_or_file);
   task_data->recursive = recursive;
 
@@ -354,3 +381,132 @@ tags_builder_iface_init (IdeTagsBuilderInterface *iface)
   iface->build_async = ide_ctags_builder_build_async;
   iface->build_finish = ide_ctags_builder_build_finish;
 }
+
+static void
+ide_ctags_builder_tag_file_worker (GTask        *task,
+                                   gpointer      source_object,
+                                   gpointer      task_data_ptr,
+                                   GCancellable *cancellable)
+{
+  BuildTaskData *task_data = task_data_ptr;
+  g_autoptr(IdeSubprocessLauncher) launcher = NULL;
+  g_autoptr(IdeSubprocess) subprocess = NULL;
+  g_autoptr(GBytes) stdout_buf = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *cwd = NULL;
+  g_autofree gchar *name = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_CTAGS_BUILDER (source_object));
+  g_assert (G_IS_FILE (task_data->directory));
+  g_assert (G_IS_FILE (task_data->destination));
+
+  cwd = g_file_get_path (task_data->directory);
+  name = g_file_get_basename (task_data->destination);
+
+  launcher = ide_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                                          G_SUBPROCESS_FLAGS_STDERR_SILENCE);
+
+  ide_subprocess_launcher_set_cwd (launcher, cwd);
+  ide_subprocess_launcher_setenv (launcher, "TMPDIR", cwd, TRUE);
+
+  /*
+   * Use the same arguments and working directory as the directory build so
+   * that the path column of the resulting tags matches what is already in
+   * the directory's tags file and the entries can be swapped by path.
+   */
+  push_ctags_arguments (launcher, task_data->ctags);
+  ide_subprocess_launcher_push_argv (launcher, name);
+
+  if (!(subprocess = ide_subprocess_launcher_spawn (launcher, cancellable, &error)) ||
+      !ide_subprocess_communicate (subprocess, NULL, cancellable, &stdout_buf, NULL, &error))
+    {
+      g_task_return_error (task, g_steal_pointer (&error));
+      IDE_EXIT;
+    }
+
+  if (stdout_buf == NULL)
+    stdout_buf = g_bytes_new (NULL, 0);
+
+  g_task_return_pointer (task, g_steal_pointer (&stdout_buf), (GDestroyNotify)g_bytes_unref);
+
+  IDE_EXIT;
+}
+
+/**
+ * ide_ctags_builder_tag_file_async:
+ * @self: a #IdeCtagsBuilder
+ * @file: the source file to generate tags for
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: a callback to execute upon completion
+ * @user_data: user data for @callback
+ *
+ * Runs ctags for a single file, rather than an entire directory, so that
+ * the result may be spliced into an existing #IdeCtagsIndex using
+ * ide_ctags_index_splice().
+ */
+void
+ide_ctags_builder_tag_file_async (IdeCtagsBuilder     *self,
+                                  GFile               *file,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  BuildTaskData *task_data;
+
+  IDE_ENTRY;
+
+  g_return_if_fail (IDE_IS_CTAGS_BUILDER (self));
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task_data = g_slice_new0 (BuildTaskData);
+  task_data->ctags = get_ctags_program ();
+  task_data->directory = g_file_get_parent (file);
+  task_data->destination = g_object_ref (file);
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ide_ctags_builder_tag_file_async);
+  g_task_set_task_data (task, task_data, build_task_data_free);
+
+  if (task_data->directory == NULL || !g_file_is_native (file))
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_NOT_SUPPORTED,
+                               "Only local files can be tagged");
+      IDE_EXIT;
+    }
+
+  ide_thread_pool_push_task (IDE_THREAD_POOL_INDEXER, task, ide_ctags_builder_tag_file_worker);
+
+  IDE_EXIT;
+}
+
+/**
+ * ide_ctags_builder_tag_file_finish:
+ *
+ * Completes a request to ide_ctags_builder_tag_file_async().
+ *
+ * Returns: (transfer full): a #GBytes containing the ctags output
+ *   or %NULL and @error is set.
+ */
+GBytes *
+ide_ctags_builder_tag_file_finish (IdeCtagsBuilder  *self,
+                                   GAsyncResult     *result,
+                                   GError          **error)
+{
+  GBytes *ret;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (IDE_IS_CTAGS_BUILDER (self), NULL);
+  g_return_val_if_fail (G_IS_TASK (result), NULL);
+
+  ret = g_task_propagate_pointer (G_TASK (result), error);
+
+  IDE_RETURN (ret);
+}
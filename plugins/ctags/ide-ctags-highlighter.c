@@ -100,19 +100,18 @@ get_tag_from_kind (IdeCtagsIndexEntryKind kind)
 }
 
 static const gchar *
-get_tag (IdeCtagsHighlighter *self,
-         IdeFile             *file,
-         const gchar         *word)
+get_tag (GPtrArray   *indexes,
+         const gchar *file_path,
+         const gchar *word)
 {
-  const gchar *file_path = ide_file_get_path (file);
   const IdeCtagsIndexEntry *entries;
   gsize n_entries;
   gsize i;
   gsize j;
 
-  for (i = 0; i < self->indexes->len; i++)
+  for (i = 0; i < indexes->len; i++)
     {
-      IdeCtagsIndex *item = g_ptr_array_index (self->indexes, i);
+      IdeCtagsIndex *item = g_ptr_array_index (indexes, i);
       entries = ide_ctags_index_lookup_prefix (item, word, &n_entries);
       if ((entries == NULL) || (n_entries == 0))
         continue;
@@ -174,7 +173,7 @@ ide_ctags_highlighter_real_update (IdeHighlighter       *highlighter,
           gchar *word;
 
           word = gtk_text_iter_get_slice (&begin, &end);
-          tag = get_tag (IDE_CTAGS_HIGHLIGHTER (highlighter), file, word);
+          tag = get_tag (IDE_CTAGS_HIGHLIGHTER (highlighter)->indexes, ide_file_get_path (file), word);
           g_free (word);
 
           if (tag != NULL)
@@ -194,6 +193,73 @@ completed:
   *location = *range_end;
 }
 
+typedef struct
+{
+  GPtrArray *indexes;
+  gchar     *path;
+} LookupData;
+
+static void
+lookup_data_free (gpointer data)
+{
+  LookupData *lookup = data;
+
+  g_clear_pointer (&lookup->indexes, g_ptr_array_unref);
+  g_clear_pointer (&lookup->path, g_free);
+  g_slice_free (LookupData, lookup);
+}
+
+static const gchar *
+ide_ctags_highlighter_lookup_word (const gchar *word,
+                                   gsize        word_len,
+                                   gpointer     user_data)
+{
+  LookupData *lookup = user_data;
+
+  return get_tag (lookup->indexes, lookup->path, word);
+}
+
+static void
+ide_ctags_highlighter_real_update_async (IdeHighlighter      *highlighter,
+                                         GBytes              *text,
+                                         guint                offset,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data)
+{
+  IdeCtagsHighlighter *self = (IdeCtagsHighlighter *)highlighter;
+  LookupData *lookup;
+  IdeBuffer *buffer = NULL;
+  IdeFile *file = NULL;
+
+  g_assert (IDE_IS_CTAGS_HIGHLIGHTER (self));
+  g_assert (text != NULL);
+
+  if (self->engine != NULL && (buffer = ide_highlight_engine_get_buffer (self->engine)))
+    file = ide_buffer_get_file (buffer);
+
+  /*
+   * Indexes are immutable once loaded (new generations replace them), so the
+   * worker only needs its own references to the current set.
+   */
+  lookup = g_slice_new0 (LookupData);
+  lookup->indexes = g_ptr_array_new_with_free_func (g_object_unref);
+  lookup->path = file ? g_strdup (ide_file_get_path (file)) : NULL;
+
+  for (guint i = 0; i < self->indexes->len; i++)
+    g_ptr_array_add (lookup->indexes, g_object_ref (g_ptr_array_index (self->indexes, i)));
+
+  ide_highlighter_scan_words_async (highlighter,
+                                    text,
+                                    offset,
+                                    ide_ctags_highlighter_lookup_word,
+                                    lookup,
+                                    lookup_data_free,
+                                    cancellable,
+                                    callback,
+                                    user_data);
+}
+
 void
 ide_ctags_highlighter_add_index (IdeCtagsHighlighter *self,
                                  IdeCtagsIndex       *index)
@@ -292,6 +358,7 @@ static void
 highlighter_iface_init (IdeHighlighterInterface *iface)
 {
   iface->update = ide_ctags_highlighter_real_update;
+  iface->update_async = ide_ctags_highlighter_real_update_async;
   iface->set_engine = ide_ctags_highlighter_real_set_engine;
 }
 
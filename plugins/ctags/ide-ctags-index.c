@@ -28,16 +28,63 @@
 
 struct _IdeCtagsIndex
 {
-  IdeObject  parent_instance;
+  IdeObject    parent_instance;
 
-  GArray    *index;
-  GBytes    *buffer;
-  GFile     *file;
-  gchar     *path_root;
+  GArray      *index;
+  GBytes      *buffer;
+  GMappedFile *mapped;
+  GHashTable  *overlays;
+  GFile       *file;
+  gchar       *path_root;
 
-  guint64    mtime;
+  guint64      mtime;
+
+  /* Spliced generations share @buffer and @mapped with their parent */
+  guint        owns_storage : 1;
 };
 
+/*
+ * The sidecar is a pre-sorted, binary form of a tags file that is written
+ * by IdeCtagsBuilder right after ctags completes. It contains a string
+ * table (paths and patterns repeat a lot, so they are only stored once)
+ * and an array of fixed-width records referencing that table by offset.
+ *
+ * Loading a sidecar is just a g_mapped_file_new() and some validation, so
+ * the strings never land on the heap and we never have to re-tokenize or
+ * re-sort the tags file. The sidecar is only ever read by the machine that
+ * wrote it, so host byte-order is used and checked via @byte_order.
+ */
+#define SIDECAR_SUFFIX     ".idx"
+#define SIDECAR_MAGIC      "IDECTAGS"
+#define SIDECAR_BYTE_ORDER 0x01020304
+#define SIDECAR_VERSION    1
+#define SIDECAR_NO_STRING  G_MAXUINT32
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 byte_order;
+  guint32 version;
+  guint64 source_mtime;
+  guint64 source_size;
+  guint64 n_entries;
+  guint64 entries_offset;
+  guint64 strings_offset;
+  guint64 strings_length;
+} SidecarHeader;
+
+typedef struct
+{
+  guint32 name;
+  guint32 path;
+  guint32 pattern;
+  guint32 keyval;
+  guint32 kind;
+} SidecarEntry;
+
+G_STATIC_ASSERT (sizeof (SidecarHeader) == 64);
+G_STATIC_ASSERT (sizeof (SidecarEntry) == 20);
+
 enum {
   PROP_0,
   PROP_FILE,
@@ -55,6 +102,7 @@ G_DEFINE_DYNAMIC_TYPE_EXTENDED (IdeCtagsIndex, ide_ctags_index, IDE_TYPE_OBJECT,
 DZL_DEFINE_COUNTER (instances, "IdeCtagsIndex", "Instances", "Number of IdeCtagsIndex instances.")
 DZL_DEFINE_COUNTER (index_entries, "IdeCtagsIndex", "N Entries", "Number of entries in indexes.")
 DZL_DEFINE_COUNTER (heap_size, "IdeCtagsIndex", "Heap Size", "Size of index string heaps.")
+DZL_DEFINE_COUNTER (mapped_size, "IdeCtagsIndex", "Mapped Size", "Size of memory-mapped index sidecars.")
 
 static GParamSpec *properties [LAST_PROP];
 
@@ -183,32 +231,16 @@ ide_ctags_index_parse_line (gchar              *line,
   return TRUE;
 }
 
-static void
-ide_ctags_index_build_index (GTask        *task,
-                             gpointer      source_object,
-                             gpointer      task_data,
-                             GCancellable *cancellable)
+static GArray *
+ide_ctags_index_parse_contents (gchar *contents,
+                                gsize  length)
 {
-  IdeCtagsIndex *self = source_object;
   IdeLineReader reader;
-  GError *error = NULL;
-  GArray *index = NULL;
-  gchar *contents = NULL;
+  GArray *index;
   gchar *line;
-  gsize length = 0;
   gsize line_length;
 
-  IDE_ENTRY;
-
-  g_assert (G_IS_TASK (task));
-  g_assert (IDE_IS_CTAGS_INDEX (self));
-  g_assert (G_IS_FILE (self->file));
-
-  if (!g_file_load_contents (self->file, cancellable, &contents, &length, NULL, &error))
-    IDE_GOTO (failure);
-
-  if (length > G_MAXSSIZE)
-    IDE_GOTO (failure);
+  g_assert (contents != NULL);
 
   index = g_array_new (FALSE, FALSE, sizeof (IdeCtagsIndexEntry));
 
@@ -239,8 +271,488 @@ ide_ctags_index_build_index (GTask        *task,
 
   g_array_sort (index, ide_ctags_index_entry_compare);
 
+  return index;
+}
+
+static gboolean
+query_source_info (GFile        *file,
+                   guint64      *mtime,
+                   guint64      *size,
+                   GCancellable *cancellable,
+                   GError      **error)
+{
+  g_autoptr(GFileInfo) info = NULL;
+
+  g_assert (G_IS_FILE (file));
+  g_assert (mtime != NULL);
+  g_assert (size != NULL);
+
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                            G_FILE_QUERY_INFO_NONE,
+                            cancellable,
+                            error);
+
+  if (info == NULL)
+    return FALSE;
+
+  *mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  *size = g_file_info_get_size (info);
+
+  return TRUE;
+}
+
+static gchar *
+get_sidecar_path (GFile *file)
+{
+  g_autofree gchar *path = NULL;
+
+  g_assert (G_IS_FILE (file));
+
+  if (!(path = g_file_get_path (file)))
+    return NULL;
+
+  return g_strconcat (path, SIDECAR_SUFFIX, NULL);
+}
+
+static inline gboolean
+sidecar_string_is_valid (guint32 offset,
+                         guint64 strings_length)
+{
+  return offset < strings_length;
+}
+
+static gboolean
+ide_ctags_index_load_sidecar (IdeCtagsIndex *self,
+                              GCancellable  *cancellable)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GArray) index = NULL;
+  g_autofree gchar *path = NULL;
+  const SidecarHeader *header;
+  const SidecarEntry *records;
+  const gchar *contents;
+  const gchar *strings;
+  guint64 source_mtime;
+  guint64 source_size;
+  gsize length;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CTAGS_INDEX (self));
+  g_assert (G_IS_FILE (self->file));
+
+  if (!(path = get_sidecar_path (self->file)) ||
+      !g_file_test (path, G_FILE_TEST_IS_REGULAR) ||
+      !query_source_info (self->file, &source_mtime, &source_size, cancellable, NULL) ||
+      !(mapped = g_mapped_file_new (path, FALSE, NULL)))
+    IDE_RETURN (FALSE);
+
+  contents = g_mapped_file_get_contents (mapped);
+  length = g_mapped_file_get_length (mapped);
+
+  if (contents == NULL || length < sizeof *header)
+    IDE_RETURN (FALSE);
+
+  header = (const SidecarHeader *)(gconstpointer)contents;
+
+  /* Stale or foreign sidecars are ignored, we'll fallback to parsing */
+  if (memcmp (header->magic, SIDECAR_MAGIC, sizeof header->magic) != 0 ||
+      header->byte_order != SIDECAR_BYTE_ORDER ||
+      header->version != SIDECAR_VERSION ||
+      header->source_mtime != source_mtime ||
+      header->source_size != source_size)
+    IDE_RETURN (FALSE);
+
+  if (header->entries_offset % sizeof (guint32) != 0 ||
+      header->entries_offset > length ||
+      header->n_entries > (length - header->entries_offset) / sizeof (SidecarEntry) ||
+      header->strings_offset > length ||
+      header->strings_length == 0 ||
+      header->strings_length > length - header->strings_offset)
+    IDE_RETURN (FALSE);
+
+  records = (const SidecarEntry *)(gconstpointer)(contents + header->entries_offset);
+  strings = contents + header->strings_offset;
+
+  if (strings [header->strings_length - 1] != '\0')
+    IDE_RETURN (FALSE);
+
+  /*
+   * The records are already sorted, so all we need to do is resolve the
+   * string offsets. The strings themselves stay in the mapped pages.
+   */
+  index = g_array_sized_new (FALSE, FALSE, sizeof (IdeCtagsIndexEntry), header->n_entries);
+
+  for (guint64 i = 0; i < header->n_entries; i++)
+    {
+      const SidecarEntry *record = &records [i];
+      IdeCtagsIndexEntry entry = { 0 };
+
+      if (!sidecar_string_is_valid (record->name, header->strings_length) ||
+          !sidecar_string_is_valid (record->path, header->strings_length) ||
+          !sidecar_string_is_valid (record->pattern, header->strings_length) ||
+          (record->keyval != SIDECAR_NO_STRING &&
+           !sidecar_string_is_valid (record->keyval, header->strings_length)))
+        IDE_RETURN (FALSE);
+
+      entry.name = strings + record->name;
+      entry.path = strings + record->path;
+      entry.pattern = strings + record->pattern;
+      entry.keyval = record->keyval != SIDECAR_NO_STRING ? strings + record->keyval : NULL;
+      entry.kind = (IdeCtagsIndexEntryKind)record->kind;
+
+      g_array_append_val (index, entry);
+    }
+
+  self->index = g_steal_pointer (&index);
+  self->mapped = g_steal_pointer (&mapped);
+  self->owns_storage = TRUE;
+
+  DZL_COUNTER_ADD (index_entries, (gint64)self->index->len);
+  DZL_COUNTER_ADD (mapped_size, (gint64)length);
+
+  IDE_RETURN (TRUE);
+}
+
+static guint32
+sidecar_add_string (GByteArray  *strings,
+                    GHashTable  *offsets,
+                    const gchar *str)
+{
+  gpointer value;
+  gsize len;
+  guint32 offset;
+
+  g_assert (strings != NULL);
+  g_assert (offsets != NULL);
+
+  if (str == NULL)
+    return SIDECAR_NO_STRING;
+
+  if (g_hash_table_lookup_extended (offsets, str, NULL, &value))
+    return GPOINTER_TO_UINT (value);
+
+  len = strlen (str) + 1;
+
+  if ((guint64)strings->len + len >= SIDECAR_NO_STRING)
+    return SIDECAR_NO_STRING;
+
+  offset = strings->len;
+  g_byte_array_append (strings, (const guint8 *)str, len);
+  g_hash_table_insert (offsets, (gpointer)str, GUINT_TO_POINTER (offset));
+
+  return offset;
+}
+
+/**
+ * ide_ctags_index_write_sidecar:
+ * @file: a #GFile containing ctags data
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @error: a location for a #GError or %NULL
+ *
+ * Parses @file and writes a pre-sorted binary sidecar next to it which
+ * will be memory-mapped by #IdeCtagsIndex instead of parsing @file the
+ * next time it is loaded.
+ *
+ * This function does blocking I/O and should be called from a thread.
+ *
+ * Returns: %TRUE if the sidecar was written; otherwise %FALSE and @error
+ *   is set.
+ */
+gboolean
+ide_ctags_index_write_sidecar (GFile         *file,
+                               GCancellable  *cancellable,
+                               GError       **error)
+{
+  g_autoptr(GFile) sidecar = NULL;
+  g_autoptr(GFileOutputStream) stream = NULL;
+  g_autoptr(GHashTable) offsets = NULL;
+  g_autoptr(GByteArray) strings = NULL;
+  g_autoptr(GArray) records = NULL;
+  g_autoptr(GArray) index = NULL;
+  g_autofree gchar *contents = NULL;
+  g_autofree gchar *sidecar_path = NULL;
+  SidecarHeader header = {{ 0 }};
+  guint64 source_mtime;
+  guint64 source_size;
+  gsize length = 0;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+
+  if (!(sidecar_path = get_sidecar_path (file)))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "ctags sidecars are only supported for local files");
+      IDE_RETURN (FALSE);
+    }
+
+  /* Query first so a concurrent rewrite results in a stale sidecar */
+  if (!query_source_info (file, &source_mtime, &source_size, cancellable, error) ||
+      !g_file_load_contents (file, cancellable, &contents, &length, NULL, error))
+    IDE_RETURN (FALSE);
+
+  index = ide_ctags_index_parse_contents (contents, length);
+
+  offsets = g_hash_table_new (g_str_hash, g_str_equal);
+  strings = g_byte_array_new ();
+  records = g_array_sized_new (FALSE, FALSE, sizeof (SidecarEntry), index->len);
+
+  for (guint i = 0; i < index->len; i++)
+    {
+      const IdeCtagsIndexEntry *entry = &g_array_index (index, IdeCtagsIndexEntry, i);
+      SidecarEntry record;
+
+      record.name = sidecar_add_string (strings, offsets, entry->name);
+      record.path = sidecar_add_string (strings, offsets, entry->path);
+      record.pattern = sidecar_add_string (strings, offsets, entry->pattern);
+      record.keyval = sidecar_add_string (strings, offsets, entry->keyval);
+      record.kind = entry->kind;
+
+      if (record.name == SIDECAR_NO_STRING ||
+          record.path == SIDECAR_NO_STRING ||
+          record.pattern == SIDECAR_NO_STRING ||
+          (entry->keyval != NULL && record.keyval == SIDECAR_NO_STRING))
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_NO_SPACE,
+                       "Too much string data for ctags sidecar");
+          IDE_RETURN (FALSE);
+        }
+
+      g_array_append_val (records, record);
+    }
+
+  /* Always have at least one byte so the table is NUL terminated */
+  if (strings->len == 0)
+    g_byte_array_append (strings, (const guint8 *)"", 1);
+
+  memcpy (header.magic, SIDECAR_MAGIC, sizeof header.magic);
+  header.byte_order = SIDECAR_BYTE_ORDER;
+  header.version = SIDECAR_VERSION;
+  header.source_mtime = source_mtime;
+  header.source_size = source_size;
+  header.n_entries = records->len;
+  header.entries_offset = sizeof header;
+  header.strings_offset = header.entries_offset + ((guint64)records->len * sizeof (SidecarEntry));
+  header.strings_length = strings->len;
+
+  sidecar = g_file_new_for_path (sidecar_path);
+  stream = g_file_replace (sidecar,
+                           NULL,
+                           FALSE,
+                           G_FILE_CREATE_REPLACE_DESTINATION,
+                           cancellable,
+                           error);
+
+  if (stream == NULL ||
+      !g_output_stream_write_all (G_OUTPUT_STREAM (stream), &header, sizeof header,
+                                  NULL, cancellable, error) ||
+      !g_output_stream_write_all (G_OUTPUT_STREAM (stream), records->data,
+                                  (gsize)records->len * sizeof (SidecarEntry),
+                                  NULL, cancellable, error) ||
+      !g_output_stream_write_all (G_OUTPUT_STREAM (stream), strings->data, strings->len,
+                                  NULL, cancellable, error) ||
+      !g_output_stream_close (G_OUTPUT_STREAM (stream), cancellable, error))
+    IDE_RETURN (FALSE);
+
+  IDE_RETURN (TRUE);
+}
+
+static gboolean
+line_has_path (const gchar *line,
+               gsize        line_length,
+               const gchar *relative_path,
+               gsize        relative_path_len)
+{
+  const gchar *path;
+  const gchar *end;
+
+  /* The path is the second tab separated field */
+  if (!(path = memchr (line, '\t', line_length)))
+    return FALSE;
+
+  path++;
+  end = line + line_length;
+
+  return (gsize)(end - path) > relative_path_len &&
+         path [relative_path_len] == '\t' &&
+         memcmp (path, relative_path, relative_path_len) == 0;
+}
+
+static gint
+compare_lines (gconstpointer a,
+               gconstpointer b)
+{
+  return strcmp (*(const gchar * const *)a, *(const gchar * const *)b);
+}
+
+static void
+collect_lines (GPtrArray   *headers,
+               GPtrArray   *lines,
+               gchar       *contents,
+               gsize        length,
+               const gchar *skip_path)
+{
+  IdeLineReader reader;
+  gsize skip_path_len = skip_path ? strlen (skip_path) : 0;
+  gchar *line;
+  gsize line_length;
+
+  ide_line_reader_init (&reader, contents, length);
+
+  while ((line = ide_line_reader_next (&reader, &line_length)))
+    {
+      if (line_length == 0)
+        continue;
+
+      if (skip_path != NULL && line_has_path (line, line_length, skip_path, skip_path_len))
+        continue;
+
+      line [line_length] = '\0';
+
+      if (line [0] == '!')
+        {
+          if (headers != NULL)
+            g_ptr_array_add (headers, line);
+        }
+      else
+        g_ptr_array_add (lines, line);
+    }
+}
+
+/**
+ * ide_ctags_index_splice_file:
+ * @file: the tags file
+ * @relative_path: the path of the re-tagged file as found in @file
+ * @contents: the ctags output for @relative_path
+ * @mtime: (out): the modification time of the rewritten @file
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @error: a location for a #GError or %NULL
+ *
+ * Rewrites @file, and its sidecar, so that the entries for @relative_path
+ * are replaced with those found in @contents. This keeps the tags file in
+ * sync with an index created with ide_ctags_index_splice(), so that the
+ * next load does not use outdated tags.
+ *
+ * This should be called from a thread.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+ide_ctags_index_splice_file (GFile         *file,
+                             const gchar   *relative_path,
+                             GBytes        *contents,
+                             guint64       *mtime,
+                             GCancellable  *cancellable,
+                             GError       **error)
+{
+  g_autoptr(GPtrArray) headers = NULL;
+  g_autoptr(GPtrArray) lines = NULL;
+  g_autoptr(GString) str = NULL;
+  g_autofree gchar *old_contents = NULL;
+  g_autofree gchar *new_contents = NULL;
+  const gchar *data;
+  guint64 size;
+  gsize old_length = 0;
+  gsize length;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+  g_return_val_if_fail (relative_path != NULL, FALSE);
+  g_return_val_if_fail (contents != NULL, FALSE);
+  g_return_val_if_fail (mtime != NULL, FALSE);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+
+  if (!g_file_load_contents (file, cancellable, &old_contents, &old_length, NULL, error))
+    IDE_RETURN (FALSE);
+
+  /* The line reader works in place and requires a trailing \0 */
+  data = g_bytes_get_data (contents, &length);
+  new_contents = g_malloc (length + 1);
+  memcpy (new_contents, data, length);
+  new_contents [length] = '\0';
+
+  headers = g_ptr_array_new ();
+  lines = g_ptr_array_new ();
+
+  collect_lines (headers, lines, old_contents, old_length, relative_path);
+  collect_lines (NULL, lines, new_contents, length, NULL);
+
+  /* Keep the file sorted like ctags does, so that other tools can bisect it */
+  g_ptr_array_sort (lines, compare_lines);
+
+  str = g_string_sized_new (old_length + length);
+
+  for (guint i = 0; i < headers->len; i++)
+    {
+      g_string_append (str, g_ptr_array_index (headers, i));
+      g_string_append_c (str, '\n');
+    }
+
+  for (guint i = 0; i < lines->len; i++)
+    {
+      g_string_append (str, g_ptr_array_index (lines, i));
+      g_string_append_c (str, '\n');
+    }
+
+  if (!g_file_replace_contents (file, str->str, str->len, NULL, FALSE,
+                                G_FILE_CREATE_REPLACE_DESTINATION,
+                                NULL, cancellable, error) ||
+      !query_source_info (file, mtime, &size, cancellable, error))
+    IDE_RETURN (FALSE);
+
+  /* A stale sidecar is ignored when loading, so this is not fatal */
+  if (!ide_ctags_index_write_sidecar (file, cancellable, NULL))
+    g_debug ("Failed to write ctags sidecar after splicing %s", relative_path);
+
+  IDE_RETURN (TRUE);
+}
+
+static void
+ide_ctags_index_build_index (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
+{
+  IdeCtagsIndex *self = source_object;
+  GError *error = NULL;
+  GArray *index = NULL;
+  gchar *contents = NULL;
+  gsize length = 0;
+
+  IDE_ENTRY;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_CTAGS_INDEX (self));
+  g_assert (G_IS_FILE (self->file));
+
+  /* Prefer the pre-sorted sidecar if it is up to date */
+  if (ide_ctags_index_load_sidecar (self, cancellable))
+    {
+      g_task_return_boolean (task, TRUE);
+      IDE_EXIT;
+    }
+
+  if (!g_file_load_contents (self->file, cancellable, &contents, &length, NULL, &error))
+    IDE_GOTO (failure);
+
+  if (length > G_MAXSSIZE)
+    IDE_GOTO (failure);
+
+  index = ide_ctags_index_parse_contents (contents, length);
+
   self->index = index;
   self->buffer = g_bytes_new_take (contents, length);
+  self->owns_storage = TRUE;
 
   DZL_COUNTER_ADD (index_entries, (gint64)index->len);
   DZL_COUNTER_ADD (heap_size, (gint64)length);
@@ -359,15 +871,23 @@ ide_ctags_index_finalize (GObject *object)
   if (self->index != NULL)
     DZL_COUNTER_SUB (index_entries, (gint64)self->index->len);
 
-  if (self->buffer != NULL)
+  if (self->buffer != NULL && self->owns_storage)
     {
       gsize len = g_bytes_get_size (self->buffer);
       DZL_COUNTER_SUB (heap_size, (gint64)len);
     }
 
+  if (self->mapped != NULL && self->owns_storage)
+    {
+      gsize len = g_mapped_file_get_length (self->mapped);
+      DZL_COUNTER_SUB (mapped_size, (gint64)len);
+    }
+
   g_clear_object (&self->file);
   g_clear_pointer (&self->index, g_array_unref);
   g_clear_pointer (&self->buffer, g_bytes_unref);
+  g_clear_pointer (&self->mapped, g_mapped_file_unref);
+  g_clear_pointer (&self->overlays, g_hash_table_unref);
   g_clear_pointer (&self->path_root, g_free);
 
   G_OBJECT_CLASS (ide_ctags_index_parent_class)->finalize (object);
@@ -685,3 +1205,124 @@ ide_ctags_index_get_is_empty (IdeCtagsIndex *self)
 
   return self->index == NULL || self->index->len == 0;
 }
+
+/**
+ * ide_ctags_index_splice:
+ * @self: A #IdeCtagsIndex
+ * @relative_path: the path of the re-tagged file as found in the index
+ * @contents: the ctags output for @relative_path
+ *
+ * Creates a new generation of @self where all of the entries for
+ * @relative_path have been replaced with those found in @contents.
+ *
+ * The new index shares the storage of @self, so the unchanged entries are
+ * not re-read or re-parsed. Only the (already sorted) entry table is merged,
+ * which makes this suitable for updating the index after a file is saved.
+ *
+ * This may be called from a thread, as @self is not modified.
+ *
+ * Returns: (transfer full): A new #IdeCtagsIndex.
+ */
+IdeCtagsIndex *
+ide_ctags_index_splice (IdeCtagsIndex *self,
+                        const gchar   *relative_path,
+                        GBytes        *contents)
+{
+  g_autoptr(GArray) added = NULL;
+  IdeCtagsIndex *ret;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  const gchar *data;
+  gchar *copy;
+  gsize length;
+  guint i = 0;
+  guint j = 0;
+
+  g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), NULL);
+  g_return_val_if_fail (relative_path != NULL, NULL);
+  g_return_val_if_fail (contents != NULL, NULL);
+
+  /* The parser works in place and requires a trailing \0 */
+  data = g_bytes_get_data (contents, &length);
+  copy = g_malloc (length + 1);
+  memcpy (copy, data, length);
+  copy [length] = '\0';
+
+  added = ide_ctags_index_parse_contents (copy, length);
+
+  ret = g_object_new (IDE_TYPE_CTAGS_INDEX,
+                      "file", self->file,
+                      "path-root", self->path_root,
+                      "mtime", self->mtime,
+                      NULL);
+
+  if (self->buffer != NULL)
+    ret->buffer = g_bytes_ref (self->buffer);
+
+  if (self->mapped != NULL)
+    ret->mapped = g_mapped_file_ref (self->mapped);
+
+  /*
+   * Overlays keep the storage for previously spliced files alive. We drop
+   * the previous overlay for @relative_path since none of the entries in
+   * the new generation reference it any longer.
+   */
+  ret->overlays = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify)g_bytes_unref);
+
+  if (self->overlays != NULL)
+    {
+      g_hash_table_iter_init (&iter, self->overlays);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          if (!g_str_equal (key, relative_path))
+            g_hash_table_insert (ret->overlays, g_strdup (key), g_bytes_ref (value));
+        }
+    }
+
+  g_hash_table_insert (ret->overlays,
+                       g_strdup (relative_path),
+                       g_bytes_new_take (copy, length + 1));
+
+  ret->index = g_array_sized_new (FALSE, FALSE, sizeof (IdeCtagsIndexEntry),
+                                  ide_ctags_index_get_size (self) + added->len);
+
+  /*
+   * Both arrays are sorted, so merge them while dropping the previous
+   * entries for @relative_path.
+   */
+  if (self->index != NULL)
+    {
+      while (i < self->index->len)
+        {
+          const IdeCtagsIndexEntry *entry = &g_array_index (self->index, IdeCtagsIndexEntry, i);
+
+          if (g_str_equal (entry->path, relative_path))
+            {
+              i++;
+              continue;
+            }
+
+          if (j < added->len &&
+              ide_ctags_index_entry_compare (&g_array_index (added, IdeCtagsIndexEntry, j), entry) < 0)
+            {
+              g_array_append_val (ret->index, g_array_index (added, IdeCtagsIndexEntry, j));
+              j++;
+              continue;
+            }
+
+          g_array_append_val (ret->index, *entry);
+          i++;
+        }
+    }
+
+  if (j < added->len)
+    g_array_append_vals (ret->index,
+                         &g_array_index (added, IdeCtagsIndexEntry, j),
+                         added->len - j);
+
+  DZL_COUNTER_ADD (index_entries, (gint64)ret->index->len);
+
+  return ret;
+}
@@ -66,6 +66,18 @@ void                      ide_ctags_index_load_async    (IdeCtagsIndex
 gboolean                  ide_ctags_index_load_finish   (IdeCtagsIndex            *index,
                                                          GAsyncResult             *result,
                                                          GError                  **error);
+IdeCtagsIndex            *ide_ctags_index_splice        (IdeCtagsIndex            *self,
+                                                         const gchar              *relative_path,
+                                                         GBytes                   *contents);
+gboolean                  ide_ctags_index_write_sidecar (GFile                    *file,
+                                                         GCancellable             *cancellable,
+                                                         GError                  **error);
+gboolean                  ide_ctags_index_splice_file   (GFile                    *file,
+                                                         const gchar              *relative_path,
+                                                         GBytes                   *contents,
+                                                         guint64                  *mtime,
+                                                         GCancellable             *cancellable,
+                                                         GError                  **error);
 GPtrArray                *ide_ctags_index_find_with_path(IdeCtagsIndex           *self,
                                                          const gchar             *relative_path);
 gchar                    *ide_ctags_index_resolve_path  (IdeCtagsIndex            *self,
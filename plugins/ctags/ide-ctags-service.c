@@ -38,9 +38,13 @@ struct _IdeCtagsService
   GPtrArray        *completions;
   GHashTable       *build_timeout_by_dir;
 
+  /* SpliceInfo of published splices, to be written to the tags files */
+  GQueue            persist_queue;
+
   guint             queued_miner_handler;
   guint             miner_active : 1;
   guint             needs_recursive_mine : 1;
+  guint             persisting : 1;
 };
 
 typedef struct
@@ -49,6 +53,18 @@ typedef struct
   guint  recursive;
 } MineInfo;
 
+typedef struct
+{
+  IdeCtagsService *self;
+  GFile           *directory;
+  GFile           *tags_file;
+  IdeCtagsIndex   *base;
+  gchar           *relative_path;
+  GBytes          *contents;
+  IdeCtagsIndex   *index;
+  guint64          mtime;
+} SpliceInfo;
+
 static void service_iface_init (IdeServiceInterface *iface);
 
 G_DEFINE_DYNAMIC_TYPE_EXTENDED (IdeCtagsService, ide_ctags_service, IDE_TYPE_OBJECT, 0,
@@ -168,6 +184,26 @@ ide_ctags_service_build_index_cb (DzlTaskCache  *cache,
   IDE_EXIT;
 }
 
+static void
+ide_ctags_service_publish_index (IdeCtagsService *self,
+                                 IdeCtagsIndex   *index)
+{
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+  g_assert (IDE_IS_CTAGS_INDEX (index));
+
+  for (guint i = 0; i < self->highlighters->len; i++)
+    {
+      IdeCtagsHighlighter *highlighter = g_ptr_array_index (self->highlighters, i);
+      ide_ctags_highlighter_add_index (highlighter, index);
+    }
+
+  for (guint i = 0; i < self->completions->len; i++)
+    {
+      IdeCtagsCompletionProvider *provider = g_ptr_array_index (self->completions, i);
+      ide_ctags_completion_provider_add_index (provider, index);
+    }
+}
+
 static void
 ide_ctags_service_tags_loaded_cb (GObject      *object,
                                   GAsyncResult *result,
@@ -177,7 +213,6 @@ ide_ctags_service_tags_loaded_cb (GObject      *object,
   g_autoptr(IdeCtagsService) self = user_data;
   g_autoptr(IdeCtagsIndex) index = NULL;
   GError *error = NULL;
-  gsize i;
 
   IDE_ENTRY;
 
@@ -197,17 +232,7 @@ ide_ctags_service_tags_loaded_cb (GObject      *object,
 
   g_assert (IDE_IS_CTAGS_INDEX (index));
 
-  for (i = 0; i < self->highlighters->len; i++)
-    {
-      IdeCtagsHighlighter *highlighter = g_ptr_array_index (self->highlighters, i);
-      ide_ctags_highlighter_add_index (highlighter, index);
-    }
-
-  for (i = 0; i < self->completions->len; i++)
-    {
-      IdeCtagsCompletionProvider *provider = g_ptr_array_index (self->completions, i);
-      ide_ctags_completion_provider_add_index (provider, index);
-    }
+  ide_ctags_service_publish_index (self, index);
 
   IDE_EXIT;
 }
@@ -276,14 +301,42 @@ ide_ctags_service_load_tags (IdeCtagsService *self,
   g_timeout_add (0, do_load, pair);
 }
 
+static void
+ide_ctags_service_mine_crawl_cb (GFile       *directory,
+                                 const gchar *relative_path,
+                                 GFileInfo   *directory_info,
+                                 GPtrArray   *children,
+                                 gpointer     user_data)
+{
+  IdeCtagsService *self = user_data;
+
+  g_assert (G_IS_FILE (directory));
+  g_assert (children != NULL);
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+
+  /* Symlinks are not followed, so they are never reported as regular files */
+  for (guint i = 0; i < children->len; i++)
+    {
+      GFileInfo *info = g_ptr_array_index (children, i);
+      const gchar *name = g_file_info_get_name (info);
+
+      if (g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+          (g_strcmp0 (name, "tags") == 0 || g_strcmp0 (name, ".tags") == 0))
+        {
+          g_autoptr(GFile) child = g_file_get_child (directory, name);
+
+          ide_ctags_service_load_tags (self, child);
+        }
+    }
+}
+
 static void
 ide_ctags_service_mine_directory (IdeCtagsService *self,
                                   GFile           *directory,
                                   gboolean         recurse,
                                   GCancellable    *cancellable)
 {
-  GFileEnumerator *enumerator = NULL;
-  gpointer infoptr;
+  g_autoptr(IdeDirectoryCrawler) crawler = NULL;
   GFile *child;
 
   g_assert (IDE_IS_CTAGS_SERVICE (self));
@@ -293,6 +346,17 @@ ide_ctags_service_mine_directory (IdeCtagsService *self,
   if (g_cancellable_is_cancelled (cancellable))
     return;
 
+  if (recurse)
+    {
+      crawler = ide_directory_crawler_new (directory);
+      ide_directory_crawler_run (crawler,
+                                 cancellable,
+                                 ide_ctags_service_mine_crawl_cb,
+                                 self,
+                                 NULL);
+      return;
+    }
+
   child = g_file_get_child (directory, "tags");
   if (g_file_query_file_type (child, 0, cancellable) == G_FILE_TYPE_REGULAR)
     ide_ctags_service_load_tags (self, child);
@@ -302,42 +366,6 @@ ide_ctags_service_mine_directory (IdeCtagsService *self,
   if (g_file_query_file_type (child, 0, cancellable) == G_FILE_TYPE_REGULAR)
     ide_ctags_service_load_tags (self, child);
   g_clear_object (&child);
-
-  if (!recurse)
-    return;
-
-  enumerator = g_file_enumerate_children (directory,
-                                          G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK","
-                                          G_FILE_ATTRIBUTE_STANDARD_NAME","
-                                          G_FILE_ATTRIBUTE_STANDARD_TYPE,
-                                          G_FILE_QUERY_INFO_NONE,
-                                          cancellable,
-                                          NULL);
-
-  if (!enumerator)
-    return;
-
-  while ((infoptr = g_file_enumerator_next_file (enumerator, cancellable, NULL)))
-    {
-      g_autoptr(GFileInfo) file_info = infoptr;
-      GFileType type = g_file_info_get_file_type (file_info);
-
-      if (g_file_info_get_is_symlink (file_info))
-        continue;
-
-      if (type == G_FILE_TYPE_DIRECTORY)
-        {
-          const gchar *name = g_file_info_get_name (file_info);
-
-          child = g_file_get_child (directory, name);
-          ide_ctags_service_mine_directory (self, child, recurse, cancellable);
-          g_clear_object (&child);
-        }
-    }
-
-  g_file_enumerator_close (enumerator, cancellable, NULL);
-
-  g_object_unref (enumerator);
 }
 
 static void
@@ -518,12 +546,354 @@ ide_ctags_service_queue_build_for_directory (IdeCtagsService *self,
     }
 }
 
+static void
+splice_info_free (gpointer data)
+{
+  SpliceInfo *info = data;
+
+  g_clear_object (&info->self);
+  g_clear_object (&info->directory);
+  g_clear_object (&info->tags_file);
+  g_clear_object (&info->base);
+  g_clear_object (&info->index);
+  g_clear_pointer (&info->relative_path, g_free);
+  g_clear_pointer (&info->contents, g_bytes_unref);
+
+  g_slice_free (SpliceInfo, info);
+}
+
+/*
+ * Copies what is needed to splice @info again, or to persist it. The
+ * service is only needed until the file was tagged, so it is left out
+ * rather than kept alive by queued splices.
+ */
+static SpliceInfo *
+splice_info_copy (const SpliceInfo *info)
+{
+  SpliceInfo *copy = g_slice_new0 (SpliceInfo);
+
+  copy->directory = g_object_ref (info->directory);
+  copy->tags_file = g_object_ref (info->tags_file);
+  copy->relative_path = g_strdup (info->relative_path);
+  copy->contents = g_bytes_ref (info->contents);
+
+  return copy;
+}
+
+static void
+ide_ctags_service_splice_worker (GTask        *task,
+                                 gpointer      source_object,
+                                 gpointer      task_data,
+                                 GCancellable *cancellable)
+{
+  SpliceInfo *info = task_data;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_CTAGS_SERVICE (source_object));
+  g_assert (info != NULL);
+  g_assert (IDE_IS_CTAGS_INDEX (info->base));
+
+  g_task_return_pointer (task,
+                         ide_ctags_index_splice (info->base, info->relative_path, info->contents),
+                         g_object_unref);
+}
+
+static void
+ide_ctags_service_persist_worker (GTask        *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+  SpliceInfo *info = task_data;
+  GError *error = NULL;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_CTAGS_SERVICE (source_object));
+  g_assert (info != NULL);
+
+  if (!ide_ctags_index_splice_file (info->tags_file,
+                                    info->relative_path,
+                                    info->contents,
+                                    &info->mtime,
+                                    cancellable,
+                                    &error))
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+static void ide_ctags_service_persist_next (IdeCtagsService *self);
+
+static void
+ide_ctags_service_persist_cb (GObject      *object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  IdeCtagsService *self = (IdeCtagsService *)object;
+  g_autoptr(GError) error = NULL;
+  SpliceInfo *info;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+  g_assert (G_IS_TASK (result));
+
+  info = g_task_get_task_data (G_TASK (result));
+  self->persisting = FALSE;
+
+  if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        IDE_EXIT;
+
+      /* Regenerate the tags file since we failed to keep it in sync */
+      g_debug ("Failed to splice tags file: %s", error->message);
+      ide_ctags_service_queue_build_for_directory (self, info->directory);
+    }
+  else if (dzl_task_cache_peek (self->indexes, info->tags_file) == info->index)
+    {
+      /* The index matches the rewritten file, take its mtime to avoid reloading it */
+      g_object_set (info->index, "mtime", info->mtime, NULL);
+    }
+
+  ide_ctags_service_persist_next (self);
+
+  IDE_EXIT;
+}
+
+/*
+ * Writes the oldest published splice to its tags file, otherwise the next
+ * load would use outdated tags until the directory is regenerated. This
+ * rewrites the whole tags file, so it is done after the spliced index was
+ * published, one splice at a time so that they are applied in order.
+ */
+static void
+ide_ctags_service_persist_next (IdeCtagsService *self)
+{
+  g_autoptr(GTask) task = NULL;
+  SpliceInfo *info;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+
+  if (self->persisting || self->cancellable == NULL)
+    return;
+
+  if (!(info = g_queue_pop_head (&self->persist_queue)))
+    return;
+
+  self->persisting = TRUE;
+
+  task = g_task_new (self, self->cancellable, ide_ctags_service_persist_cb, NULL);
+  g_task_set_source_tag (task, ide_ctags_service_persist_next);
+  g_task_set_priority (task, G_PRIORITY_LOW);
+  g_task_set_task_data (task, info, splice_info_free);
+  ide_thread_pool_push_task (IDE_THREAD_POOL_INDEXER, task, ide_ctags_service_persist_worker);
+}
+
+static void ide_ctags_service_splice (IdeCtagsService *self,
+                                      SpliceInfo      *info);
+
+static void
+ide_ctags_service_splice_cb (GObject      *object,
+                             GAsyncResult *result,
+                             gpointer      user_data)
+{
+  IdeCtagsService *self = (IdeCtagsService *)object;
+  g_autoptr(IdeCtagsIndex) index = NULL;
+  g_autoptr(GError) error = NULL;
+  IdeCtagsIndex *current;
+  SpliceInfo *persist;
+  SpliceInfo *info;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+  g_assert (G_IS_TASK (result));
+
+  info = g_task_get_task_data (G_TASK (result));
+
+  if (!(index = g_task_propagate_pointer (G_TASK (result), &error)))
+    {
+      g_debug ("%s", error->message);
+      IDE_EXIT;
+    }
+
+  current = dzl_task_cache_peek (self->indexes, info->tags_file);
+
+  /*
+   * If another generation was published (or the index was reloaded) while
+   * we were merging, our result is based on stale data. Splice again using
+   * the same ctags output on top of whatever is current.
+   */
+  if (current != info->base)
+    {
+      SpliceInfo *retry;
+
+      if (current == NULL)
+        IDE_EXIT;
+
+      retry = splice_info_copy (info);
+      ide_ctags_service_splice (self, retry);
+
+      IDE_EXIT;
+    }
+
+  dzl_task_cache_insert (self->indexes, info->tags_file, index);
+  ide_ctags_service_publish_index (self, index);
+
+  /* Now that the new tags are visible, update the tags file in the background */
+  persist = splice_info_copy (info);
+  persist->index = g_steal_pointer (&index);
+  g_queue_push_tail (&self->persist_queue, persist);
+  ide_ctags_service_persist_next (self);
+
+  IDE_EXIT;
+}
+
+static void
+ide_ctags_service_splice (IdeCtagsService *self,
+                          SpliceInfo      *info)
+{
+  g_autoptr(GTask) task = NULL;
+  IdeCtagsIndex *base;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+  g_assert (info != NULL);
+  g_assert (info->contents != NULL);
+
+  if (!(base = dzl_task_cache_peek (self->indexes, info->tags_file)))
+    {
+      /* The index went away, so just regenerate the whole directory */
+      ide_ctags_service_queue_build_for_directory (self, info->directory);
+      splice_info_free (info);
+      return;
+    }
+
+  info->base = g_object_ref (base);
+
+  task = g_task_new (self, self->cancellable, ide_ctags_service_splice_cb, NULL);
+  g_task_set_source_tag (task, ide_ctags_service_splice);
+  g_task_set_task_data (task, info, splice_info_free);
+  ide_thread_pool_push_task (IDE_THREAD_POOL_INDEXER, task, ide_ctags_service_splice_worker);
+}
+
+static void
+ide_ctags_service_tag_file_cb (GObject      *object,
+                               GAsyncResult *result,
+                               gpointer      user_data)
+{
+  IdeCtagsBuilder *builder = (IdeCtagsBuilder *)object;
+  g_autoptr(GError) error = NULL;
+  SpliceInfo *info = user_data;
+  IdeCtagsService *self;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CTAGS_BUILDER (builder));
+  g_assert (info != NULL);
+  g_assert (IDE_IS_CTAGS_SERVICE (info->self));
+
+  self = info->self;
+
+  if (!(info->contents = ide_ctags_builder_tag_file_finish (builder, result, &error)))
+    {
+      g_debug ("Failed to re-tag file, regenerating directory: %s", error->message);
+      ide_ctags_service_queue_build_for_directory (self, info->directory);
+      splice_info_free (info);
+      IDE_EXIT;
+    }
+
+  ide_ctags_service_splice (self, info);
+
+  IDE_EXIT;
+}
+
+static GFile *
+get_tags_file_for_directory (IdeCtagsService *self,
+                             GFile           *directory)
+{
+  g_autofree gchar *relative_path = NULL;
+  g_autofree gchar *path = NULL;
+  IdeContext *context;
+  IdeProject *project;
+  GFile *workdir;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+  g_assert (G_IS_FILE (directory));
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  project = ide_context_get_project (context);
+  workdir = ide_vcs_get_working_directory (ide_context_get_vcs (context));
+
+  /* This must match the layout used by IdeCtagsBuilder */
+  if (!g_file_equal (workdir, directory) &&
+      !(relative_path = g_file_get_relative_path (workdir, directory)))
+    return NULL;
+
+  path = g_build_filename (g_get_user_cache_dir (),
+                           ide_get_program_name (),
+                           "tags",
+                           ide_project_get_id (project),
+                           relative_path ? relative_path : "",
+                           "tags",
+                           NULL);
+
+  return g_file_new_for_path (path);
+}
+
+static gboolean
+ide_ctags_service_reindex_file (IdeCtagsService *self,
+                                GFile           *file,
+                                GFile           *directory)
+{
+  g_autoptr(IdeTagsBuilder) builder = NULL;
+  g_autoptr(GFile) tags_file = NULL;
+  IdeContext *context;
+  SpliceInfo *info;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+  g_assert (G_IS_FILE (file));
+  g_assert (G_IS_FILE (directory));
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+
+  /*
+   * We can only splice into indexes we generated ourselves, since we need
+   * to know the tags file layout. A directory rebuild is also already
+   * queued for new directories and those with a pending rebuild.
+   */
+  if (IDE_IS_TAGS_BUILDER (ide_context_get_build_system (context)) ||
+      g_hash_table_contains (self->build_timeout_by_dir, directory) ||
+      !(tags_file = get_tags_file_for_directory (self, directory)) ||
+      dzl_task_cache_peek (self->indexes, tags_file) == NULL)
+    IDE_RETURN (FALSE);
+
+  info = g_slice_new0 (SpliceInfo);
+  info->self = g_object_ref (self);
+  info->directory = g_object_ref (directory);
+  info->tags_file = g_steal_pointer (&tags_file);
+  info->relative_path = g_file_get_basename (file);
+
+  builder = ide_ctags_builder_new (context);
+
+  ide_ctags_builder_tag_file_async (IDE_CTAGS_BUILDER (builder),
+                                    file,
+                                    self->cancellable,
+                                    ide_ctags_service_tag_file_cb,
+                                    info);
+
+  IDE_RETURN (TRUE);
+}
+
 static void
 ide_ctags_service_buffer_saved (IdeCtagsService  *self,
                                 IdeBuffer        *buffer,
                                 IdeBufferManager *buffer_manager)
 {
   g_autoptr(GFile) parent = NULL;
+  GFile *file;
 
   IDE_ENTRY;
 
@@ -531,8 +901,16 @@ ide_ctags_service_buffer_saved (IdeCtagsService  *self,
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (IDE_IS_BUFFER_MANAGER (buffer_manager));
 
-  parent = g_file_get_parent (ide_file_get_file (ide_buffer_get_file (buffer)));
-  ide_ctags_service_queue_build_for_directory (self, parent);
+  file = ide_file_get_file (ide_buffer_get_file (buffer));
+  parent = g_file_get_parent (file);
+
+  /*
+   * Try to re-tag just the saved file and splice the result into the
+   * loaded index for its directory. If that is not possible, fallback to
+   * regenerating the tags for the whole directory.
+   */
+  if (!ide_ctags_service_reindex_file (self, file, parent))
+    ide_ctags_service_queue_build_for_directory (self, parent);
 
   IDE_EXIT;
 }
@@ -585,6 +963,9 @@ ide_ctags_service_stop (IdeService *service)
     g_cancellable_cancel (self->cancellable);
 
   g_clear_object (&self->cancellable);
+
+  g_queue_foreach (&self->persist_queue, (GFunc)splice_info_free, NULL);
+  g_queue_clear (&self->persist_queue);
 }
 
 static void
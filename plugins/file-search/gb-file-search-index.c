@@ -19,6 +19,7 @@
 #define G_LOG_DOMAIN "gb-file-search-index"
 
 #include <glib/gi18n.h>
+#include <errno.h>
 #include <ide.h>
 #include <string.h>
 
@@ -131,84 +132,308 @@ gb_file_search_index_init (GbFileSearchIndex *self)
 {
 }
 
+/*
+ * The index is cached as a list of directories, each with the modification
+ * time of the directory and the names of the files and (non-ignored)
+ * subdirectories it contained. Adding, removing or renaming an entry
+ * updates the modification time of the containing directory, so on the
+ * next build we only need to stat() each directory and can reuse the
+ * cached listing for any that are unchanged.
+ */
+#define CACHE_VERSION      1
+#define CACHE_VARIANT_TYPE "(usa(stasas))"
+#define ENTRY_VARIANT_TYPE "(stasas)"
+
+typedef struct
+{
+  GFile *root_directory;
+  gchar *cache_path;
+} BuildData;
+
+typedef struct
+{
+  DzlFuzzyMutableIndex *fuzzy;
+  GHashTable           *cached;
+  GVariantBuilder      *builder;
+  guint                 n_reused;
+  guint                 n_enumerated;
+} Populate;
+
 static void
-populate_from_dir (DzlFuzzyMutableIndex *fuzzy,
-                   IdeVcs               *vcs,
-                   const gchar          *relpath,
-                   GFile                *directory,
-                   GCancellable         *cancellable)
+build_data_free (gpointer data)
 {
-  GFileEnumerator *enumerator;
-  GPtrArray *children = NULL;
-  gpointer file_info_ptr;
+  BuildData *bd = data;
 
-  g_assert (fuzzy != NULL);
-  g_assert (G_IS_FILE (directory));
-  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+  g_clear_object (&bd->root_directory);
+  g_clear_pointer (&bd->cache_path, g_free);
+  g_slice_free (BuildData, bd);
+}
+
+static BuildData *
+build_data_new (GbFileSearchIndex *self)
+{
+  g_autofree gchar *branch = NULL;
+  IdeContext *context;
+  IdeProject *project;
+  IdeVcs *vcs;
+  BuildData *bd;
 
-  if (ide_vcs_is_ignored (vcs, directory, NULL))
-    return;
+  g_assert (GB_IS_FILE_SEARCH_INDEX (self));
 
-  enumerator = g_file_enumerate_children (directory,
-                                          G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME","
-                                          G_FILE_ATTRIBUTE_STANDARD_TYPE,
-                                          G_FILE_QUERY_INFO_NONE,
-                                          cancellable,
-                                          NULL);
+  context = ide_object_get_context (IDE_OBJECT (self));
+  project = ide_context_get_project (context);
+  vcs = ide_context_get_vcs (context);
+
+  /* Each branch gets its own cache so switching back and forth is cheap */
+  if (NULL == (branch = ide_vcs_get_branch_name (vcs)))
+    branch = g_strdup ("default");
+  g_strdelimit (branch, G_DIR_SEPARATOR_S, '_');
+
+  bd = g_slice_new0 (BuildData);
+  bd->root_directory = g_object_ref (self->root_directory);
+  bd->cache_path = g_build_filename (g_get_user_cache_dir (),
+                                     "gnome-builder",
+                                     "file-search",
+                                     ide_project_get_id (project),
+                                     branch,
+                                     NULL);
+
+  return bd;
+}
+
+/*
+ * Maps the cache at @cache_path and returns the array of directory
+ * entries, or %NULL if the cache is missing or unusable.
+ */
+static GVariant *
+load_cache (const gchar *cache_path,
+            GFile       *root_directory)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autofree gchar *root_path = NULL;
+  const gchar *cached_root = NULL;
+  GVariant *entries = NULL;
+  guint32 version = 0;
+
+  g_assert (cache_path != NULL);
+  g_assert (G_IS_FILE (root_directory));
+
+  if (NULL == (mapped = g_mapped_file_new (cache_path, FALSE, NULL)))
+    return NULL;
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  variant = g_variant_take_ref (g_variant_new_from_bytes (G_VARIANT_TYPE (CACHE_VARIANT_TYPE), bytes, FALSE));
+
+  root_path = g_file_get_path (root_directory);
+  g_variant_get (variant, "(u&s@a" ENTRY_VARIANT_TYPE ")", &version, &cached_root, &entries);
+
+  if (version != CACHE_VERSION || g_strcmp0 (root_path, cached_root) != 0)
+    g_clear_pointer (&entries, g_variant_unref);
+
+  return entries;
+}
+
+static void
+save_cache (const gchar *cache_path,
+            GFile       *root_directory,
+            GVariant    *entries)
+{
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *root_path = NULL;
+  g_autofree gchar *dir = NULL;
+
+  g_assert (cache_path != NULL);
+  g_assert (G_IS_FILE (root_directory));
+  g_assert (entries != NULL);
+
+  root_path = g_file_get_path (root_directory);
+  variant = g_variant_take_ref (g_variant_new ("(us@a" ENTRY_VARIANT_TYPE ")",
+                                               CACHE_VERSION,
+                                               root_path,
+                                               entries));
+
+  dir = g_path_get_dirname (cache_path);
+
+  if (g_mkdir_with_parents (dir, 0750) != 0 ||
+      !g_file_set_contents (cache_path,
+                            g_variant_get_data (variant),
+                            g_variant_get_size (variant),
+                            &error))
+    g_warning ("Failed to save file search index: %s",
+               error ? error->message : g_strerror (errno));
+}
+
+static void
+insert_entry (DzlFuzzyMutableIndex *fuzzy,
+              GVariant             *entry)
+{
+  g_autofree const gchar **files = NULL;
+  g_autoptr(GVariant) files_variant = NULL;
+  const gchar *relpath = NULL;
+
+  g_assert (fuzzy != NULL);
+  g_assert (entry != NULL);
 
-  if (enumerator == NULL)
-    return;
+  g_variant_get_child (entry, 0, "&s", &relpath);
+  files_variant = g_variant_get_child_value (entry, 2);
+  files = g_variant_get_strv (files_variant, NULL);
 
-  while ((file_info_ptr = g_file_enumerator_next_file (enumerator, cancellable, NULL)))
+  for (guint i = 0; files[i] != NULL; i++)
     {
-      g_autoptr(GFileInfo) file_info = file_info_ptr;
       g_autofree gchar *path = NULL;
-      g_autoptr(GFile) file = NULL;
-      const gchar *name;
 
-      name = g_file_info_get_display_name (file_info);
-      file = g_file_get_child (directory, name);
+      if (*relpath != '\0')
+        path = g_build_filename (relpath, files[i], NULL);
 
-      if (g_file_info_get_file_type (file_info) == G_FILE_TYPE_DIRECTORY)
-        {
-          if (children == NULL)
-            children = g_ptr_array_new_with_free_func (g_object_unref);
-          g_ptr_array_add (children, g_object_ref (file));
-          continue;
-        }
+      dzl_fuzzy_mutable_index_insert (fuzzy, path ? path : files[i], NULL);
+    }
+}
+
+static guint64
+get_mtime (GFileInfo *info)
+{
+  return g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+         g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
 
-      if (ide_vcs_is_ignored (vcs, file, NULL))
-        continue;
+static GVariant *
+lookup_cached (GHashTable  *cached,
+               const gchar *relpath,
+               GFileInfo   *info)
+{
+  GVariant *entry;
+  guint64 mtime = 0;
 
-      if (relpath != NULL)
-        name = path = g_build_filename (relpath, name, NULL);
+  g_assert (relpath != NULL);
 
-      dzl_fuzzy_mutable_index_insert (fuzzy, name, NULL);
-    }
+  if (cached == NULL || info == NULL)
+    return NULL;
+
+  if (NULL == (entry = g_hash_table_lookup (cached, relpath)))
+    return NULL;
+
+  g_variant_get_child (entry, 1, "t", &mtime);
+
+  return mtime == get_mtime (info) ? entry : NULL;
+}
+
+/* Called from the crawler workers to skip unchanged directories */
+static gchar **
+reuse_cached_dir (GFile       *directory,
+                  const gchar *relpath,
+                  GFileInfo   *directory_info,
+                  gpointer     user_data)
+{
+  g_autoptr(GVariant) dirs = NULL;
+  GHashTable *cached = user_data;
+  GVariant *entry;
+
+  if (NULL == (entry = lookup_cached (cached, relpath, directory_info)))
+    return NULL;
+
+  dirs = g_variant_get_child_value (entry, 3);
+
+  return g_variant_dup_strv (dirs, NULL);
+}
 
-  g_clear_object (&enumerator);
+static void
+populate_from_dir (GFile       *directory,
+                   const gchar *relpath,
+                   GFileInfo   *directory_info,
+                   GPtrArray   *children,
+                   gpointer     user_data)
+{
+  Populate *state = user_data;
+  g_autoptr(GVariant) entry = NULL;
 
-  if (children != NULL)
+  g_assert (G_IS_FILE (directory));
+  g_assert (relpath != NULL);
+  g_assert (state != NULL);
+
+  if (children == NULL)
+    {
+      entry = g_variant_ref (lookup_cached (state->cached, relpath, directory_info));
+      state->n_reused++;
+    }
+  else
     {
-      gsize i;
+      g_autoptr(GPtrArray) files = g_ptr_array_new ();
+      g_autoptr(GPtrArray) dirs = g_ptr_array_new ();
 
-      for (i = 0; i < children->len; i++)
+      for (guint i = 0; i < children->len; i++)
         {
-          g_autofree gchar *path = NULL;
-          g_autofree gchar *name = NULL;
-          GFile *child;
+          GFileInfo *info = g_ptr_array_index (children, i);
+          const gchar *name = g_file_info_get_name (info);
 
-          child = g_ptr_array_index (children, i);
-          name = g_file_get_basename (child);
+          if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+            g_ptr_array_add (dirs, (gchar *)name);
+          else
+            g_ptr_array_add (files, (gchar *)name);
+        }
 
-          if (relpath != NULL)
-            path = g_build_filename (relpath, name, NULL);
+      g_ptr_array_add (files, NULL);
+      g_ptr_array_add (dirs, NULL);
 
-          populate_from_dir (fuzzy, vcs, path ? path : name, child, cancellable);
-        }
+      entry = g_variant_take_ref (g_variant_new ("(st^as^as)",
+                                                 relpath,
+                                                 directory_info ? get_mtime (directory_info) : 0,
+                                                 (gchar **)files->pdata,
+                                                 (gchar **)dirs->pdata));
+      state->n_enumerated++;
     }
 
-  g_clear_pointer (&children, g_ptr_array_unref);
+  insert_entry (state->fuzzy, entry);
+  g_variant_builder_add_value (state->builder, entry);
+}
+
+static void
+gb_file_search_index_loader (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
+{
+  GbFileSearchIndex *self = source_object;
+  g_autoptr(GVariant) entries = NULL;
+  g_autoptr(GTimer) timer = NULL;
+  BuildData *bd = task_data;
+  DzlFuzzyMutableIndex *fuzzy;
+  GVariantIter iter;
+  GVariant *entry;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (GB_IS_FILE_SEARCH_INDEX (self));
+  g_assert (bd != NULL);
+
+  timer = g_timer_new ();
+
+  if (NULL == (entries = load_cache (bd->cache_path, bd->root_directory)))
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_NOT_FOUND,
+                               "No usable file index cache was found");
+      return;
+    }
+
+  fuzzy = dzl_fuzzy_mutable_index_new (FALSE);
+  dzl_fuzzy_mutable_index_begin_bulk_insert (fuzzy);
+  g_variant_iter_init (&iter, entries);
+  while ((entry = g_variant_iter_next_value (&iter)))
+    {
+      insert_entry (fuzzy, entry);
+      g_variant_unref (entry);
+    }
+  dzl_fuzzy_mutable_index_end_bulk_insert (fuzzy);
+
+  self->fuzzy = fuzzy;
+
+  g_debug ("File index loaded from cache in %lf seconds.",
+           g_timer_elapsed (timer, NULL));
+
+  g_task_return_boolean (task, TRUE);
 }
 
 static void
@@ -218,38 +443,138 @@ gb_file_search_index_builder (GTask        *task,
                               GCancellable *cancellable)
 {
   GbFileSearchIndex *self = source_object;
+  g_autoptr(IdeDirectoryCrawler) crawler = NULL;
+  g_autoptr(GVariant) entries = NULL;
+  g_autoptr(GHashTable) cached = NULL;
   g_autoptr(GTimer) timer = NULL;
-  GFile *directory = task_data;
+  g_autoptr(GError) error = NULL;
+  BuildData *bd = task_data;
+  GVariantBuilder builder;
   IdeContext *context;
-  IdeVcs *vcs;
-  DzlFuzzyMutableIndex *fuzzy;
+  Populate state = { 0 };
   gdouble elapsed;
 
   g_assert (G_IS_TASK (task));
   g_assert (GB_IS_FILE_SEARCH_INDEX (self));
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
-  g_assert (G_IS_FILE (directory));
+  g_assert (bd != NULL);
 
   context = ide_object_get_context (IDE_OBJECT (self));
-  vcs = ide_context_get_vcs (context);
 
   timer = g_timer_new ();
 
-  fuzzy = dzl_fuzzy_mutable_index_new (FALSE);
-  dzl_fuzzy_mutable_index_begin_bulk_insert (fuzzy);
-  populate_from_dir (fuzzy, vcs, NULL, directory, cancellable);
-  dzl_fuzzy_mutable_index_end_bulk_insert (fuzzy);
+  crawler = ide_directory_crawler_new (bd->root_directory);
+  ide_directory_crawler_set_vcs (crawler, ide_context_get_vcs (context));
+  ide_directory_crawler_set_attributes (crawler,
+                                        G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                                        G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
 
-  self->fuzzy = fuzzy;
+  /* The cache entries reference the mapped file, so they are not copied */
+  if (NULL != (entries = load_cache (bd->cache_path, bd->root_directory)))
+    {
+      GVariantIter iter;
+      GVariant *entry;
+
+      cached = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)g_variant_unref);
+
+      g_variant_iter_init (&iter, entries);
+      while ((entry = g_variant_iter_next_value (&iter)))
+        {
+          const gchar *relpath = NULL;
+
+          g_variant_get_child (entry, 0, "&s", &relpath);
+          g_hash_table_insert (cached, (gchar *)relpath, entry);
+        }
+
+      ide_directory_crawler_set_reuse_func (crawler,
+                                            reuse_cached_dir,
+                                            g_hash_table_ref (cached),
+                                            (GDestroyNotify)g_hash_table_unref);
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a" ENTRY_VARIANT_TYPE));
+
+  state.fuzzy = dzl_fuzzy_mutable_index_new (FALSE);
+  state.cached = cached;
+  state.builder = &builder;
+
+  dzl_fuzzy_mutable_index_begin_bulk_insert (state.fuzzy);
+
+  if (!ide_directory_crawler_run (crawler, cancellable, populate_from_dir, &state, &error))
+    {
+      g_variant_builder_clear (&builder);
+      dzl_fuzzy_mutable_index_unref (state.fuzzy);
+      g_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+
+  dzl_fuzzy_mutable_index_end_bulk_insert (state.fuzzy);
+
+  save_cache (bd->cache_path, bd->root_directory, g_variant_builder_end (&builder));
+
+  self->fuzzy = state.fuzzy;
 
   g_timer_stop (timer);
   elapsed = g_timer_elapsed (timer, NULL);
 
-  g_message ("File index built in %lf seconds.", elapsed);
+  g_message ("File index built in %lf seconds (%u directories enumerated, %u reused).",
+             elapsed, state.n_enumerated, state.n_reused);
 
   g_task_return_boolean (task, TRUE);
 }
 
+/**
+ * gb_file_search_index_load_async:
+ *
+ * Loads the index from the cache of a previous build, without touching
+ * the working directory. This fails if no cache is available, in which
+ * case gb_file_search_index_build_async() should be used.
+ */
+void
+gb_file_search_index_load_async (GbFileSearchIndex   *self,
+                                 GCancellable        *cancellable,
+                                 GAsyncReadyCallback  callback,
+                                 gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+
+  g_return_if_fail (GB_IS_FILE_SEARCH_INDEX (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, gb_file_search_index_load_async);
+  g_task_set_priority (task, G_PRIORITY_LOW);
+
+  if (self->root_directory == NULL)
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_INVALID_FILENAME,
+                               "Root directory has not been set.");
+      return;
+    }
+
+  g_task_set_task_data (task, build_data_new (self), build_data_free);
+  g_task_run_in_thread (task, gb_file_search_index_loader);
+}
+
+gboolean
+gb_file_search_index_load_finish (GbFileSearchIndex  *self,
+                                  GAsyncResult       *result,
+                                  GError            **error)
+{
+  g_return_val_if_fail (GB_IS_FILE_SEARCH_INDEX (self), FALSE);
+  g_return_val_if_fail (G_IS_TASK (result), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * gb_file_search_index_build_async:
+ *
+ * Builds the index by walking the working directory, reusing the cached
+ * listing of any directory that has not changed, and updates the cache.
+ */
 void
 gb_file_search_index_build_async (GbFileSearchIndex   *self,
                                   GCancellable        *cancellable,
@@ -274,7 +599,7 @@ gb_file_search_index_build_async (GbFileSearchIndex   *self,
       return;
     }
 
-  g_task_set_task_data (task, g_object_ref (self->root_directory), g_object_unref);
+  g_task_set_task_data (task, build_data_new (self), build_data_free);
   g_task_run_in_thread (task, gb_file_search_index_builder);
 }
 
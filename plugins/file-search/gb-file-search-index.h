@@ -30,6 +30,13 @@ G_DECLARE_FINAL_TYPE (GbFileSearchIndex, gb_file_search_index, GB, FILE_SEARCH_I
 GPtrArray *gb_file_search_index_populate     (GbFileSearchIndex    *self,
                                               const gchar          *query,
                                               gsize                 max_results);
+void       gb_file_search_index_load_async   (GbFileSearchIndex    *self,
+                                              GCancellable         *cancellable,
+                                              GAsyncReadyCallback   callback,
+                                              gpointer              user_data);
+gboolean   gb_file_search_index_load_finish  (GbFileSearchIndex    *self,
+                                              GAsyncResult         *result,
+                                              GError              **error);
 void       gb_file_search_index_build_async  (GbFileSearchIndex    *self,
                                               GCancellable         *cancellable,
                                               GAsyncReadyCallback   callback,
@@ -220,19 +220,19 @@ gb_file_search_provider_activate (IdeSearchProvider *provider,
 #endif
 
 static void
-gb_file_search_provider_vcs_changed_cb (GbFileSearchProvider *self,
-                                        IdeVcs               *vcs)
+gb_file_search_provider_rebuild (GbFileSearchProvider *self)
 {
   g_autoptr(GbFileSearchIndex) index = NULL;
   IdeContext *context;
+  IdeVcs *vcs;
   GFile *workdir;
 
   IDE_ENTRY;
 
-  g_return_if_fail (GB_IS_FILE_SEARCH_PROVIDER (self));
-  g_return_if_fail (IDE_IS_VCS (vcs));
+  g_assert (GB_IS_FILE_SEARCH_PROVIDER (self));
 
   context = ide_object_get_context (IDE_OBJECT (self));
+  vcs = ide_context_get_vcs (context);
   workdir = ide_vcs_get_working_directory (vcs);
 
   index = g_object_new (GB_TYPE_FILE_SEARCH_INDEX,
@@ -248,6 +248,40 @@ gb_file_search_provider_vcs_changed_cb (GbFileSearchProvider *self,
   IDE_EXIT;
 }
 
+static void
+gb_file_search_provider_vcs_changed_cb (GbFileSearchProvider *self,
+                                        IdeVcs               *vcs)
+{
+  g_return_if_fail (GB_IS_FILE_SEARCH_PROVIDER (self));
+  g_return_if_fail (IDE_IS_VCS (vcs));
+
+  gb_file_search_provider_rebuild (self);
+}
+
+static void
+gb_file_search_provider_load_cb (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
+{
+  GbFileSearchIndex *index = (GbFileSearchIndex *)object;
+  g_autoptr(GbFileSearchProvider) self = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (GB_IS_FILE_SEARCH_INDEX (index));
+  g_assert (GB_IS_FILE_SEARCH_PROVIDER (self));
+
+  /*
+   * Use the cached index right away so that searching is available
+   * immediately, and then reconcile it with the working directory.
+   */
+  if (!gb_file_search_index_load_finish (index, result, &error))
+    g_debug ("%s", error->message);
+  else if (self->index == NULL)
+    g_set_object (&self->index, index);
+
+  gb_file_search_provider_rebuild (self);
+}
+
 static void
 gb_file_search_provider_constructed (GObject *object)
 {
@@ -296,10 +330,10 @@ gb_file_search_provider_constructed (GObject *object)
                         "root-directory", workdir,
                         NULL);
 
-  gb_file_search_index_build_async (index,
-                                    NULL,
-                                    gb_file_search_provider_build_cb,
-                                    g_object_ref (self));
+  gb_file_search_index_load_async (index,
+                                   NULL,
+                                   gb_file_search_provider_load_cb,
+                                   g_object_ref (self));
 
   G_OBJECT_CLASS (gb_file_search_provider_parent_class)->constructed (object);
 }
@@ -41,6 +41,7 @@ typedef struct
 {
   IdeFile *file;
   IdeUnsavedFile *unsaved_file;
+  gchar *input_path;
 } TranslationUnit;
 
 static void diagnostic_provider_iface_init (IdeDiagnosticProviderInterface *iface);
@@ -135,6 +136,7 @@ translation_unit_free (TranslationUnit *unit)
     {
       g_clear_object (&unit->file);
       g_clear_pointer (&unit->unsaved_file, ide_unsaved_file_unref);
+      g_clear_pointer (&unit->input_path, g_free);
       g_slice_free (TranslationUnit, unit);
     }
 }
@@ -307,7 +309,7 @@ subprocess_wait_cb (GObject      *object,
 
   stderr_input = g_subprocess_get_stderr_pipe (subprocess);
   stderr_data_input = g_data_input_stream_new (stderr_input);
-  input_prefix = g_strdup_printf ("%s:", ide_unsaved_file_get_temp_path (unit->unsaved_file));
+  input_prefix = g_strdup_printf ("%s:", unit->input_path);
 
   for (;;)
     {
@@ -393,11 +395,13 @@ populate_cache (DzlTaskCache  *cache,
 {
   IdeGettextDiagnosticProvider *self = user_data;
   g_autoptr(IdeUnsavedFile) unsaved_file = NULL;
+  g_autoptr(GSubprocessLauncher) launcher = NULL;
   g_autoptr(GSubprocess) subprocess = NULL;
+  g_autofree gchar *input_path = NULL;
   GtkSourceLanguage *language;
   const gchar *language_id;
   const gchar *xgettext_lang;
-  const gchar *temp_path;
+  gint fd;
   TranslationUnit *unit;
   IdeFile *file = (IdeFile *)key;
   GCancellable *cancellable;
@@ -430,15 +434,32 @@ populate_cache (DzlTaskCache  *cache,
       return;
     }
 
-  if (!ide_unsaved_file_persist (unsaved_file, cancellable, &error))
+  launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDIN_PIPE
+                                        | G_SUBPROCESS_FLAGS_STDOUT_PIPE
+                                        | G_SUBPROCESS_FLAGS_STDERR_PIPE);
+
+  /*
+   * Hand xgettext the shared snapshot of the buffer rather than writing
+   * the draft to disk for every change. Fallback to the draft if that is
+   * not possible.
+   */
+  if (-1 != (fd = ide_unsaved_file_dup_fd (unsaved_file, NULL)))
     {
-      g_task_return_error (task, error);
-      return;
+      g_subprocess_launcher_take_fd (launcher, fd, 3);
+      input_path = g_strdup ("/dev/fd/3");
     }
+  else
+    {
+      if (!ide_unsaved_file_persist (unsaved_file, cancellable, &error))
+        {
+          g_task_return_error (task, error);
+          return;
+        }
 
-  temp_path = ide_unsaved_file_get_temp_path (unsaved_file);
+      input_path = g_strdup (ide_unsaved_file_get_temp_path (unsaved_file));
+    }
 
-  g_assert (temp_path != NULL);
+  g_assert (input_path != NULL);
 
   args = g_ptr_array_new ();
   g_ptr_array_add (args, "xgettext");
@@ -451,7 +472,7 @@ populate_cache (DzlTaskCache  *cache,
   g_ptr_array_add (args, (gchar *)xgettext_lang);
   g_ptr_array_add (args, "-o");
   g_ptr_array_add (args, "-");
-  g_ptr_array_add (args, (gchar *)temp_path);
+  g_ptr_array_add (args, input_path);
   g_ptr_array_add (args, NULL);
 
 #ifdef IDE_ENABLE_TRACE
@@ -462,11 +483,9 @@ populate_cache (DzlTaskCache  *cache,
   }
 #endif
 
-  subprocess = g_subprocess_newv ((const gchar * const *)args->pdata,
-                                  G_SUBPROCESS_FLAGS_STDIN_PIPE
-                                  | G_SUBPROCESS_FLAGS_STDOUT_PIPE
-                                  | G_SUBPROCESS_FLAGS_STDERR_PIPE,
-                                  &error);
+  subprocess = g_subprocess_launcher_spawnv (launcher,
+                                             (const gchar * const *)args->pdata,
+                                             &error);
 
   g_ptr_array_free (args, TRUE);
 
@@ -479,6 +498,7 @@ populate_cache (DzlTaskCache  *cache,
   unit = g_slice_new0 (TranslationUnit);
   unit->file = g_object_ref (file);
   unit->unsaved_file = ide_unsaved_file_ref (unsaved_file);
+  unit->input_path = g_steal_pointer (&input_path);
   g_task_set_task_data (task, unit, (GDestroyNotify)translation_unit_free);
 
   g_subprocess_wait_async (subprocess,
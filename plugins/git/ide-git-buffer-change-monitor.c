@@ -23,6 +23,8 @@
 #include <libgit2-glib/ggit.h>
 
 #include "ide-git-buffer-change-monitor.h"
+#include "ide-git-line-diff.h"
+#include "ide-git-tree-snapshot.h"
 #include "ide-git-vcs.h"
 
 /**
@@ -34,13 +36,27 @@
  *
  * To enable us to avoid blocking the main loop, the actual diff is performed in a background
  * thread. To avoid threading issues with the rest of LibIDE, this module creates a copy of the
- * loaded repository. A single thread will be dispatched for the context and all reload tasks
- * will be performed from that thread.
+ * loaded repository. A small pool of worker threads is shared by all monitors. The committed
+ * version of the file is found using the IdeGitTreeSnapshot shared by all monitors of the
+ * IdeGitVcs, which also serializes access to the repository from those workers. The rare full
+ * diffs by libgit2 are done with a repository private to each worker instead.
+ *
+ * A monitor has at most one task queued or running. If the buffer changes while its task is
+ * still waiting in the queue, the task is updated with the new content rather than running a
+ * stale diff and then queuing another. Tasks for the focused buffer are placed ahead of the
+ * others, so that the buffer being edited is not stuck behind every other open buffer after
+ * the repository is reloaded (such as when switching branches).
  *
  * Upon completion of the diff, the results will be passed back to the primary thread and the
  * state updated for use by line change renderer in the source view.
  *
- * TODO: Move the thread work into ide_thread_pool?
+ * The cached blob is checked against the snapshot before each diff, so it (and the differ)
+ * survive a reload of the repository unless the file actually changed at HEAD.
+ *
+ * The diff is performed by an IdeGitLineDiff which travels with the cached blob. It remembers
+ * the previous content of the buffer so that, after the first run, only the region that was
+ * edited needs to be compared again. When it cannot (for example, most of the file was
+ * replaced), we fall back to a full diff performed by libgit2.
  */
 
 struct _IdeGitBufferChangeMonitor
@@ -53,9 +69,13 @@ struct _IdeGitBufferChangeMonitor
   IdeBuffer              *buffer;
 
   GgitRepository         *repository;
-  GHashTable             *state;
+  GArray                 *ranges;
 
   GgitBlob               *cached_blob;
+  IdeGitLineDiff         *differ;
+
+  /* The task queued or running, while in_calculation is set */
+  GTask                  *pending;
 
   guint                   changed_timeout;
 
@@ -67,12 +87,17 @@ struct _IdeGitBufferChangeMonitor
 
 typedef struct
 {
-  GgitRepository *repository;
-  GHashTable     *state;
-  GFile          *file;
-  GBytes         *content;
-  GgitBlob       *blob;
-  guint           is_child_of_workdir : 1;
+  GgitRepository     *repository;
+  GArray             *ranges;
+  GFile              *file;
+  GBytes             *content;
+  GgitBlob           *blob;
+  IdeGitLineDiff     *differ;
+  IdeGitTreeSnapshot *snapshot;
+  gint                priority;
+  guint               is_child_of_workdir : 1;
+  /* Protected by work_lock */
+  guint               queued : 1;
 } DiffTask;
 
 G_DEFINE_TYPE (IdeGitBufferChangeMonitor,
@@ -88,9 +113,12 @@ enum {
   LAST_PROP
 };
 
-static GParamSpec  *properties [LAST_PROP];
-static GAsyncQueue *work_queue;
-static GThread     *work_thread;
+#define MAX_WORKERS 4
+
+static GParamSpec *properties [LAST_PROP];
+static GMutex      work_lock;
+static GCond       work_cond;
+static GQueue      work_queue = G_QUEUE_INIT;
 
 static void
 diff_task_free (gpointer data)
@@ -102,12 +130,15 @@ diff_task_free (gpointer data)
       g_clear_object (&diff->file);
       g_clear_object (&diff->blob);
       g_clear_object (&diff->repository);
-      g_clear_pointer (&diff->state, g_hash_table_unref);
+      g_clear_pointer (&diff->ranges, g_array_unref);
       g_clear_pointer (&diff->content, g_bytes_unref);
+      g_clear_pointer (&diff->differ, ide_git_line_diff_free);
+      g_clear_pointer (&diff->snapshot, ide_git_tree_snapshot_unref);
+      g_slice_free (DiffTask, diff);
     }
 }
 
-static GHashTable *
+static GArray *
 ide_git_buffer_change_monitor_calculate_finish (IdeGitBufferChangeMonitor  *self,
                                                 GAsyncResult               *result,
                                                 GError                    **error)
@@ -124,12 +155,48 @@ ide_git_buffer_change_monitor_calculate_finish (IdeGitBufferChangeMonitor  *self
   if (diff->blob != self->cached_blob)
     g_set_object (&self->cached_blob, diff->blob);
 
+  /* And the differ that goes with it, so the next diff can be incremental */
+  if (diff->differ != NULL)
+    {
+      g_clear_pointer (&self->differ, ide_git_line_diff_free);
+      self->differ = g_steal_pointer (&diff->differ);
+    }
+
   /* If the file is a child of the working directory, we need to know */
   self->is_child_of_workdir = diff->is_child_of_workdir;
 
   return g_task_propagate_pointer (task, error);
 }
 
+static gint
+ide_git_buffer_change_monitor_get_priority (IdeGitBufferChangeMonitor *self)
+{
+  IdeBufferManager *buffer_manager;
+  IdeContext *context;
+
+  g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  buffer_manager = ide_context_get_buffer_manager (context);
+
+  if (self->buffer == ide_buffer_manager_get_focus_buffer (buffer_manager))
+    return G_PRIORITY_HIGH;
+
+  return G_PRIORITY_DEFAULT;
+}
+
+static gint
+compare_by_priority (gconstpointer a,
+                     gconstpointer b,
+                     gpointer      user_data)
+{
+  const DiffTask *queued = g_task_get_task_data ((GTask *)a);
+  const DiffTask *diff = g_task_get_task_data ((GTask *)b);
+
+  /* Keep insertion order among tasks of the same priority */
+  return queued->priority <= diff->priority ? -1 : 1;
+}
+
 static void
 ide_git_buffer_change_monitor_calculate_async (IdeGitBufferChangeMonitor *self,
                                                GCancellable              *cancellable,
@@ -139,6 +206,7 @@ ide_git_buffer_change_monitor_calculate_async (IdeGitBufferChangeMonitor *self,
   g_autoptr(GTask) task = NULL;
   DiffTask *diff;
   IdeFile *file;
+  IdeVcs *vcs;
   GFile *gfile;
 
   g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self));
@@ -165,15 +233,70 @@ ide_git_buffer_change_monitor_calculate_async (IdeGitBufferChangeMonitor *self,
   diff = g_slice_new0 (DiffTask);
   diff->file = g_object_ref (gfile);
   diff->repository = g_object_ref (self->repository);
-  diff->state = g_hash_table_new (g_direct_hash, g_direct_equal);
   diff->content = ide_buffer_get_content (self->buffer);
   diff->blob = self->cached_blob ? g_object_ref (self->cached_blob) : NULL;
 
+  /* The differ is only valid for the blob it was created from */
+  if (diff->blob != NULL)
+    diff->differ = g_steal_pointer (&self->differ);
+
+  vcs = ide_context_get_vcs (ide_object_get_context (IDE_OBJECT (self)));
+  if (IDE_IS_GIT_VCS (vcs) && ide_git_vcs_get_snapshot (IDE_GIT_VCS (vcs)) != NULL)
+    diff->snapshot = ide_git_tree_snapshot_ref (ide_git_vcs_get_snapshot (IDE_GIT_VCS (vcs)));
+
+  diff->priority = ide_git_buffer_change_monitor_get_priority (self);
+  diff->queued = TRUE;
+
   g_task_set_task_data (task, diff, diff_task_free);
 
   self->in_calculation = TRUE;
+  g_set_object (&self->pending, task);
 
-  g_async_queue_push (work_queue, g_object_ref (task));
+  g_mutex_lock (&work_lock);
+  g_queue_insert_sorted (&work_queue, g_object_ref (task), compare_by_priority, NULL);
+  g_cond_signal (&work_cond);
+  g_mutex_unlock (&work_lock);
+}
+
+/*
+ * Replaces the content of our queued task with the current content of the
+ * buffer. Returns %FALSE if a worker already picked up the task, in which
+ * case we must wait for it to complete.
+ */
+static gboolean
+ide_git_buffer_change_monitor_supersede (IdeGitBufferChangeMonitor *self)
+{
+  g_autoptr(GBytes) content = NULL;
+  gboolean ret = FALSE;
+  DiffTask *diff;
+
+  g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+  g_assert (G_IS_TASK (self->pending));
+
+  diff = g_task_get_task_data (self->pending);
+  content = ide_buffer_get_content (self->buffer);
+
+  g_mutex_lock (&work_lock);
+
+  if (diff->queued)
+    {
+      g_clear_pointer (&diff->content, g_bytes_unref);
+      diff->content = g_steal_pointer (&content);
+
+      /* The buffer may have gained focus since it was queued */
+      diff->priority = ide_git_buffer_change_monitor_get_priority (self);
+      g_queue_remove (&work_queue, self->pending);
+      g_queue_insert_sorted (&work_queue, self->pending, compare_by_priority, NULL);
+
+      ret = TRUE;
+    }
+
+  g_mutex_unlock (&work_lock);
+
+  if (ret)
+    self->state_dirty = FALSE;
+
+  return ret;
 }
 
 static IdeBufferLineChange
@@ -181,13 +304,11 @@ ide_git_buffer_change_monitor_get_change (IdeBufferChangeMonitor *monitor,
                                           const GtkTextIter      *iter)
 {
   IdeGitBufferChangeMonitor *self = (IdeGitBufferChangeMonitor *)monitor;
-  gpointer key;
-  gpointer value;
 
   g_return_val_if_fail (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self), IDE_BUFFER_LINE_CHANGE_NONE);
   g_return_val_if_fail (iter, IDE_BUFFER_LINE_CHANGE_NONE);
 
-  if (!self->state)
+  if (!self->ranges)
     {
       /*
        * If the file is within the working directory, synthesize line addition.
@@ -197,10 +318,7 @@ ide_git_buffer_change_monitor_get_change (IdeBufferChangeMonitor *monitor,
       return IDE_BUFFER_LINE_CHANGE_NONE;
     }
 
-  key = GINT_TO_POINTER (gtk_text_iter_get_line (iter) + 1);
-  value = g_hash_table_lookup (self->state, key);
-
-  return GPOINTER_TO_INT (value);
+  return ide_git_line_ranges_lookup (self->ranges, gtk_text_iter_get_line (iter));
 }
 
 static void
@@ -219,12 +337,13 @@ ide_git_buffer_change_monitor__calculate_cb (GObject      *object,
                                              gpointer      user_data_unused)
 {
   IdeGitBufferChangeMonitor *self = (IdeGitBufferChangeMonitor *)object;
-  g_autoptr(GHashTable) ret = NULL;
+  g_autoptr(GArray) ret = NULL;
   g_autoptr(GError) error = NULL;
 
   g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self));
 
   self->in_calculation = FALSE;
+  g_clear_object (&self->pending);
 
   ret = ide_git_buffer_change_monitor_calculate_finish (self, result, &error);
 
@@ -235,8 +354,8 @@ ide_git_buffer_change_monitor__calculate_cb (GObject      *object,
     }
   else
     {
-      g_clear_pointer (&self->state, g_hash_table_unref);
-      self->state = g_hash_table_ref (ret);
+      g_clear_pointer (&self->ranges, g_array_unref);
+      self->ranges = g_steal_pointer (&ret);
     }
 
   ide_buffer_change_monitor_emit_changed (IDE_BUFFER_CHANGE_MONITOR (self));
@@ -259,7 +378,10 @@ ide_git_buffer_change_monitor_recalculate (IdeGitBufferChangeMonitor *self)
   self->state_dirty = TRUE;
 
   if (self->in_calculation)
-    return;
+    {
+      ide_git_buffer_change_monitor_supersede (self);
+      return;
+    }
 
   ide_git_buffer_change_monitor_calculate_async (self,
                                                  NULL,
@@ -422,7 +544,7 @@ ide_git_buffer_change_monitor_reload (IdeBufferChangeMonitor *monitor)
 
   g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self));
 
-  g_clear_object (&self->cached_blob);
+  /* The cached blob is validated against the current snapshot by the worker */
   ide_git_buffer_change_monitor_recalculate (self);
 
   IDE_EXIT;
@@ -471,86 +593,84 @@ ide_git_buffer_change_monitor_set_buffer (IdeBufferChangeMonitor *monitor,
 }
 
 static gint
-diff_line_cb (GgitDiffDelta *delta,
+diff_hunk_cb (GgitDiffDelta *delta,
               GgitDiffHunk  *hunk,
-              GgitDiffLine  *line,
               gpointer       user_data)
 {
-  GgitDiffLineType type;
-  GHashTable *hash = user_data;
-  gint new_lineno;
-  gint old_lineno;
-  gint adjust;
+  GArray *hunks = user_data;
+  IdeGitLineDiffHunk item;
 
   g_return_val_if_fail (delta, GGIT_ERROR_GIT_ERROR);
   g_return_val_if_fail (hunk, GGIT_ERROR_GIT_ERROR);
-  g_return_val_if_fail (line, GGIT_ERROR_GIT_ERROR);
-  g_return_val_if_fail (hash, GGIT_ERROR_GIT_ERROR);
+  g_return_val_if_fail (hunks, GGIT_ERROR_GIT_ERROR);
 
-  type = ggit_diff_line_get_origin (line);
+  /*
+   * Hunk starts are one-based, except that an empty side refers to the
+   * line after which the change happened.
+   */
+  item.old_len = ggit_diff_hunk_get_old_lines (hunk);
+  item.old_start = ggit_diff_hunk_get_old_start (hunk);
+  if (item.old_len > 0)
+    item.old_start--;
 
-  if ((type != GGIT_DIFF_LINE_ADDITION) && (type != GGIT_DIFF_LINE_DELETION))
-    return 0;
+  item.new_len = ggit_diff_hunk_get_new_lines (hunk);
+  item.new_start = ggit_diff_hunk_get_new_start (hunk);
+  if (item.new_len > 0)
+    item.new_start--;
 
-  new_lineno = ggit_diff_line_get_new_lineno (line);
-  old_lineno = ggit_diff_line_get_old_lineno (line);
+  g_array_append_val (hunks, item);
 
-  switch (type)
-    {
-    case GGIT_DIFF_LINE_ADDITION:
-      if (g_hash_table_lookup (hash, GINT_TO_POINTER (new_lineno)))
-        g_hash_table_replace (hash,
-                              GINT_TO_POINTER (new_lineno),
-                              GINT_TO_POINTER (IDE_BUFFER_LINE_CHANGE_CHANGED));
-      else
-        g_hash_table_insert (hash,
-                             GINT_TO_POINTER (new_lineno),
-                             GINT_TO_POINTER (IDE_BUFFER_LINE_CHANGE_ADDED));
-      break;
+  return 0;
+}
 
-    case GGIT_DIFF_LINE_DELETION:
-      adjust = (ggit_diff_hunk_get_new_start (hunk) - ggit_diff_hunk_get_old_start (hunk));
-      old_lineno += adjust;
-      if (g_hash_table_lookup (hash, GINT_TO_POINTER (old_lineno)))
-        g_hash_table_replace (hash,
-                              GINT_TO_POINTER (old_lineno),
-                              GINT_TO_POINTER (IDE_BUFFER_LINE_CHANGE_CHANGED));
-      else
-        g_hash_table_insert (hash,
-                             GINT_TO_POINTER (old_lineno),
-                             GINT_TO_POINTER (IDE_BUFFER_LINE_CHANGE_DELETED));
-      break;
+/*
+ * Loads the blob @oid from a repository private to the calling worker, opening it
+ * (again) if @private_repository is not for the same location as @repository.
+ */
+static GgitBlob *
+load_private_blob (GgitRepository  *repository,
+                   GgitRepository **private_repository,
+                   GgitOId         *oid,
+                   GError         **error)
+{
+  g_autoptr(GFile) location = NULL;
 
-    case GGIT_DIFF_LINE_CONTEXT:
-    case GGIT_DIFF_LINE_CONTEXT_EOFNL:
-    case GGIT_DIFF_LINE_ADD_EOFNL:
-    case GGIT_DIFF_LINE_DEL_EOFNL:
-    case GGIT_DIFF_LINE_FILE_HDR:
-    case GGIT_DIFF_LINE_BINARY:
-    default:
-      break;
+  g_assert (GGIT_IS_REPOSITORY (repository));
+  g_assert (private_repository != NULL);
+  g_assert (oid != NULL);
 
-    case GGIT_DIFF_LINE_HUNK_HDR:
-      g_assert_not_reached ();
+  location = ggit_repository_get_location (repository);
+
+  if (*private_repository != NULL)
+    {
+      g_autoptr(GFile) private_location = ggit_repository_get_location (*private_repository);
+
+      if (!g_file_equal (location, private_location))
+        g_clear_object (private_repository);
     }
 
-  return 0;
+  if (*private_repository == NULL &&
+      !(*private_repository = ggit_repository_open (location, error)))
+    return NULL;
+
+  return (GgitBlob *)ggit_repository_lookup (*private_repository, oid, GGIT_TYPE_BLOB, error);
 }
 
 static gboolean
 ide_git_buffer_change_monitor_calculate_threaded (IdeGitBufferChangeMonitor  *self,
                                                   DiffTask                   *diff,
+                                                  GgitRepository            **private_repository,
                                                   GError                    **error)
 {
   g_autofree gchar *relative_path = NULL;
   g_autoptr(GFile) workdir = NULL;
   const guint8 *data;
   gsize data_len = 0;
+  GgitOId *oid = NULL;
 
   g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self));
   g_assert (diff);
   g_assert (G_IS_FILE (diff->file));
-  g_assert (diff->state);
   g_assert (GGIT_IS_REPOSITORY (diff->repository));
   g_assert (diff->content);
   g_assert (!diff->blob || GGIT_IS_BLOB (diff->blob));
@@ -581,100 +701,129 @@ ide_git_buffer_change_monitor_calculate_threaded (IdeGitBufferChangeMonitor  *se
 
   diff->is_child_of_workdir = TRUE;
 
+  if (!diff->snapshot || !(oid = ide_git_tree_snapshot_lookup (diff->snapshot, relative_path)))
+    {
+      g_set_error (error,
+                   GGIT_ERROR,
+                   GGIT_ERROR_NOTFOUND,
+                   _("The requested file does not exist within the git index."));
+      return FALSE;
+    }
+
   /*
-   * Find the blob if necessary. This will be cached by the main thread for us on the way out
+   * Drop the cached blob (and the differ built from it) if the file changed at HEAD, such as
+   * after switching branches. Otherwise both are reused.
+   */
+  if (diff->blob)
+    {
+      GgitOId *blob_oid = ggit_object_get_id (GGIT_OBJECT (diff->blob));
+
+      if (!ggit_oid_equal (oid, blob_oid))
+        {
+          g_clear_object (&diff->blob);
+          g_clear_pointer (&diff->differ, ide_git_line_diff_free);
+        }
+
+      g_clear_pointer (&blob_oid, ggit_oid_free);
+    }
+
+  /*
+   * Load the blob if necessary. This will be cached by the main thread for us on the way out
    * of the async operation.
    */
   if (!diff->blob)
     {
-      GgitOId *entry_oid = NULL;
-      GgitOId *oid = NULL;
-      GgitObject *blob = NULL;
-      GgitObject *commit = NULL;
-      GgitRef *head = NULL;
-      GgitTree *tree = NULL;
-      GgitTreeEntry *entry = NULL;
-
-      head = ggit_repository_get_head (diff->repository, error);
-      if (!head)
-        goto cleanup;
-
-      oid = ggit_ref_get_target (head);
-      if (!oid)
-        goto cleanup;
-
-      commit = ggit_repository_lookup (diff->repository, oid, GGIT_TYPE_COMMIT, error);
-      if (!commit)
-        goto cleanup;
-
-      tree = ggit_commit_get_tree (GGIT_COMMIT (commit));
-      if (!tree)
-        goto cleanup;
-
-      entry = ggit_tree_get_by_path (tree, relative_path, error);
-      if (!entry)
-        goto cleanup;
-
-      entry_oid = ggit_tree_entry_get_id (entry);
-      if (!entry_oid)
-        goto cleanup;
-
-      blob = ggit_repository_lookup (diff->repository, entry_oid, GGIT_TYPE_BLOB, error);
-      if (!blob)
-        goto cleanup;
-
-      diff->blob = g_object_ref (blob);
-
-    cleanup:
-      g_clear_object (&blob);
-      g_clear_pointer (&entry_oid, ggit_oid_free);
-      g_clear_pointer (&entry, ggit_tree_entry_unref);
-      g_clear_object (&tree);
-      g_clear_object (&commit);
-      g_clear_pointer (&oid, ggit_oid_free);
-      g_clear_object (&head);
+      g_clear_pointer (&diff->differ, ide_git_line_diff_free);
+      diff->blob = ide_git_tree_snapshot_load_blob (diff->snapshot, oid, error);
     }
 
+  g_clear_pointer (&oid, ggit_oid_free);
+
   if (!diff->blob)
+    return FALSE;
+
+  if (!diff->differ)
     {
-      if ((*error) == NULL)
-        g_set_error (error,
-                     G_IO_ERROR,
-                     G_IO_ERROR_NOT_FOUND,
-                     _("The requested file does not exist within the git index."));
-      return FALSE;
+      g_autoptr(GBytes) base = NULL;
+      gsize base_len = 0;
+
+      data = ggit_blob_get_raw_content (diff->blob, &base_len);
+      base = g_bytes_new (data, base_len);
+      diff->differ = ide_git_line_diff_new (base);
     }
 
-  data = g_bytes_get_data (diff->content, &data_len);
+  if (!ide_git_line_diff_update (diff->differ, diff->content))
+    {
+      g_autoptr(GgitDiffOptions) options = NULL;
+      g_autoptr(GgitBlob) blob = NULL;
+      g_autoptr(GArray) hunks = NULL;
+
+      /*
+       * Too much changed to diff incrementally, let libgit2 do the full diff. Diffing reaches
+       * back into the repository of the blob, so we load it again from a repository private to
+       * this worker. That way the shared repository is only used under the snapshot lock, and
+       * other workers do not have to wait on a large diff.
+       */
+      oid = ggit_object_get_id (GGIT_OBJECT (diff->blob));
+      blob = load_private_blob (diff->repository, private_repository, oid, error);
+      g_clear_pointer (&oid, ggit_oid_free);
+
+      if (blob == NULL)
+        {
+          g_clear_pointer (&diff->differ, ide_git_line_diff_free);
+          return FALSE;
+        }
+
+      options = ggit_diff_options_new ();
+      ggit_diff_options_set_n_context_lines (options, 0);
 
-  ggit_diff_blob_to_buffer (diff->blob, relative_path, data, data_len, relative_path,
-                            NULL, NULL, NULL, NULL, diff_line_cb, (gpointer)diff->state, error);
+      hunks = g_array_new (FALSE, FALSE, sizeof (IdeGitLineDiffHunk));
+      data = g_bytes_get_data (diff->content, &data_len);
 
-  return ((*error) == NULL);
+      ggit_diff_blob_to_buffer (blob, relative_path, data, data_len, relative_path,
+                                options, NULL, NULL, diff_hunk_cb, NULL, hunks, error);
+
+      if (*error != NULL)
+        {
+          g_clear_pointer (&diff->differ, ide_git_line_diff_free);
+          return FALSE;
+        }
+
+      ide_git_line_diff_set_hunks (diff->differ, hunks);
+    }
+
+  diff->ranges = ide_git_line_diff_get_ranges (diff->differ);
+
+  return TRUE;
 }
 
 static gpointer
 ide_git_buffer_change_monitor_worker (gpointer data)
 {
-  GAsyncQueue *queue = data;
-  GTask *task;
+  /* Opened on first use for full diffs, see ide_git_buffer_change_monitor_calculate_threaded() */
+  GgitRepository *private_repository = NULL;
 
-  g_assert (queue);
-
-  while ((task = g_async_queue_pop (queue)))
+  for (;;)
     {
       IdeGitBufferChangeMonitor *self;
       DiffTask *diff;
       GError *error = NULL;
+      GTask *task;
 
-      self = g_task_get_source_object (task);
+      g_mutex_lock (&work_lock);
+      while (NULL == (task = g_queue_pop_head (&work_queue)))
+        g_cond_wait (&work_cond, &work_lock);
       diff = g_task_get_task_data (task);
+      diff->queued = FALSE;
+      g_mutex_unlock (&work_lock);
 
-      if (!ide_git_buffer_change_monitor_calculate_threaded (self, diff, &error))
+      self = g_task_get_source_object (task);
+
+      if (!ide_git_buffer_change_monitor_calculate_threaded (self, diff, &private_repository, &error))
         g_task_return_error (task, error);
       else
-        g_task_return_pointer (task, g_hash_table_ref (diff->state),
-                               (GDestroyNotify)g_hash_table_unref);
+        g_task_return_pointer (task, g_array_ref (diff->ranges),
+                               (GDestroyNotify)g_array_unref);
 
       g_object_unref (task);
     }
@@ -699,6 +848,8 @@ ide_git_buffer_change_monitor_dispose (GObject *object)
   g_clear_object (&self->vcs_signal_group);
   g_clear_object (&self->cached_blob);
   g_clear_object (&self->repository);
+  g_clear_pointer (&self->differ, ide_git_line_diff_free);
+  g_clear_object (&self->pending);
 
   G_OBJECT_CLASS (ide_git_buffer_change_monitor_parent_class)->dispose (object);
 }
@@ -706,6 +857,10 @@ ide_git_buffer_change_monitor_dispose (GObject *object)
 static void
 ide_git_buffer_change_monitor_finalize (GObject *object)
 {
+  IdeGitBufferChangeMonitor *self = (IdeGitBufferChangeMonitor *)object;
+
+  g_clear_pointer (&self->ranges, g_array_unref);
+
   G_OBJECT_CLASS (ide_git_buffer_change_monitor_parent_class)->finalize (object);
 
   DZL_COUNTER_DEC (instances);
@@ -735,6 +890,7 @@ ide_git_buffer_change_monitor_class_init (IdeGitBufferChangeMonitorClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   IdeBufferChangeMonitorClass *parent_class = IDE_BUFFER_CHANGE_MONITOR_CLASS (klass);
+  guint n_workers;
 
   object_class->dispose = ide_git_buffer_change_monitor_dispose;
   object_class->finalize = ide_git_buffer_change_monitor_finalize;
@@ -753,10 +909,15 @@ ide_git_buffer_change_monitor_class_init (IdeGitBufferChangeMonitorClass *klass)
 
   g_object_class_install_properties (object_class, LAST_PROP, properties);
 
-  work_queue = g_async_queue_new ();
-  work_thread = g_thread_new ("IdeGitBufferChangeMonitorWorker",
-                              ide_git_buffer_change_monitor_worker,
-                              work_queue);
+  n_workers = CLAMP (g_get_num_processors () / 2, 1, MAX_WORKERS);
+
+  for (guint i = 0; i < n_workers; i++)
+    {
+      g_autofree gchar *name = g_strdup_printf ("IdeGitBufferChangeMonitorWorker%u", i);
+
+      /* Workers live for the duration of the process */
+      g_thread_unref (g_thread_new (name, ide_git_buffer_change_monitor_worker, NULL));
+    }
 }
 
 static void
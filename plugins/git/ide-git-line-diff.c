@@ -0,0 +1,617 @@
+/* ide-git-line-diff.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-git-line-diff"
+
+#include <string.h>
+
+#include "ide-git-line-diff.h"
+
+/*
+ * IdeGitLineDiff computes which lines of a buffer differ from the version
+ * in the repository, and keeps enough state to redo that cheaply as the
+ * buffer is edited.
+ *
+ * Both sides are reduced to an array of line hashes, so comparing lines
+ * is a single integer comparison. The base side is hashed once per blob.
+ * When new content arrives, we compare its hashes with the content of the
+ * previous update to find the lines that were edited, widen that region to
+ * cover the hunks it touches, and rerun the diff only within that window.
+ * Hunks outside of the window are kept, shifted by the number of lines the
+ * edit added or removed.
+ *
+ * The diff itself is the greedy O(ND) algorithm by Eugene Myers. It is
+ * bounded by MAX_EDIT_COST so that a large rewrite cannot make us consume
+ * quadratic time and memory. When that happens, or when the edited window
+ * covers most of the file, the update fails and the caller is expected to
+ * provide the hunks from a full diff with ide_git_line_diff_set_hunks().
+ */
+
+#define MAX_EDIT_COST 1024
+
+struct _IdeGitLineDiff
+{
+  /* Line hashes of the base content (guint64) */
+  GArray *base;
+
+  /* Line hashes of the content from the last update, or %NULL */
+  GArray *lines;
+
+  /* IdeGitLineDiffHunk between @base and @lines, sorted */
+  GArray *hunks;
+
+  guint   hunks_valid : 1;
+};
+
+typedef struct
+{
+  guint a;
+  guint b;
+  guint is_insert : 1;
+} Edit;
+
+static GArray *
+hash_lines (GBytes *bytes)
+{
+  const gchar *data;
+  const gchar *end;
+  GArray *ret;
+  gsize len = 0;
+
+  ret = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+  if (bytes == NULL)
+    return ret;
+
+  data = g_bytes_get_data (bytes, &len);
+  end = data + len;
+
+  while (data < end)
+    {
+      const gchar *eol = memchr (data, '\n', end - data);
+      guint64 hash = 0xcbf29ce484222325ULL;
+
+      if (eol == NULL)
+        eol = end;
+
+      /* FNV-1a */
+      for (const gchar *iter = data; iter < eol; iter++)
+        {
+          hash ^= (guint8)*iter;
+          hash *= 0x100000001b3ULL;
+        }
+
+      g_array_append_val (ret, hash);
+
+      data = eol + 1;
+    }
+
+  return ret;
+}
+
+static inline gint
+trace_get (const GArray *trace,
+           gint          d,
+           gint          k)
+{
+  if (k < -d || k > d)
+    return -1;
+
+  return g_array_index (trace, gint, d * d + k + d);
+}
+
+/*
+ * Picks how diagonal @k is entered from the furthest reaching points of
+ * the previous round. Returns the x coordinate reached before following
+ * the snake, or -1 if the diagonal cannot be reached within the grid.
+ */
+static inline gint
+choose_move (const GArray *trace,
+             gint          d,
+             gint          k,
+             guint         n,
+             guint         m,
+             gboolean     *is_insert)
+{
+  gint down = trace_get (trace, d - 1, k + 1);
+  gint right = trace_get (trace, d - 1, k - 1);
+
+  if (down >= 0 && down - k > (gint)m)
+    down = -1;
+
+  if (right >= 0)
+    {
+      right++;
+
+      if (right > (gint)n)
+        right = -1;
+    }
+
+  if (down >= 0 && down >= right)
+    {
+      *is_insert = TRUE;
+      return down;
+    }
+
+  *is_insert = FALSE;
+
+  return right;
+}
+
+static void
+push_edit (GArray *hunks,
+           guint   a,
+           guint   b,
+           gboolean is_insert)
+{
+  IdeGitLineDiffHunk *last = NULL;
+
+  if (hunks->len > 0)
+    last = &g_array_index (hunks, IdeGitLineDiffHunk, hunks->len - 1);
+
+  if (last == NULL ||
+      last->old_start + last->old_len != a ||
+      last->new_start + last->new_len != b)
+    {
+      IdeGitLineDiffHunk hunk = { a, 0, b, 0 };
+
+      g_array_append_val (hunks, hunk);
+      last = &g_array_index (hunks, IdeGitLineDiffHunk, hunks->len - 1);
+    }
+
+  if (is_insert)
+    last->new_len++;
+  else
+    last->old_len++;
+}
+
+/*
+ * Appends to @hunks the hunks between @a and @b, offsetting line numbers
+ * by @a_base and @b_base. Returns %FALSE if more than MAX_EDIT_COST
+ * insertions and deletions are needed, leaving @hunks untouched.
+ */
+static gboolean
+diff_range (const guint64 *a,
+            guint          n,
+            const guint64 *b,
+            guint          m,
+            guint          a_base,
+            guint          b_base,
+            GArray        *hunks)
+{
+  g_autoptr(GArray) trace = NULL;
+  g_autoptr(GArray) edits = NULL;
+  guint prefix = 0;
+  guint suffix = 0;
+  gint max_d;
+  gint x = 0;
+  gint y = 0;
+  gint d;
+
+  while (prefix < n && prefix < m && a[prefix] == b[prefix])
+    prefix++;
+
+  while (suffix < n - prefix && suffix < m - prefix && a[n - 1 - suffix] == b[m - 1 - suffix])
+    suffix++;
+
+  a += prefix;
+  b += prefix;
+  n -= prefix + suffix;
+  m -= prefix + suffix;
+  a_base += prefix;
+  b_base += prefix;
+
+  if (n == 0 && m == 0)
+    return TRUE;
+
+  if (n == 0 || m == 0)
+    {
+      IdeGitLineDiffHunk hunk = { a_base, n, b_base, m };
+
+      g_array_append_val (hunks, hunk);
+
+      return TRUE;
+    }
+
+  if (n + m <= MAX_EDIT_COST)
+    max_d = n + m;
+  else
+    max_d = MAX_EDIT_COST;
+
+  trace = g_array_new (FALSE, FALSE, sizeof (gint));
+
+  for (d = 0; d <= max_d; d++)
+    {
+      gboolean found = FALSE;
+      guint slice = trace->len;
+
+      g_array_set_size (trace, slice + 2 * d + 1);
+
+      for (gint k = -d; k <= d; k += 2)
+        {
+          gboolean is_insert;
+
+          if (d == 0)
+            x = 0;
+          else if (-1 == (x = choose_move (trace, d, k, n, m, &is_insert)))
+            {
+              g_array_index (trace, gint, slice + k + d) = -1;
+              continue;
+            }
+
+          y = x - k;
+
+          while (x < (gint)n && y < (gint)m && a[x] == b[y])
+            x++, y++;
+
+          g_array_index (trace, gint, slice + k + d) = x;
+
+          if (x >= (gint)n && y >= (gint)m)
+            {
+              found = TRUE;
+              break;
+            }
+        }
+
+      if (found)
+        break;
+    }
+
+  if (d > max_d)
+    return FALSE;
+
+  /* Walk back from the end to find the edits along the path */
+  edits = g_array_sized_new (FALSE, FALSE, sizeof (Edit), d);
+
+  for (; d > 0; d--)
+    {
+      gint k = x - y;
+      gboolean is_insert;
+      Edit edit;
+
+      choose_move (trace, d, k, n, m, &is_insert);
+
+      if (is_insert)
+        {
+          x = trace_get (trace, d - 1, k + 1);
+          y = x - (k + 1);
+        }
+      else
+        {
+          x = trace_get (trace, d - 1, k - 1);
+          y = x - (k - 1);
+        }
+
+      edit.a = x;
+      edit.b = y;
+      edit.is_insert = is_insert;
+
+      g_array_append_val (edits, edit);
+    }
+
+  for (guint i = edits->len; i > 0; i--)
+    {
+      const Edit *edit = &g_array_index (edits, Edit, i - 1);
+
+      push_edit (hunks, a_base + edit->a, b_base + edit->b, edit->is_insert);
+    }
+
+  return TRUE;
+}
+
+/**
+ * ide_git_line_diff_new:
+ * @base: the content of the file in the repository
+ *
+ * Creates a new line differ against @base. Call ide_git_line_diff_update()
+ * with the content of the buffer to compute the changes.
+ *
+ * Returns: (transfer full): a new #IdeGitLineDiff
+ */
+IdeGitLineDiff *
+ide_git_line_diff_new (GBytes *base)
+{
+  IdeGitLineDiff *self;
+
+  self = g_slice_new0 (IdeGitLineDiff);
+  self->base = hash_lines (base);
+  self->hunks = g_array_new (FALSE, FALSE, sizeof (IdeGitLineDiffHunk));
+
+  return self;
+}
+
+void
+ide_git_line_diff_free (IdeGitLineDiff *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->base, g_array_unref);
+      g_clear_pointer (&self->lines, g_array_unref);
+      g_clear_pointer (&self->hunks, g_array_unref);
+      g_slice_free (IdeGitLineDiff, self);
+    }
+}
+
+static gboolean
+ide_git_line_diff_update_window (IdeGitLineDiff *self,
+                                 GArray         *lines,
+                                 GArray         *hunks)
+{
+  const guint64 *prev = (const guint64 *)(gpointer)self->lines->data;
+  const guint64 *next = (const guint64 *)(gpointer)lines->data;
+  guint prev_len = self->lines->len;
+  guint next_len = lines->len;
+  guint prefix = 0;
+  guint suffix = 0;
+  gint64 offset = 0;
+  gint64 delta;
+  guint wa0, wa1;
+  guint wb0, wb1;
+  guint first;
+  guint last;
+
+  while (prefix < prev_len && prefix < next_len && prev[prefix] == next[prefix])
+    prefix++;
+
+  while (suffix < prev_len - prefix &&
+         suffix < next_len - prefix &&
+         prev[prev_len - 1 - suffix] == next[next_len - 1 - suffix])
+    suffix++;
+
+  /* The edited lines, in the coordinates of the previous content */
+  wb0 = prefix;
+  wb1 = prev_len - suffix;
+  delta = (gint64)next_len - (gint64)prev_len;
+
+  /* Widen the window to the hunks it touches */
+  for (first = 0; first < self->hunks->len; first++)
+    {
+      const IdeGitLineDiffHunk *hunk = &g_array_index (self->hunks, IdeGitLineDiffHunk, first);
+
+      if (hunk->new_start + hunk->new_len >= wb0)
+        break;
+
+      offset += (gint64)hunk->new_len - (gint64)hunk->old_len;
+    }
+
+  wa0 = wb0 - offset;
+
+  for (last = first; last < self->hunks->len; last++)
+    {
+      const IdeGitLineDiffHunk *hunk = &g_array_index (self->hunks, IdeGitLineDiffHunk, last);
+
+      if (hunk->new_start > wb1)
+        break;
+
+      if (last == first && hunk->new_start < wb0)
+        {
+          wb0 = hunk->new_start;
+          wa0 = hunk->old_start;
+        }
+
+      wb1 = MAX (wb1, hunk->new_start + hunk->new_len);
+      offset += (gint64)hunk->new_len - (gint64)hunk->old_len;
+    }
+
+  wa1 = wb1 - offset;
+
+  /* Not worth it if the edit touched most of the file */
+  if ((wa1 - wa0) + (wb1 + delta - wb0) > (self->base->len + next_len) / 2)
+    return FALSE;
+
+  g_array_append_vals (hunks, self->hunks->data, first);
+
+  if (!diff_range ((const guint64 *)(gpointer)self->base->data + wa0, wa1 - wa0,
+                   next + wb0, wb1 + delta - wb0,
+                   wa0, wb0, hunks))
+    return FALSE;
+
+  for (guint i = last; i < self->hunks->len; i++)
+    {
+      IdeGitLineDiffHunk hunk = g_array_index (self->hunks, IdeGitLineDiffHunk, i);
+
+      hunk.new_start += delta;
+      g_array_append_val (hunks, hunk);
+    }
+
+  return TRUE;
+}
+
+/**
+ * ide_git_line_diff_update:
+ * @self: an #IdeGitLineDiff
+ * @content: the new content of the buffer
+ *
+ * Updates the hunks for @content. If a previous update succeeded, only the
+ * region of the file that changed since then is diffed again.
+ *
+ * Returns: %TRUE if successful. If the change was too large, %FALSE is
+ *   returned and the hunks must be provided with
+ *   ide_git_line_diff_set_hunks() before the next update.
+ */
+gboolean
+ide_git_line_diff_update (IdeGitLineDiff *self,
+                          GBytes         *content)
+{
+  g_autoptr(GArray) lines = NULL;
+  g_autoptr(GArray) hunks = NULL;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  lines = hash_lines (content);
+  hunks = g_array_new (FALSE, FALSE, sizeof (IdeGitLineDiffHunk));
+
+  if (self->lines == NULL || !self->hunks_valid ||
+      !ide_git_line_diff_update_window (self, lines, hunks))
+    {
+      g_array_set_size (hunks, 0);
+
+      self->hunks_valid = diff_range ((const guint64 *)(gpointer)self->base->data, self->base->len,
+                                      (const guint64 *)(gpointer)lines->data, lines->len,
+                                      0, 0, hunks);
+    }
+
+  g_clear_pointer (&self->lines, g_array_unref);
+  self->lines = g_steal_pointer (&lines);
+
+  if (self->hunks_valid)
+    {
+      g_clear_pointer (&self->hunks, g_array_unref);
+      self->hunks = g_steal_pointer (&hunks);
+    }
+
+  return self->hunks_valid;
+}
+
+/**
+ * ide_git_line_diff_set_hunks:
+ * @self: an #IdeGitLineDiff
+ * @hunks: (element-type IdeGitLineDiffHunk): the hunks
+ *
+ * Sets the hunks between the base and the content of the last update,
+ * such as from a diff performed by libgit2 after
+ * ide_git_line_diff_update() failed. The hunks must not overlap and be
+ * sorted by line.
+ */
+void
+ide_git_line_diff_set_hunks (IdeGitLineDiff *self,
+                             GArray         *hunks)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (hunks != NULL);
+
+  g_clear_pointer (&self->hunks, g_array_unref);
+  self->hunks = g_array_ref (hunks);
+  self->hunks_valid = TRUE;
+}
+
+/**
+ * ide_git_line_diff_get_hunks:
+ * @self: an #IdeGitLineDiff
+ *
+ * Returns: (transfer full) (element-type IdeGitLineDiffHunk): the hunks
+ */
+GArray *
+ide_git_line_diff_get_hunks (IdeGitLineDiff *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return g_array_ref (self->hunks);
+}
+
+/**
+ * ide_git_line_diff_get_ranges:
+ * @self: an #IdeGitLineDiff
+ *
+ * Converts the hunks into runs of lines for the gutter. Lines that replace
+ * lines of the base are changed, additional lines are added, and the line
+ * following removed lines is marked as deleted.
+ *
+ * Returns: (transfer full) (element-type IdeGitLineRange): a new array
+ *   suitable for ide_git_line_ranges_lookup().
+ */
+GArray *
+ide_git_line_diff_get_ranges (IdeGitLineDiff *self)
+{
+  GArray *ret;
+  guint n_lines;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  ret = g_array_sized_new (FALSE, FALSE, sizeof (IdeGitLineRange), self->hunks->len);
+  n_lines = self->lines ? self->lines->len : 0;
+
+  for (guint i = 0; i < self->hunks->len; i++)
+    {
+      const IdeGitLineDiffHunk *hunk = &g_array_index (self->hunks, IdeGitLineDiffHunk, i);
+      guint common = MIN (hunk->old_len, hunk->new_len);
+
+      if (common > 0)
+        {
+          IdeGitLineRange range = { hunk->new_start, common, IDE_BUFFER_LINE_CHANGE_CHANGED };
+          g_array_append_val (ret, range);
+        }
+
+      if (hunk->new_len > common)
+        {
+          IdeGitLineRange range = { hunk->new_start + common,
+                                    hunk->new_len - common,
+                                    IDE_BUFFER_LINE_CHANGE_ADDED };
+          g_array_append_val (ret, range);
+        }
+      else if (hunk->old_len > common)
+        {
+          IdeGitLineRange range = { hunk->new_start + hunk->new_len, 1, IDE_BUFFER_LINE_CHANGE_DELETED };
+
+          /* Lines removed from the end are shown on the last line */
+          if (range.begin >= n_lines)
+            {
+              if (hunk->new_len > 0 || n_lines == 0)
+                continue;
+              range.begin = n_lines - 1;
+
+              if (ret->len > 0)
+                {
+                  const IdeGitLineRange *prev = &g_array_index (ret, IdeGitLineRange, ret->len - 1);
+
+                  if (prev->begin + prev->len > range.begin)
+                    continue;
+                }
+            }
+
+          g_array_append_val (ret, range);
+        }
+    }
+
+  return ret;
+}
+
+/**
+ * ide_git_line_ranges_lookup:
+ * @ranges: (element-type IdeGitLineRange): ranges from
+ *   ide_git_line_diff_get_ranges()
+ * @line: a zero-based line number
+ *
+ * Returns: the #IdeBufferLineChange for @line
+ */
+IdeBufferLineChange
+ide_git_line_ranges_lookup (GArray *ranges,
+                            guint   line)
+{
+  guint lo = 0;
+  guint hi;
+
+  g_return_val_if_fail (ranges != NULL, IDE_BUFFER_LINE_CHANGE_NONE);
+
+  hi = ranges->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      const IdeGitLineRange *range = &g_array_index (ranges, IdeGitLineRange, mid);
+
+      if (line < range->begin)
+        hi = mid;
+      else if (line >= range->begin + range->len)
+        lo = mid + 1;
+      else
+        return range->change;
+    }
+
+  return IDE_BUFFER_LINE_CHANGE_NONE;
+}
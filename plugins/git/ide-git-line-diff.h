@@ -0,0 +1,67 @@
+/* ide-git-line-diff.h
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_GIT_LINE_DIFF_H
+#define IDE_GIT_LINE_DIFF_H
+
+#include <ide.h>
+
+G_BEGIN_DECLS
+
+typedef struct _IdeGitLineDiff IdeGitLineDiff;
+
+/*
+ * A block of changed lines, with zero-based line numbers. Either length
+ * may be zero for pure insertions or deletions, in which case the start
+ * is the line before which the change happened.
+ */
+typedef struct
+{
+  guint old_start;
+  guint old_len;
+  guint new_start;
+  guint new_len;
+} IdeGitLineDiffHunk;
+
+/*
+ * A run of lines in the new content sharing the same change, sorted by
+ * @begin and never overlapping.
+ */
+typedef struct
+{
+  guint begin;
+  guint len;
+  guint change;
+} IdeGitLineRange;
+
+IdeGitLineDiff      *ide_git_line_diff_new         (GBytes         *base);
+void                 ide_git_line_diff_free        (IdeGitLineDiff *self);
+gboolean             ide_git_line_diff_update      (IdeGitLineDiff *self,
+                                                    GBytes         *content);
+void                 ide_git_line_diff_set_hunks   (IdeGitLineDiff *self,
+                                                    GArray         *hunks);
+GArray              *ide_git_line_diff_get_hunks   (IdeGitLineDiff *self);
+GArray              *ide_git_line_diff_get_ranges  (IdeGitLineDiff *self);
+IdeBufferLineChange  ide_git_line_ranges_lookup    (GArray         *ranges,
+                                                    guint           line);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeGitLineDiff, ide_git_line_diff_free)
+
+G_END_DECLS
+
+#endif /* IDE_GIT_LINE_DIFF_H */
@@ -0,0 +1,388 @@
+/* ide-git-tree-snapshot.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-git-tree-snapshot"
+
+#include <dazzle.h>
+#include <string.h>
+
+#include "ide-git-tree-snapshot.h"
+
+/*
+ * IdeGitTreeSnapshot is an immutable view of the tree at HEAD, shared by
+ * everything that needs to find the committed version of a file.
+ *
+ * Directories are loaded from the repository the first time a path within
+ * them is requested, and then kept for the lifetime of the snapshot. So
+ * opening many buffers, or recalculating them all after a reload, only
+ * walks each tree once.
+ *
+ * The snapshot remembers which HEAD and which version of the index it was
+ * created for. IdeGitVcs uses ide_git_tree_snapshot_is_current() to avoid
+ * reloading when the index monitor fires but nothing actually changed.
+ *
+ * The snapshot may be used from any thread. Access to the repository is
+ * serialized by the snapshot. Blobs loaded from it may have their content
+ * read from any thread, but anything which reaches back into the
+ * repository, such as diffing them, must use a repository of its own.
+ */
+
+struct _IdeGitTreeSnapshot
+{
+  volatile gint   ref_count;
+
+  GMutex          mutex;
+
+  GgitRepository *repository;
+
+  /* The HEAD this snapshot was created for, or %NULL if unborn */
+  gchar          *head_name;
+  GgitOId        *head_oid;
+  GgitOId        *tree_oid;
+
+  /* Stamp of the index file, to detect staging */
+  guint64         index_mtime;
+  goffset         index_size;
+
+  /* Directory path ("" for the root) to GHashTable of Entry by name */
+  GHashTable     *dirs;
+};
+
+typedef struct
+{
+  GgitOId *oid;
+  guint    is_tree : 1;
+} Entry;
+
+DZL_DEFINE_COUNTER (snapshots, "IdeGitTreeSnapshot", "Instances", "Number of tree snapshots")
+DZL_DEFINE_COUNTER (loaded_dirs, "IdeGitTreeSnapshot", "Loaded Directories", "Number of trees loaded by snapshots")
+
+static void
+entry_free (gpointer data)
+{
+  Entry *entry = data;
+
+  g_clear_pointer (&entry->oid, ggit_oid_free);
+  g_slice_free (Entry, entry);
+}
+
+static void
+read_head (GgitRepository  *repository,
+           gchar          **head_name,
+           GgitOId        **head_oid,
+           GgitOId        **tree_oid)
+{
+  g_autoptr(GgitRef) head = NULL;
+  g_autoptr(GgitObject) commit = NULL;
+
+  g_assert (GGIT_IS_REPOSITORY (repository));
+
+  *head_name = NULL;
+  *head_oid = NULL;
+  *tree_oid = NULL;
+
+  if (!(head = ggit_repository_get_head (repository, NULL)))
+    return;
+
+  *head_name = g_strdup (ggit_ref_get_name (head));
+
+  if (!(*head_oid = ggit_ref_get_target (head)))
+    return;
+
+  if ((commit = ggit_repository_lookup (repository, *head_oid, GGIT_TYPE_COMMIT, NULL)))
+    *tree_oid = ggit_commit_get_tree_id (GGIT_COMMIT (commit));
+}
+
+static void
+read_index_stamp (GgitRepository *repository,
+                  guint64        *mtime,
+                  goffset        *size)
+{
+  g_autoptr(GFile) location = NULL;
+  g_autoptr(GFile) index_file = NULL;
+  g_autoptr(GFileInfo) info = NULL;
+
+  g_assert (GGIT_IS_REPOSITORY (repository));
+
+  *mtime = 0;
+  *size = 0;
+
+  location = ggit_repository_get_location (repository);
+  index_file = g_file_get_child (location, "index");
+  info = g_file_query_info (index_file,
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC","
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                            NULL,
+                            NULL);
+
+  if (info != NULL)
+    {
+      *mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+             + g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+      *size = g_file_info_get_size (info);
+    }
+}
+
+static gboolean
+oid_equal0 (GgitOId *a,
+            GgitOId *b)
+{
+  if (a == NULL || b == NULL)
+    return a == b;
+  return ggit_oid_equal (a, b);
+}
+
+/**
+ * ide_git_tree_snapshot_new:
+ * @repository: a #GgitRepository
+ *
+ * Creates a snapshot of the tree at the current HEAD of @repository. If
+ * HEAD cannot be resolved, such as in a new repository, the snapshot is
+ * empty.
+ *
+ * This may block while reading the repository and should be called from a
+ * worker thread.
+ *
+ * Returns: (transfer full): a new #IdeGitTreeSnapshot
+ */
+IdeGitTreeSnapshot *
+ide_git_tree_snapshot_new (GgitRepository *repository)
+{
+  IdeGitTreeSnapshot *self;
+
+  g_return_val_if_fail (GGIT_IS_REPOSITORY (repository), NULL);
+
+  self = g_slice_new0 (IdeGitTreeSnapshot);
+  self->ref_count = 1;
+  g_mutex_init (&self->mutex);
+  self->repository = g_object_ref (repository);
+  self->dirs = g_hash_table_new_full (g_str_hash,
+                                      g_str_equal,
+                                      g_free,
+                                      (GDestroyNotify)g_hash_table_unref);
+
+  read_head (repository, &self->head_name, &self->head_oid, &self->tree_oid);
+  read_index_stamp (repository, &self->index_mtime, &self->index_size);
+
+  DZL_COUNTER_INC (snapshots);
+
+  return self;
+}
+
+IdeGitTreeSnapshot *
+ide_git_tree_snapshot_ref (IdeGitTreeSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+ide_git_tree_snapshot_unref (IdeGitTreeSnapshot *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_clear_pointer (&self->dirs, g_hash_table_unref);
+      g_clear_pointer (&self->head_name, g_free);
+      g_clear_pointer (&self->head_oid, ggit_oid_free);
+      g_clear_pointer (&self->tree_oid, ggit_oid_free);
+      g_clear_object (&self->repository);
+      g_mutex_clear (&self->mutex);
+      g_slice_free (IdeGitTreeSnapshot, self);
+
+      DZL_COUNTER_DEC (snapshots);
+    }
+}
+
+/**
+ * ide_git_tree_snapshot_is_current:
+ * @self: an #IdeGitTreeSnapshot
+ *
+ * Checks whether HEAD or the index changed since @self was created. This
+ * is much cheaper than reloading the repository, but may still block and
+ * should be called from a worker thread.
+ *
+ * Returns: %TRUE if @self still reflects the repository.
+ */
+gboolean
+ide_git_tree_snapshot_is_current (IdeGitTreeSnapshot *self)
+{
+  g_autofree gchar *head_name = NULL;
+  GgitOId *head_oid = NULL;
+  GgitOId *tree_oid = NULL;
+  guint64 index_mtime;
+  goffset index_size;
+  gboolean ret;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  g_mutex_lock (&self->mutex);
+  read_head (self->repository, &head_name, &head_oid, &tree_oid);
+  read_index_stamp (self->repository, &index_mtime, &index_size);
+  g_mutex_unlock (&self->mutex);
+
+  ret = g_strcmp0 (head_name, self->head_name) == 0 &&
+        oid_equal0 (head_oid, self->head_oid) &&
+        index_mtime == self->index_mtime &&
+        index_size == self->index_size;
+
+  g_clear_pointer (&head_oid, ggit_oid_free);
+  g_clear_pointer (&tree_oid, ggit_oid_free);
+
+  return ret;
+}
+
+/* Must be called with the mutex held */
+static GHashTable *
+ide_git_tree_snapshot_get_dir (IdeGitTreeSnapshot *self,
+                               const gchar        *dir)
+{
+  g_autoptr(GgitObject) tree = NULL;
+  GHashTable *entries;
+  GgitOId *tree_oid = NULL;
+
+  g_assert (self != NULL);
+  g_assert (dir != NULL);
+
+  if ((entries = g_hash_table_lookup (self->dirs, dir)))
+    return entries;
+
+  if (*dir == '\0')
+    {
+      tree_oid = self->tree_oid;
+    }
+  else
+    {
+      const gchar *slash = strrchr (dir, '/');
+      g_autofree gchar *parent_dir = slash ? g_strndup (dir, slash - dir) : g_strdup ("");
+      const gchar *name = slash ? slash + 1 : dir;
+      GHashTable *parent = ide_git_tree_snapshot_get_dir (self, parent_dir);
+      Entry *entry = g_hash_table_lookup (parent, name);
+
+      if (entry != NULL && entry->is_tree)
+        tree_oid = entry->oid;
+    }
+
+  entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, entry_free);
+
+  /* Missing directories are cached too, as empty */
+  if (tree_oid != NULL &&
+      (tree = ggit_repository_lookup (self->repository, tree_oid, GGIT_TYPE_TREE, NULL)))
+    {
+      guint n_entries = ggit_tree_size (GGIT_TREE (tree));
+
+      for (guint i = 0; i < n_entries; i++)
+        {
+          GgitTreeEntry *tree_entry = ggit_tree_get (GGIT_TREE (tree), i);
+          Entry *entry;
+
+          if (tree_entry == NULL)
+            continue;
+
+          entry = g_slice_new0 (Entry);
+          entry->oid = ggit_tree_entry_get_id (tree_entry);
+          entry->is_tree = ggit_tree_entry_get_object_type (tree_entry) == GGIT_TYPE_TREE;
+
+          g_hash_table_insert (entries, g_strdup (ggit_tree_entry_get_name (tree_entry)), entry);
+
+          ggit_tree_entry_unref (tree_entry);
+        }
+
+      DZL_COUNTER_INC (loaded_dirs);
+    }
+
+  g_hash_table_insert (self->dirs, g_strdup (dir), entries);
+
+  return entries;
+}
+
+/**
+ * ide_git_tree_snapshot_lookup:
+ * @self: an #IdeGitTreeSnapshot
+ * @path: a path relative to the working directory
+ *
+ * Looks up the blob for @path in the tree at HEAD.
+ *
+ * Returns: (transfer full) (nullable): the #GgitOId of the blob, or %NULL
+ *   if @path is not a file within the tree.
+ */
+GgitOId *
+ide_git_tree_snapshot_lookup (IdeGitTreeSnapshot *self,
+                              const gchar        *path)
+{
+  g_autofree gchar *dir = NULL;
+  const gchar *slash;
+  const gchar *name;
+  GHashTable *entries;
+  GgitOId *ret = NULL;
+  Entry *entry;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+
+  slash = strrchr (path, '/');
+  dir = slash ? g_strndup (path, slash - path) : g_strdup ("");
+  name = slash ? slash + 1 : path;
+
+  g_mutex_lock (&self->mutex);
+
+  entries = ide_git_tree_snapshot_get_dir (self, dir);
+  entry = g_hash_table_lookup (entries, name);
+
+  if (entry != NULL && !entry->is_tree)
+    ret = ggit_oid_copy (entry->oid);
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/**
+ * ide_git_tree_snapshot_load_blob:
+ * @self: an #IdeGitTreeSnapshot
+ * @oid: a #GgitOId from ide_git_tree_snapshot_lookup()
+ * @error: a location for a #GError, or %NULL
+ *
+ * Loads the blob for @oid from the repository.
+ *
+ * Returns: (transfer full): a #GgitBlob or %NULL and @error is set.
+ */
+GgitBlob *
+ide_git_tree_snapshot_load_blob (IdeGitTreeSnapshot  *self,
+                                 GgitOId             *oid,
+                                 GError             **error)
+{
+  GgitObject *ret;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (oid != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+  ret = ggit_repository_lookup (self->repository, oid, GGIT_TYPE_BLOB, error);
+  g_mutex_unlock (&self->mutex);
+
+  return (GgitBlob *)ret;
+}
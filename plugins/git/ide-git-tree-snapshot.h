@@ -0,0 +1,43 @@
+/* ide-git-tree-snapshot.h
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_GIT_TREE_SNAPSHOT_H
+#define IDE_GIT_TREE_SNAPSHOT_H
+
+#include <libgit2-glib/ggit.h>
+#include <ide.h>
+
+G_BEGIN_DECLS
+
+typedef struct _IdeGitTreeSnapshot IdeGitTreeSnapshot;
+
+IdeGitTreeSnapshot *ide_git_tree_snapshot_new        (GgitRepository      *repository);
+IdeGitTreeSnapshot *ide_git_tree_snapshot_ref        (IdeGitTreeSnapshot  *self);
+void                ide_git_tree_snapshot_unref      (IdeGitTreeSnapshot  *self);
+gboolean            ide_git_tree_snapshot_is_current (IdeGitTreeSnapshot  *self);
+GgitOId            *ide_git_tree_snapshot_lookup     (IdeGitTreeSnapshot  *self,
+                                                      const gchar         *path);
+GgitBlob           *ide_git_tree_snapshot_load_blob  (IdeGitTreeSnapshot  *self,
+                                                      GgitOId             *oid,
+                                                      GError             **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeGitTreeSnapshot, ide_git_tree_snapshot_unref)
+
+G_END_DECLS
+
+#endif /* IDE_GIT_TREE_SNAPSHOT_H */
@@ -23,6 +23,7 @@
 #include <libgit2-glib/ggit.h>
 
 #include "ide-git-buffer-change-monitor.h"
+#include "ide-git-tree-snapshot.h"
 #include "ide-git-vcs.h"
 #include "ide-git-vcs-config.h"
 
@@ -35,6 +36,9 @@ struct _IdeGitVcs
   GgitRepository *repository;
   GgitRepository *change_monitor_repository;
 
+  /* Tree at HEAD, shared by the change monitors */
+  IdeGitTreeSnapshot *snapshot;
+
   GFile          *working_directory;
   GFileMonitor   *monitor;
 
@@ -92,6 +96,22 @@ ide_git_vcs_get_repository (IdeGitVcs *self)
   return self->repository;
 }
 
+/**
+ * ide_git_vcs_get_snapshot:
+ *
+ * Retrieves the snapshot of the tree at HEAD. It is replaced when the
+ * repository is reloaded after HEAD or the index changed.
+ *
+ * Returns: (transfer none) (nullable): An #IdeGitTreeSnapshot.
+ */
+IdeGitTreeSnapshot *
+ide_git_vcs_get_snapshot (IdeGitVcs *self)
+{
+  g_return_val_if_fail (IDE_IS_GIT_VCS (self), NULL);
+
+  return self->snapshot;
+}
+
 static GFile *
 ide_git_vcs_get_working_directory (IdeVcs *vcs)
 {
@@ -349,6 +369,7 @@ ide_git_vcs_reload_worker (GTask        *task,
                            GCancellable *cancellable)
 {
   IdeGitVcs *self = source_object;
+  IdeGitTreeSnapshot *snapshot = task_data;
   g_autoptr(GgitRepository) repository1 = NULL;
   g_autoptr(GgitRepository) repository2 = NULL;
   GError *error = NULL;
@@ -359,6 +380,16 @@ ide_git_vcs_reload_worker (GTask        *task,
   g_assert (IDE_IS_GIT_VCS (self));
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
+  /*
+   * The index monitor fires for more than actual changes to the index. If
+   * neither HEAD nor the index changed, there is nothing to reload.
+   */
+  if (snapshot != NULL && ide_git_tree_snapshot_is_current (snapshot))
+    {
+      g_task_return_pointer (task, NULL, NULL);
+      IDE_EXIT;
+    }
+
   if (!(repository1 = ide_git_vcs_load (self, &error)) ||
       !(repository2 = ide_git_vcs_load (self, &error)))
     {
@@ -376,7 +407,11 @@ ide_git_vcs_reload_worker (GTask        *task,
       IDE_EXIT;
     }
 
-  g_task_return_boolean (task, TRUE);
+  g_task_return_pointer (task,
+                         ide_git_tree_snapshot_new (repository2),
+                         (GDestroyNotify)ide_git_tree_snapshot_unref);
+
+  IDE_EXIT;
 }
 
 static void
@@ -393,6 +428,12 @@ ide_git_vcs_reload_async (IdeGitVcs           *self,
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   task = g_task_new (self, cancellable, callback, user_data);
+
+  if (self->snapshot != NULL)
+    g_task_set_task_data (task,
+                          ide_git_tree_snapshot_ref (self->snapshot),
+                          (GDestroyNotify)ide_git_tree_snapshot_unref);
+
   g_task_run_in_thread (task, ide_git_vcs_reload_worker);
 
   IDE_EXIT;
@@ -404,7 +445,8 @@ ide_git_vcs_reload_finish (IdeGitVcs     *self,
                            GError       **error)
 {
   GTask *task = (GTask *)result;
-  gboolean ret;
+  IdeGitTreeSnapshot *snapshot;
+  GError *local_error = NULL;
 
   IDE_ENTRY;
 
@@ -412,15 +454,25 @@ ide_git_vcs_reload_finish (IdeGitVcs     *self,
 
   self->reloading = FALSE;
 
-  ret = g_task_propagate_boolean (task, error);
+  snapshot = g_task_propagate_pointer (task, &local_error);
+
+  if (local_error != NULL)
+    {
+      g_propagate_error (error, local_error);
+      IDE_RETURN (FALSE);
+    }
 
-  if (ret)
+  /* A NULL snapshot means nothing changed */
+  if (snapshot != NULL)
     {
+      g_clear_pointer (&self->snapshot, ide_git_tree_snapshot_unref);
+      self->snapshot = snapshot;
+
       g_signal_emit (self, signals [RELOADED], 0, self->change_monitor_repository);
       ide_vcs_emit_changed (IDE_VCS (self));
     }
 
-  IDE_RETURN (ret);
+  IDE_RETURN (TRUE);
 }
 
 static gboolean
@@ -500,6 +552,7 @@ ide_git_vcs_dispose (GObject *object)
       g_clear_object (&self->monitor);
     }
 
+  g_clear_pointer (&self->snapshot, ide_git_tree_snapshot_unref);
   g_clear_object (&self->change_monitor_repository);
   g_clear_object (&self->repository);
   g_clear_object (&self->working_directory);
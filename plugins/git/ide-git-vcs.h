@@ -22,13 +22,16 @@
 #include <libgit2-glib/ggit.h>
 #include <ide.h>
 
+#include "ide-git-tree-snapshot.h"
+
 G_BEGIN_DECLS
 
 #define IDE_TYPE_GIT_VCS (ide_git_vcs_get_type())
 
 G_DECLARE_FINAL_TYPE (IdeGitVcs, ide_git_vcs, IDE, GIT_VCS, IdeObject)
 
-GgitRepository *ide_git_vcs_get_repository (IdeGitVcs *self);
+GgitRepository     *ide_git_vcs_get_repository (IdeGitVcs *self);
+IdeGitTreeSnapshot *ide_git_vcs_get_snapshot   (IdeGitVcs *self);
 
 G_END_DECLS
 
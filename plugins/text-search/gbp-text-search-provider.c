@@ -0,0 +1,325 @@
+/* gbp-text-search-provider.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "gbp-text-search-provider"
+
+#include <string.h>
+
+#include "buildsystem/ide-build-utils.h"
+
+#include "gbp-text-search-provider.h"
+#include "gbp-text-search-result.h"
+
+/*
+ * Searches the contents of project files. Plain queries are matched
+ * literally and case-insensitively, while queries of the form /pattern/
+ * are treated as a regular expression. In both cases the content index
+ * is used to narrow the set of files we need to open.
+ */
+
+#define MIN_QUERY_LEN     3
+/* Like grep -I, a NUL byte within this prefix marks a file as binary */
+#define BINARY_SNIFF_SIZE 8192
+
+struct _GbpTextSearchProvider
+{
+  IdeObject parent_instance;
+};
+
+typedef struct
+{
+  GFile     *workdir;
+  GPtrArray *files;
+  GRegex    *regex;
+  guint      max_results;
+} Search;
+
+typedef struct
+{
+  gchar *path;
+  gchar *text;
+  guint  line;
+  guint  line_offset;
+} Match;
+
+static void search_provider_iface_init (IdeSearchProviderInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GbpTextSearchProvider, gbp_text_search_provider, IDE_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (IDE_TYPE_SEARCH_PROVIDER, search_provider_iface_init))
+
+static void
+search_free (gpointer data)
+{
+  Search *search = data;
+
+  g_clear_object (&search->workdir);
+  g_clear_pointer (&search->files, g_ptr_array_unref);
+  g_clear_pointer (&search->regex, g_regex_unref);
+  g_slice_free (Search, search);
+}
+
+static void
+match_clear (gpointer data)
+{
+  Match *match = data;
+
+  g_clear_pointer (&match->path, g_free);
+  g_clear_pointer (&match->text, g_free);
+}
+
+/*
+ * Picks the longest of the literals that any match of @pattern must
+ * contain, so that it can be used to query the content index. The
+ * content index matches files containing any of the literals given to
+ * it, so only one of them can narrow the search.
+ */
+static gchar *
+get_required_literal (const gchar        *pattern,
+                      GRegexCompileFlags  flags)
+{
+  g_auto(GStrv) literals = NULL;
+  const gchar *best = NULL;
+
+  g_assert (pattern != NULL);
+
+  if (NULL == (literals = ide_build_utils_get_required_literals (pattern, flags)))
+    return NULL;
+
+  for (guint i = 0; literals[i] != NULL; i++)
+    {
+      if (best == NULL || strlen (literals[i]) > strlen (best))
+        best = literals[i];
+    }
+
+  return g_strdup (best);
+}
+
+static void
+gbp_text_search_provider_search_file (Search       *search,
+                                      GFile        *file,
+                                      GArray       *matches,
+                                      GCancellable *cancellable)
+{
+  g_autofree gchar *contents = NULL;
+  g_autofree gchar *path = NULL;
+  IdeLineReader reader;
+  gchar *line;
+  gsize len = 0;
+  guint lineno = 0;
+
+  g_assert (search != NULL);
+  g_assert (G_IS_FILE (file));
+  g_assert (matches != NULL);
+
+  if (!g_file_load_contents (file, cancellable, &contents, &len, NULL, NULL))
+    return;
+
+  if (memchr (contents, '\0', MIN (len, BINARY_SNIFF_SIZE)) != NULL ||
+      !g_utf8_validate (contents, len, NULL))
+    return;
+
+  if (NULL == (path = g_file_get_relative_path (search->workdir, file)))
+    return;
+
+  ide_line_reader_init (&reader, contents, len);
+  while (NULL != (line = ide_line_reader_next (&reader, &len)))
+    {
+      g_autoptr(GMatchInfo) match_info = NULL;
+      gint begin;
+      gint end;
+
+      line[len] = '\0';
+
+      if (g_regex_match (search->regex, line, 0, &match_info) &&
+          g_match_info_fetch_pos (match_info, 0, &begin, &end))
+        {
+          Match match;
+
+          match.path = g_strdup (path);
+          match.text = g_strndup (line, len);
+          match.line = lineno;
+          match.line_offset = g_utf8_pointer_to_offset (line, line + begin);
+
+          g_array_append_val (matches, match);
+
+          if (matches->len >= search->max_results)
+            return;
+        }
+
+      lineno++;
+    }
+}
+
+static void
+gbp_text_search_provider_search_worker (GTask        *task,
+                                        gpointer      source_object,
+                                        gpointer      task_data,
+                                        GCancellable *cancellable)
+{
+  Search *search = task_data;
+  g_autoptr(GArray) matches = NULL;
+  g_autoptr(GTimer) timer = g_timer_new ();
+
+  g_assert (G_IS_TASK (task));
+  g_assert (GBP_IS_TEXT_SEARCH_PROVIDER (source_object));
+  g_assert (search != NULL);
+  g_assert (search->files != NULL);
+
+  matches = g_array_new (FALSE, FALSE, sizeof (Match));
+  g_array_set_clear_func (matches, match_clear);
+
+  for (guint i = 0; i < search->files->len; i++)
+    {
+      GFile *file = g_ptr_array_index (search->files, i);
+
+      if (g_task_return_error_if_cancelled (task))
+        return;
+
+      gbp_text_search_provider_search_file (search, file, matches, cancellable);
+
+      if (matches->len >= search->max_results)
+        break;
+    }
+
+  g_debug ("Found %u matches in %u candidate files in %0.4lf seconds",
+           matches->len, search->files->len, g_timer_elapsed (timer, NULL));
+
+  g_task_return_pointer (task, g_steal_pointer (&matches), (GDestroyNotify)g_array_unref);
+}
+
+static void
+gbp_text_search_provider_search_async (IdeSearchProvider   *provider,
+                                       const gchar         *search_terms,
+                                       guint                max_results,
+                                       GCancellable        *cancellable,
+                                       GAsyncReadyCallback  callback,
+                                       gpointer             user_data)
+{
+  GbpTextSearchProvider *self = (GbpTextSearchProvider *)provider;
+  g_autoptr(GTask) task = NULL;
+  g_autoptr(GRegex) regex = NULL;
+  g_autofree gchar *pattern = NULL;
+  g_autofree gchar *literal = NULL;
+  const gchar *literals[2] = { NULL };
+  IdeContentIndex *index;
+  IdeContext *context;
+  GRegexCompileFlags flags = G_REGEX_OPTIMIZE;
+  Search *search;
+  gsize len;
+
+  g_assert (GBP_IS_TEXT_SEARCH_PROVIDER (self));
+  g_assert (search_terms != NULL);
+  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, gbp_text_search_provider_search_async);
+  g_task_set_priority (task, G_PRIORITY_LOW);
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  index = ide_context_get_content_index (context);
+
+  if (!ide_content_index_get_loaded (index))
+    {
+      /* Nothing to search until the index is ready */
+      ide_content_index_load_async (index, NULL, NULL, NULL);
+      g_task_return_pointer (task, g_array_new (FALSE, FALSE, sizeof (Match)), (GDestroyNotify)g_array_unref);
+      return;
+    }
+
+  len = strlen (search_terms);
+
+  if (len > 2 && search_terms[0] == '/' && search_terms[len - 1] == '/')
+    {
+      pattern = g_strndup (search_terms + 1, len - 2);
+      literal = get_required_literal (pattern, flags);
+    }
+  else if (len >= MIN_QUERY_LEN)
+    {
+      pattern = g_regex_escape_string (search_terms, len);
+      literal = g_strdup (search_terms);
+      flags |= G_REGEX_CASELESS;
+    }
+
+  /* Incomplete expressions are common while typing, so they are not an error */
+  if (pattern == NULL || NULL == (regex = g_regex_new (pattern, flags, 0, NULL)))
+    {
+      g_task_return_pointer (task, g_array_new (FALSE, FALSE, sizeof (Match)), (GDestroyNotify)g_array_unref);
+      return;
+    }
+
+  /* Without a literal to look for, every file is a candidate */
+  literals[0] = literal ? literal : "";
+
+  search = g_slice_new0 (Search);
+  search->workdir = g_object_ref (ide_vcs_get_working_directory (ide_context_get_vcs (context)));
+  search->files = ide_content_index_find_candidates (index, literals);
+  search->regex = g_steal_pointer (&regex);
+  search->max_results = max_results;
+
+  g_task_set_task_data (task, search, search_free);
+  g_task_run_in_thread (task, gbp_text_search_provider_search_worker);
+}
+
+static GPtrArray *
+gbp_text_search_provider_search_finish (IdeSearchProvider  *provider,
+                                        GAsyncResult       *result,
+                                        GError            **error)
+{
+  g_autoptr(GArray) matches = NULL;
+  IdeContext *context;
+  GPtrArray *ret;
+
+  g_assert (GBP_IS_TEXT_SEARCH_PROVIDER (provider));
+  g_assert (G_IS_TASK (result));
+
+  if (NULL == (matches = g_task_propagate_pointer (G_TASK (result), error)))
+    return NULL;
+
+  context = ide_object_get_context (IDE_OBJECT (provider));
+  ret = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint i = 0; i < matches->len; i++)
+    {
+      const Match *match = &g_array_index (matches, Match, i);
+
+      g_ptr_array_add (ret, gbp_text_search_result_new (context,
+                                                        match->path,
+                                                        match->line,
+                                                        match->line_offset,
+                                                        match->text));
+    }
+
+  return ret;
+}
+
+static void
+gbp_text_search_provider_class_init (GbpTextSearchProviderClass *klass)
+{
+}
+
+static void
+gbp_text_search_provider_init (GbpTextSearchProvider *self)
+{
+}
+
+static void
+search_provider_iface_init (IdeSearchProviderInterface *iface)
+{
+  iface->search_async = gbp_text_search_provider_search_async;
+  iface->search_finish = gbp_text_search_provider_search_finish;
+}
@@ -0,0 +1,128 @@
+/* gbp-text-search-result.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "gbp-text-search-result"
+
+#include "gbp-text-search-result.h"
+
+struct _GbpTextSearchResult
+{
+  IdeSearchResult  parent_instance;
+
+  IdeContext      *context;
+  gchar           *path;
+  guint            line;
+  guint            line_offset;
+};
+
+G_DEFINE_TYPE (GbpTextSearchResult, gbp_text_search_result, IDE_TYPE_SEARCH_RESULT)
+
+static IdeSourceLocation *
+gbp_text_search_result_get_source_location (IdeSearchResult *result)
+{
+  GbpTextSearchResult *self = (GbpTextSearchResult *)result;
+  g_autoptr(GFile) file = NULL;
+  g_autoptr(IdeFile) ifile = NULL;
+  IdeVcs *vcs;
+  GFile *workdir;
+
+  g_return_val_if_fail (GBP_IS_TEXT_SEARCH_RESULT (self), NULL);
+
+  if (self->context == NULL)
+    return NULL;
+
+  vcs = ide_context_get_vcs (self->context);
+  workdir = ide_vcs_get_working_directory (vcs);
+  file = g_file_get_child (workdir, self->path);
+  ifile = ide_file_new (self->context, file);
+
+  return ide_source_location_new (ifile, self->line, self->line_offset, 0);
+}
+
+static void
+gbp_text_search_result_finalize (GObject *object)
+{
+  GbpTextSearchResult *self = (GbpTextSearchResult *)object;
+
+  ide_clear_weak_pointer (&self->context);
+  g_clear_pointer (&self->path, g_free);
+
+  G_OBJECT_CLASS (gbp_text_search_result_parent_class)->finalize (object);
+}
+
+static void
+gbp_text_search_result_class_init (GbpTextSearchResultClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  IdeSearchResultClass *result_class = IDE_SEARCH_RESULT_CLASS (klass);
+
+  object_class->finalize = gbp_text_search_result_finalize;
+
+  result_class->get_source_location = gbp_text_search_result_get_source_location;
+}
+
+static void
+gbp_text_search_result_init (GbpTextSearchResult *self)
+{
+}
+
+/**
+ * gbp_text_search_result_new:
+ * @context: An #IdeContext
+ * @path: the path of the file relative to the working directory
+ * @line: the line number of the match, starting from zero
+ * @line_offset: the character offset of the match within @line
+ * @text: the contents of @line
+ *
+ * Creates a new search result for a match within a project file.
+ *
+ * Returns: (transfer full): A #GbpTextSearchResult
+ */
+GbpTextSearchResult *
+gbp_text_search_result_new (IdeContext  *context,
+                            const gchar *path,
+                            guint        line,
+                            guint        line_offset,
+                            const gchar *text)
+{
+  GbpTextSearchResult *self;
+  g_autofree gchar *stripped = NULL;
+  g_autofree gchar *title = NULL;
+  g_autofree gchar *subtitle = NULL;
+
+  g_return_val_if_fail (IDE_IS_CONTEXT (context), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail (text != NULL, NULL);
+
+  stripped = g_strstrip (g_strdup (text));
+  title = g_markup_escape_text (stripped, -1);
+  subtitle = g_strdup_printf ("%s:%u", path, line + 1);
+
+  self = g_object_new (GBP_TYPE_TEXT_SEARCH_RESULT,
+                       "icon-name", "edit-find-symbolic",
+                       "title", title,
+                       "subtitle", subtitle,
+                       NULL);
+
+  ide_set_weak_pointer (&self->context, context);
+  self->path = g_strdup (path);
+  self->line = line;
+  self->line_offset = line_offset;
+
+  return self;
+}
@@ -20,8 +20,6 @@
 
 #include "gbp-todo-item.h"
 
-#define MAX_TODO_LINES 5
-
 struct _GbpTodoItem
 {
   GObject      parent_instance;
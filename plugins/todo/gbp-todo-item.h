@@ -24,6 +24,8 @@ G_BEGIN_DECLS
 
 #define GBP_TYPE_TODO_ITEM (gbp_todo_item_get_type())
 
+#define MAX_TODO_LINES 5
+
 G_DECLARE_FINAL_TYPE (GbpTodoItem, gbp_todo_item, GBP, TODO_ITEM, GObject)
 
 GbpTodoItem *gbp_todo_item_new        (GBytes       *bytes);
@@ -43,20 +43,20 @@ struct _GbpTodoModel {
 typedef struct
 {
   GbpTodoModel *self;
+  GPtrArray    *paths;
   GPtrArray    *items;
 } ResultInfo;
 
-G_DEFINE_TYPE (GbpTodoModel, gbp_todo_model, GTK_TYPE_LIST_STORE)
+typedef struct
+{
+  GFile     *workdir;
+  GPtrArray *files;
+} MineData;
 
-static GRegex *line1;
-static GRegex *line2;
+G_DEFINE_TYPE (GbpTodoModel, gbp_todo_model, GTK_TYPE_LIST_STORE)
 
-static const gchar *exclude_dirs[] = {
-  ".bzr",
-  ".flatpak-builder",
-  ".git",
-  ".svn",
-};
+/* Like grep -I, a NUL byte within this prefix marks a file as binary */
+#define BINARY_SNIFF_SIZE 8192
 
 static const gchar *exclude_files[] = {
   "*.m4",
@@ -68,6 +68,7 @@ static const gchar *keywords[] = {
   "XXX",
   "TODO",
   "HACK",
+  NULL
 };
 
 static void
@@ -76,10 +77,21 @@ result_info_free (gpointer data)
   ResultInfo *info = data;
 
   g_clear_object (&info->self);
+  g_clear_pointer (&info->paths, g_ptr_array_unref);
   g_clear_pointer (&info->items, g_ptr_array_unref);
   g_slice_free (ResultInfo, info);
 }
 
+static void
+mine_data_free (gpointer data)
+{
+  MineData *md = data;
+
+  g_clear_object (&md->workdir);
+  g_clear_pointer (&md->files, g_ptr_array_unref);
+  g_slice_free (MineData, md);
+}
+
 static void
 gbp_todo_model_clear (GbpTodoModel *self,
                       const gchar  *path)
@@ -139,16 +151,22 @@ static gboolean
 gbp_todo_model_merge_results (gpointer user_data)
 {
   ResultInfo *info = user_data;
-  const gchar *last_path = NULL;
-  gboolean needs_clear = FALSE;
 
   g_assert (info != NULL);
   g_assert (GBP_IS_TODO_MODEL (info->self));
+  g_assert (info->paths != NULL);
   g_assert (info->items != NULL);
 
-  /* Try to avoid clearing on the initial build of the model */
+  /*
+   * Remove stale items for every file we scanned, not just the ones that
+   * still have items, so that resolving the last TODO in a file drops it
+   * from the panel. Avoid this on the initial build of the model.
+   */
   if (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (info->self), NULL) > 0)
-    needs_clear = TRUE;
+    {
+      for (guint i = 0; i < info->paths->len; i++)
+        gbp_todo_model_clear (info->self, g_ptr_array_index (info->paths, i));
+    }
 
   /* Walk backwards to preserve ordering, as merging will always prepend
    * the item to the store.
@@ -156,14 +174,8 @@ gbp_todo_model_merge_results (gpointer user_data)
   for (guint i = info->items->len; i > 0; i--)
     {
       GbpTodoItem *item = g_ptr_array_index (info->items, i - 1);
-      const gchar *path = gbp_todo_item_get_path (item);
-
-      if (needs_clear && (g_strcmp0 (path, last_path) != 0))
-        gbp_todo_model_clear (info->self, path);
 
       gbp_todo_model_merge (info->self, item);
-
-      last_path = path;
     }
 
   return G_SOURCE_REMOVE;
@@ -172,15 +184,6 @@ gbp_todo_model_merge_results (gpointer user_data)
 static void
 gbp_todo_model_class_init (GbpTodoModelClass *klass)
 {
-  g_autoptr(GError) error = NULL;
-
-  line1 = g_regex_new ("(.*):(\\d+):(.*)", 0, 0, &error);
-  g_assert_no_error (error);
-  g_assert (line1 != NULL);
-
-  line2 = g_regex_new ("(.*)-(\\d+)-(.*)", 0, 0, &error);
-  g_assert_no_error (error);
-  g_assert (line2 != NULL);
 }
 
 static void
@@ -193,6 +196,20 @@ gbp_todo_model_init (GbpTodoModel *self)
                                    column_types);
 }
 
+/**
+ * gbp_todo_model_get_keywords:
+ *
+ * Gets the keywords that mark a line as a TODO item, suitable for
+ * use with ide_content_index_find_candidates().
+ *
+ * Returns: (transfer none) (array zero-terminated=1): the keywords
+ */
+const gchar * const *
+gbp_todo_model_get_keywords (void)
+{
+  return keywords;
+}
+
 /**
  * gbp_todo_model_new:
  *
@@ -208,207 +225,165 @@ gbp_todo_model_new (void)
   return g_object_new (GBP_TYPE_TODO_MODEL, NULL);
 }
 
-static void
-gbp_todo_model_mine_worker (GTask        *task,
-                            gpointer      source_object,
-                            gpointer      task_data,
-                            GCancellable *cancellable)
+static gboolean
+line_has_keyword (const gchar *line)
 {
-  g_autoptr(IdeSubprocessLauncher) launcher = NULL;
-  g_autoptr(IdeSubprocess) subprocess = NULL;
-  g_autoptr(GError) error = NULL;
-  g_autoptr(GPtrArray) items = NULL;
-  g_autoptr(GbpTodoItem) item = NULL;
-  g_autoptr(GBytes) bytes = NULL;
-  g_autoptr(GTimer) timer = g_timer_new ();
-  g_autofree gchar *path = NULL;
-  IdeLineReader reader;
-  ResultInfo *info;
-  gchar *stdoutstr = NULL;
-  GFile *file = task_data;
-  gchar *line;
-  gsize stdoutstr_len;
-  gsize pathlen;
-  gsize len;
+  g_assert (line != NULL);
 
-  g_assert (G_IS_TASK (task));
-  g_assert (GBP_IS_TODO_MODEL (source_object));
-  g_assert (G_IS_FILE (file));
-  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+  /* Matches the "KEYWORD(:| )" expression we used to pass to grep */
+  for (guint i = 0; keywords[i] != NULL; i++)
+    {
+      const gchar *keyword = keywords[i];
+      gsize keyword_len = strlen (keyword);
+      const gchar *found = line;
 
-  launcher = ide_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE);
+      while (NULL != (found = strstr (found, keyword)))
+        {
+          found += keyword_len;
 
-  ide_subprocess_launcher_push_argv (launcher, "grep");
-  ide_subprocess_launcher_push_argv (launcher, "-A");
-  ide_subprocess_launcher_push_argv (launcher, "5");
-  ide_subprocess_launcher_push_argv (launcher, "-I");
-  ide_subprocess_launcher_push_argv (launcher, "-H");
-  ide_subprocess_launcher_push_argv (launcher, "-n");
-  ide_subprocess_launcher_push_argv (launcher, "-r");
-  ide_subprocess_launcher_push_argv (launcher, "-E");
+          if (*found == ':' || *found == ' ')
+            return TRUE;
+        }
+    }
 
-  for (guint i = 0; i < G_N_ELEMENTS (exclude_files); i++)
-    {
-      const gchar *exclude_file = exclude_files[i];
-      g_autofree gchar *arg = NULL;
+  return FALSE;
+}
 
-      arg = g_strdup_printf ("--exclude=%s", exclude_file);
-      ide_subprocess_launcher_push_argv (launcher, arg);
-    }
+static gboolean
+is_excluded (const gchar *path)
+{
+  g_autofree gchar *name = g_path_get_basename (path);
 
-  for (guint i = 0; i < G_N_ELEMENTS (exclude_dirs); i++)
+  for (guint i = 0; i < G_N_ELEMENTS (exclude_files); i++)
     {
-      const gchar *exclude_dir = exclude_dirs[i];
-      g_autofree gchar *arg = NULL;
-
-      arg = g_strdup_printf ("--exclude-dir=%s", exclude_dir);
-      ide_subprocess_launcher_push_argv (launcher, arg);
+      if (g_pattern_match_simple (exclude_files[i], name))
+        return TRUE;
     }
 
-  for (guint i = 0; i < G_N_ELEMENTS (keywords); i++)
-    {
-      const gchar *keyword = keywords[i];
-      g_autofree gchar *arg = NULL;
+  return FALSE;
+}
 
-      arg = g_strdup_printf ("%s(:| )", keyword);
-      ide_subprocess_launcher_push_argv (launcher, "-e");
-      ide_subprocess_launcher_push_argv (launcher, arg);
-    }
+static void
+gbp_todo_model_mine_file (GFile        *file,
+                          const gchar  *path,
+                          GPtrArray    *items,
+                          GCancellable *cancellable)
+{
+  g_autoptr(GbpTodoItem) item = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autofree gchar *contents = NULL;
+  IdeLineReader reader;
+  gchar *buffer;
+  gchar *line;
+  gsize pathlen;
+  gsize len = 0;
+  guint lineno = 0;
 
-  /* Let grep know where to scan */
-  path = g_file_get_path (file);
-  pathlen = strlen (path);
-  ide_subprocess_launcher_push_argv (launcher, path);
+  g_assert (G_IS_FILE (file));
+  g_assert (path != NULL);
+  g_assert (items != NULL);
 
-  /* Spawn our grep process */
-  if (NULL == (subprocess = ide_subprocess_launcher_spawn (launcher, cancellable, &error)))
-    {
-      g_task_return_error (task, g_steal_pointer (&error));
-      return;
-    }
+  if (!g_file_load_contents (file, cancellable, &contents, &len, NULL, NULL))
+    return;
 
-  /* Read all of the output into a giant string */
-  if (!ide_subprocess_communicate_utf8 (subprocess, NULL, NULL, &stdoutstr, NULL, &error))
-    {
-      g_task_return_error (task, g_steal_pointer (&error));
-      return;
-    }
+  if (memchr (contents, '\0', MIN (len, BINARY_SNIFF_SIZE)) != NULL)
+    return;
+
+  /* Most files have nothing to report, so avoid any further work */
+  if (!line_has_keyword (contents))
+    return;
 
   /*
    * To avoid lots of string allocations in the model, we instead
-   * store GObjects which contain a reference to the whole buffer
-   * (the GBytes) and raw pointers into that data. We'll create
-   * the buffer up front, but still mutate the contents as we
-   * walk through it.
+   * store GObjects which contain a reference to a shared buffer
+   * (the GBytes) and raw pointers into that data. The buffer holds
+   * the path followed by the file contents, which we mutate in place
+   * so that each line may be used as a C string.
    */
-  stdoutstr_len = strlen (stdoutstr);
-  bytes = g_bytes_new_take (stdoutstr, stdoutstr_len);
-
-  items = g_ptr_array_new_with_free_func (g_object_unref);
+  pathlen = strlen (path);
+  buffer = g_malloc (pathlen + 1 + len + 1);
+  memcpy (buffer, path, pathlen + 1);
+  memcpy (buffer + pathlen + 1, contents, len + 1);
+  bytes = g_bytes_new_take (buffer, pathlen + 1 + len + 1);
 
-  /*
-   * Process the STDOUT string iteratively, while trying to be tidy
-   * with additional allocations. If we overwrite the trailing \n to
-   * a \0, we can use it as a C string.
-   */
-  ide_line_reader_init (&reader, stdoutstr, stdoutstr_len);
+  ide_line_reader_init (&reader, buffer + pathlen + 1, len);
   while (NULL != (line = ide_line_reader_next (&reader, &len)))
     {
-      g_autoptr(GMatchInfo) match_info1 = NULL;
-      g_autoptr(GMatchInfo) match_info2 = NULL;
-
       line[len] = '\0';
+      lineno++;
 
-      /* We just finished a group of lines, flush this item
-       * to the list of items and get started processing the
-       * next result.
-       */
-      if (g_str_has_prefix (line, "--"))
+      if (line_has_keyword (line))
         {
           if (item != NULL)
             g_ptr_array_add (items, g_steal_pointer (&item));
+
+          item = gbp_todo_item_new (bytes);
+          gbp_todo_item_set_path (item, buffer);
+          gbp_todo_item_set_lineno (item, lineno);
+          gbp_todo_item_add_line (item, line);
           continue;
         }
 
-      if (ide_str_empty0 (line))
-        continue;
-
-      /* Try to match the first line */
-      if (item == NULL)
+      if (item != NULL)
         {
-          if (g_regex_match_full (line1, line, len, 0, 0, &match_info1, NULL))
-            {
-              gint begin;
-              gint end;
-
-              item = gbp_todo_item_new (bytes);
-
-              /* Get the path */
-              if (g_match_info_fetch_pos (match_info1, 1, &begin, &end))
-                {
-                  const gchar *pathstr;
-
-                  line[end] = '\0';
-                  pathstr = &line[begin];
-
-                  /*
-                   * Try to skip past the prefix of the working directory
-                   * of the project.
-                   */
-
-                  if (strncmp (pathstr, path, pathlen) == 0)
-                    {
-                      pathstr += pathlen;
-
-                      while (*pathstr == G_DIR_SEPARATOR)
-                        pathstr++;
-                    }
-
-                  gbp_todo_item_set_path (item, pathstr);
-                }
-
-              /* Get the line number */
-              if (g_match_info_fetch_pos (match_info1, 2, &begin, &end))
-                {
-                  gint64 lineno;
-
-                  line[end] = '\0';
-                  lineno = g_ascii_strtoll (&line[begin], NULL, 10);
-                  gbp_todo_item_set_lineno (item, lineno);
-                }
-
-              /* Get the message */
-              if (g_match_info_fetch_pos (match_info1, 3, &begin, &end))
-                {
-                  line[end] = '\0';
-                  gbp_todo_item_add_line (item, &line[begin]);
-                }
-            }
+          gbp_todo_item_add_line (item, line);
 
-          continue;
+          if (gbp_todo_item_get_line (item, MAX_TODO_LINES - 1) != NULL)
+            g_ptr_array_add (items, g_steal_pointer (&item));
         }
+    }
 
-      g_assert (item != NULL);
+  if (item != NULL)
+    g_ptr_array_add (items, g_steal_pointer (&item));
+}
 
-      if (g_regex_match_full (line2, line, len, 0, 0, &match_info2, NULL))
-        {
-          gint begin;
-          gint end;
+static void
+gbp_todo_model_mine_worker (GTask        *task,
+                            gpointer      source_object,
+                            gpointer      task_data,
+                            GCancellable *cancellable)
+{
+  g_autoptr(GPtrArray) paths = NULL;
+  g_autoptr(GPtrArray) items = NULL;
+  g_autoptr(GTimer) timer = g_timer_new ();
+  MineData *md = task_data;
+  ResultInfo *info;
 
-          /* Get the message */
-          if (g_match_info_fetch_pos (match_info2, 3, &begin, &end))
-            {
-              line[end] = '\0';
-              gbp_todo_item_add_line (item, &line[begin]);
-            }
-        }
+  g_assert (G_IS_TASK (task));
+  g_assert (GBP_IS_TODO_MODEL (source_object));
+  g_assert (md != NULL);
+  g_assert (G_IS_FILE (md->workdir));
+  g_assert (md->files != NULL);
+  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  paths = g_ptr_array_new_with_free_func (g_free);
+  items = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint i = 0; i < md->files->len; i++)
+    {
+      GFile *file = g_ptr_array_index (md->files, i);
+      g_autofree gchar *path = NULL;
+
+      if (g_task_return_error_if_cancelled (task))
+        return;
+
+      if (NULL == (path = g_file_get_relative_path (md->workdir, file)))
+        path = g_file_get_path (file);
+
+      if (path == NULL || is_excluded (path))
+        continue;
+
+      gbp_todo_model_mine_file (file, path, items, cancellable);
+
+      g_ptr_array_add (paths, g_steal_pointer (&path));
     }
 
-  g_debug ("Located %u TODO items in %0.4lf seconds",
-           items->len, g_timer_elapsed (timer, NULL));
+  g_debug ("Located %u TODO items in %u files in %0.4lf seconds",
+           items->len, md->files->len, g_timer_elapsed (timer, NULL));
 
   info = g_slice_new0 (ResultInfo);
   info->self = g_object_ref (source_object);
+  info->paths = g_steal_pointer (&paths);
   info->items = g_steal_pointer (&items);
 
   gdk_threads_add_idle_full (G_PRIORITY_LOW + 100,
@@ -421,49 +396,46 @@ gbp_todo_model_mine_worker (GTask        *task,
 /**
  * gbp_todo_model_mine_async:
  * @self: a #GbpTodoModel
- * @file: A #GFile to mine
+ * @workdir: the #GFile of the project working directory
+ * @files: (element-type GFile): the files to mine
  * @cancellable: (nullable): A #Gancellable or %NULL
  * @callback: (scope async) (closure user_data): An async callback
  * @user_data: user data for @callback
  *
- * Asynchronously mines @file.
+ * Asynchronously mines @files, replacing any previous items for them.
  *
- * If @file is a directory, it will be recursively scanned.  @callback
- * will be called after the operation is complete.  Call
+ * Paths of the resulting items are relative to @workdir. Callers
+ * mining a whole project are expected to narrow @files using the
+ * #IdeContentIndex rather than passing every file in the tree.
+ * @callback will be called after the operation is complete.  Call
  * gbp_todo_model_mine_finish() to get the result of this operation.
  *
- * If @file is not a native file (meaning it is accessable on the
- * normal, mounted, local file-system) this operation will fail.
- *
  * Since: 3.26
  */
 void
 gbp_todo_model_mine_async (GbpTodoModel        *self,
-                           GFile               *file,
+                           GFile               *workdir,
+                           GPtrArray           *files,
                            GCancellable        *cancellable,
                            GAsyncReadyCallback  callback,
                            gpointer             user_data)
 {
   g_autoptr(GTask) task = NULL;
+  MineData *md;
 
   g_return_if_fail (GBP_IS_TODO_MODEL (self));
-  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (G_IS_FILE (workdir));
+  g_return_if_fail (files != NULL);
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
+  md = g_slice_new0 (MineData);
+  md->workdir = g_object_ref (workdir);
+  md->files = g_ptr_array_ref (files);
+
   task = g_task_new (self, cancellable, callback, user_data);
   g_task_set_priority (task, G_PRIORITY_LOW + 100);
   g_task_set_source_tag (task, gbp_todo_model_mine_async);
-  g_task_set_task_data (task, g_object_ref (file), g_object_unref);
-
-  if (!g_file_is_native (file))
-    {
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               G_IO_ERROR_NOT_SUPPORTED,
-                               "Only local files are supported");
-      return;
-    }
-
+  g_task_set_task_data (task, md, mine_data_free);
   g_task_run_in_thread (task, gbp_todo_model_mine_worker);
 }
 
@@ -26,14 +26,16 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (GbpTodoModel, gbp_todo_model, GBP, TODO_MODEL, GtkListStore)
 
-GbpTodoModel *gbp_todo_model_new         (void);
-void          gbp_todo_model_mine_async  (GbpTodoModel         *self,
-                                          GFile                *file,
-                                          GCancellable         *cancellable,
-                                          GAsyncReadyCallback   callback,
-                                          gpointer              user_data);
-gboolean      gbp_todo_model_mine_finish (GbpTodoModel         *self,
-                                          GAsyncResult         *result,
-                                          GError              **error);
+const gchar * const *gbp_todo_model_get_keywords (void);
+GbpTodoModel        *gbp_todo_model_new          (void);
+void                 gbp_todo_model_mine_async   (GbpTodoModel         *self,
+                                                  GFile                *workdir,
+                                                  GPtrArray            *files,
+                                                  GCancellable         *cancellable,
+                                                  GAsyncReadyCallback   callback,
+                                                  gpointer              user_data);
+gboolean             gbp_todo_model_mine_finish  (GbpTodoModel         *self,
+                                                  GAsyncResult         *result,
+                                                  GError              **error);
 
 G_END_DECLS
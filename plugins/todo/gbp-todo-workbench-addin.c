@@ -53,18 +53,66 @@ gbp_todo_workbench_addin_buffer_saved (GbpTodoWorkbenchAddin *self,
                                        IdeBuffer             *buffer,
                                        IdeBufferManager      *bufmgr)
 {
+  g_autoptr(GPtrArray) files = NULL;
+  IdeContext *context;
   IdeFile *file;
-  GFile *gfile;
+  IdeVcs *vcs;
 
   g_assert (GBP_IS_TODO_WORKBENCH_ADDIN (self));
   g_assert (self->model != NULL);
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (IDE_IS_BUFFER_MANAGER (bufmgr));
 
+  context = ide_object_get_context (IDE_OBJECT (bufmgr));
+  vcs = ide_context_get_vcs (context);
   file = ide_buffer_get_file (buffer);
-  gfile = ide_file_get_file (file);
+
+  files = g_ptr_array_new_with_free_func (g_object_unref);
+  g_ptr_array_add (files, g_object_ref (ide_file_get_file (file)));
+
+  gbp_todo_model_mine_async (self->model,
+                             ide_vcs_get_working_directory (vcs),
+                             files,
+                             self->cancellable,
+                             gbp_todo_workbench_addin_mine_cb,
+                             g_object_ref (self));
+}
+
+static void
+gbp_todo_workbench_addin_index_loaded_cb (GObject      *object,
+                                          GAsyncResult *result,
+                                          gpointer      user_data)
+{
+  IdeContentIndex *index = (IdeContentIndex *)object;
+  g_autoptr(GbpTodoWorkbenchAddin) self = user_data;
+  g_autoptr(GPtrArray) files = NULL;
+  g_autoptr(GError) error = NULL;
+  IdeContext *context;
+  IdeVcs *vcs;
+
+  g_assert (IDE_IS_CONTENT_INDEX (index));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (GBP_IS_TODO_WORKBENCH_ADDIN (self));
+
+  if (!ide_content_index_load_finish (index, result, &error))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s", error->message);
+      return;
+    }
+
+  if (self->model == NULL)
+    return;
+
+  /* Only files containing one of the keywords need to be scanned */
+  files = ide_content_index_find_candidates (index, gbp_todo_model_get_keywords ());
+
+  context = ide_object_get_context (IDE_OBJECT (index));
+  vcs = ide_context_get_vcs (context);
+
   gbp_todo_model_mine_async (self->model,
-                             gfile,
+                             ide_vcs_get_working_directory (vcs),
+                             files,
                              self->cancellable,
                              gbp_todo_workbench_addin_mine_cb,
                              g_object_ref (self));
@@ -79,8 +127,6 @@ gbp_todo_workbench_addin_load (IdeWorkbenchAddin *addin,
   IdeBufferManager *bufmgr;
   IdePerspective *editor;
   IdeContext *context;
-  IdeVcs *vcs;
-  GFile *workdir;
 
   g_assert (GBP_IS_TODO_WORKBENCH_ADDIN (self));
   g_assert (IDE_IS_WORKBENCH (workbench));
@@ -88,8 +134,6 @@ gbp_todo_workbench_addin_load (IdeWorkbenchAddin *addin,
   self->cancellable = g_cancellable_new ();
 
   context = ide_workbench_get_context (workbench);
-  vcs = ide_context_get_vcs (context);
-  workdir = ide_vcs_get_working_directory (vcs);
   bufmgr = ide_context_get_buffer_manager (context);
   editor = ide_workbench_get_perspective_by_name (workbench, "editor");
   sidebar = ide_editor_perspective_get_sidebar (IDE_EDITOR_PERSPECTIVE (editor));
@@ -118,11 +162,10 @@ gbp_todo_workbench_addin_load (IdeWorkbenchAddin *addin,
                                   GTK_WIDGET (self->panel),
                                   200);
 
-  gbp_todo_model_mine_async (self->model,
-                             workdir,
-                             self->cancellable,
-                             gbp_todo_workbench_addin_mine_cb,
-                             g_object_ref (self));
+  ide_content_index_load_async (ide_context_get_content_index (context),
+                                self->cancellable,
+                                gbp_todo_workbench_addin_index_loaded_cb,
+                                g_object_ref (self));
 }
 
 static void
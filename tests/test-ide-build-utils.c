@@ -0,0 +1,267 @@
+/* test-ide-build-utils.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+#include <string.h>
+
+#include "buildsystem/ide-build-utils.h"
+
+/* The same regex used by the gcc plugin */
+#define GCC_ERROR_FORMAT                 \
+  "(?<filename>[a-zA-Z0-9\\-\\.\\/_]+):" \
+  "(?<line>\\d+):"                       \
+  "(?<column>\\d+): "                    \
+  "(?<level>[\\w\\s]+): "                \
+  "(?<message>.*)"
+
+#define N_LOG_LINES 100000
+#define N_REPLAYS   5
+
+static void
+assert_literals (const gchar        *regex,
+                 GRegexCompileFlags  flags,
+                 const gchar        *expected)
+{
+  g_auto(GStrv) literals = ide_build_utils_get_required_literals (regex, flags);
+  g_autofree gchar *joined = NULL;
+
+  if (literals != NULL)
+    joined = g_strjoinv ("|", literals);
+
+  g_assert_cmpstr (joined, ==, expected);
+}
+
+static void
+test_required_literals (void)
+{
+  assert_literals (GCC_ERROR_FORMAT, G_REGEX_CASELESS, ":|:|: |: ");
+  assert_literals ("(?<file>[^(]+)\\((?<line>\\d+)\\): (?<message>.*)", 0, "(|): ");
+  assert_literals ("ab?c", 0, "a|c");
+  assert_literals ("x{2,3}yz+w", 0, "yz|w");
+  assert_literals ("ab{0,3}c", 0, "a|c");
+  assert_literals ("ab{2}cd{1,}", 0, "a|c");
+  assert_literals ("[ab]]c", 0, "]c");
+  assert_literals ("[[:digit:]]+: error", 0, ": error");
+  assert_literals ("[^[:space:]]x", 0, "x");
+  assert_literals ("[[:alpha:]_]+: x", 0, ": x");
+  assert_literals ("[[.-.][=a=]]y", 0, "y");
+  assert_literals ("[[:digit:]", 0, NULL);
+  assert_literals ("\\d+\\s*", 0, NULL);
+
+  /* Anything not understood disables the prefilter */
+  assert_literals ("error|warning", 0, NULL);
+  assert_literals ("(?i)error", 0, NULL);
+  assert_literals ("\\x41", 0, NULL);
+  assert_literals ("ab\\x41cd", 0, NULL);
+  assert_literals ("\\p{L}+abc", 0, NULL);
+  assert_literals ("error", G_REGEX_EXTENDED, NULL);
+}
+
+static void
+test_contains_literals (void)
+{
+  g_auto(GStrv) literals = ide_build_utils_get_required_literals (GCC_ERROR_FORMAT, 0);
+  static const struct {
+    const gchar *line;
+    gboolean     caseless;
+    gboolean     expected;
+  } checks[] = {
+    { "../libide/ide.c:12:3: warning: unused variable", FALSE, TRUE },
+    { "[12/400] Compiling C object 'libide/ide.c.o'", FALSE, FALSE },
+    { "ide.c:1:2:error: missing space", FALSE, FALSE },
+    { "ninja: build stopped: subcommand failed.", FALSE, FALSE },
+    { "", FALSE, FALSE },
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS (checks); i++)
+    g_assert_cmpint (ide_build_utils_contains_literals (checks[i].line,
+                                                        strlen (checks[i].line),
+                                                        (const gchar * const *)literals,
+                                                        checks[i].caseless),
+                     ==,
+                     checks[i].expected);
+
+  g_clear_pointer (&literals, g_strfreev);
+  literals = ide_build_utils_get_required_literals ("Error: (?<message>.*)", G_REGEX_CASELESS);
+
+  g_assert_true (ide_build_utils_contains_literals ("foo ERROR: bar", 14, (const gchar * const *)literals, TRUE));
+  g_assert_false (ide_build_utils_contains_literals ("foo ERROR: bar", 14, (const gchar * const *)literals, FALSE));
+  g_assert_true (ide_build_utils_contains_literals ("anything", 8, NULL, FALSE));
+
+  /* A POSIX class must not leave its closing bracket as a literal */
+  g_clear_pointer (&literals, g_strfreev);
+  literals = ide_build_utils_get_required_literals ("(?<line>[[:digit:]]+): (?<message>.*)", 0);
+  g_assert_true (ide_build_utils_contains_literals ("12: oops", 8, (const gchar * const *)literals, FALSE));
+}
+
+static void
+test_has_color_codes (void)
+{
+  g_assert_false (ide_build_utils_has_color_codes ("plain text", 10));
+  g_assert_true (ide_build_utils_has_color_codes ("\033[1mbold", 8));
+  g_assert_true (ide_build_utils_has_color_codes ("\\e[1mbold", 9));
+  g_assert_false (ide_build_utils_has_color_codes ("C:\\path", 7));
+}
+
+/*
+ * Synthesizes output similar to a ninja build of a large C project, where
+ * most lines are progress and only a few are diagnostics.
+ */
+static GPtrArray *
+make_log (void)
+{
+  GPtrArray *lines = g_ptr_array_new_with_free_func (g_free);
+
+  for (guint i = 0; i < N_LOG_LINES; i++)
+    {
+      if (i % 500 == 0)
+        g_ptr_array_add (lines, g_strdup_printf ("../src/module-%u/file-%u.c:%u:%u: warning: unused variable 'x' [-Wunused-variable]",
+                                                 i % 37, i, i % 900 + 1, i % 80 + 1));
+      else if (i % 500 == 1)
+        g_ptr_array_add (lines, g_strdup_printf ("\033[1m../src/module-%u/file-%u.c:%u:%u: \033[0;1;31merror: \033[0mexpected ';'",
+                                                 i % 37, i, i % 900 + 1, i % 80 + 1));
+      else if (i % 500 == 2)
+        g_ptr_array_add (lines, g_strdup ("   int x = 0"));
+      else
+        g_ptr_array_add (lines, g_strdup_printf ("[%u/%u] Compiling C object 'src/module-%u/libmodule.a.p/file-%u.c.o'.",
+                                                 i, N_LOG_LINES, i % 37, i));
+    }
+
+  return lines;
+}
+
+static GPtrArray *
+load_log (const gchar *path)
+{
+  g_autofree gchar *contents = NULL;
+  g_autoptr(GError) error = NULL;
+  g_auto(GStrv) split = NULL;
+  GPtrArray *lines;
+
+  g_file_get_contents (path, &contents, NULL, &error);
+  g_assert_no_error (error);
+
+  split = g_strsplit (contents, "\n", -1);
+  lines = g_ptr_array_new_with_free_func (g_free);
+
+  for (guint i = 0; split[i] != NULL; i++)
+    g_ptr_array_add (lines, g_steal_pointer (&split[i]));
+
+  return lines;
+}
+
+static guint
+replay (GPtrArray           *lines,
+        GRegex              *regex,
+        const gchar * const *literals)
+{
+  guint n_matches = 0;
+
+  for (guint i = 0; i < lines->len; i++)
+    {
+      const gchar *line = g_ptr_array_index (lines, i);
+      g_autofree gchar *filtered = NULL;
+      gsize len = strlen (line);
+
+      if (literals == NULL)
+        {
+          /* What the pipeline used to do for every line */
+          filtered = ide_build_utils_color_codes_filtering (line);
+        }
+      else
+        {
+          if (ide_build_utils_has_color_codes (line, len))
+            {
+              filtered = ide_build_utils_color_codes_filtering (line);
+              line = filtered;
+              len = strlen (filtered);
+            }
+
+          if (!ide_build_utils_contains_literals (line, len, literals, TRUE))
+            continue;
+        }
+
+      if (g_regex_match (regex, filtered ? filtered : line, 0, NULL))
+        n_matches++;
+    }
+
+  return n_matches;
+}
+
+/*
+ * Replays a build log through the error format matching, with and without
+ * the literal prefilter. Set IDE_BUILD_LOG_BENCH_FILE to replay a captured
+ * log instead of the synthetic one.
+ */
+static void
+test_replay_log (void)
+{
+  g_autoptr(GPtrArray) lines = NULL;
+  g_autoptr(GRegex) regex = NULL;
+  g_auto(GStrv) literals = NULL;
+  const gchar *path;
+  gdouble elapsed[2] = { 0 };
+  guint n_matches[2] = { 0 };
+
+  if (NULL != (path = g_getenv ("IDE_BUILD_LOG_BENCH_FILE")))
+    lines = load_log (path);
+  else
+    lines = make_log ();
+
+  regex = g_regex_new (GCC_ERROR_FORMAT, G_REGEX_OPTIMIZE | G_REGEX_CASELESS, 0, NULL);
+  g_assert (regex != NULL);
+
+  literals = ide_build_utils_get_required_literals (GCC_ERROR_FORMAT, G_REGEX_CASELESS);
+  g_assert (literals != NULL);
+
+  for (guint i = 0; i < N_REPLAYS; i++)
+    {
+      g_autoptr(GTimer) timer = g_timer_new ();
+
+      n_matches[0] = replay (lines, regex, NULL);
+      elapsed[0] += g_timer_elapsed (timer, NULL);
+
+      g_timer_reset (timer);
+
+      n_matches[1] = replay (lines, regex, (const gchar * const *)literals);
+      elapsed[1] += g_timer_elapsed (timer, NULL);
+
+      g_assert_cmpint (n_matches[0], ==, n_matches[1]);
+    }
+
+  g_test_message ("%u lines, %u matches: regex only %lf seconds, prefiltered %lf seconds",
+                  lines->len, n_matches[0],
+                  elapsed[0] / N_REPLAYS, elapsed[1] / N_REPLAYS);
+
+  if (path == NULL)
+    g_assert_cmpint (n_matches[0], ==, 2 * N_LOG_LINES / 500);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/Ide/BuildUtils/required-literals", test_required_literals);
+  g_test_add_func ("/Ide/BuildUtils/contains-literals", test_contains_literals);
+  g_test_add_func ("/Ide/BuildUtils/has-color-codes", test_has_color_codes);
+  g_test_add_func ("/Ide/BuildUtils/replay-log", test_replay_log);
+
+  return g_test_run ();
+}
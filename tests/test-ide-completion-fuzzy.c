@@ -0,0 +1,269 @@
+/* test-ide-completion-fuzzy.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+#include <string.h>
+
+#include "sourceview/ide-completion-fuzzy-private.h"
+
+/*
+ * Compares the batch matcher with the strchr() based matcher it replaced,
+ * on a synthetic set of C symbols. Set IDE_COMPLETION_BENCH_FILE to a file
+ * with one proposal per line (such as the typed text of a clang result
+ * set) to use real proposals instead. Set IDE_COMPLETION_FUZZY_IMPL to
+ * "scalar" or "sse2" to compare the implementations.
+ */
+
+#define N_SYMBOLS 50000
+
+static const gchar *queries[] = {
+  "g", "gt", "gtk", "gtkw", "gtk_widget", "gwsh", "show", "sig", "new",
+  "IdeBuf", "ide_buffer_get", "cnt", "xyz", "_", "init", "ADD", "zzzzq",
+};
+
+static gboolean
+reference_fuzzy_match (const gchar *haystack,
+                       const gchar *casefold_needle,
+                       guint       *priority)
+{
+  gint real_score = 0;
+
+  for (; *casefold_needle; casefold_needle = g_utf8_next_char (casefold_needle))
+    {
+      gunichar ch = g_utf8_get_char (casefold_needle);
+      const gchar *tmp;
+
+      tmp = strchr (haystack, ch);
+
+      if (tmp == NULL)
+        {
+          tmp = strchr (haystack, g_unichar_toupper (ch));
+          if (tmp == NULL)
+            return FALSE;
+        }
+
+      real_score += (tmp - haystack) * 2;
+      haystack = tmp + 1;
+    }
+
+  if (priority != NULL)
+    *priority = real_score + strlen (haystack);
+
+  return TRUE;
+}
+
+static GPtrArray *
+load_symbols (void)
+{
+  static const gchar *prefixes[] = { "gtk", "g", "ide", "dzl", "gdk", "pango", "cairo", "json" };
+  static const gchar *types[] = { "widget", "buffer", "text_iter", "source_view", "context",
+                                  "object", "list_store", "tree_model", "file", "settings" };
+  static const gchar *verbs[] = { "get", "set", "new", "add", "remove", "show", "hide",
+                                  "connect", "emit", "init", "ref", "unref", "free" };
+  static const gchar *nouns[] = { "", "_name", "_count", "_signal_handler", "_visible",
+                                  "_for_display_with_extra_long_suffix", "_at_iter", "_full" };
+  GPtrArray *ret = g_ptr_array_new_with_free_func (g_free);
+  const gchar *path = g_getenv ("IDE_COMPLETION_BENCH_FILE");
+  GRand *rand;
+
+  if (path != NULL)
+    {
+      g_autofree gchar *contents = NULL;
+      g_auto(GStrv) lines = NULL;
+
+      g_assert_true (g_file_get_contents (path, &contents, NULL, NULL));
+      lines = g_strsplit (contents, "\n", -1);
+
+      for (guint i = 0; lines[i] != NULL; i++)
+        {
+          if (*lines[i] != '\0')
+            g_ptr_array_add (ret, g_strdup (lines[i]));
+        }
+
+      return ret;
+    }
+
+  rand = g_rand_new_with_seed (1234);
+
+  for (guint i = 0; i < N_SYMBOLS; i++)
+    {
+      const gchar *prefix = prefixes[g_rand_int_range (rand, 0, G_N_ELEMENTS (prefixes))];
+      const gchar *type = types[g_rand_int_range (rand, 0, G_N_ELEMENTS (types))];
+      const gchar *verb = verbs[g_rand_int_range (rand, 0, G_N_ELEMENTS (verbs))];
+      const gchar *noun = nouns[g_rand_int_range (rand, 0, G_N_ELEMENTS (nouns))];
+
+      switch (i % 3)
+        {
+        case 0:
+          g_ptr_array_add (ret, g_strdup_printf ("%s_%s_%s%s", prefix, type, verb, noun));
+          break;
+
+        case 1:
+          {
+            /* Type names, such as GtkTextIter */
+            g_autofree gchar *camel = g_strdup_printf ("%s_%s", prefix, type);
+            GString *str = g_string_new (NULL);
+            gboolean up = TRUE;
+
+            for (const gchar *c = camel; *c; c++)
+              {
+                if (*c == '_')
+                  up = TRUE;
+                else
+                  {
+                    g_string_append_c (str, up ? g_ascii_toupper (*c) : *c);
+                    up = FALSE;
+                  }
+              }
+
+            g_ptr_array_add (ret, g_string_free (str, FALSE));
+          }
+          break;
+
+        default:
+          {
+            /* Macros, such as ADD_WIDGET_123 */
+            g_autofree gchar *upper = g_ascii_strup (verb, -1);
+            g_autofree gchar *utype = g_ascii_strup (type, -1);
+
+            g_ptr_array_add (ret, g_strdup_printf ("%s_%s_%u", upper, utype, i));
+          }
+          break;
+        }
+    }
+
+  g_rand_free (rand);
+
+  return ret;
+}
+
+static void
+test_matches_reference (void)
+{
+  static const gchar *haystacks[] = {
+    "", "a", "A", "aA", "Aa", "gtk_widget_show", "GtkWidget", "GTK_WIDGET",
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxa",
+    "Xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx",
+    "XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXx",
+    "Bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb",
+    "ünïcödé_gtk_wïdget", "a_b_c_d_e_f_g_h_i_j_k_l_m_n_o_p_q_r_s_t_u_v_w_x_y_z_0123456789",
+  };
+  static const gchar *needles[] = { "", "a", "x", "b", "bb", "xa", "gw", "gtkw", "_", "z0", "ab" };
+
+  for (guint i = 0; i < G_N_ELEMENTS (haystacks); i++)
+    {
+      for (guint j = 0; j < G_N_ELEMENTS (needles); j++)
+        {
+          guint expected = 0;
+          guint priority = 0;
+          gboolean r1;
+          gboolean r2;
+
+          r1 = reference_fuzzy_match (haystacks[i], needles[j], &expected);
+          r2 = ide_completion_item_fuzzy_match (haystacks[i], needles[j], &priority);
+
+          g_assert_cmpint (r1, ==, r2);
+          if (r1)
+            g_assert_cmpint (expected, ==, priority);
+        }
+    }
+}
+
+static void
+test_batch (void)
+{
+  g_autoptr(IdeCompletionFuzzyBatch) batch = _ide_completion_fuzzy_batch_new ();
+  g_autoptr(GPtrArray) symbols = load_symbols ();
+  g_autofree guint *indexes = NULL;
+  g_autofree guint *priorities = NULL;
+  gdouble reference_time = 0;
+  gdouble batch_time = 0;
+  guint n_queries = 0;
+
+  for (guint i = 0; i < symbols->len; i++)
+    g_assert_cmpint (_ide_completion_fuzzy_batch_add (batch, g_ptr_array_index (symbols, i)), ==, i);
+
+  g_assert_cmpint (_ide_completion_fuzzy_batch_get_length (batch), ==, symbols->len);
+
+  indexes = g_new (guint, symbols->len);
+  priorities = g_new (guint, symbols->len);
+
+  for (guint q = 0; q < G_N_ELEMENTS (queries); q++)
+    {
+      g_autofree gchar *casefold = g_utf8_casefold (queries[q], -1);
+      g_autoptr(GTimer) timer = g_timer_new ();
+      g_autoptr(GArray) expected = g_array_new (FALSE, FALSE, sizeof (guint));
+      guint n_matched;
+
+      /* Each keystroke of the query, as when typing */
+      for (guint len = 1; len <= strlen (casefold); len++)
+        {
+          g_autofree gchar *prefix = g_strndup (casefold, len);
+
+          g_array_set_size (expected, 0);
+
+          g_timer_start (timer);
+          for (guint i = 0; i < symbols->len; i++)
+            {
+              guint priority;
+
+              if (reference_fuzzy_match (g_ptr_array_index (symbols, i), prefix, &priority))
+                {
+                  g_array_append_val (expected, i);
+                  g_array_append_val (expected, priority);
+                }
+            }
+          reference_time += g_timer_elapsed (timer, NULL);
+
+          for (guint i = 0; i < symbols->len; i++)
+            indexes[i] = i;
+
+          g_timer_start (timer);
+          n_matched = _ide_completion_fuzzy_batch_filter (batch, prefix, indexes, symbols->len, priorities);
+          batch_time += g_timer_elapsed (timer, NULL);
+
+          g_assert_cmpint (n_matched * 2, ==, expected->len);
+
+          for (guint i = 0; i < n_matched; i++)
+            {
+              g_assert_cmpint (indexes[i], ==, g_array_index (expected, guint, i * 2));
+              g_assert_cmpint (priorities[indexes[i]], ==, g_array_index (expected, guint, i * 2 + 1));
+            }
+
+          n_queries++;
+        }
+    }
+
+  g_test_message ("%u proposals, %u queries: strchr %lf msec, %s batch %lf msec per query",
+                  symbols->len, n_queries,
+                  reference_time * 1000 / n_queries,
+                  _ide_completion_fuzzy_get_impl (),
+                  batch_time * 1000 / n_queries);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/Ide/CompletionFuzzy/matches-reference", test_matches_reference);
+  g_test_add_func ("/Ide/CompletionFuzzy/batch", test_batch);
+
+  return g_test_run ();
+}
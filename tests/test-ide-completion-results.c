@@ -0,0 +1,246 @@
+/* test-ide-completion-results.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+#include <string.h>
+
+#include "sourceview/ide-completion-results-private.h"
+
+/*
+ * Compares the proposals selected a page at a time by IdeCompletionResults
+ * with a full sort of every matching proposal. Many proposals share the
+ * same key and score, so this also checks that ties keep the order the
+ * proposals were added in.
+ */
+
+#define N_SYMBOLS 5000
+
+static const gchar *queries[] = {
+  "", "g", "gtkw", "gtk_widget", "g", "sh", "ide_b", "ADD", "zzzzq", "_",
+};
+
+static const guint page_sizes[] = { 1, 10, 100, 1000, G_MAXUINT };
+
+typedef struct
+{
+  guint        index;
+  guint        priority;
+  const gchar *key;
+} Expected;
+
+#define TEST_TYPE_ITEM (test_item_get_type())
+G_DECLARE_FINAL_TYPE (TestItem, test_item, TEST, ITEM, IdeCompletionItem)
+
+struct _TestItem
+{
+  IdeCompletionItem  parent_instance;
+  gchar             *key;
+};
+
+G_DEFINE_TYPE (TestItem, test_item, IDE_TYPE_COMPLETION_ITEM)
+
+static gboolean
+test_item_match (IdeCompletionItem *item,
+                 const gchar       *query,
+                 const gchar       *casefold)
+{
+  TestItem *self = (TestItem *)item;
+
+  return ide_completion_item_fuzzy_match (self->key, casefold, &item->priority);
+}
+
+static void
+test_item_finalize (GObject *object)
+{
+  TestItem *self = (TestItem *)object;
+
+  g_clear_pointer (&self->key, g_free);
+
+  G_OBJECT_CLASS (test_item_parent_class)->finalize (object);
+}
+
+static void
+test_item_class_init (TestItemClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  IdeCompletionItemClass *item_class = IDE_COMPLETION_ITEM_CLASS (klass);
+
+  object_class->finalize = test_item_finalize;
+  item_class->match = test_item_match;
+}
+
+static void
+test_item_init (TestItem *self)
+{
+}
+
+static GPtrArray *
+create_symbols (void)
+{
+  static const gchar *prefixes[] = { "gtk", "g", "ide", "gdk" };
+  static const gchar *types[] = { "widget", "buffer", "text_iter", "source_view", "settings" };
+  static const gchar *verbs[] = { "get", "set", "new", "add", "show", "hide" };
+  GPtrArray *ret = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr(GRand) rand = g_rand_new_with_seed (4321);
+
+  /* Few enough combinations that most keys appear many times */
+  for (guint i = 0; i < N_SYMBOLS; i++)
+    {
+      const gchar *prefix = prefixes[g_rand_int_range (rand, 0, G_N_ELEMENTS (prefixes))];
+      const gchar *type = types[g_rand_int_range (rand, 0, G_N_ELEMENTS (types))];
+      const gchar *verb = verbs[g_rand_int_range (rand, 0, G_N_ELEMENTS (verbs))];
+
+      if (i % 4 == 0)
+        {
+          g_autofree gchar *upper = g_ascii_strup (verb, -1);
+          g_autofree gchar *utype = g_ascii_strup (type, -1);
+
+          g_ptr_array_add (ret, g_strdup_printf ("%s_%s", upper, utype));
+        }
+      else
+        {
+          g_ptr_array_add (ret, g_strdup_printf ("%s_%s_%s", prefix, type, verb));
+        }
+    }
+
+  return ret;
+}
+
+static gint
+compare_expected_keyed (gconstpointer a,
+                        gconstpointer b)
+{
+  const Expected *ea = a;
+  const Expected *eb = b;
+  gint ret;
+
+  if (ea->priority != eb->priority)
+    return ea->priority < eb->priority ? -1 : 1;
+
+  if ((ret = strcmp (ea->key, eb->key)))
+    return ret;
+
+  return (ea->index > eb->index) - (ea->index < eb->index);
+}
+
+static gint
+compare_expected_unkeyed (gconstpointer a,
+                          gconstpointer b)
+{
+  const Expected *ea = a;
+  const Expected *eb = b;
+
+  if (ea->priority != eb->priority)
+    return ea->priority < eb->priority ? -1 : 1;
+
+  return (ea->index > eb->index) - (ea->index < eb->index);
+}
+
+static void
+check_results (IdeCompletionResults *results,
+               GPtrArray            *items,
+               GPtrArray            *symbols,
+               gboolean              keyed)
+{
+  for (guint q = 0; q < G_N_ELEMENTS (queries); q++)
+    {
+      g_autofree gchar *casefold = g_utf8_casefold (queries[q], -1);
+      g_autoptr(GArray) expected = g_array_new (FALSE, FALSE, sizeof (Expected));
+
+      g_assert_true (ide_completion_results_replay (results, queries[q]));
+
+      for (guint i = 0; i < symbols->len; i++)
+        {
+          Expected e = { i, 0, g_ptr_array_index (symbols, i) };
+
+          /* Keyed results match everything with the same score on an empty query */
+          if (keyed && *casefold == '\0')
+            g_array_append_val (expected, e);
+          else if (ide_completion_item_fuzzy_match (e.key, casefold, &e.priority))
+            g_array_append_val (expected, e);
+        }
+
+      g_array_sort (expected, keyed ? compare_expected_keyed : compare_expected_unkeyed);
+
+      /* Select growing pages, as presenting does */
+      for (guint p = 0; p < G_N_ELEMENTS (page_sizes); p++)
+        {
+          g_autoptr(GPtrArray) top = _ide_completion_results_get_top (results, page_sizes[p]);
+
+          g_assert_cmpint (top->len, ==, MIN (page_sizes[p], expected->len));
+
+          for (guint i = 0; i < top->len; i++)
+            {
+              const Expected *e = &g_array_index (expected, Expected, i);
+
+              g_assert_true (g_ptr_array_index (top, i) == g_ptr_array_index (items, e->index));
+            }
+        }
+    }
+}
+
+static void
+test_keyed (void)
+{
+  g_autoptr(IdeCompletionResults) results = ide_completion_results_new ("");
+  g_autoptr(GPtrArray) symbols = create_symbols ();
+  g_autoptr(GPtrArray) items = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint i = 0; i < symbols->len; i++)
+    {
+      IdeCompletionItem *item = ide_completion_item_new ();
+
+      g_ptr_array_add (items, g_object_ref (item));
+      ide_completion_results_take_proposal_with_key (results, item, g_ptr_array_index (symbols, i));
+    }
+
+  g_assert_cmpint (ide_completion_results_get_size (results), ==, symbols->len);
+
+  check_results (results, items, symbols, TRUE);
+}
+
+static void
+test_unkeyed (void)
+{
+  g_autoptr(IdeCompletionResults) results = ide_completion_results_new ("");
+  g_autoptr(GPtrArray) symbols = create_symbols ();
+  g_autoptr(GPtrArray) items = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint i = 0; i < symbols->len; i++)
+    {
+      TestItem *item = g_object_new (TEST_TYPE_ITEM, NULL);
+
+      item->key = g_strdup (g_ptr_array_index (symbols, i));
+      g_ptr_array_add (items, g_object_ref (item));
+      ide_completion_results_take_proposal (results, IDE_COMPLETION_ITEM (item));
+    }
+
+  check_results (results, items, symbols, FALSE);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/Ide/CompletionResults/keyed", test_keyed);
+  g_test_add_func ("/Ide/CompletionResults/unkeyed", test_unkeyed);
+
+  return g_test_run ();
+}
@@ -0,0 +1,230 @@
+/* test-ide-diagnostics-index.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+
+#include "diagnostics/ide-diagnostics-index-private.h"
+
+#define N_FILES       2000
+#define N_DIRECTORIES 40
+
+static IdeDiagnostics *
+make_diagnostics (guint n_warnings,
+                  guint n_errors)
+{
+  IdeDiagnostics *ret = ide_diagnostics_new (NULL);
+
+  for (guint i = 0; i < n_warnings; i++)
+    {
+      g_autoptr(IdeDiagnostic) diagnostic = ide_diagnostic_new (IDE_DIAGNOSTIC_WARNING, "warning", NULL);
+      ide_diagnostics_add (ret, diagnostic);
+    }
+
+  for (guint i = 0; i < n_errors; i++)
+    {
+      g_autoptr(IdeDiagnostic) diagnostic = ide_diagnostic_new (IDE_DIAGNOSTIC_ERROR, "error", NULL);
+      ide_diagnostics_add (ret, diagnostic);
+    }
+
+  return ret;
+}
+
+static guint
+count (IdeDiagnosticsIndex   *index,
+       const gchar           *uri,
+       IdeDiagnosticSeverity  min_severity)
+{
+  g_autoptr(GFile) file = uri ? g_file_new_for_uri (uri) : NULL;
+
+  return _ide_diagnostics_index_count (index, file, min_severity);
+}
+
+static guint
+list (IdeDiagnosticsIndex *index,
+      const gchar         *uri,
+      guint                since_sequence)
+{
+  g_autoptr(GFile) file = uri ? g_file_new_for_uri (uri) : NULL;
+  g_autoptr(GPtrArray) ar = NULL;
+
+  ar = _ide_diagnostics_index_list_files (index, file, IDE_DIAGNOSTIC_IGNORED, since_sequence);
+
+  return ar->len;
+}
+
+static void
+test_basic (void)
+{
+  g_autoptr(IdeDiagnosticsIndex) index = _ide_diagnostics_index_new ();
+  g_autoptr(GFile) a = g_file_new_for_uri ("file:///project/src/a.c");
+  g_autoptr(GFile) b = g_file_new_for_uri ("file:///project/src/sub/b.c");
+  g_autoptr(GFile) c = g_file_new_for_uri ("file:///project/srcfoo.c");
+  g_autoptr(IdeDiagnostics) a_diags = make_diagnostics (2, 1);
+  g_autoptr(IdeDiagnostics) b_diags = make_diagnostics (1, 0);
+  g_autoptr(IdeDiagnostics) got = NULL;
+  g_autoptr(IdeDiagnostic) build_error = ide_diagnostic_new (IDE_DIAGNOSTIC_ERROR, "build", NULL);
+  guint sequence;
+
+  g_assert (_ide_diagnostics_index_set (index, "provider", a, a_diags));
+  g_assert (_ide_diagnostics_index_set (index, "provider", b, b_diags));
+  _ide_diagnostics_index_add (index, "build", c, build_error);
+  _ide_diagnostics_index_add (index, "build", a, build_error);
+
+  g_assert_cmpint (count (index, NULL, IDE_DIAGNOSTIC_IGNORED), ==, 6);
+  g_assert_cmpint (count (index, NULL, IDE_DIAGNOSTIC_ERROR), ==, 3);
+  g_assert_cmpint (count (index, "file:///project", IDE_DIAGNOSTIC_IGNORED), ==, 6);
+  g_assert_cmpint (count (index, "file:///project/src/", IDE_DIAGNOSTIC_IGNORED), ==, 5);
+  g_assert_cmpint (count (index, "file:///project/src/sub", IDE_DIAGNOSTIC_ERROR), ==, 0);
+  g_assert_cmpint (count (index, "file:///project/src/a.c", IDE_DIAGNOSTIC_ERROR), ==, 2);
+  g_assert_cmpint (count (index, "file:///other", IDE_DIAGNOSTIC_IGNORED), ==, 0);
+
+  /* "srcfoo.c" sorts next to "src/" but is not within it */
+  g_assert_cmpint (list (index, NULL, 0), ==, 3);
+  g_assert_cmpint (list (index, "file:///project/src", 0), ==, 2);
+  g_assert_cmpint (list (index, "file:///project/src/sub", 0), ==, 1);
+
+  got = _ide_diagnostics_index_get_diagnostics (index, a, IDE_DIAGNOSTIC_IGNORED);
+  g_assert_cmpint (ide_diagnostics_get_size (got), ==, 4);
+  g_clear_pointer (&got, ide_diagnostics_unref);
+
+  got = _ide_diagnostics_index_get_diagnostics (index, a, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (ide_diagnostics_get_size (got), ==, 2);
+  g_clear_pointer (&got, ide_diagnostics_unref);
+
+  /* Only the file that changed is listed */
+  sequence = _ide_diagnostics_index_get_sequence (index);
+  g_assert (_ide_diagnostics_index_set (index, "provider", b, a_diags));
+  g_assert_cmpint (list (index, NULL, sequence), ==, 1);
+  g_assert_cmpint (count (index, "file:///project/src/sub", IDE_DIAGNOSTIC_ERROR), ==, 1);
+
+  /* Clearing a provider leaves the build diagnostics in place */
+  g_assert (_ide_diagnostics_index_set (index, "provider", a, NULL));
+  g_assert (!_ide_diagnostics_index_set (index, "provider", a, NULL));
+  g_assert_cmpint (count (index, "file:///project/src/a.c", IDE_DIAGNOSTIC_IGNORED), ==, 1);
+
+  /* And clearing the build removes files that are left empty */
+  sequence = _ide_diagnostics_index_get_sequence (index);
+  g_assert (_ide_diagnostics_index_remove_source (index, "build"));
+  g_assert (!_ide_diagnostics_index_remove_source (index, "build"));
+  g_assert_cmpint (_ide_diagnostics_index_get_sequence (index), >, sequence);
+  g_assert_cmpint (list (index, NULL, 0), ==, 1);
+  g_assert_cmpint (count (index, NULL, IDE_DIAGNOSTIC_IGNORED), ==, 3);
+  g_assert_cmpint (count (index, "file:///project/src", IDE_DIAGNOSTIC_IGNORED), ==, 3);
+  g_assert_cmpint (count (index, "file:///project/src/a.c", IDE_DIAGNOSTIC_IGNORED), ==, 0);
+
+  g_assert (_ide_diagnostics_index_set (index, "provider", b, NULL));
+  g_assert_cmpint (count (index, NULL, IDE_DIAGNOSTIC_IGNORED), ==, 0);
+  g_assert_cmpint (count (index, "file:///project", IDE_DIAGNOSTIC_IGNORED), ==, 0);
+  g_assert_cmpint (list (index, NULL, 0), ==, 0);
+}
+
+/* Adding a batch must be equivalent to adding each diagnostic */
+static void
+test_add_all (void)
+{
+  g_autoptr(IdeDiagnosticsIndex) one = _ide_diagnostics_index_new ();
+  g_autoptr(IdeDiagnosticsIndex) all = _ide_diagnostics_index_new ();
+  g_autoptr(GFile) a = g_file_new_for_uri ("file:///project/src/a.c");
+  g_autoptr(IdeDiagnostics) diagnostics = make_diagnostics (3, 2);
+  g_autoptr(IdeDiagnostics) empty = make_diagnostics (0, 0);
+  g_autoptr(IdeDiagnostics) got = NULL;
+  guint sequence;
+
+  for (guint i = 0; i < ide_diagnostics_get_size (diagnostics); i++)
+    _ide_diagnostics_index_add (one, "build", a, ide_diagnostics_index (diagnostics, i));
+
+  _ide_diagnostics_index_add_all (all, "build", a, diagnostics);
+
+  /* The whole batch is a single change */
+  g_assert_cmpint (_ide_diagnostics_index_get_sequence (all), ==, 1);
+
+  for (IdeDiagnosticSeverity severity = IDE_DIAGNOSTIC_IGNORED; severity <= IDE_DIAGNOSTIC_FATAL; severity++)
+    {
+      g_assert_cmpint (count (all, NULL, severity), ==, count (one, NULL, severity));
+      g_assert_cmpint (count (all, "file:///project", severity), ==, count (one, "file:///project", severity));
+      g_assert_cmpint (count (all, "file:///project/src/a.c", severity), ==, count (one, "file:///project/src/a.c", severity));
+    }
+
+  got = _ide_diagnostics_index_get_diagnostics (all, a, IDE_DIAGNOSTIC_IGNORED);
+  g_assert_cmpint (ide_diagnostics_get_size (got), ==, 5);
+
+  sequence = _ide_diagnostics_index_get_sequence (all);
+  _ide_diagnostics_index_add_all (all, "build", a, empty);
+  g_assert_cmpint (_ide_diagnostics_index_get_sequence (all), ==, sequence);
+
+  g_assert (_ide_diagnostics_index_remove_source (all, "build"));
+  g_assert_cmpint (count (all, "file:///project", IDE_DIAGNOSTIC_IGNORED), ==, 0);
+  g_assert_cmpint (list (all, NULL, 0), ==, 0);
+}
+
+/*
+ * Indexes a large project and reports the cost of the queries a problem
+ * view makes, which should not depend on the number of files.
+ */
+static void
+test_many (void)
+{
+  g_autoptr(IdeDiagnosticsIndex) index = _ide_diagnostics_index_new ();
+  g_autoptr(IdeDiagnostics) diagnostics = make_diagnostics (3, 1);
+  g_autoptr(GTimer) timer = g_timer_new ();
+  gdouble publish;
+  gdouble counting;
+  guint total = 0;
+
+  for (guint i = 0; i < N_FILES; i++)
+    {
+      g_autofree gchar *uri = g_strdup_printf ("file:///project/dir%u/file%u.c", i % N_DIRECTORIES, i);
+      g_autoptr(GFile) file = g_file_new_for_uri (uri);
+
+      _ide_diagnostics_index_set (index, "provider", file, diagnostics);
+    }
+
+  publish = g_timer_elapsed (timer, NULL);
+
+  g_timer_reset (timer);
+
+  for (guint i = 0; i < N_DIRECTORIES; i++)
+    {
+      g_autofree gchar *uri = g_strdup_printf ("file:///project/dir%u", i);
+
+      g_assert_cmpint (count (index, uri, IDE_DIAGNOSTIC_ERROR), ==, N_FILES / N_DIRECTORIES);
+      total += count (index, uri, IDE_DIAGNOSTIC_IGNORED);
+    }
+
+  counting = g_timer_elapsed (timer, NULL);
+
+  g_assert_cmpint (total, ==, N_FILES * 4);
+  g_assert_cmpint (count (index, NULL, IDE_DIAGNOSTIC_IGNORED), ==, N_FILES * 4);
+  g_assert_cmpint (list (index, "file:///project/dir7", 0), ==, N_FILES / N_DIRECTORIES);
+
+  g_test_message ("%u files: indexed in %lf seconds, %lf seconds per directory count",
+                  N_FILES, publish, counting / (N_DIRECTORIES * 2));
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/Ide/DiagnosticsIndex/basic", test_basic);
+  g_test_add_func ("/Ide/DiagnosticsIndex/add-all", test_add_all);
+  g_test_add_func ("/Ide/DiagnosticsIndex/many", test_many);
+
+  return g_test_run ();
+}
@@ -0,0 +1,194 @@
+/* test-ide-diagnostics-intervals.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+
+#include "diagnostics/ide-diagnostics-intervals-private.h"
+
+#define N_DIAGNOSTICS 5000
+#define N_LINES       20000
+#define N_VISIBLE     60
+
+static void
+count_cb (guint                 begin_line,
+          guint                 end_line,
+          IdeDiagnosticSeverity severity,
+          gpointer              data,
+          gpointer              user_data)
+{
+  guint *count = user_data;
+
+  (*count)++;
+}
+
+static guint
+count_range (IdeDiagnosticsIntervals *intervals,
+             guint                    begin_line,
+             guint                    end_line)
+{
+  guint count = 0;
+
+  _ide_diagnostics_intervals_foreach (intervals, begin_line, end_line, count_cb, &count);
+
+  return count;
+}
+
+static void
+test_query (void)
+{
+  g_autoptr(IdeDiagnosticsIntervals) intervals = _ide_diagnostics_intervals_new ();
+  IdeDiagnosticSeverity severities[6];
+
+  _ide_diagnostics_intervals_add (intervals, 2, 2, IDE_DIAGNOSTIC_NOTE, NULL);
+  _ide_diagnostics_intervals_add (intervals, 4, 1, IDE_DIAGNOSTIC_WARNING, NULL);
+  _ide_diagnostics_intervals_add (intervals, 10, 12, IDE_DIAGNOSTIC_ERROR, NULL);
+  _ide_diagnostics_intervals_add (intervals, 0, 30, IDE_DIAGNOSTIC_NOTE, NULL);
+
+  g_assert_cmpint (_ide_diagnostics_intervals_get_size (intervals), ==, 4);
+
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 0), ==, IDE_DIAGNOSTIC_NOTE);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 2), ==, IDE_DIAGNOSTIC_WARNING);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 5), ==, IDE_DIAGNOSTIC_NOTE);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 11), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 31), ==, IDE_DIAGNOSTIC_IGNORED);
+
+  g_assert_cmpint (count_range (intervals, 0, 0), ==, 1);
+  g_assert_cmpint (count_range (intervals, 2, 3), ==, 3);
+  g_assert_cmpint (count_range (intervals, 5, 9), ==, 1);
+  g_assert_cmpint (count_range (intervals, 5, 10), ==, 2);
+  g_assert_cmpint (count_range (intervals, 31, 100), ==, 0);
+
+  _ide_diagnostics_intervals_get_range (intervals, 9, 14, severities);
+  g_assert_cmpint (severities[0], ==, IDE_DIAGNOSTIC_NOTE);
+  g_assert_cmpint (severities[1], ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (severities[3], ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (severities[4], ==, IDE_DIAGNOSTIC_NOTE);
+
+  _ide_diagnostics_intervals_clear (intervals);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_size (intervals), ==, 0);
+  g_assert_cmpint (count_range (intervals, 0, 100), ==, 0);
+}
+
+static void
+test_edits (void)
+{
+  g_autoptr(IdeDiagnosticsIntervals) intervals = _ide_diagnostics_intervals_new ();
+
+  _ide_diagnostics_intervals_add (intervals, 5, 5, IDE_DIAGNOSTIC_WARNING, NULL);
+  _ide_diagnostics_intervals_add (intervals, 8, 10, IDE_DIAGNOSTIC_ERROR, NULL);
+
+  /* Lines added before the warning move everything down */
+  _ide_diagnostics_intervals_insert_lines (intervals, 5, 2);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 5), ==, IDE_DIAGNOSTIC_IGNORED);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 7), ==, IDE_DIAGNOSTIC_WARNING);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 10), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 12), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 13), ==, IDE_DIAGNOSTIC_IGNORED);
+
+  /* Lines added within the error grow it */
+  _ide_diagnostics_intervals_insert_lines (intervals, 11, 3);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 15), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 16), ==, IDE_DIAGNOSTIC_IGNORED);
+
+  /* Joining lines 6 through 11 collapses onto line 6 */
+  _ide_diagnostics_intervals_delete_lines (intervals, 6, 5);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 6), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 10), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 11), ==, IDE_DIAGNOSTIC_IGNORED);
+  g_assert_cmpint (count_range (intervals, 6, 6), ==, 2);
+
+  /* Removing everything before them moves both to the first line */
+  _ide_diagnostics_intervals_delete_lines (intervals, 0, 6);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 0), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (count_range (intervals, 0, 0), ==, 2);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 4), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, 5), ==, IDE_DIAGNOSTIC_IGNORED);
+}
+
+/*
+ * Compares against the per-line table that IdeBuffer used to rebuild for
+ * every publish, both for correctness and to report the cost of resolving
+ * a screen of gutter lines while typing.
+ */
+static void
+test_many (void)
+{
+  g_autoptr(IdeDiagnosticsIntervals) intervals = _ide_diagnostics_intervals_new ();
+  g_autoptr(GTimer) timer = g_timer_new ();
+  g_autofree IdeDiagnosticSeverity *expected = g_new0 (IdeDiagnosticSeverity, N_LINES);
+  IdeDiagnosticSeverity severities[N_VISIBLE];
+  GRand *rand = g_rand_new_with_seed (1234);
+  gdouble publish;
+  gdouble edits;
+
+  for (guint i = 0; i < N_DIAGNOSTICS; i++)
+    {
+      guint begin = g_rand_int_range (rand, 0, N_LINES - 10);
+      guint end = begin + (i % 7 == 0 ? g_rand_int_range (rand, 0, 10) : 0);
+      IdeDiagnosticSeverity severity = g_rand_int_range (rand, IDE_DIAGNOSTIC_NOTE, IDE_DIAGNOSTIC_FATAL + 1);
+
+      _ide_diagnostics_intervals_add (intervals, begin, end, severity, NULL);
+
+      for (guint line = begin; line <= end; line++)
+        expected[line] = MAX (expected[line], severity);
+    }
+
+  g_timer_reset (timer);
+  _ide_diagnostics_intervals_get_severity (intervals, 0);
+  publish = g_timer_elapsed (timer, NULL);
+
+  for (guint line = 0; line < N_LINES; line++)
+    g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, line), ==, expected[line]);
+
+  /* Type a newline and redraw the visible lines, over and over */
+  g_timer_reset (timer);
+
+  for (guint i = 0; i < 1000; i++)
+    {
+      guint line = g_rand_int_range (rand, 0, N_LINES - N_VISIBLE);
+
+      _ide_diagnostics_intervals_insert_lines (intervals, line, 1);
+      _ide_diagnostics_intervals_get_range (intervals, line, line + N_VISIBLE - 1, severities);
+      _ide_diagnostics_intervals_delete_lines (intervals, line, 1);
+      _ide_diagnostics_intervals_get_range (intervals, line, line + N_VISIBLE - 1, severities);
+    }
+
+  edits = g_timer_elapsed (timer, NULL);
+
+  g_test_message ("%u diagnostics: indexed in %lf seconds, %lf seconds per edit and redraw",
+                  N_DIAGNOSTICS, publish, edits / 2000);
+
+  /* Every edit was undone, so nothing should have moved */
+  for (guint line = 0; line < N_LINES; line++)
+    g_assert_cmpint (_ide_diagnostics_intervals_get_severity (intervals, line), ==, expected[line]);
+
+  g_rand_free (rand);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/Ide/DiagnosticsIntervals/query", test_query);
+  g_test_add_func ("/Ide/DiagnosticsIntervals/edits", test_edits);
+  g_test_add_func ("/Ide/DiagnosticsIntervals/many", test_many);
+
+  return g_test_run ();
+}
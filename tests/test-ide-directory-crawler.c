@@ -0,0 +1,221 @@
+/* test-ide-directory-crawler.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gstdio.h>
+#include <ide.h>
+
+/*
+ * Measures crawl time on a synthetic deep tree with varying numbers of
+ * workers. Set IDE_CRAWLER_BENCH_DIR to crawl an existing directory
+ * instead, such as a checkout on a network file-system.
+ */
+
+#define TREE_DEPTH     6
+#define TREE_FANOUT    3
+#define FILES_PER_DIR  8
+
+typedef struct
+{
+  guint n_dirs;
+  guint n_files;
+} Totals;
+
+static void
+make_tree (const gchar *path,
+           guint        depth,
+           Totals      *totals)
+{
+  totals->n_dirs++;
+
+  for (guint i = 0; i < FILES_PER_DIR; i++)
+    {
+      g_autofree gchar *name = g_strdup_printf ("file-%u.c", i);
+      g_autofree gchar *file = g_build_filename (path, name, NULL);
+
+      g_assert_true (g_file_set_contents (file, "", 0, NULL));
+      totals->n_files++;
+    }
+
+  if (depth == 0)
+    return;
+
+  for (guint i = 0; i < TREE_FANOUT; i++)
+    {
+      g_autofree gchar *name = g_strdup_printf ("dir-%u", i);
+      g_autofree gchar *dir = g_build_filename (path, name, NULL);
+
+      g_assert_cmpint (g_mkdir (dir, 0750), ==, 0);
+      make_tree (dir, depth - 1, totals);
+    }
+}
+
+static void
+remove_tree (const gchar *path)
+{
+  g_autoptr(GDir) dir = g_dir_open (path, 0, NULL);
+  const gchar *name;
+
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      g_autofree gchar *child = g_build_filename (path, name, NULL);
+
+      if (g_file_test (child, G_FILE_TEST_IS_DIR))
+        remove_tree (child);
+      else
+        g_unlink (child);
+    }
+
+  g_rmdir (path);
+}
+
+static void
+count_cb (GFile       *directory,
+          const gchar *relative_path,
+          GFileInfo   *directory_info,
+          GPtrArray   *children,
+          gpointer     user_data)
+{
+  Totals *totals = user_data;
+
+  g_assert (G_IS_FILE (directory));
+  g_assert (relative_path != NULL);
+
+  totals->n_dirs++;
+
+  if (children == NULL)
+    return;
+
+  for (guint i = 0; i < children->len; i++)
+    {
+      GFileInfo *info = g_ptr_array_index (children, i);
+
+      if (g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY)
+        totals->n_files++;
+    }
+}
+
+static gchar **
+reuse_cb (GFile       *directory,
+          const gchar *relative_path,
+          GFileInfo   *directory_info,
+          gpointer     user_data)
+{
+  static const gchar *subdirs[] = { "dir-0", NULL };
+
+  /* Pretend we know the contents of the root, and only descend into dir-0 */
+  if (*relative_path == '\0')
+    return g_strdupv ((gchar **)subdirs);
+
+  return NULL;
+}
+
+static void
+test_crawl_deep_tree (void)
+{
+  g_autofree gchar *tmpdir = NULL;
+  g_autoptr(GFile) root = NULL;
+  const gchar *bench_dir;
+  Totals expected = { 0 };
+  guint n_workers[] = { 1, 2, 4, 8 };
+
+  if (NULL != (bench_dir = g_getenv ("IDE_CRAWLER_BENCH_DIR")))
+    {
+      root = g_file_new_for_path (bench_dir);
+    }
+  else
+    {
+      tmpdir = g_dir_make_tmp ("test-ide-directory-crawler-XXXXXX", NULL);
+      g_assert (tmpdir != NULL);
+      make_tree (tmpdir, TREE_DEPTH, &expected);
+      root = g_file_new_for_path (tmpdir);
+    }
+
+  for (guint i = 0; i < G_N_ELEMENTS (n_workers); i++)
+    {
+      g_autoptr(IdeDirectoryCrawler) crawler = ide_directory_crawler_new (root);
+      g_autoptr(GTimer) timer = g_timer_new ();
+      g_autoptr(GError) error = NULL;
+      Totals totals = { 0 };
+      gboolean r;
+
+      ide_directory_crawler_set_n_workers (crawler, n_workers[i]);
+      r = ide_directory_crawler_run (crawler, NULL, count_cb, &totals, &error);
+      g_timer_stop (timer);
+
+      g_assert_no_error (error);
+      g_assert_true (r);
+
+      g_test_message ("%u workers: %u directories, %u files in %lf seconds",
+                      n_workers[i], totals.n_dirs, totals.n_files,
+                      g_timer_elapsed (timer, NULL));
+
+      if (bench_dir == NULL)
+        {
+          g_assert_cmpint (totals.n_dirs, ==, expected.n_dirs);
+          g_assert_cmpint (totals.n_files, ==, expected.n_files);
+        }
+    }
+
+  if (tmpdir != NULL)
+    remove_tree (tmpdir);
+}
+
+static void
+test_crawl_reuse (void)
+{
+  g_autofree gchar *tmpdir = NULL;
+  g_autoptr(IdeDirectoryCrawler) crawler = NULL;
+  g_autoptr(GFile) root = NULL;
+  g_autoptr(GError) error = NULL;
+  Totals expected = { 0 };
+  Totals totals = { 0 };
+  gboolean r;
+
+  tmpdir = g_dir_make_tmp ("test-ide-directory-crawler-XXXXXX", NULL);
+  g_assert (tmpdir != NULL);
+  make_tree (tmpdir, 2, &expected);
+  root = g_file_new_for_path (tmpdir);
+
+  crawler = ide_directory_crawler_new (root);
+  ide_directory_crawler_set_reuse_func (crawler, reuse_cb, NULL, NULL);
+  r = ide_directory_crawler_run (crawler, NULL, count_cb, &totals, &error);
+
+  g_assert_no_error (error);
+  g_assert_true (r);
+
+  /* The root, dir-0 and its children, none of the root's own files */
+  g_assert_cmpint (totals.n_dirs, ==, 2 + TREE_FANOUT);
+  g_assert_cmpint (totals.n_files, ==, (1 + TREE_FANOUT) * FILES_PER_DIR);
+
+  remove_tree (tmpdir);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/Ide/DirectoryCrawler/deep-tree", test_crawl_deep_tree);
+  g_test_add_func ("/Ide/DirectoryCrawler/reuse", test_crawl_reuse);
+
+  return g_test_run ();
+}
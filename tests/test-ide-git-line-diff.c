@@ -0,0 +1,249 @@
+/* test-ide-git-line-diff.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+#include <string.h>
+
+#include "ide-git-line-diff.h"
+
+#define N_ROUNDS 50
+#define N_EDITS  40
+
+/*
+ * Lines are represented by integer ids so that we can control how often
+ * the same line text repeats. With unique ids the minimal diff is unique,
+ * so the incremental result must match a full diff exactly. With repeated
+ * ids, equally short alignments may differ, and we only require that the
+ * hunks describe the new content.
+ */
+
+static GBytes *
+lines_to_bytes (GArray *lines)
+{
+  GString *str = g_string_new (NULL);
+
+  for (guint i = 0; i < lines->len; i++)
+    {
+      if (i > 0)
+        g_string_append_c (str, '\n');
+      g_string_append_printf (str, "line %u", g_array_index (lines, guint, i));
+    }
+
+  return g_string_free_to_bytes (str);
+}
+
+static guint
+next_line (GRand *rand,
+           guint *next_id,
+           guint  n_ids)
+{
+  if (n_ids == 0)
+    return (*next_id)++;
+  return g_rand_int_range (rand, 0, n_ids);
+}
+
+static void
+random_edit (GRand  *rand,
+             GArray *lines,
+             guint  *next_id,
+             guint   n_ids)
+{
+  guint pos = g_rand_int_range (rand, 0, lines->len + 1);
+  guint count = g_rand_int_range (rand, 1, 4);
+
+  switch (lines->len ? g_rand_int_range (rand, 0, 3) : 0)
+    {
+    case 0:
+      for (guint i = 0; i < count; i++)
+        {
+          guint id = next_line (rand, next_id, n_ids);
+          g_array_insert_val (lines, pos, id);
+        }
+      break;
+
+    case 1:
+      pos = MIN (pos, lines->len - 1);
+      g_array_remove_range (lines, pos, MIN (count, lines->len - pos));
+      break;
+
+    case 2:
+      pos = MIN (pos, lines->len - 1);
+      g_array_index (lines, guint, pos) = next_line (rand, next_id, n_ids);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+assert_hunks_apply (GArray *hunks,
+                    GArray *base,
+                    GArray *lines)
+{
+  guint a = 0;
+  guint b = 0;
+
+  for (guint i = 0; i <= hunks->len; i++)
+    {
+      guint old_start = base->len;
+      guint new_start = lines->len;
+
+      if (i < hunks->len)
+        {
+          const IdeGitLineDiffHunk *hunk = &g_array_index (hunks, IdeGitLineDiffHunk, i);
+
+          old_start = hunk->old_start;
+          new_start = hunk->new_start;
+          g_assert_cmpint (hunk->old_len + hunk->new_len, >, 0);
+          g_assert_cmpint (hunk->old_start + hunk->old_len, <=, base->len);
+          g_assert_cmpint (hunk->new_start + hunk->new_len, <=, lines->len);
+        }
+
+      /* Everything between hunks must be unchanged */
+      g_assert_cmpint (old_start, >=, a);
+      g_assert_cmpint (new_start, >=, b);
+      g_assert_cmpint (old_start - a, ==, new_start - b);
+
+      for (; a < old_start; a++, b++)
+        g_assert_cmpint (g_array_index (base, guint, a), ==, g_array_index (lines, guint, b));
+
+      if (i < hunks->len)
+        {
+          const IdeGitLineDiffHunk *hunk = &g_array_index (hunks, IdeGitLineDiffHunk, i);
+
+          a += hunk->old_len;
+          b += hunk->new_len;
+        }
+    }
+}
+
+static void
+assert_arrays_equal (GArray *a,
+                     GArray *b,
+                     gsize   element_size)
+{
+  g_assert_cmpint (a->len, ==, b->len);
+  g_assert_cmpint (memcmp (a->data, b->data, a->len * element_size), ==, 0);
+}
+
+static void
+check_random_edits (guint n_ids)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (n_ids + 1);
+
+  for (guint round = 0; round < N_ROUNDS; round++)
+    {
+      g_autoptr(GArray) base = g_array_new (FALSE, FALSE, sizeof (guint));
+      g_autoptr(GArray) lines = NULL;
+      g_autoptr(GBytes) base_bytes = NULL;
+      g_autoptr(IdeGitLineDiff) diff = NULL;
+      guint next_id = 0;
+      guint n_lines = g_rand_int_range (rand, 1, 200);
+
+      for (guint i = 0; i < n_lines; i++)
+        {
+          guint id = next_line (rand, &next_id, n_ids);
+          g_array_append_val (base, id);
+        }
+
+      lines = g_array_sized_new (FALSE, FALSE, sizeof (guint), base->len);
+      g_array_append_vals (lines, base->data, base->len);
+
+      base_bytes = lines_to_bytes (base);
+      diff = ide_git_line_diff_new (base_bytes);
+
+      for (guint edit = 0; edit < N_EDITS; edit++)
+        {
+          g_autoptr(GBytes) bytes = NULL;
+          g_autoptr(IdeGitLineDiff) full = NULL;
+          g_autoptr(GArray) hunks = NULL;
+          g_autoptr(GArray) full_hunks = NULL;
+          g_autoptr(GArray) ranges = NULL;
+          g_autoptr(GArray) full_ranges = NULL;
+
+          random_edit (rand, lines, &next_id, n_ids);
+          bytes = lines_to_bytes (lines);
+
+          full = ide_git_line_diff_new (base_bytes);
+          g_assert_true (ide_git_line_diff_update (full, bytes));
+          full_hunks = ide_git_line_diff_get_hunks (full);
+
+          /* Mirror the change monitor, which falls back to libgit2 */
+          if (!ide_git_line_diff_update (diff, bytes))
+            ide_git_line_diff_set_hunks (diff, full_hunks);
+
+          hunks = ide_git_line_diff_get_hunks (diff);
+          assert_hunks_apply (hunks, base, lines);
+
+          if (n_ids == 0)
+            {
+              assert_arrays_equal (hunks, full_hunks, sizeof (IdeGitLineDiffHunk));
+
+              ranges = ide_git_line_diff_get_ranges (diff);
+              full_ranges = ide_git_line_diff_get_ranges (full);
+              assert_arrays_equal (ranges, full_ranges, sizeof (IdeGitLineRange));
+            }
+        }
+    }
+}
+
+static void
+test_unique_lines (void)
+{
+  check_random_edits (0);
+}
+
+static void
+test_repeated_lines (void)
+{
+  check_random_edits (3);
+  check_random_edits (20);
+}
+
+static void
+test_ranges (void)
+{
+  g_autoptr(GBytes) base = g_bytes_new_static ("a\nb\nc\nd\ne", 9);
+  g_autoptr(GBytes) content = g_bytes_new_static ("a\nB\nc\nx\ny\nd", 11);
+  g_autoptr(IdeGitLineDiff) diff = ide_git_line_diff_new (base);
+  g_autoptr(GArray) ranges = NULL;
+
+  g_assert_true (ide_git_line_diff_update (diff, content));
+  ranges = ide_git_line_diff_get_ranges (diff);
+
+  g_assert_cmpint (ide_git_line_ranges_lookup (ranges, 0), ==, IDE_BUFFER_LINE_CHANGE_NONE);
+  g_assert_cmpint (ide_git_line_ranges_lookup (ranges, 1), ==, IDE_BUFFER_LINE_CHANGE_CHANGED);
+  g_assert_cmpint (ide_git_line_ranges_lookup (ranges, 2), ==, IDE_BUFFER_LINE_CHANGE_NONE);
+  g_assert_cmpint (ide_git_line_ranges_lookup (ranges, 3), ==, IDE_BUFFER_LINE_CHANGE_ADDED);
+  g_assert_cmpint (ide_git_line_ranges_lookup (ranges, 4), ==, IDE_BUFFER_LINE_CHANGE_ADDED);
+  g_assert_cmpint (ide_git_line_ranges_lookup (ranges, 5), ==, IDE_BUFFER_LINE_CHANGE_DELETED);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/Ide/GitLineDiff/unique-lines", test_unique_lines);
+  g_test_add_func ("/Ide/GitLineDiff/repeated-lines", test_repeated_lines);
+  g_test_add_func ("/Ide/GitLineDiff/ranges", test_ranges);
+
+  return g_test_run ();
+}
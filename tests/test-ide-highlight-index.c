@@ -0,0 +1,97 @@
+/* test-ide-highlight-index.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+#include <string.h>
+
+#define N_WORDS 50000
+
+static void
+test_lookup_slice (void)
+{
+  g_autoptr(IdeHighlightIndex) index = ide_highlight_index_new ();
+  const gchar *text = "gtk_widget_show (widget);";
+
+  ide_highlight_index_insert (index, "gtk_widget_show", "def:function");
+  ide_highlight_index_insert (index, "widget", "def:identifier");
+
+  for (guint i = 0; i < 2; i++)
+    {
+      g_assert_cmpstr (ide_highlight_index_lookup (index, "gtk_widget_show"), ==, "def:function");
+      g_assert_cmpstr (ide_highlight_index_lookup_len (index, text, 15), ==, "def:function");
+      g_assert_cmpstr (ide_highlight_index_lookup_len (index, text + 17, 6), ==, "def:identifier");
+      g_assert_null (ide_highlight_index_lookup_len (index, text, 10));
+      g_assert_null (ide_highlight_index_lookup_len (index, text, 16));
+      g_assert_null (ide_highlight_index_lookup (index, "gtk_widget_hide"));
+
+      ide_highlight_index_freeze (index);
+    }
+}
+
+static void
+test_freeze_empty (void)
+{
+  g_autoptr(IdeHighlightIndex) index = ide_highlight_index_new ();
+
+  ide_highlight_index_freeze (index);
+
+  g_assert_null (ide_highlight_index_lookup (index, "anything"));
+  g_assert_null (ide_highlight_index_lookup_len (index, "", 0));
+}
+
+static void
+test_freeze_many (void)
+{
+  g_autoptr(IdeHighlightIndex) index = ide_highlight_index_new ();
+  g_autoptr(GTimer) timer = g_timer_new ();
+
+  for (guint i = 0; i < N_WORDS; i++)
+    {
+      g_autofree gchar *word = g_strdup_printf ("symbol_%u", i);
+
+      ide_highlight_index_insert (index, word, GUINT_TO_POINTER (i + 1));
+    }
+
+  g_timer_start (timer);
+  ide_highlight_index_freeze (index);
+  g_test_message ("Froze %u words in %lf seconds", N_WORDS, g_timer_elapsed (timer, NULL));
+
+  ide_highlight_index_dump (index);
+
+  for (guint i = 0; i < N_WORDS; i++)
+    {
+      g_autofree gchar *word = g_strdup_printf ("symbol_%u", i);
+      g_autofree gchar *miss = g_strdup_printf ("symbol_%u", N_WORDS + i);
+
+      g_assert_cmpint (GPOINTER_TO_UINT (ide_highlight_index_lookup (index, word)), ==, i + 1);
+      g_assert_null (ide_highlight_index_lookup (index, miss));
+    }
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/Ide/HighlightIndex/lookup-slice", test_lookup_slice);
+  g_test_add_func ("/Ide/HighlightIndex/freeze-empty", test_freeze_empty);
+  g_test_add_func ("/Ide/HighlightIndex/freeze-many", test_freeze_many);
+
+  return g_test_run ();
+}
@@ -0,0 +1,227 @@
+/* test-ide-trigram-index.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "search/ide-trigram-index.h"
+
+static const struct {
+  const gchar *path;
+  guint64      mtime;
+  const gchar *contents;
+} documents[] = {
+  { "src/main.c",      1, "int main (void) { return app_run (); }" },
+  { "src/app.c",       2, "int app_run (void) { /* TODO: parse args */ return 0; }" },
+  { "README",          3, "Run the app with ./app --help" },
+  { "data/image.png",  4, "" },
+  { "tiny",            5, "ab" },
+};
+
+static IdeTrigramIndex *
+create_index (void)
+{
+  IdeTrigramIndex *index = ide_trigram_index_new ();
+
+  for (guint i = 0; i < G_N_ELEMENTS (documents); i++)
+    ide_trigram_index_insert (index,
+                              documents[i].path,
+                              documents[i].mtime,
+                              documents[i].contents,
+                              strlen (documents[i].contents));
+
+  return index;
+}
+
+static gchar *
+query (IdeTrigramIndex *index,
+       const gchar     *first_literal,
+       ...)
+{
+  g_autoptr(GPtrArray) literals = g_ptr_array_new ();
+  g_autoptr(GPtrArray) paths = NULL;
+  const gchar *literal = first_literal;
+  va_list args;
+
+  va_start (args, first_literal);
+  while (literal != NULL)
+    {
+      g_ptr_array_add (literals, (gchar *)literal);
+      literal = va_arg (args, const gchar *);
+    }
+  va_end (args);
+
+  g_ptr_array_add (literals, NULL);
+  paths = ide_trigram_index_query (index, (const gchar * const *)literals->pdata);
+  g_ptr_array_add (paths, NULL);
+
+  return g_strjoinv (",", (gchar **)paths->pdata);
+}
+
+static void
+assert_index (IdeTrigramIndex *index)
+{
+  g_autofree gchar *r1 = query (index, "app_run", NULL);
+  g_autofree gchar *r2 = query (index, "APP_RUN", NULL);
+  g_autofree gchar *r3 = query (index, "todo", NULL);
+  g_autofree gchar *r4 = query (index, "main", "--help", NULL);
+  g_autofree gchar *r5 = query (index, "nothing here", NULL);
+
+  g_assert_cmpstr (r1, ==, "src/main.c,src/app.c");
+  g_assert_cmpstr (r2, ==, "src/main.c,src/app.c");
+  g_assert_cmpstr (r3, ==, "src/app.c");
+  g_assert_cmpstr (r4, ==, "src/main.c,README");
+  g_assert_cmpstr (r5, ==, "");
+}
+
+static void
+test_insert_query (void)
+{
+  g_autoptr(IdeTrigramIndex) index = create_index ();
+  g_autofree gchar *all = NULL;
+  guint64 mtime = 0;
+
+  g_assert_cmpint (ide_trigram_index_get_n_paths (index), ==, G_N_ELEMENTS (documents));
+
+  for (guint i = 0; i < G_N_ELEMENTS (documents); i++)
+    {
+      g_assert_true (ide_trigram_index_get_mtime (index, documents[i].path, &mtime));
+      g_assert_cmpint (mtime, ==, documents[i].mtime);
+    }
+
+  g_assert_false (ide_trigram_index_get_mtime (index, "missing", &mtime));
+
+  assert_index (index);
+
+  /* Short literals cannot be filtered and match everything */
+  all = query (index, "ap", NULL);
+  g_assert_cmpstr (all, ==, "src/main.c,src/app.c,README,data/image.png,tiny");
+}
+
+static void
+test_remove (void)
+{
+  g_autoptr(IdeTrigramIndex) index = create_index ();
+  g_autofree gchar *r1 = NULL;
+  g_autofree gchar *r2 = NULL;
+  g_autofree gchar *r3 = NULL;
+  guint64 mtime = 0;
+
+  ide_trigram_index_remove (index, "src/main.c");
+  ide_trigram_index_remove (index, "missing");
+
+  g_assert_cmpint (ide_trigram_index_get_n_paths (index), ==, G_N_ELEMENTS (documents) - 1);
+  g_assert_false (ide_trigram_index_get_mtime (index, "src/main.c", &mtime));
+
+  r1 = query (index, "app_run", NULL);
+  g_assert_cmpstr (r1, ==, "src/app.c");
+
+  /* Re-inserting replaces the previous contents */
+  ide_trigram_index_insert (index, "src/app.c", 10, "nothing to see", 14);
+  r2 = query (index, "app_run", NULL);
+  g_assert_cmpstr (r2, ==, "");
+  r3 = query (index, "see", NULL);
+  g_assert_cmpstr (r3, ==, "src/app.c");
+
+  g_assert_true (ide_trigram_index_get_mtime (index, "src/app.c", &mtime));
+  g_assert_cmpint (mtime, ==, 10);
+}
+
+static void
+test_save_load (void)
+{
+  g_autoptr(IdeTrigramIndex) index = create_index ();
+  g_autoptr(IdeTrigramIndex) loaded = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *tmpdir = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *r1 = NULL;
+  guint64 mtime = 0;
+
+  tmpdir = g_dir_make_tmp ("test-ide-trigram-index-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (tmpdir, "nested", "trigrams", NULL);
+
+  /* Saving compacts tombstones, so make sure the ids survive that */
+  ide_trigram_index_remove (index, "tiny");
+  ide_trigram_index_insert (index, "tiny", 5, "ab", 2);
+
+  g_assert_true (ide_trigram_index_save (index, path, &error));
+  g_assert_no_error (error);
+
+  loaded = ide_trigram_index_new_from_file (path, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (loaded);
+
+  g_assert_cmpint (ide_trigram_index_get_n_paths (loaded), ==, G_N_ELEMENTS (documents));
+
+  for (guint i = 0; i < G_N_ELEMENTS (documents); i++)
+    {
+      g_assert_true (ide_trigram_index_get_mtime (loaded, documents[i].path, &mtime));
+      g_assert_cmpint (mtime, ==, documents[i].mtime);
+    }
+
+  assert_index (loaded);
+
+  /* The loaded index must remain mutable */
+  ide_trigram_index_remove (loaded, "src/app.c");
+  r1 = query (loaded, "app_run", NULL);
+  g_assert_cmpstr (r1, ==, "src/main.c");
+
+  g_assert_cmpint (g_unlink (path), ==, 0);
+  g_clear_pointer (&path, g_free);
+  path = g_build_filename (tmpdir, "nested", NULL);
+  g_assert_cmpint (g_rmdir (path), ==, 0);
+  g_assert_cmpint (g_rmdir (tmpdir), ==, 0);
+}
+
+static void
+test_load_corrupted (void)
+{
+  g_autoptr(IdeTrigramIndex) index = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *path = NULL;
+  gint fd;
+
+  fd = g_file_open_tmp ("test-ide-trigram-index-XXXXXX", &path, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (write (fd, "garbage", 7), ==, 7);
+  close (fd);
+
+  index = ide_trigram_index_new_from_file (path, &error);
+  g_assert_null (index);
+  g_assert_nonnull (error);
+
+  g_unlink (path);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/Ide/TrigramIndex/insert-query", test_insert_query);
+  g_test_add_func ("/Ide/TrigramIndex/remove", test_remove);
+  g_test_add_func ("/Ide/TrigramIndex/save-load", test_save_load);
+  g_test_add_func ("/Ide/TrigramIndex/load-corrupted", test_load_corrupted);
+
+  return g_test_run ();
+}
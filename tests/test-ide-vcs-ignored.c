@@ -0,0 +1,342 @@
+/* test-ide-vcs-ignored.c
+ *
+ * Copyright (C) 2017 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gstdio.h>
+#include <ide.h>
+#include <string.h>
+
+static void
+test_vcs_ignored_patterns (void)
+{
+  static const struct {
+    const gchar *path;
+    gboolean     ignored;
+  } samples[] = {
+    { ".flatpak-builder", TRUE },
+    { "/home/user/project/.flatpak-builder", TRUE },
+    { "/home/user/project/.flatpak-builder/", TRUE },
+    { "project/.flatpak-builder/cache", FALSE },
+    { "foo.o", TRUE },
+    { "libfoo.so.o", TRUE },
+    { "foo.c", FALSE },
+    { "foo.c~", TRUE },
+    { "~", TRUE },
+    { ".#foo.c", TRUE },
+    { ".#", TRUE },
+    { "#foo.c#", TRUE },
+    { "#foo.c", FALSE },
+    { "foo.pyc", TRUE },
+    { "foo.py", FALSE },
+    { "ñandú.pyc", TRUE },
+    { "", FALSE },
+    { "/", FALSE },
+  };
+
+  ide_vcs_register_ignored (".flatpak-builder");
+  ide_vcs_register_ignored ("*.o");
+  ide_vcs_register_ignored ("*~");
+  ide_vcs_register_ignored (".#*");
+  ide_vcs_register_ignored ("#*#");
+  ide_vcs_register_ignored ("*.py?");
+
+  for (guint i = 0; i < G_N_ELEMENTS (samples); i++)
+    {
+      const gchar *path = samples[i].path;
+
+      g_assert_cmpint (ide_vcs_path_matches_ignored (path, -1), ==, samples[i].ignored);
+      g_assert_cmpint (ide_vcs_path_matches_ignored (path, strlen (path)), ==, samples[i].ignored);
+    }
+}
+
+static void
+test_vcs_ignored_slice (void)
+{
+  static const gchar *buffer = "src/foo.o\nsrc/foo.c\n";
+
+  ide_vcs_register_ignored ("*.o");
+
+  /* The slice must not be read past @len */
+  g_assert_true (ide_vcs_path_matches_ignored (buffer, 9));
+  g_assert_false (ide_vcs_path_matches_ignored (buffer + 10, 9));
+  g_assert_false (ide_vcs_path_matches_ignored (buffer, 8));
+}
+
+/*
+ * A version control backend that behaves like IdeGitVcs: it ignores .git
+ * and the names listed in the .gitignore at the root of the tree. Like
+ * the GgitRepository used by IdeGitVcs, it must not be used from several
+ * threads at once, which is_ignored() checks.
+ */
+
+#define TEST_TYPE_VCS (test_vcs_get_type())
+G_DECLARE_FINAL_TYPE (TestVcs, test_vcs, TEST, VCS, IdeObject)
+
+struct _TestVcs
+{
+  IdeObject      parent_instance;
+  GFile         *working_directory;
+  gchar        **gitignore;
+  volatile gint  in_is_ignored;
+  volatile gint  n_calls;
+};
+
+enum {
+  PROP_0,
+  PROP_BRANCH_NAME,
+  PROP_WORKING_DIRECTORY,
+};
+
+static gboolean
+test_vcs_is_ignored (IdeVcs   *vcs,
+                     GFile    *file,
+                     GError  **error)
+{
+  TestVcs *self = (TestVcs *)vcs;
+  g_autofree gchar *name = g_file_get_basename (file);
+  gboolean ret;
+
+  g_assert_cmpint (g_atomic_int_add (&self->in_is_ignored, 1), ==, 0);
+  g_atomic_int_inc (&self->n_calls);
+
+  /* Give other workers a chance to enter at the same time */
+  g_usleep (50);
+
+  ret = g_strcmp0 (name, ".git") == 0 || g_strv_contains ((const gchar * const *)self->gitignore, name);
+
+  g_assert_cmpint (g_atomic_int_add (&self->in_is_ignored, -1), ==, 1);
+
+  return ret;
+}
+
+static GFile *
+test_vcs_get_working_directory (IdeVcs *vcs)
+{
+  return TEST_VCS (vcs)->working_directory;
+}
+
+static void
+vcs_iface_init (IdeVcsInterface *iface)
+{
+  iface->is_ignored = test_vcs_is_ignored;
+  iface->get_working_directory = test_vcs_get_working_directory;
+}
+
+G_DEFINE_TYPE_WITH_CODE (TestVcs, test_vcs, IDE_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (IDE_TYPE_VCS, vcs_iface_init))
+
+static void
+test_vcs_finalize (GObject *object)
+{
+  TestVcs *self = (TestVcs *)object;
+
+  g_clear_object (&self->working_directory);
+  g_clear_pointer (&self->gitignore, g_strfreev);
+
+  G_OBJECT_CLASS (test_vcs_parent_class)->finalize (object);
+}
+
+static void
+test_vcs_get_property (GObject    *object,
+                       guint       prop_id,
+                       GValue     *value,
+                       GParamSpec *pspec)
+{
+  TestVcs *self = TEST_VCS (object);
+
+  switch (prop_id)
+    {
+    case PROP_BRANCH_NAME:
+      g_value_set_string (value, "master");
+      break;
+
+    case PROP_WORKING_DIRECTORY:
+      g_value_set_object (value, self->working_directory);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+test_vcs_class_init (TestVcsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = test_vcs_finalize;
+  object_class->get_property = test_vcs_get_property;
+
+  g_object_class_override_property (object_class, PROP_BRANCH_NAME, "branch-name");
+  g_object_class_override_property (object_class, PROP_WORKING_DIRECTORY, "working-directory");
+}
+
+static void
+test_vcs_init (TestVcs *self)
+{
+}
+
+static TestVcs *
+test_vcs_new (const gchar *path)
+{
+  TestVcs *self = g_object_new (TEST_TYPE_VCS, NULL);
+  g_autofree gchar *gitignore = g_build_filename (path, ".gitignore", NULL);
+  g_autofree gchar *contents = NULL;
+
+  g_assert_true (g_file_get_contents (gitignore, &contents, NULL, NULL));
+
+  self->working_directory = g_file_new_for_path (path);
+  self->gitignore = g_strsplit (contents, "\n", -1);
+
+  return self;
+}
+
+static void
+make_tree (const gchar *path,
+           guint        depth)
+{
+  for (guint i = 0; i < 8; i++)
+    {
+      g_autofree gchar *name = g_strdup_printf ("file-%u.c", i);
+      g_autofree gchar *file = g_build_filename (path, name, NULL);
+
+      g_assert_true (g_file_set_contents (file, "", 0, NULL));
+    }
+
+  if (depth == 0)
+    return;
+
+  for (guint i = 0; i < 3; i++)
+    {
+      g_autofree gchar *name = g_strdup_printf ("dir-%u", i);
+      g_autofree gchar *dir = g_build_filename (path, name, NULL);
+
+      g_assert_cmpint (g_mkdir (dir, 0750), ==, 0);
+      make_tree (dir, depth - 1);
+    }
+}
+
+static void
+remove_tree (const gchar *path)
+{
+  g_autoptr(GDir) dir = g_dir_open (path, 0, NULL);
+  const gchar *name;
+
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      g_autofree gchar *child = g_build_filename (path, name, NULL);
+
+      if (g_file_test (child, G_FILE_TEST_IS_DIR))
+        remove_tree (child);
+      else
+        g_unlink (child);
+    }
+
+  g_rmdir (path);
+}
+
+typedef struct
+{
+  guint n_dirs;
+  guint n_files;
+} Totals;
+
+static void
+count_cb (GFile       *directory,
+          const gchar *relative_path,
+          GFileInfo   *directory_info,
+          GPtrArray   *children,
+          gpointer     user_data)
+{
+  Totals *totals = user_data;
+
+  totals->n_dirs++;
+
+  for (guint i = 0; i < children->len; i++)
+    {
+      GFileInfo *info = g_ptr_array_index (children, i);
+
+      g_assert_cmpstr (g_file_info_get_name (info), !=, ".git");
+      g_assert_cmpstr (g_file_info_get_name (info), !=, "dir-1");
+      g_assert_cmpstr (g_file_info_get_name (info), !=, "file-3.c");
+
+      if (g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY)
+        totals->n_files++;
+    }
+}
+
+static void
+test_vcs_ignored_crawl (void)
+{
+  g_autofree gchar *tmpdir = NULL;
+  g_autofree gchar *git_dir = NULL;
+  g_autofree gchar *gitignore = NULL;
+  g_autoptr(TestVcs) vcs = NULL;
+  g_autoptr(GFile) root = NULL;
+  guint n_workers[] = { 2, 4, 8 };
+
+  tmpdir = g_dir_make_tmp ("test-ide-vcs-ignored-XXXXXX", NULL);
+  g_assert (tmpdir != NULL);
+  make_tree (tmpdir, 2);
+
+  git_dir = g_build_filename (tmpdir, ".git", NULL);
+  g_assert_cmpint (g_mkdir (git_dir, 0750), ==, 0);
+  gitignore = g_build_filename (tmpdir, ".gitignore", NULL);
+  g_assert_true (g_file_set_contents (gitignore, "dir-1\nfile-3.c\n", -1, NULL));
+
+  root = g_file_new_for_path (tmpdir);
+  vcs = test_vcs_new (tmpdir);
+
+  for (guint i = 0; i < G_N_ELEMENTS (n_workers); i++)
+    {
+      g_autoptr(IdeDirectoryCrawler) crawler = ide_directory_crawler_new (root);
+      g_autoptr(GError) error = NULL;
+      Totals totals = { 0 };
+      gboolean r;
+
+      ide_directory_crawler_set_vcs (crawler, IDE_VCS (vcs));
+      ide_directory_crawler_set_n_workers (crawler, n_workers[i]);
+      r = ide_directory_crawler_run (crawler, NULL, count_cb, &totals, &error);
+
+      g_assert_no_error (error);
+      g_assert_true (r);
+
+      /* The root, dir-0 and dir-2, and theirs, with 7 files each plus .gitignore */
+      g_assert_cmpint (totals.n_dirs, ==, 7);
+      g_assert_cmpint (totals.n_files, ==, 7 * 7 + 1);
+    }
+
+  g_assert_cmpint (vcs->n_calls, >, 0);
+
+  remove_tree (tmpdir);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/Ide/Vcs/ignored-patterns", test_vcs_ignored_patterns);
+  g_test_add_func ("/Ide/Vcs/ignored-slice", test_vcs_ignored_slice);
+  g_test_add_func ("/Ide/Vcs/ignored-crawl", test_vcs_ignored_crawl);
+
+  return g_test_run ();
+}